@@ -0,0 +1,33 @@
+#!/usr/bin/env perl
+#
+# usage:
+#   $ bench-access-log.pl [megabytes [runs]]
+#
+# bench-access-log.pl:
+#
+#   Compares throughput of "log" reporting each message on stderr
+#   with it writing records instead (-o), as JSON and binary.
+#
+
+use warnings;
+use strict;
+
+use FindBin;
+use lib "$FindBin::Bin/lib";
+use Bench qw(corpus best_time report);
+
+BEGIN {
+    $ENV{PATH} = '../src:./src:' . $ENV{PATH};
+    $ENV{ULOG_LEVEL} = 4;
+}
+
+my $MEGABYTES = shift || 64;
+my $RUNS = shift || 5;
+
+# Small messages, so the per message cost shows
+my ($input, $size) = corpus($MEGABYTES, qw( sample-request-get.txt
+					     sample-response-304.txt ));
+
+foreach my $cmd ( 'log', 'log -o /dev/null -F json', 'log -o /dev/null -F bin' ) {
+    report($cmd, $size, best_time($cmd, $input, $RUNS));
+}
@@ -0,0 +1,43 @@
+#!/usr/bin/env perl
+#
+# usage:
+#   $ bench-chunked.pl [megabytes [runs]]
+#
+# bench-chunked.pl:
+#
+#   Compares throughput of "log" and of unpiped "body" (which chunks
+#   the body again on the way out) on chunked responses made of many
+#   tiny chunks, using each of the chunk size scanners (see
+#   src/http_scan.h).
+#
+
+use warnings;
+use strict;
+
+use FindBin;
+use lib "$FindBin::Bin/lib";
+use Bench qw(repeat_corpus best_time report);
+
+BEGIN {
+    $ENV{PATH} = '../src:./src:' . $ENV{PATH};
+    $ENV{ULOG_LEVEL} = 4;
+}
+
+my $MEGABYTES = shift || 64;
+my $RUNS = shift || 5;
+
+my $block = "HTTP/1.1 200 OK\r\n"
+    . "Content-Type: text/plain\r\n"
+    . "Transfer-Encoding: chunked\r\n"
+    . "\r\n"
+    . join('', map { sprintf("%x\r\n%s\r\n", $_, 'x' x $_) } (1 .. 40) x 10)
+    . "0\r\n\r\n";
+
+my ($input, $size) = repeat_corpus($MEGABYTES, $block);
+
+foreach my $cmd ( 'log -q', 'body -t no/match -c cat' ) {
+    foreach my $scan ( qw(scalar sse4.2 avx2) ) {
+	report("$cmd ($scan)", $size,
+	       best_time($cmd, $input, $RUNS, MUMPSIMUS_SCAN => $scan));
+    }
+}
@@ -0,0 +1,39 @@
+#!/usr/bin/env perl
+#
+# usage:
+#   $ bench-log-alloc.pl [megabytes [runs]]
+#
+# bench-log-alloc.pl:
+#
+#   Compares parse throughput of "log" with its buffers from malloc
+#   and from the huge page backend (see src/buffer_alloc.h). Run with
+#   a larger read buffer to see the most effect, for example by
+#   building with CFLAGS=-DBUFFER_MAX=4194304.
+#
+
+use warnings;
+use strict;
+
+use FindBin;
+use lib "$FindBin::Bin/lib";
+use Bench qw(corpus best_time report);
+
+BEGIN {
+    $ENV{PATH} = '../src:./src:' . $ENV{PATH};
+    $ENV{ULOG_LEVEL} = 4;
+}
+
+my $MEGABYTES = shift || 64;
+my $RUNS = shift || 5;
+
+my ($input, $size) = corpus($MEGABYTES);
+
+foreach my $volume ( '-q', '' ) {
+    report("log $volume (malloc)", $size,
+	   best_time("log $volume", $input, $RUNS, MUMPSIMUS_ALLOC => 'malloc'));
+    report("log $volume (hugepage)", $size,
+	   best_time("log $volume", $input, $RUNS, MUMPSIMUS_ALLOC => 'hugepage'));
+    report("log $volume (hugepage, node 0)", $size,
+	   best_time("log $volume", $input, $RUNS, MUMPSIMUS_ALLOC => 'hugepage',
+		     MUMPSIMUS_ALLOC_NODE => 0));
+}
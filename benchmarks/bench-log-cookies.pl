@@ -0,0 +1,45 @@
+#!/usr/bin/env perl
+#
+# usage:
+#   $ bench-log-cookies.pl [megabytes [runs]]
+#
+# bench-log-cookies.pl:
+#
+#   Compares throughput of "log" at each volume on requests with
+#   hundreds of Cookie headers, and with one Cookie header larger
+#   than a read, where verbose output has the most headers to keep
+#   and print.
+#
+
+use warnings;
+use strict;
+
+use FindBin;
+use lib "$FindBin::Bin/lib";
+use Bench qw(repeat_corpus best_time report);
+
+BEGIN {
+    $ENV{PATH} = '../src:./src:' . $ENV{PATH};
+    $ENV{ULOG_LEVEL} = 4;
+}
+
+my $MEGABYTES = shift || 64;
+my $RUNS = shift || 5;
+
+my %blocks = (
+    'many cookies' => "GET /index.html HTTP/1.1\r\n"
+	. "Host: www.example.com\r\n"
+	. join('', map { sprintf("Cookie: session%03d=%s\r\n", $_, 'c' x 32) } (1 .. 300))
+	. "\r\n",
+    'one large cookie' => "GET /index.html HTTP/1.1\r\n"
+	. "Host: www.example.com\r\n"
+	. "Cookie: " . join('; ', map { sprintf("session%04d=%s", $_, 'c' x 32) } (1 .. 1000)) . "\r\n"
+	. "\r\n",
+    );
+
+foreach my $name ( sort keys %blocks ) {
+    my ($input, $size) = repeat_corpus($MEGABYTES, $blocks{$name});
+    foreach my $cmd ( 'log -q', 'log', 'log -v', 'log -v -s 1/100' ) {
+	report("$cmd ($name)", $size, best_time($cmd, $input, $RUNS));
+    }
+}
@@ -0,0 +1,55 @@
+#!/usr/bin/env perl
+#
+# usage:
+#   $ bench-parse-framing.pl [megabytes [runs]]
+#
+# bench-parse-framing.pl:
+#
+#   Compares parse throughput of quiet and normal "log", which only
+#   parse the headers that frame each message, with the same commands
+#   told to parse every header (-a), on header heavy traffic: requests
+#   with big cookies and responses setting them.
+#
+
+use warnings;
+use strict;
+
+use FindBin;
+use lib "$FindBin::Bin/lib";
+use Bench qw(repeat_corpus best_time report);
+
+BEGIN {
+    $ENV{PATH} = '../src:./src:' . $ENV{PATH};
+    $ENV{ULOG_LEVEL} = 4;
+}
+
+my $MEGABYTES = shift || 64;
+my $RUNS = shift || 5;
+
+my $cookie = join('; ', map { "session_$_=" . ('abcdef0123456789' x 4) } 1 .. 12);
+my $block = "GET /index.html HTTP/1.1\r\n"
+    . "Host: www.example.com\r\n"
+    . "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko)\r\n"
+    . "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+    . "Accept-Language: en-AU,en;q=0.8\r\n"
+    . "Accept-Encoding: gzip, deflate\r\n"
+    . "Referer: http://www.example.com/\r\n"
+    . "Cookie: $cookie\r\n"
+    . "Connection: keep-alive\r\n"
+    . "\r\n"
+    . "HTTP/1.1 200 OK\r\n"
+    . "Date: Mon, 19 Oct 2026 10:00:00 GMT\r\n"
+    . "Server: Apache\r\n"
+    . "Cache-Control: private, max-age=0\r\n"
+    . "Content-Type: text/html; charset=UTF-8\r\n"
+    . join('', map { "Set-Cookie: session_$_=" . ('abcdef0123456789' x 4) . "; path=/; HttpOnly\r\n" } 1 .. 12)
+    . "Content-Length: 5\r\n"
+    . "\r\n"
+    . "hello";
+
+my ($input, $size) = repeat_corpus($MEGABYTES, $block);
+
+foreach my $cmd ( 'log -q', 'log' ) {
+    report("$cmd -a (all headers)", $size, best_time("$cmd -a", $input, $RUNS));
+    report("$cmd (framing only)", $size, best_time($cmd, $input, $RUNS));
+}
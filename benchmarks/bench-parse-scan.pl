@@ -0,0 +1,47 @@
+#!/usr/bin/env perl
+#
+# usage:
+#   $ bench-parse-scan.pl [megabytes [runs]]
+#
+# bench-parse-scan.pl:
+#
+#   Compares parse throughput of "log" on a header heavy request
+#   stream (long URLs and cookies) using each of the http_parser
+#   scanners (see src/http_scan.h). Scanners the CPU doesn't support
+#   fall back to the best one available.
+#
+
+use warnings;
+use strict;
+
+use FindBin;
+use lib "$FindBin::Bin/lib";
+use Bench qw(repeat_corpus best_time report);
+
+BEGIN {
+    $ENV{PATH} = '../src:./src:' . $ENV{PATH};
+    $ENV{ULOG_LEVEL} = 4;
+}
+
+my $MEGABYTES = shift || 64;
+my $RUNS = shift || 5;
+
+my $cookie = join('; ', map { "session_$_=" . ('abcdef0123456789' x 4) } 1 .. 12);
+my $path = '/' . join('/', map { "segment$_" } 1 .. 20) . '?' . join('&', map { "q$_=value$_" } 1 .. 20);
+my $block = "GET $path HTTP/1.1\r\n"
+    . "Host: www.example.com\r\n"
+    . "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko)\r\n"
+    . "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+    . "Accept-Language: en-AU,en;q=0.8\r\n"
+    . "Referer: http://www.example.com$path\r\n"
+    . "Cookie: $cookie\r\n"
+    . "\r\n";
+
+my ($input, $size) = repeat_corpus($MEGABYTES, $block);
+
+foreach my $cmd ( 'log -q', 'log -v' ) {
+    foreach my $scan ( qw(scalar sse4.2 avx2) ) {
+	report("$cmd ($scan)", $size,
+	       best_time($cmd, $input, $RUNS, MUMPSIMUS_SCAN => $scan));
+    }
+}
@@ -0,0 +1,42 @@
+#!/usr/bin/env perl
+#
+# usage:
+#   $ bench-parse-variants.pl [megabytes [runs]]
+#
+# bench-parse-variants.pl:
+#
+#   Compares parse throughput of each tool, whose parser is built with
+#   only the callbacks it uses, with the same tool built with the full
+#   parser ("make generic" in src). body is given a type pattern that
+#   never matches so that it only parses; headers pipes every head
+#   through its command, which would swamp the parse time, so it is
+#   left out.
+#
+
+use warnings;
+use strict;
+
+use FindBin;
+use lib "$FindBin::Bin/lib";
+use Bench qw(corpus best_time report);
+
+BEGIN {
+    $ENV{PATH} = '../src:./src:' . $ENV{PATH};
+    $ENV{ULOG_LEVEL} = 4;
+}
+
+my $MEGABYTES = shift || 64;
+my $RUNS = shift || 5;
+
+my ($input, $size) = corpus($MEGABYTES);
+
+foreach my $tool ( [ 'log', '-q' ], [ 'log', '' ], [ 'log', '-v' ],
+		   [ 'body', "-t no/match -c cat" ] ) {
+    my ($name, $args) = @$tool;
+    my $label = join(' ', $name, $args || ());
+    my $generic = best_time("$name-generic $args", $input, $RUNS);
+    my $tuned = best_time("$name $args", $input, $RUNS);
+    report("$label (generic)", $size, $generic);
+    report("$label (tuned)", $size, $tuned);
+    printf "%-40s %+8.1f %%\n", "$label gain", ($generic / $tuned - 1) * 100;
+}
@@ -0,0 +1,114 @@
+#
+# Bench.pm:
+#
+#   Helpers shared by the benchmark scripts: build a large HTTP
+#   stream out of the system test data, time commands over it and
+#   report throughput.
+#
+
+package Bench;
+
+use warnings;
+use strict;
+
+use File::Temp qw(tempfile);
+use Time::HiRes qw(time);
+
+use Exporter 'import';
+our @EXPORT_OK = qw(find_test_data corpus repeat_corpus best_time report);
+
+my @SEARCH_DIR = ( $ENV{TEST_DATA} || (),
+		   '../system-tests/test-data', 'system-tests/test-data' );
+
+
+# find_test_data:
+#
+#   Returns the path of a file in the system test data.
+#
+sub find_test_data {
+    my $name = shift;
+    foreach my $dir ( @SEARCH_DIR ) {
+	return "$dir/$name" if -f "$dir/$name";
+    }
+    die "Cannot find test data file $name in @SEARCH_DIR\n";
+}
+
+
+# corpus:
+#
+#   Writes a temporary file of (at least) $megabytes made by
+#   repeating the given test data files, and returns its name and
+#   size. The file is removed on exit.
+#
+sub corpus {
+    my ($megabytes, @files) = @_;
+    @files = qw( sample-request-get.txt sample-response-302.txt
+		 sample-request-put.txt sample-response-200-png.txt )
+	unless @files;
+
+    my $block = '';
+    foreach my $name ( @files ) {
+	open(my $fh, '<', find_test_data($name)) or die "$name: $!\n";
+	binmode($fh);
+	local $/;
+	$block .= <$fh>;
+	close($fh);
+    }
+
+    return repeat_corpus($megabytes, $block);
+}
+
+
+# repeat_corpus:
+#
+#   Writes a temporary file of (at least) $megabytes made by
+#   repeating $block, and returns its name and size. The file is
+#   removed on exit.
+#
+sub repeat_corpus {
+    my ($megabytes, $block) = @_;
+
+    my ($out, $filename) = tempfile('mumpsimus-bench-XXXXXX', TMPDIR => 1, UNLINK => 1);
+    binmode($out);
+    my $size = 0;
+    while ( $size < $megabytes * 1024 * 1024 ) {
+	print $out $block;
+	$size += length($block);
+    }
+    close($out);
+    return ($filename, $size);
+}
+
+
+# best_time:
+#
+#   Runs shell command $cmd $runs times with stdin from $input and
+#   stdout/stderr discarded, returning the fastest wall time in
+#   seconds. %env is set for the command only.
+#
+sub best_time {
+    my ($cmd, $input, $runs, %env) = @_;
+    my $best;
+    local %ENV = ( %ENV, %env );
+    for ( 1 .. $runs ) {
+	my $start = time();
+	system("$cmd < '$input' > /dev/null 2>&1") == 0
+	    or die "Benchmark command failed: $cmd\n";
+	my $elapsed = time() - $start;
+	$best = $elapsed if !defined($best) || $elapsed < $best;
+    }
+    return $best;
+}
+
+
+# report:
+#
+#   Prints one line of results.
+#
+sub report {
+    my ($label, $bytes, $seconds) = @_;
+    printf "%-40s %8.3f s %10.1f MB/s\n", $label, $seconds,
+	$bytes / $seconds / (1024 * 1024);
+}
+
+1;
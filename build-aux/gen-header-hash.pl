@@ -0,0 +1,88 @@
+#!/usr/bin/env perl
+#
+# usage:
+#   $ gen-header-hash.pl src/http_parser.h > src/http_header_hash.h
+#
+# gen-header-hash.pl:
+#
+#   Reads HTTP_HEADER_MAP from http_parser.h and writes the perfect
+#   hash table http_parser.c uses to turn header names into
+#   HTTP_HEADER_* ids. The hash is 32-bit FNV-1a over the lower case
+#   name, started from a seed. We search for the smallest table and a
+#   seed that give every name its own slot.
+#
+
+use warnings;
+use strict;
+use integer;
+
+my $FNV_PRIME = 16777619;
+
+my $header_file = shift or die "usage: $0 http_parser.h\n";
+open(my $fh, '<', $header_file) or die "$header_file: $!\n";
+my @names;
+while ( my $line = <$fh> ) {
+    if ( $line =~ m/^\s*XX\((\d+),\s*(\w+),\s*([\w-]+)\)/ ) {
+	$names[$1] = $3;
+    }
+}
+close($fh);
+die "No HTTP_HEADER_MAP found in $header_file\n" unless @names > 1;
+
+sub fnv {
+    my ($seed, $name) = @_;
+    my $h = $seed;
+    foreach my $c ( unpack('C*', lc($name)) ) {
+	$h = (($h ^ $c) * $FNV_PRIME) & 0xffffffff;
+    }
+    return $h;
+}
+
+sub slot {
+    my ($h, $bits) = @_;
+    return (($h ^ ($h >> 16)) & ((1 << $bits) - 1));
+}
+
+my ($seed, $bits);
+SEARCH:
+for ( $bits = 6; $bits <= 12; $bits++ ) {
+    next if (1 << $bits) < @names;
+    for ( $seed = 1; $seed < 100000; $seed++ ) {
+	my %used;
+	my $ok = 1;
+	foreach my $id ( 1 .. $#names ) {
+	    my $s = slot(fnv($seed, $names[$id]), $bits);
+	    if ( $used{$s}++ ) { $ok = 0; last; }
+	}
+	last SEARCH if $ok;
+    }
+}
+die "No perfect hash found\n" if $bits > 12;
+
+my @table = (0) x (1 << $bits);
+$table[ slot(fnv($seed, $names[$_]), $bits) ] = $_ foreach ( 1 .. $#names );
+
+print "/* http_header_hash.h\n";
+print " *\n";
+print " *    Generated by build-aux/gen-header-hash.pl from HTTP_HEADER_MAP in\n";
+print " *    http_parser.h. Do not edit.\n";
+print " */\n";
+printf "#define HTTP_HEADER_HASH_SEED 0x%08xU\n", $seed;
+printf "#define HTTP_HEADER_HASH_BITS %d\n\n", $bits;
+
+print "static const uint8_t header_hash_slots[", scalar(@table), "] = {\n";
+for ( my $i = 0; $i < @table; $i += 16 ) {
+    my $end = $i + 15 < $#table ? $i + 15 : $#table;
+    print "  ", join(', ', @table[$i .. $end]), ",\n";
+}
+print "};\n\n";
+
+print "static const uint32_t header_hashes[] = {\n";
+print "  0,\n";
+printf "  0x%08xU,\t/* %s */\n", fnv($seed, $names[$_]), $names[$_] foreach ( 1 .. $#names );
+print "};\n\n";
+
+print "static const char *header_lower_names[] = {\n";
+print "  \"\",\n";
+printf "  \"%s\",\n", lc($names[$_]) foreach ( 1 .. $#names );
+print "};\n";
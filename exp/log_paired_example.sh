@@ -0,0 +1,32 @@
+#!/bin/sh
+#
+# log_paired_example.sh [proxy_host [proxy_port]]
+#
+# Like log_proxy_example.sh, but one log reads both directions, so it
+# can pair each response with its request and time the transaction.
+#
+# Requirements:
+#     - assumes you have ncat installed
+#     - assumes that proxy_host and proxy_port point at a real proxy server
+#
+
+if [ "x$1" = "x" ] ; then
+    http_proxy=proxy
+else
+    http_proxy=$1
+fi
+if [ "x$2" = "x" ] ; then
+    http_port=3128
+else
+    http_port=$2
+fi
+
+if [ ! -x ./src/log ] ; then
+    echo "$0: Run this from package root, and build with make"
+    exit 1
+fi
+
+# Each connection gets a FIFO for the responses coming back from the
+# proxy; log echoes them to the client on fd 3
+echo "Press Ctrl-C to quit proxy. Connecting to $http_proxy:$http_port"
+ncat -l -k localhost 3128 -c "fifo=\$(mktemp -u) && mkfifo \$fifo && exec 3>&1 && ./src/log -p \$fifo -P /dev/fd/3 | ncat $http_proxy $http_port > \$fifo; rm -f \$fifo"
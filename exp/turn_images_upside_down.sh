@@ -3,7 +3,8 @@
 # turn_images_upside_down.sh [http_proxy_host [http_proxy_port]]
 #
 # Pipes message bodies through ImageMagick's mogrify to flip an
-# image upside down.
+# image upside down. Bodies are handed over in memfds (body -m) so
+# convert gets a seekable stdin and no pipe copies are made.
 #
 # Status: Kind of works for single image requests but doesn't
 # work well as part of a proxy that's handling non-image requests
@@ -32,7 +33,7 @@ PATH=$PATH:./src:../src:.
 
 echo "Assuming you have a real proxy running on $http_proxy_host:$http_proxy_port"
 echo "Point your browser to localhost:3128. Press Ctrl-C to quit proxy."
-ncat -l -k localhost 3128 -c "headers -c \"sed -El -e 's/^Cache-Control: .*/Cache-Control: no-cache/g'  -e 's/If-Modified-Since: .*/X-If-Modified-Since: none/g'\" | log | ncat $http_proxy_host $http_proxy_port | ULOG_LEVEL=6 body -t 'image/*' -c \"convert -flip -flop fd:0 fd:1\" | log -v"
+ncat -l -k localhost 3128 -c "headers -c \"sed -El -e 's/^Cache-Control: .*/Cache-Control: no-cache/g'  -e 's/If-Modified-Since: .*/X-If-Modified-Since: none/g'\" | log | ncat $http_proxy_host $http_proxy_port | ULOG_LEVEL=6 body -m -t 'image/*' -c \"convert -flip -flop fd:0 fd:1\" | log -v"
 
 
 
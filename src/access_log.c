@@ -0,0 +1,356 @@
+/* access_log.c:
+ *
+ *    Per message records in JSON or binary form.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "access_log.h"
+
+
+/* access_log_format_lookup:
+ *
+ *    Returns the format named "json" or "bin", or -1.
+ */
+int
+access_log_format_lookup(const char *name)
+{
+  if (strcmp(name, "json") == 0)
+    return ACCESS_LOG_JSON;
+  if (strcmp(name, "bin") == 0)
+    return ACCESS_LOG_BIN;
+  return -1;
+}
+
+
+/* access_log_fdopen:
+ *
+ *    Returns a log writing to "fd", or NULL if there was a memory
+ *    allocation error. A binary log that is empty so far is given its
+ *    magic number. The fd is closed by access_log_close.
+ */
+struct Access_Log *
+access_log_fdopen(int fd, enum access_log_format format)
+{
+  struct Access_Log *log = malloc(sizeof(struct Access_Log));
+  if (NULL == log)
+    return NULL;
+  log->buffer = malloc(ACCESS_LOG_BUFFER);
+  if (NULL == log->buffer)
+    {
+      free(log);
+      return NULL;
+    }
+  log->fd = fd;
+  log->format = format;
+  log->used = 0;
+
+  struct stat st;
+  if (ACCESS_LOG_BIN == format && (fstat(fd, &st) != 0 || 0 == st.st_size))
+    {
+      memcpy(log->buffer, ACCESS_LOG_MAGIC, ACCESS_LOG_MAGIC_LEN);
+      log->used = ACCESS_LOG_MAGIC_LEN;
+    }
+  return log;
+}
+
+
+/* access_log_open:
+ *
+ *    Returns a log appending to file "path", or NULL with errno set.
+ */
+struct Access_Log *
+access_log_open(const char *path, enum access_log_format format)
+{
+  int fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+  if (fd < 0)
+    return NULL;
+
+  struct Access_Log *log = access_log_fdopen(fd, format);
+  if (NULL == log)
+    {
+      close(fd);
+      errno = ENOMEM;
+    }
+  return log;
+}
+
+
+/* access_log_flush:
+ *
+ *    Writes out the records buffered. Returns 0, or -1 if they could
+ *    not all be written.
+ */
+int
+access_log_flush(struct Access_Log *log)
+{
+  if (0 == log->used)
+    return 0;
+  ssize_t nw = write_all(log->fd, log->buffer, log->used);
+  int rc = (nw == (ssize_t) log->used ? 0 : -1);
+  log->used = 0;
+  return rc;
+}
+
+
+/* access_log_close:
+ *
+ *    Flushes and frees the log, and closes its fd. Returns 0, or -1
+ *    if records were lost.
+ */
+int
+access_log_close(struct Access_Log *log)
+{
+  int rc = access_log_flush(log);
+  if (close(log->fd) != 0)
+    rc = -1;
+  free(log->buffer);
+  free(log);
+  return rc;
+}
+
+
+/* access_log_write:
+ *
+ *    Adds a record, writing out those before it first if there might
+ *    not be room. Returns 0, or -1 if records were lost.
+ */
+int
+access_log_write(struct Access_Log *log, const struct Access_Record *rec)
+{
+  int rc = 0;
+  size_t need = (ACCESS_LOG_JSON == log->format ? ACCESS_LOG_JSON_MAX
+		 : ACCESS_LOG_BIN_MAX);
+  if (log->used + need > ACCESS_LOG_BUFFER)
+    rc = access_log_flush(log);
+
+  if (ACCESS_LOG_JSON == log->format)
+    log->used += access_log_json(log->buffer + log->used, rec);
+  else
+    log->used += access_log_encode(log->buffer + log->used, rec);
+  return rc;
+}
+
+
+/* put_literal:
+ *
+ *    Copies a string constant. Returns the end of what was written.
+ */
+#define put_literal(p, s) (memcpy((p), (s), sizeof(s) - 1), (p) + sizeof(s) - 1)
+
+
+/* put_u64:
+ *
+ *    Writes "value" in decimal. Returns the end of what was written.
+ */
+static char *
+put_u64(char *p, uint64_t value)
+{
+  char digits[20];
+  size_t n = 0;
+  do
+    {
+      digits[n++] = '0' + value % 10;
+      value /= 10;
+    }
+  while (value > 0);
+  while (n > 0)
+    *p++ = digits[--n];
+  return p;
+}
+
+
+/* put_string:
+ *
+ *    Writes "length" bytes at "s" as a quoted JSON string. Bytes that
+ *    are not printable ASCII are escaped as \u00XX (read as Latin-1),
+ *    so the output is valid whatever the input. Returns the end.
+ */
+static char *
+put_string(char *p, const char *s, size_t length)
+{
+  static const char hex[] = "0123456789abcdef";
+  *p++ = '"';
+  for (size_t i = 0; i < length; i++)
+    {
+      unsigned char c = s[i];
+      if ('"' == c || '\\' == c)
+	{
+	  *p++ = '\\';
+	  *p++ = c;
+	}
+      else if (c >= 0x20 && c < 0x7f)
+	*p++ = c;
+      else
+	{
+	  p = put_literal(p, "\\u00");
+	  *p++ = hex[c >> 4];
+	  *p++ = hex[c & 0xf];
+	}
+    }
+  *p++ = '"';
+  return p;
+}
+
+
+/* access_log_json:
+ *
+ *    Formats a record as one line of JSON at "buf", which must have
+ *    room for ACCESS_LOG_JSON_MAX bytes. Returns its length.
+ */
+size_t
+access_log_json(char *buf, const struct Access_Record *rec)
+{
+  char *p = buf;
+  size_t url_len = MIN(rec->url_len, ACCESS_LOG_URL_MAX);
+  size_t error_len = MIN(rec->error_len, ACCESS_LOG_ERROR_MAX);
+
+  if (HTTP_REQUEST == rec->type)
+    {
+      const char *method = http_method_str(rec->method);
+      p = put_literal(p, "{\"type\":\"req\",\"method\":");
+      p = put_string(p, method, strlen(method));
+    }
+  else
+    {
+      p = put_literal(p, "{\"type\":\"res\",\"status\":");
+      p = put_u64(p, rec->status_code);
+    }
+  p = put_literal(p, ",\"url\":");
+  p = put_string(p, rec->url, url_len);
+  p = put_literal(p, ",\"version\":\"");
+  p = put_u64(p, rec->http_major);
+  *p++ = '.';
+  p = put_u64(p, rec->http_minor);
+  *p++ = '"';
+  if (0 != rec->stream)
+    {
+      p = put_literal(p, ",\"stream\":");
+      p = put_u64(p, rec->stream);
+    }
+  p = put_literal(p, ",\"header_bytes\":");
+  p = put_u64(p, rec->header_bytes);
+  p = put_literal(p, ",\"body_bytes\":");
+  p = put_u64(p, rec->body_bytes);
+  p = put_literal(p, ",\"begin_ns\":");
+  p = put_u64(p, rec->begin_ns);
+  p = put_literal(p, ",\"end_ns\":");
+  p = put_u64(p, rec->end_ns);
+  if (error_len > 0)
+    {
+      p = put_literal(p, ",\"error\":");
+      p = put_string(p, rec->error, error_len);
+    }
+  p = put_literal(p, "}\n");
+  return p - buf;
+}
+
+
+/* put_le:
+ *
+ *    Writes the low "bytes" bytes of "value", little endian. Returns
+ *    the end.
+ */
+static char *
+put_le(char *p, uint64_t value, int bytes)
+{
+  for (int i = 0; i < bytes; i++)
+    *p++ = (value >> (8 * i)) & 0xff;
+  return p;
+}
+
+
+/* get_le:
+ *
+ *    Reads a "bytes" byte little endian integer.
+ */
+static uint64_t
+get_le(const char *p, int bytes)
+{
+  uint64_t value = 0;
+  for (int i = bytes - 1; i >= 0; i--)
+    value = (value << 8) | (unsigned char) p[i];
+  return value;
+}
+
+
+/* access_log_encode:
+ *
+ *    Writes a record in binary form at "buf", which must have room
+ *    for ACCESS_LOG_BIN_MAX bytes. Returns its length.
+ */
+size_t
+access_log_encode(char *buf, const struct Access_Record *rec)
+{
+  size_t url_len = MIN(rec->url_len, ACCESS_LOG_URL_MAX);
+  size_t error_len = MIN(rec->error_len, ACCESS_LOG_ERROR_MAX);
+  size_t size = ACCESS_LOG_FIXED + url_len + error_len;
+
+  char *p = put_le(buf, size, 2);
+  p = put_le(p, rec->type, 1);
+  p = put_le(p, rec->method, 1);
+  p = put_le(p, rec->status_code, 2);
+  p = put_le(p, rec->http_major, 1);
+  p = put_le(p, rec->http_minor, 1);
+  p = put_le(p, rec->stream, 4);
+  p = put_le(p, rec->begin_ns, 8);
+  p = put_le(p, rec->end_ns, 8);
+  p = put_le(p, rec->header_bytes, 8);
+  p = put_le(p, rec->body_bytes, 8);
+  p = put_le(p, url_len, 2);
+  p = put_le(p, error_len, 2);
+  memcpy(p, rec->url, url_len);
+  memcpy(p + url_len, rec->error, error_len);
+  return size;
+}
+
+
+/* access_log_decode:
+ *
+ *    Reads the binary record at the start of "length" bytes at
+ *    "buf". The record's url and error point into "buf". Returns the
+ *    record's size, 0 if it is not all there yet, or -1 if it is
+ *    malformed.
+ */
+ssize_t
+access_log_decode(const char *buf, size_t length, struct Access_Record *rec)
+{
+  if (length < 2)
+    return 0;
+  size_t size = get_le(buf, 2);
+  if (size < ACCESS_LOG_FIXED || size > ACCESS_LOG_BIN_MAX)
+    return -1;
+  if (length < size)
+    return 0;
+
+  rec->type = get_le(buf + 2, 1);
+  rec->method = get_le(buf + 3, 1);
+  rec->status_code = get_le(buf + 4, 2);
+  rec->http_major = get_le(buf + 6, 1);
+  rec->http_minor = get_le(buf + 7, 1);
+  rec->stream = get_le(buf + 8, 4);
+  rec->begin_ns = get_le(buf + 12, 8);
+  rec->end_ns = get_le(buf + 20, 8);
+  rec->header_bytes = get_le(buf + 28, 8);
+  rec->body_bytes = get_le(buf + 36, 8);
+  rec->url_len = get_le(buf + 44, 2);
+  rec->error_len = get_le(buf + 46, 2);
+  rec->url = buf + ACCESS_LOG_FIXED;
+  rec->error = rec->url + rec->url_len;
+
+  if (ACCESS_LOG_FIXED + rec->url_len + rec->error_len != size
+      || rec->type > HTTP_RESPONSE || rec->url_len > ACCESS_LOG_URL_MAX
+      || rec->error_len > ACCESS_LOG_ERROR_MAX)
+    return -1;
+  return size;
+}
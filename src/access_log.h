@@ -0,0 +1,107 @@
+/* access_log.h
+ *
+ *    One record per HTTP message, for analytics rather than people:
+ *    newline delimited JSON, or a compact binary form that mumplog
+ *    turns back into the same JSON. Records are formatted by hand
+ *    into a buffer sized for the largest record, and written out when
+ *    it fills or is flushed, so logging a message costs no printf and
+ *    (usually) no system call.
+ *
+ *    A binary log starts with ACCESS_LOG_MAGIC. Each record is then
+ *    ACCESS_LOG_FIXED bytes, all integers little endian:
+ *
+ *      u16 size          whole record, including the URL and error
+ *      u8  type          HTTP_REQUEST or HTTP_RESPONSE
+ *      u8  method        enum http_method (requests)
+ *      u16 status        status code (responses)
+ *      u8  http_major
+ *      u8  http_minor
+ *      u32 stream        HTTP/2 stream, or 0
+ *      u64 begin_ns      wall clock time the message began
+ *      u64 end_ns        and was logged (ns since the epoch)
+ *      u64 header_bytes
+ *      u64 body_bytes
+ *      u16 url_len
+ *      u16 error_len
+ *
+ *    followed by the URL and error bytes. The error is empty unless
+ *    the message could not be parsed.
+ */
+#ifndef __ACCESS_LOG_H__
+#define __ACCESS_LOG_H__
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "http_parser.h"
+#include "util.h"
+
+#define ACCESS_LOG_MAGIC "MUMPLOG1"
+#define ACCESS_LOG_MAGIC_LEN 8
+#define ACCESS_LOG_FIXED 48
+
+// Longest URL and error kept
+#define ACCESS_LOG_URL_MAX URL_MAX
+#define ACCESS_LOG_ERROR_MAX LINE_MAX
+
+// Largest record in either format (a JSON escape is up to 6 bytes)
+#define ACCESS_LOG_BIN_MAX \
+  (ACCESS_LOG_FIXED + ACCESS_LOG_URL_MAX + ACCESS_LOG_ERROR_MAX)
+#define ACCESS_LOG_JSON_MAX \
+  (6 * (ACCESS_LOG_URL_MAX + ACCESS_LOG_ERROR_MAX) + 256)
+
+#define ACCESS_LOG_BUFFER (64 * 1024)
+
+enum access_log_format
+{ ACCESS_LOG_JSON, ACCESS_LOG_BIN };
+
+/* Access_Record:
+ *
+ *    What is logged about one message. url and error need not be
+ *    terminated; they are cut at the maximums above.
+ */
+struct Access_Record
+{
+  unsigned int type:2;		// HTTP_REQUEST or HTTP_RESPONSE
+  unsigned int method:8;
+  unsigned int status_code:16;
+  unsigned short http_major;
+  unsigned short http_minor;
+  uint32_t stream;
+  uint64_t begin_ns;
+  uint64_t end_ns;
+  uint64_t header_bytes;
+  uint64_t body_bytes;
+  const char *url;
+  size_t url_len;
+  const char *error;
+  size_t error_len;
+};
+
+/* Access_Log:
+ *
+ *    All members should be treated as 'private'.
+ */
+struct Access_Log
+{
+  int fd;
+  enum access_log_format format;
+  char *buffer;
+  size_t used;
+};
+
+int access_log_format_lookup(const char *name);
+struct Access_Log *access_log_open(const char *path,
+				   enum access_log_format format);
+struct Access_Log *access_log_fdopen(int fd, enum access_log_format format);
+int access_log_write(struct Access_Log *log,
+		     const struct Access_Record *rec);
+int access_log_flush(struct Access_Log *log);
+int access_log_close(struct Access_Log *log);
+
+size_t access_log_json(char *buf, const struct Access_Record *rec);
+size_t access_log_encode(char *buf, const struct Access_Record *rec);
+ssize_t access_log_decode(const char *buf, size_t length,
+			  struct Access_Record *rec);
+
+#endif
@@ -10,7 +10,25 @@
  *
  * So this command will hold both read and write ends of the pipe
  * and read the piped commands output and then send to stdout once
- * the message has finished being read.
+ * the message has finished being read. The command is only started
+ * when the first byte of a body that is to be piped arrives, so
+ * bodiless and non-matching messages never cost a process.
+ *
+ * With -m the pipe is replaced by a pair of memfds: the body is
+ * written once into a sealed memfd which becomes the command's
+ * (seekable) stdin, the command writes into a second memfd, and that
+ * is sent to stdout with sendfile(2).
+ *
+ * A chunked message's head keeps saying it is chunked, so its body
+ * is chunked again on the way out; the small chunks the parser hands
+ * over from each read are gathered into larger ones (see chunked.h). Piped bodies
+ * are sent with a Content-Length, or with -C as chunks straight from
+ * the command's output.
+ *
+ * After an upgrade to WebSocket the payload of each text message is
+ * piped through the command instead, and sent on as a single frame
+ * (masked again with the original key). Other frames pass through,
+ * as do text messages with RSV bits set (compressed, say).
  *
  */
 
@@ -25,9 +43,12 @@
 #include <fcntl.h>
 #include <fnmatch.h>
 #include <getopt.h>
+#include <limits.h>
 #include <paths.h>
+#include <signal.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -37,9 +58,40 @@
 #include "http_parser.h"
 #include "util.h"
 #include "ulog.h"
+#include "counters.h"
 #include "stream_buffer.h"
+#include "http_message.h"
+#include "http_scan.h"
+#include "method_queue.h"
+#include "tunnel.h"
+#include "ws_parser.h"
+#include "chunked.h"
+#include "buffer_alloc.h"
 #include "pipes.h"
+#include "child_stats.h"
+#include "stage_timing.h"
+#include "probes.h"
+
+// Starts each line of the -R report
+#define CHILD_STATS_PREFIX "body: [children]"
+
 
+/* Type_Ratio
+ *
+ *    Learned ratio of piped output size to input size for one
+ *    Content-Type (parameters such as charset are ignored). Used to
+ *    reserve the output buffer before the command's output arrives.
+ */
+#define RATIO_TABLE_MAX 16
+#define RATIO_TYPE_MAX 64
+#define RATIO_WEIGHT_MAX 8
+#define RESERVE_MAX (64 * 1024 * 1024)
+struct Type_Ratio
+{
+  char type[RATIO_TYPE_MAX];
+  double ratio;
+  unsigned int samples;
+};
 
 
 /* Body_State
@@ -48,28 +100,56 @@
  *
  *    fd_stdin    File handle (int) to read, usually STDIN.
  *    fd_stdout   File handle to write to, usually STDOUT.
- *    url         Copy of last URL encountered.
- *    status_line Copy of last HTTP status line (res or req).
- *    headers     Stream buffer that stores headers.
+ *    msg         Start line and headers of the current message.
+ *    methods     Methods of requests not yet answered.
+ *    tunnel      Whether the stream has switched protocols.
+ *    ws_text     A WebSocket text message is being piped.
+ *    ws_masked   ...and its frames were masked, with ws_mask.
+ *    ws_passing  A WebSocket text message with RSV bits is passing.
+ *    headers_sent True once headers have gone out unmodified.
  *    body        Stream buffer for storing piped (modified) body.
+ *    out         Gathers body pieces going to stdout, pipe or memfd.
+ *    chunked_out Send piped bodies chunked rather than buffer them.
  *    ph          Pipe_Handle for communicating with pipe command.
+ *    use_memfd   Hand bodies to the command in memfds, not pipes.
+ *    body_fd     memfd holding the current message body (or -1).
+ *    pipe_cmd    Command to run (memfd mode spawns per message).
+ *    content_type Content-Type of the current message ("" if none).
+ *    body_in     Bytes of body read so far for the current message.
+ *    ratios      Output/input size ratios learned per Content-Type.
+ *    children    What the commands used, per Content-Type (NULL unless -R).
+ *    timing      How long this message has been held (see -T).
  */
 struct Body_State
 {
   int fd_stdin;
   int fd_stdout;
 
-  ssize_t content_length_at;
-  bool last_field_was_content_type;
+  bool use_memfd;
+  int body_fd;
+  const char *pipe_cmd;
+
   bool do_pipe_this_message;
+  bool headers_sent;
 
-  char *url;
-  char *status_line;
   char *content_type_pattern;
-
-  struct Stream_Buffer *headers;
+  char content_type[LINE_MAX];
+  size_t body_in;
+  struct Type_Ratio ratios[RATIO_TABLE_MAX];
+
+  struct Http_Message *msg;
+  struct Method_Queue *methods;
+  struct Tunnel tunnel;
+  bool ws_text;
+  bool ws_masked;
+  bool ws_passing;
+  unsigned char ws_mask[4];
   struct Stream_Buffer *body;
+  struct Chunk_Writer *out;
+  bool chunked_out;
   struct Pipe_Handle *ph;
+  struct Child_Stats *children;
+  struct Stage_Timing timing;
 };
 
 
@@ -79,36 +159,42 @@ struct Body_State
  *    (terminates) program on malloc errors, otherwise returns void.
  */
 struct Body_State *
-body_state_new(const char *type_pattern)
+body_state_new(const char *type_pattern, char *read_buffer,
+	       size_t read_size)
 {
   struct Body_State *bstate = malloc(sizeof(struct Body_State));
 
   bstate->fd_stdin = STDIN_FILENO;
   bstate->fd_stdout = STDOUT_FILENO;
-  bstate->content_length_at = -1;
-  bstate->last_field_was_content_type = false;
   bstate->do_pipe_this_message = true;
+  bstate->headers_sent = false;
+  bstate->use_memfd = false;
+  bstate->body_fd = -1;
+  bstate->pipe_cmd = NULL;
+  bstate->content_type[0] = '\0';
+  bstate->body_in = 0;
+  memset(bstate->ratios, 0, sizeof(bstate->ratios));
 
   if (NULL == type_pattern)
     bstate->content_type_pattern = NULL;
   else
     bstate->content_type_pattern = strdup(type_pattern);
 
-  bstate->url = malloc(URL_MAX);
-  bstate->status_line = malloc(LINE_MAX);
-  if ((NULL == bstate->url) || (NULL == bstate->status_line))
-    {
-      perror("malloc() error initialising body state");
-      abort();
-    }
-  bzero(bstate->url, URL_MAX);
-  bzero(bstate->status_line, LINE_MAX);
-
-  bstate->headers = stream_buffer_new();
+  bstate->msg = http_message_new(read_buffer, read_size);
+  bstate->methods = method_queue_new();
+  tunnel_start(&bstate->tunnel);
+  bstate->ws_text = false;
+  bstate->ws_masked = false;
+  bstate->ws_passing = false;
   bstate->body = stream_buffer_new();
-  if ((bstate->headers == NULL) || (bstate->body == NULL))
+  bstate->out = chunk_writer_new(BUFFER_MAX);
+  bstate->chunked_out = false;
+  bstate->children = NULL;
+  stage_timing_init(&bstate->timing, NULL);
+  if ((bstate->msg == NULL) || (bstate->methods == NULL)
+      || (bstate->body == NULL) || (bstate->out == NULL))
     {
-      perror("stream_buffer_new() error initiaising body state");
+      perror("buffer_new() error initiaising body state");
       abort();
     }
 
@@ -129,130 +215,105 @@ body_state_new(const char *type_pattern)
 void
 body_state_delete(struct Body_State *bstate)
 {
-  free(bstate->url);
-  bstate->url = NULL;
-  free(bstate->status_line);
-  bstate->status_line = NULL;
-
   if (NULL != bstate->content_type_pattern)
     {
       free(bstate->content_type_pattern);
       bstate->content_type_pattern = NULL;
     }
 
-  stream_buffer_delete(bstate->headers);
-  bstate->headers = NULL;
+  http_message_delete(bstate->msg);
+  bstate->msg = NULL;
+  method_queue_delete(bstate->methods);
+  bstate->methods = NULL;
   stream_buffer_delete(bstate->body);
   bstate->body = NULL;
+  chunk_writer_delete(bstate->out);
+  bstate->out = NULL;
   pipe_handle_delete(bstate->ph);
   bstate->ph = NULL;
 
+  if (bstate->body_fd >= 0)
+    close(bstate->body_fd);
+
   free(bstate);
   return;
 }
 
 
 
+/* cb_message_begin:
+ *
+ *    Called when a new HTTP message starts. Forget the last one's
+ *    headers.
+ */
+int
+cb_message_begin(http_parser * parser)
+{
+  struct Body_State *bstate = (struct Body_State *) parser->data;
+
+  http_message_clear(bstate->msg);
+  bstate->headers_sent = false;
+  bstate->do_pipe_this_message = (NULL == bstate->content_type_pattern);
+  bstate->content_type[0] = '\0';
+  bstate->body_in = 0;
+  stage_timing_begin(&bstate->timing);
+  return 0;
+}
+
+
 /* cb_url: 
  *
  *    Callback from http_parser, called when URL read. Preserves the
- *    URL for later.
+ *    URL for later. The parser may deliver the URL in pieces.
  */
 int
 cb_url(http_parser * parser, const char *at, size_t length)
 {
   struct Body_State *bstate = (struct Body_State *) parser->data;
 
-  // Safely copy URL to buffer provided.
-  if (length < URL_MAX)
-    {
-      strncpy(bstate->url, at, length);
-      bstate->url[length] = '\0';
-    }
-  else
-    {
-      strncpy(bstate->url, at, URL_MAX - 1);
-      bstate->url[URL_MAX - 1] = '\0';
-      ulog(LOG_WARNING, "URL exceeded %zd bytes and was truncated", URL_MAX);
-    }
-  ulog_debug("Recorded URL of HTTP message: %s", bstate->url);
-  return 0;
+  ulog_debug("URL of HTTP message: %.*s", (int) length, at);
+  return http_message_on_url(bstate->msg, at, length);
 }
 
 
 /* cb_status_complete:
  *
  *    Called when the HTTP status has been read. Take opportunity to
- *    record the URL (pointed to by "at").
+ *    record the status text (pointed to by "at").
  */
 int
 cb_status_complete(http_parser * parser, const char *at, size_t length)
 {
   struct Body_State *bstate = (struct Body_State *) parser->data;
 
-  // Reset headers
-  bstate->content_length_at = -1;
-  stream_buffer_clear(bstate->headers);
-
-  // Safely copy URL to allocated space
-  if (length < URL_MAX)
-    {
-      strncpy(bstate->url, at, length);
-      bstate->url[length] = '\0';
-    }
-  else
-    {
-      strncpy(bstate->url, at, URL_MAX - 1);
-      bstate->url[URL_MAX] = '\0';
-    }
-  ulog_debug("HTTP response status: %s", bstate->url);
-  return 0;
+  ulog_debug("HTTP response status: %.*s", (int) length, at);
+  return http_message_on_url(bstate->msg, at, length);
 }
 
 
 /* cb_header_field:
  *
  *    Called when HTTP parser has read a header field. The parser will
- *    discard this but we need it to output it again. So we add it to
- *    our output (stream) buffer. Also need to add the colon and
- *    trailing space.
- */
-#define CONTENT_LENGTH_STR "content-length"
-#define CONTENT_LENGTH_LEN 14
-#define CONTENT_TYPE_STR "content-type"
-#define CONTENT_TYPE_LEN 12
+ *    discard this but we need it to output it again. So we keep it in
+ *    the message (the colon and trailing space are added back on
+ *    output).
+ */
 int
 cb_header_field(http_parser * parser, const char *at, size_t length)
 {
   struct Body_State *bstate = (struct Body_State *) parser->data;
 
-  ulog_debug("Header field: %.*s", (int)length, at);
-
-  // If this header field is for Content-Length, remember where we are before appending.
-  // If field is content-type, set flag for checking content type on header value.
-  bstate->last_field_was_content_type = false;
-  if (strncasecmp(CONTENT_LENGTH_STR, at, MIN(length, CONTENT_LENGTH_LEN)) == 0)
-    {
-      bstate->content_length_at = stream_buffer_size(bstate->headers);
-    }
-  else if (strncasecmp(CONTENT_TYPE_STR, at, MIN(length, CONTENT_TYPE_LEN)) == 0)
-    {
-      bstate->last_field_was_content_type = true;
-    }
-
-  // Now append headers to output buffer
-  stream_buffer_add(bstate->headers, at, length);
-  stream_buffer_add(bstate->headers, ": ", 2);
-  return 0;
+  ulog_debug("Header field: %.*s (id=%d)", (int)length, at,
+	     parser->header_id);
+  return http_message_on_header_field(bstate->msg, parser, at, length);
 }
 
 
 /* cb_header_value:
  *
  *    Companion to above function, called when a value for a header
- *    has been read. Append this to the same output stream
- *    buffer. Parser has stripped the trailing newline sequence so
- *    need to add that back.
+ *    has been read. Keep it in the same message. Parser has stripped
+ *    the trailing newline sequence, which is added back on output.
  */
 int
 cb_header_value(http_parser *parser, const char *at, size_t length)
@@ -260,28 +321,94 @@ cb_header_value(http_parser *parser, const char *at, size_t length)
   struct Body_State *bstate = (struct Body_State *) parser->data;
 
   ulog_debug("Header value: %.*s", (int)length, at);
+  return http_message_on_header_value(bstate->msg, at, length);
+}
 
-  stream_buffer_add(bstate->headers, at, length);
-  stream_buffer_add(bstate->headers, "\r\n", 2);
 
-  // Was last header field "content-type"? If so, match content type here
-  if (bstate->last_field_was_content_type && (NULL != bstate->content_type_pattern))
+/* type_ratio_find:
+ *
+ *    Returns the ratio table entry for the current message's
+ *    Content-Type. If "create" is true and there is none, the entry
+ *    with the fewest samples is recycled for it. Returns NULL if
+ *    there is no entry.
+ */
+struct Type_Ratio *
+type_ratio_find(struct Body_State *bstate, bool create)
+{
+  char type[RATIO_TYPE_MAX];
+  size_t len = strcspn(bstate->content_type, "; \t");
+  if (len >= RATIO_TYPE_MAX)
+    len = RATIO_TYPE_MAX - 1;
+  memcpy(type, bstate->content_type, len);
+  type[len] = '\0';
+
+  struct Type_Ratio *fewest = &bstate->ratios[0];
+  for (int i = 0; i < RATIO_TABLE_MAX; i++)
     {
-      char *temp_copy = strndup(at, length);
-      if (fnmatch(bstate->content_type_pattern, temp_copy, FNM_CASEFOLD) == 0)
-	{
-	  bstate->do_pipe_this_message = true;
-	}
-      else
-	{
-	  bstate->do_pipe_this_message = false;
-	}
-      ulog_debug("Content type was [%s] matched against [%s] == %d", temp_copy, 
-		 bstate->content_type_pattern, bstate->do_pipe_this_message);
-      free(temp_copy);
+      struct Type_Ratio *tr = &bstate->ratios[i];
+      if (tr->samples > 0 && strcasecmp(tr->type, type) == 0)
+	return tr;
+      if (tr->samples < fewest->samples)
+	fewest = tr;
     }
 
-  return 0;
+  if (!create)
+    return NULL;
+
+  strcpy(fewest->type, type);
+  fewest->ratio = 1.0;
+  fewest->samples = 0;
+  return fewest;
+}
+
+
+/* type_ratio_learn:
+ *
+ *    Folds the output/input ratio of the message just piped into the
+ *    estimate for its Content-Type. Recent messages count for more
+ *    once RATIO_WEIGHT_MAX samples have been seen.
+ */
+void
+type_ratio_learn(struct Body_State *bstate, size_t body_out)
+{
+  if (0 == bstate->body_in)
+    return;
+
+  struct Type_Ratio *tr = type_ratio_find(bstate, true);
+  double sample = (double) body_out / (double) bstate->body_in;
+  if (tr->samples < RATIO_WEIGHT_MAX)
+    tr->samples++;
+  tr->ratio += (sample - tr->ratio) / tr->samples;
+
+  ulog_debug("Ratio for [%s] is now %.3f (sample %.3f, %u samples)",
+	     tr->type, tr->ratio, sample, tr->samples);
+  return;
+}
+
+
+/* reserve_body_buffer:
+ *
+ *    Sizes the body buffer for the command's output before the body
+ *    arrives: Content-Length times the learned ratio for this
+ *    Content-Type (1.0 if not yet seen), plus 1/16 headroom. Capped
+ *    at RESERVE_MAX so a bogus Content-Length can't exhaust memory.
+ */
+void
+reserve_body_buffer(struct Body_State *bstate)
+{
+  uint64_t content_length = bstate->msg->content_length;
+  if (ULLONG_MAX == content_length || 0 == content_length)
+    return;
+
+  struct Type_Ratio *tr = type_ratio_find(bstate, false);
+  double ratio = (NULL == tr ? 1.0 : tr->ratio);
+  double estimate = (double) content_length * ratio;
+  estimate += estimate / 16;
+  if (estimate > RESERVE_MAX)
+    estimate = RESERVE_MAX;
+
+  stream_buffer_reserve(bstate->body, (size_t) estimate);
+  return;
 }
 
 
@@ -292,37 +419,92 @@ cb_header_value(http_parser *parser, const char *at, size_t length)
  *    have changed size and we need to recalculate the Content-Length
  *    header.
  *
- *    Note: if we're not really going to pipe the body, because the
- *    user has specified that they want to match against a type, and
- *    the current message doesn't match that type, then we are going
- *    to dump headers as soon as the body starts getting written. But
- *    for now, we still accumulate headers into the stream buffer.
+ *    This is where the Content-Type is matched. If we're not really
+ *    going to pipe the body, because the user has specified that they
+ *    want to match against a type, and the current message doesn't
+ *    match that type, then we are going to dump headers as soon as
+ *    the body starts getting written.
  *
  */
 int
 cb_headers_complete(http_parser * parser)
 {
   struct Body_State *bstate = (struct Body_State *) parser->data;
+  PROBE3(headers__complete, parser, (int) parser->type, parser->nread);
+
+  http_message_on_headers_complete(bstate->msg, parser);
 
-  // Build the HTTP message start based on message type
-  char *str = bstate->status_line;
-  if (HTTP_REQUEST == parser->type)
+  // Remember the Content-Type, and match it if asked to
+  size_t length = 0;
+  const char *type =
+    http_message_get(bstate->msg, HTTP_HEADER_CONTENT_TYPE, &length);
+  if (NULL != type)
+    snprintf(bstate->content_type, LINE_MAX, "%.*s", (int) length, type);
+  if (NULL != type && NULL != bstate->content_type_pattern)
     {
-      snprintf(str, BUFFER_MAX, "%s %s HTTP/%d.%d\r\n",
-	       http_method_str(parser->method),
-	       bstate->url, parser->http_major, parser->http_minor);
+      bstate->do_pipe_this_message =
+	(fnmatch(bstate->content_type_pattern, bstate->content_type,
+		 FNM_CASEFOLD) == 0);
+      ulog_debug("Content type was [%s] matched against [%s] == %d",
+		 bstate->content_type, bstate->content_type_pattern,
+		 bstate->do_pipe_this_message);
     }
+
+  ulog_debug("cb_headers_complete(parser=%X, parser->type=%d, do_pipe_this_message=%d)", parser,
+	     parser->type, bstate->do_pipe_this_message);
+
+  // Responses to HEAD (and 1xx, 204 and 304) have no body whatever
+  // their Content-Length says
+  int skip_body = method_queue_skip_body(bstate->methods, parser);
+
+  if (bstate->do_pipe_this_message && !bstate->use_memfd && !skip_body)
+    reserve_body_buffer(bstate);
+
+  return skip_body;
+}
+
+
+/* body_sink_is_open:
+ *
+ *    True once the current message's body has started going to the
+ *    command (or its memfd).
+ */
+bool
+body_sink_is_open(struct Body_State *bstate)
+{
+  if (bstate->use_memfd)
+    return (bstate->body_fd >= 0);
   else
+    return (PIPES_CLOSED != bstate->ph->state);
+}
+
+
+/* open_body_sink:
+ *
+ *    Called on the first body byte of a message that is to be
+ *    piped. Starts the command, or in memfd mode creates the memfd
+ *    that the body is collected in (the command is started when the
+ *    message completes). Returns 0 on success.
+ */
+int
+open_body_sink(struct Body_State *bstate)
+{
+  if (body_sink_is_open(bstate))
+    return 0;
+
+  if (bstate->use_memfd)
     {
-      snprintf(str, BUFFER_MAX, "HTTP/%d.%d %d %s\r\n",
-	       parser->http_major,
-	       parser->http_minor, parser->status_code, bstate->url);
+      bstate->body_fd = memfd_open("mumpsimus-body-in");
+      if (bstate->body_fd < 0)
+	return -1;
     }
-  ulog_debug("cb_headers_complete(parser=%X, parser->type=%d, do_pipe_this_message=%d): %s\n", parser,
-	     parser->type, bstate->do_pipe_this_message, str);
-
-  // Append blank line to end of HTTP headers.
-  stream_buffer_add(bstate->headers, "\r\n", 2);
+  else if (pipe_open2(bstate->ph, bstate->pipe_cmd) != 0)
+    {
+      ulog(LOG_ERR, "Unable to open pipe to command: %s", bstate->pipe_cmd);
+      return -1;
+    }
+  else
+    stage_timing_spawned(&bstate->timing, bstate->ph->fork_ns);
 
   return 0;
 }
@@ -333,11 +515,12 @@ cb_headers_complete(http_parser * parser)
  *    Called each time a chunk of the body has been read by the
  *    parser. Some conditional logic here:
  *      - If we are piping this output, We will write this to the 
- *        pipe write end. 
+ *        pipe write end (opening the pipe on the first chunk).
  *      - If we are not piping this output, just send to stdout.
  *
  *    If we're not piping, we'll need to write headers before writing
- *    this body chunk. 
+ *    this body chunk. Pieces are gathered (see chunked.h), and
+ *    chunked again for stdout if the message was.
  *
  *    TODO: The main parser loop will periodically poll the read end
  *    to make sure the piped command doesn't block on write because
@@ -347,9 +530,18 @@ int
 cb_body(http_parser * parser, const char *at, size_t length)
 {
   struct Body_State *bstate = (struct Body_State *) parser->data;
+  PROBE2(body, parser, length);
 
   int fd = 0;
-  if (bstate->do_pipe_this_message)
+  if (bstate->do_pipe_this_message && open_body_sink(bstate) != 0)
+    {
+      return -1;
+    }
+  else if (bstate->do_pipe_this_message && bstate->use_memfd)
+    {
+      fd = bstate->body_fd;
+    }
+  else if (bstate->do_pipe_this_message)
     {
       fd = pipe_write_fileno(bstate->ph);
     }
@@ -357,14 +549,19 @@ cb_body(http_parser * parser, const char *at, size_t length)
     {
       fd = bstate->fd_stdout;
       // write headers if haven't already
-      if (stream_buffer_size(bstate->headers) > 0) 
+      if (!bstate->headers_sent) 
 	{
-	  write_all(fd, bstate->status_line, strlen(bstate->status_line));
-	  stream_buffer_write(bstate->headers, fd);
+	  stage_timing_insert(&bstate->timing, bstate->msg, false);
+	  http_message_write_head(bstate->msg, fd);
+	  bstate->headers_sent = true;
 	}
     }
 
-  write_all(fd, at, length);
+  if (0 == bstate->body_in)
+    chunk_writer_start(bstate->out, fd,
+		       (fd == bstate->fd_stdout && bstate->msg->chunked));
+  chunk_writer_add(bstate->out, at, length);
+  bstate->body_in += length;
 
   ulog_debug
     ("cb_body(parser=%X, at=%X, length=%zd) -> fd=%d (do_pipe_this_message=%d)",
@@ -375,95 +572,431 @@ cb_body(http_parser * parser, const char *at, size_t length)
 
 
 
+/* replace_header:
+ *
+ *    Replaces header "n" with "field: value", keeping the original
+ *    just after it as X-Mumpsimus-Original-<field>.
+ */
+void
+replace_header(struct Http_Message *msg, size_t n, const char *field,
+	       const char *value)
+{
+  char orig_field[LINE_MAX];
+  char orig_value[LINE_MAX];
+
+  size_t length = 0;
+  const char *at = http_message_field(msg, n, &length);
+  int orig_field_len = snprintf(orig_field, LINE_MAX,
+				"X-Mumpsimus-Original-%.*s", (int) length,
+				at);
+  at = http_message_value(msg, n, &length);
+  int orig_value_len = snprintf(orig_value, LINE_MAX, "%.*s", (int) length,
+				at);
+
+  http_message_remove(msg, n);
+  http_message_insert(msg, n, field, strlen(field), value, strlen(value));
+  http_message_insert(msg, n + 1, orig_field, orig_field_len, orig_value,
+		      orig_value_len);
+  return;
+}
+
+
+/* write_message_head:
+ *
+ *    Outputs the status line and headers for the current message,
+ *    correcting the Content-Length field to "body_length" and keeping
+ *    the original as X-Mumpsimus-Original-Content-Length. A chunked
+ *    message gets a Content-Length in place of its Transfer-Encoding.
+ */
+void
+write_message_head(struct Body_State *bstate, size_t body_length)
+{
+  char field[LINE_MAX];
+  char value[LINE_MAX];
+  struct Http_Message *msg = bstate->msg;
+
+  ulog_debug("Body length is %zd", body_length);
+
+  // Without a Content-Length header (or chunking) the head goes out
+  // unchanged. TODO: Should we add a "Connection: close" then?
+  ssize_t n = http_message_find(msg, HTTP_HEADER_CONTENT_LENGTH);
+  if (n >= 0)
+    {
+      // Copy the original first: the message may move as it grows
+      size_t length = 0;
+      const char *at = http_message_field(msg, n, &length);
+      int field_len = snprintf(field, LINE_MAX, "X-Mumpsimus-Original-%.*s",
+			       (int) length, at);
+      at = http_message_value(msg, n, &length);
+      int value_len = snprintf(value, LINE_MAX, "%.*s", (int) length, at);
+
+      // Keep the original just after it, then correct it
+      http_message_insert(msg, n + 1, field, field_len, value, value_len);
+      value_len = snprintf(value, LINE_MAX, "%zd", body_length);
+      http_message_set_value(msg, n, value, value_len);
+    }
+  else if (msg->chunked)
+    {
+      n = http_message_find(msg, HTTP_HEADER_TRANSFER_ENCODING);
+      snprintf(value, LINE_MAX, "%zd", body_length);
+      if (n >= 0)
+	replace_header(msg, n, "Content-Length", value);
+    }
+
+  stage_timing_insert(&bstate->timing, msg, true);
+  http_message_write_head(msg, bstate->fd_stdout);
+  bstate->headers_sent = true;
+
+  return;
+}
+
+
+/* read_command_output:
+ *
+ *    Close our write-end of the pipe, so that the command gets eof
+ *    and flushes, then read all its output into the body buffer. If
+ *    "mask" is not NULL the output is WebSocket masked with it as it
+ *    arrives.
+ */
+void
+read_command_output(struct Body_State *bstate, const unsigned char *mask)
+{
+  pipe_send_eof(bstate->ph);
+
+  char *buffer = malloc(BUFFER_MAX);
+  if (buffer == NULL)
+    {
+      perror("Error retured from malloc");
+      abort();
+    }
+
+  ssize_t bytes_read = 0;
+  size_t total = 0;
+  do
+    {
+      bytes_read = read(pipe_read_fileno(bstate->ph), buffer, BUFFER_MAX);
+      if (bytes_read > 0)
+	{
+	  if (NULL != mask)
+	    http_scan_unmask(buffer, bytes_read, mask, total);
+	  stream_buffer_add(bstate->body, buffer, bytes_read);
+	  total += bytes_read;
+	}
+      else if (bytes_read < 0)
+	ulog(LOG_ERR, "read returned an error (%d): %s", errno,
+	     strerror(errno));
+    }
+  while (bytes_read > 0);
+
+  free(buffer);
+  return;
+}
+
+
+/* can_send_chunked:
+ *
+ *    True if the current message may be sent with chunked coding:
+ *    only HTTP/1.1 and later know it.
+ */
+bool
+can_send_chunked(struct Http_Message *msg)
+{
+  return (msg->http_major > 1
+	  || (1 == msg->http_major && msg->http_minor >= 1));
+}
+
+
+/* stream_chunked_message:
+ *
+ *    Output headers saying the body is chunked (in place of any
+ *    Content-Length), then the command's output as it is read, one
+ *    chunk per read. Nothing is buffered. Returns the body length.
+ */
+size_t
+stream_chunked_message(struct Body_State *bstate)
+{
+  struct Http_Message *msg = bstate->msg;
+
+  ssize_t n = http_message_find(msg, HTTP_HEADER_CONTENT_LENGTH);
+  if (n >= 0)
+    replace_header(msg, n, "Transfer-Encoding", "chunked");
+  else if (!msg->chunked)
+    http_message_insert(msg, http_message_header_count(msg),
+			"Transfer-Encoding", 17, "chunked", 7);
+  stage_timing_insert(&bstate->timing, msg, true);
+  http_message_write_head(msg, bstate->fd_stdout);
+  bstate->headers_sent = true;
+
+  pipe_send_eof(bstate->ph);
+
+  char *buffer = malloc(BUFFER_MAX);
+  if (buffer == NULL)
+    {
+      perror("Error retured from malloc");
+      abort();
+    }
+
+  size_t total = 0;
+  ssize_t bytes_read = 0;
+  do
+    {
+      bytes_read = read(pipe_read_fileno(bstate->ph), buffer, BUFFER_MAX);
+      if (bytes_read > 0)
+	{
+	  chunked_write(bstate->fd_stdout, buffer, bytes_read);
+	  total += bytes_read;
+	}
+      else if (bytes_read < 0)
+	ulog(LOG_ERR, "read returned an error (%d): %s", errno,
+	     strerror(errno));
+    }
+  while (bytes_read > 0);
+  chunked_write_end(bstate->fd_stdout);
+
+  free(buffer);
+  return total;
+}
+
+
+/* close_command:
+ *
+ *    Closes the pipe to the command, waiting for it to finish, and
+ *    adds what it used to the -R totals under "type".
+ */
+void
+close_command(struct Body_State *bstate, const char *type)
+{
+  pipe_close(bstate->ph);
+  if (NULL != bstate->children)
+    child_stats_record(bstate->children, bstate->pipe_cmd, type,
+		       &bstate->ph->rusage, bstate->ph->wall_ns);
+  return;
+}
+
+
+/* flush_piped_message:
+ *
+ *    Close our write-end of the pipe, read the command's output back
+ *    into the body buffer, then output headers and the new body and
+ *    close the pipe. The next message with a body opens a new one.
+ *    With -C the output is streamed chunked instead.
+ */
+void
+flush_piped_message(struct Body_State *bstate)
+{
+  if (bstate->chunked_out && can_send_chunked(bstate->msg))
+    {
+      type_ratio_learn(bstate, stream_chunked_message(bstate));
+      close_command(bstate, bstate->content_type);
+      return;
+    }
+
+  read_command_output(bstate, NULL);
+  type_ratio_learn(bstate, stream_buffer_size(bstate->body));
+
+  // Output headers and the new body
+  write_message_head(bstate, stream_buffer_size(bstate->body));
+  stream_buffer_write(bstate->body, bstate->fd_stdout);
+
+  // Done with this command
+  close_command(bstate, bstate->content_type);
+  return;
+}
+
+
+/* flush_memfd_message:
+ *
+ *    Seal the memfd holding the body, run the command with it as
+ *    stdin and a second memfd as stdout, then output headers and send
+ *    the command's output with sendfile. Returns 0 on success.
+ */
+int
+flush_memfd_message(struct Body_State *bstate)
+{
+  int rc = 0;
+  int out_fd = memfd_open("mumpsimus-body-out");
+  if (out_fd < 0)
+    return -1;
+
+  // Command reads from the start of the sealed body
+  memfd_seal(bstate->body_fd);
+  if (pipe_open_fds(bstate->ph, bstate->pipe_cmd, bstate->body_fd, out_fd)
+      != 0)
+    {
+      ulog(LOG_ERR, "Unable to run command: %s", bstate->pipe_cmd);
+      rc = -1;
+    }
+  else
+    {
+      stage_timing_spawned(&bstate->timing, bstate->ph->fork_ns);
+      close_command(bstate, bstate->content_type);
+
+      off_t body_length = lseek(out_fd, 0, SEEK_END);
+      if (body_length < 0)
+	{
+	  ulog(LOG_ERR, "lseek on body memfd failed (%m)");
+	  rc = -1;
+	}
+      else
+	{
+	  write_message_head(bstate, body_length);
+	  sendfile_all(bstate->fd_stdout, out_fd, body_length);
+	}
+    }
+
+  close(out_fd);
+  close(bstate->body_fd);
+  bstate->body_fd = -1;
+
+  return rc;
+}
+
+
 /* cb_message_complete:
  *
  *    Called by http_parser_execute when the HTTP message is all
  *    done. Need to:
- *        - Close our write-end of the pipe.
+ *        - Output headers now if a bodiless (or unpiped) message had
+ *          none sent.
+ *        - Close our write-end of the pipe (or seal the memfd).
  *        - Read remaining data from read-end of the pipe.
  *        - Calculate the length of the body.
  *        - Output the headers, correcting the Content-Length field.
  *        - Output the body.
- *        - Reset the pipe.
+ *        - Close the pipe.
  *        - Reset the parser.
  */
 int
 cb_message_complete(http_parser * parser)
 {
   struct Body_State *bstate = (struct Body_State *) parser->data;
+  int rc = 0;
+  counter_add(COUNTER_MESSAGES, 1);
+  stage_timing_end(&bstate->timing);
 
+  // Body gathered so far goes out first (ending it if chunked)
+  chunk_writer_end(bstate->out);
 
   // If we've been filtering then need to flush out the pipe
-  if ( ! bstate->do_pipe_this_message)
+  if (!bstate->do_pipe_this_message || !body_sink_is_open(bstate))
     {
+      if (!bstate->headers_sent)
+	{
+	  stage_timing_insert(&bstate->timing, bstate->msg, false);
+	  http_message_write_head(bstate->msg, bstate->fd_stdout);
+	}
+      // An empty chunked body still needs its last-chunk
+      if (bstate->msg->chunked && 0 == bstate->body_in
+	  && !(parser->flags & F_SKIPBODY))
+	chunked_write_end(bstate->fd_stdout);
       ulog(LOG_INFO, "Message complete");
     }
+  else if (bstate->use_memfd)
+    {
+      rc = flush_memfd_message(bstate);
+    }
   else
     {
-      // Close the write end of the pipe so that it gets eof and flushes data
-      pipe_send_eof(bstate->ph);
+      flush_piped_message(bstate);
+    }
 
-      // Read remaining data from read-end of pipe.
-      char *buffer = malloc(BUFFER_MAX);
-      if (buffer == NULL)
-	{
-	  perror("Error retured from malloc");
-	  abort();
-	}
+  // Reset parser
+  tunnel_after_message(&bstate->tunnel, parser, bstate->msg);
+  http_parser_init(parser, HTTP_BOTH);
+  http_message_clear(bstate->msg);
 
-      ssize_t bytes_read = 0;
-      do
-	{
-	  bytes_read = read(pipe_read_fileno(bstate->ph), buffer, BUFFER_MAX);
-	  if (bytes_read > 0)
-	    stream_buffer_add(bstate->body, buffer, bytes_read);
-	  else if (bytes_read < 0)
-	    ulog(LOG_ERR, "read returned an error (%d): %s", errno,
-		 strerror(errno));
-	}
-      while (bytes_read > 0);
+  return rc;
+}
 
-      // Get the new body length
-      size_t body_length = stream_buffer_size(bstate->body);
 
-      // Output HTTP status message
-      ulog_debug("Body length is %zd", body_length);
-      write_all(bstate->fd_stdout, bstate->status_line,
-	    strlen(bstate->status_line));
-      
-      if (bstate->content_length_at >= 0)
-	{
-	  // Output all headers up to (not including) Content-Length
-	  stream_buffer_write_to(bstate->headers, bstate->fd_stdout,
-				 bstate->content_length_at);
-	  snprintf(buffer, BUFFER_MAX,
-		   "Content-Length: %zd\r\nX-Mumpsimus-Original-",
-		   body_length);
-	  write_all(bstate->fd_stdout, buffer, strlen(buffer));
-
-	  // Rest of headers buffer already includes blank line
-	  stream_buffer_write(bstate->headers, bstate->fd_stdout);
-	}
-      else
+/* cb_frame_header:
+ *
+ *    Called by ws_parser for each WebSocket frame. A text message
+ *    (a text frame and any continuations) has its payload unmasked
+ *    and piped to the command, which is started on its first
+ *    frame. Any other frame goes straight out: its header now, its
+ *    payload untouched (returning 1 stops it being unmasked).
+ */
+int
+cb_frame_header(ws_parser * ws)
+{
+  struct Body_State *bstate = (struct Body_State *) ws->data;
+
+  ulog_debug("WebSocket frame: %s fin=%d rsv=%d length=%llu",
+	     ws_opcode_str(ws->opcode), ws->fin, ws->rsv,
+	     (unsigned long long) ws->payload_length);
+
+  // RSV bits belong to an extension (RSV1 is permessage-deflate): the
+  // payload is not text the command could read, and the bits would be
+  // lost if it were re-framed. Such messages pass through whole.
+  if (WS_OP_TEXT == ws->opcode && !bstate->ws_text && 0 != ws->rsv)
+    bstate->ws_passing = !ws->fin;
+  else if (WS_OP_CONTINUATION == ws->opcode && bstate->ws_passing)
+    bstate->ws_passing = !ws->fin;
+  else if (WS_OP_TEXT == ws->opcode && !bstate->ws_text)
+    {
+      if (pipe_open2(bstate->ph, bstate->pipe_cmd) != 0)
 	{
-	  // No Content-Length header! TODO: Should we add a "Connection: close" here?
-	  stream_buffer_write(bstate->headers, bstate->fd_stdout);
+	  ulog(LOG_ERR, "Unable to open pipe to command: %s",
+	       bstate->pipe_cmd);
+	  return -1;
 	}
+      bstate->ws_text = true;
+      bstate->ws_masked = ws->masked;
+      memcpy(bstate->ws_mask, ws->mask, 4);
+      return 0;
+    }
+  if (WS_OP_CONTINUATION == ws->opcode && bstate->ws_text)
+    return 0;
 
-      // Output the new body
-      stream_buffer_write(bstate->body, bstate->fd_stdout);
+  write_all(bstate->fd_stdout, (const char *) ws->header, ws->header_len);
+  return 1;
+}
 
-      // Reset pipe
-      pipe_reset(bstate->ph);
 
-      // Free memory from this routine
-      free(buffer);
-    }
+/* cb_frame_payload:
+ *
+ *    Text payloads (now unmasked) go to the command, the rest to
+ *    stdout as they were.
+ */
+int
+cb_frame_payload(ws_parser * ws, const char *at, size_t length)
+{
+  struct Body_State *bstate = (struct Body_State *) ws->data;
 
-  // Reset parser
-  http_parser_init(parser, HTTP_BOTH);
-  bstate->content_length_at = -1;
+  if (ws->raw)
+    write_all(bstate->fd_stdout, at, length);
+  else
+    write_all(pipe_write_fileno(bstate->ph), at, length);
+  return 0;
+}
+
+
+/* cb_frame_complete:
+ *
+ *    At the end of a text message, send the command's output on as
+ *    one text frame, masked with the first frame's key if that was
+ *    masked.
+ */
+int
+cb_frame_complete(ws_parser * ws)
+{
+  struct Body_State *bstate = (struct Body_State *) ws->data;
+
+  if (ws->raw || !bstate->ws_text || !ws->fin)
+    return 0;
+
+  const unsigned char *mask = (bstate->ws_masked ? bstate->ws_mask : NULL);
+  read_command_output(bstate, mask);
 
+  unsigned char header[WS_FRAME_HEADER_MAX];
+  size_t header_len = ws_frame_header(header, 1, WS_OP_TEXT,
+				      stream_buffer_size(bstate->body), mask);
+  write_all(bstate->fd_stdout, (const char *) header, header_len);
+  stream_buffer_write(bstate->body, bstate->fd_stdout);
+
+  close_command(bstate, "websocket");
+  bstate->ws_text = false;
   return 0;
 }
 
@@ -476,23 +1009,43 @@ cb_message_complete(http_parser * parser)
  *    pipe_cmd      Shell command to open pipe to
  *    type_pattern  If not NULL, matched against Content-Type. Only
  *                  messages that match are sent to pipe_cmd.
+ *    use_memfd     If true, hand bodies over in memfds, not a pipe.
+ *    chunked_out   If true, send piped bodies chunked (not with memfds).
+ *    children      If not NULL, what each command used is added here.
+ *    timing        If true, add X-Mumpsimus-Timing to each message.
  */
 int
 pipe_http_messages(int fd_in, int fd_out, const char *pipe_cmd,
-		   const char *type_pattern)
+		   const char *type_pattern, bool use_memfd, bool chunked_out,
+		   struct Child_Stats *children, bool timing)
 {
   int errors = 0;
   int rc = EX_OK;
 
 
+  // Buffer for reading data from stdin
+  char *buffer = buffer_alloc(BUFFER_MAX);
+  if (NULL == buffer)
+    {
+      perror("Error from malloc");
+      return -1;
+    }
+
   // This struct will hold inforamtion we need on each callback
-  struct Body_State *bstate = body_state_new(type_pattern);
+  struct Body_State *bstate = body_state_new(type_pattern, buffer, BUFFER_MAX);
   bstate->fd_stdin = fd_in;
   bstate->fd_stdout = fd_out;
+  bstate->use_memfd = use_memfd;
+  bstate->chunked_out = chunked_out;
+  bstate->pipe_cmd = pipe_cmd;
+  bstate->children = children;
+  if (timing)
+    stage_timing_init(&bstate->timing, "body");
 
   // This struct sets up callbacks for the HTTP parser
   http_parser_settings settings;
   http_parser_settings_init(&settings);
+  settings.on_message_begin = cb_message_begin;
   settings.on_header_field = cb_header_field;
   settings.on_header_value = cb_header_value;
   settings.on_headers_complete = cb_headers_complete;
@@ -506,23 +1059,17 @@ pipe_http_messages(int fd_in, int fd_out, const char *pipe_cmd,
   http_parser_init(&parser, HTTP_BOTH);
   parser.data = (void *) bstate;
 
-
-  // Now need to open pipe command 
-  if (pipe_open2(bstate->ph, pipe_cmd) != 0)
-    {
-      ulog(LOG_ERR, "Unable to open pipe to command: %s", pipe_cmd);
-      return -1;
-    }
+  // Frame parser for after an upgrade to WebSocket
+  ws_parser_settings ws_settings;
+  ws_parser_settings_init(&ws_settings);
+  ws_settings.on_frame_header = cb_frame_header;
+  ws_settings.on_payload = cb_frame_payload;
+  ws_settings.on_frame_complete = cb_frame_complete;
+  ws_parser ws;
+  ws.data = (void *) bstate;
+  ws_parser_init(&ws);
 
 
-  // Buffer for reading data from stdin
-  char *buffer = malloc(BUFFER_MAX);
-  if (NULL == buffer)
-    {
-      perror("Error from malloc");
-      return -1;
-    }
-
 
   ssize_t last_parsed = 0;
   ssize_t bytes_read = 0;
@@ -530,11 +1077,16 @@ pipe_http_messages(int fd_in, int fd_out, const char *pipe_cmd,
   bool do_reads = true;
   do
     {
+      // Headers still pending point into the buffer. Keep them.
+      http_message_retain(bstate->msg);
+
       // Read data from stdin
       memset(buffer, 0, BUFFER_MAX);
       buf_ptr = buffer;
-      bytes_read = read(fd_in, buffer, BUFFER_MAX);
+      bytes_read = read_input(fd_in, buffer, BUFFER_MAX);
       ulog_debug("Read %zd bytes from fd=%d", bytes_read, fd_in);
+      if (NULL != children && child_stats_wanted())
+	child_stats_dump(children, stderr, CHILD_STATS_PREFIX);
 
       // Handle error or eof
       if (bytes_read < 0)
@@ -556,27 +1108,49 @@ pipe_http_messages(int fd_in, int fd_out, const char *pipe_cmd,
 	  // Repeatedly call http_parser_execute while there is data left in the buffer
 	  while ((bytes_read > 0) && (errors <= 0))
 	    {
+	      // After a protocol switch the rest is not HTTP/1.x. Only
+	      // WebSocket frames are followed: HTTP/2 passes unmodified,
+	      // as rewriting it would upset its HPACK and flow control.
+	      tunnel_resolve(&bstate->tunnel, buf_ptr, bytes_read);
+	      bool in_tunnel = (TUNNEL_OPEN == bstate->tunnel.state);
+	      if (in_tunnel && !bstate->tunnel.websocket)
+		{
+		  if (bstate->tunnel.h2c)
+		    ulog(LOG_WARNING, "HTTP/2 (h2c) stream -- bodies in it "
+			 "are passed through untransformed");
+		  tunnel_pass(fd_in, fd_out, buf_ptr, bytes_read);
+		  do_reads = false;
+		  break;
+		}
 
-	      last_parsed =
-		http_parser_execute(&parser, &settings, buf_ptr, bytes_read);
+	      if (in_tunnel)
+		last_parsed =
+		  ws_parser_execute(&ws, &ws_settings, buf_ptr, bytes_read);
+	      else
+		last_parsed =
+		  http_parser_execute(&parser, &settings, buf_ptr,
+				      bytes_read);
 	      ulog_debug("Parsed %zd bytes out of %zd bytes remaining",
 			 last_parsed, bytes_read);
 
-	      if (parser.upgrade) // TODO: support this properly
-		{
-		  ulog(LOG_ERR, "HTTP Upgrade protocol invoked -- feature not supported");
-		  errors++;
-		}
-	      else if (last_parsed > 0)
+	      if (last_parsed > 0)
 		{
 		  // Some data was parsed. Advance to next part of buffer
 		  bytes_read -= last_parsed;
 		  buf_ptr += last_parsed;
 		}
+	      else if (in_tunnel)
+		{
+		  errors++;
+		  counter_add(COUNTER_PARSE_ERRORS, 1);
+		  ulog(LOG_ERR, "Parser error reading WebSocket stream: %s",
+		       ws_errno_str(ws.ws_errno));
+		}
 	      else
 		{
 		  // Parser returned an error condition
 		  errors++;
+		  counter_add(COUNTER_PARSE_ERRORS, 1);
 		  ulog(LOG_ERR,
 		       "Parser error reading HTTP stream type %d: %s (%s). Next char is %c (%d)",
 		       parser.type,
@@ -585,6 +1159,10 @@ pipe_http_messages(int fd_in, int fd_out, const char *pipe_cmd,
 		       *buf_ptr);
 		}		// while (bytes_read > 0) && (errors <= 0)
 	    }			// if...else
+
+	  // Gather no further than this read: a streamed body (such as
+	  // server-sent events) must not wait for the next one
+	  chunk_writer_flush(bstate->out);
 	}
       ulog_debug("Inner parser loop exited (bytes_read=%zd; errors=%d)",
 		 bytes_read, errors);
@@ -592,7 +1170,7 @@ pipe_http_messages(int fd_in, int fd_out, const char *pipe_cmd,
   while (do_reads && (errors <= 0));
 
   // We allocated these
-  free(buffer);
+  buffer_free(buffer);
   body_state_delete(bstate);
 
   if (errors > 0)
@@ -611,7 +1189,14 @@ usage(const char *ident, const char *message)
 {
   if (message != NULL)
     fprintf(stderr, "error: %s\n", message);
-  fprintf(stderr, "usage: %s -c command\n", ident);
+  fprintf(stderr, "usage: %s [-C] [-m] [-R] [-T] [-t type] -c command\n"
+	  "\t-c\tcommand to pipe message bodies through\n"
+	  "\t-C\tsend piped bodies chunked, as the command outputs them\n"
+	  "\t-m\thand bodies to command in memfds instead of pipes\n"
+	  "\t-R\treport what the commands used, per Content-Type, at exit or on SIGUSR1\n"
+	  "\t-t\tonly pipe bodies with Content-Type matching glob\n"
+	  "\t-T\tadd X-Mumpsimus-Timing to each message\n",
+	  ident);
   exit(EX_USAGE);
 }
 
@@ -631,12 +1216,16 @@ main(int argc, char *argv[])
   int rc = EX_OK;		// Exit code to return to environment
   char *pipe_cmd = NULL;	// Pointer to command line to pipe output through
   char *type_pattern = NULL;	// Pointer to MIME type glob pattern
+  bool use_memfd = false;	// Use memfds instead of pipes
+  bool chunked_out = false;	// Send piped bodies chunked
+  struct Child_Stats *children = NULL;	// What the commands used, if -R
+  bool timing = false;		// Add X-Mumpsimus-Timing
 
   // TODO: Maybe add option to only do requests or responses?
 
   // Process command line arguments
   int c = 0;
-  while ((c = getopt(argc, argv, "t:c:")) != -1)
+  while ((c = getopt(argc, argv, "CmRTt:c:")) != -1)
     {
       switch (c)
 	{
@@ -645,6 +1234,24 @@ main(int argc, char *argv[])
 	    usage(argv[0], "Must pass a command to -c");
 	  pipe_cmd = optarg;
 	  break;
+	case 'C':
+	  chunked_out = true;
+	  break;
+	case 'm':
+	  use_memfd = true;
+	  break;
+	case 'R':
+	  if (NULL == children)
+	    children = child_stats_new();
+	  if (NULL == children)
+	    {
+	      perror("Error from malloc");
+	      return EX_OSERR;
+	    }
+	  break;
+	case 'T':
+	  timing = true;
+	  break;
 	case 't':
 	  if (NULL == optarg)
 	    usage(argv[0], "Must pass a type pattern to -t");
@@ -672,13 +1279,23 @@ main(int argc, char *argv[])
 
   // Initialise logging tool and begin debug log message
   ulog_init(argv[0]);
-  ulog(LOG_INFO, "Piping all HTTP message bodies through %s", pipe_cmd);
+  counters_open(argv[0]);
+  ulog(LOG_INFO, "Piping all HTTP message bodies through %s (buffers: %s)",
+       pipe_cmd, buffer_alloc_describe());
   if (NULL != type_pattern)
     ulog(LOG_INFO, "Matching Content-Type against %s", type_pattern);
+  if (use_memfd)
+    ulog(LOG_INFO, "Handing message bodies to command in memfds");
+  if (NULL != children)
+    child_stats_watch(SIGUSR1);
 
   // Call main program loop
   rc =
-    pipe_http_messages(STDIN_FILENO, STDOUT_FILENO, pipe_cmd, type_pattern);
+    pipe_http_messages(STDIN_FILENO, STDOUT_FILENO, pipe_cmd, type_pattern,
+		       use_memfd, chunked_out, children, timing);
+  if (NULL != children)
+    child_stats_dump(children, stderr, CHILD_STATS_PREFIX);
+  child_stats_delete(children);
 
   ulog_close();
 
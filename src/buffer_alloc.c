@@ -0,0 +1,294 @@
+/* buffer_alloc.c:
+ *
+ *    Allocator for large I/O buffers, with an optional huge page and
+ *    NUMA aware mmap backend.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef HAVE_SYS_MMAN_H
+#  include <sys/mman.h>
+#endif
+#ifdef HAVE_SYS_SYSCALL_H
+#  include <sys/syscall.h>
+#endif
+
+#include "ulog.h"
+#include "util.h"
+
+#include "buffer_alloc.h"
+
+#define BUFFER_ALLOC_ENVVAR "MUMPSIMUS_ALLOC"
+#define BUFFER_ALLOC_THRESHOLD_ENVVAR "MUMPSIMUS_ALLOC_THRESHOLD"
+#define BUFFER_ALLOC_NODE_ENVVAR "MUMPSIMUS_ALLOC_NODE"
+
+#define HUGEPAGE_SIZE (2 * 1024 * 1024)
+#define MPOL_BIND_MODE 2	// MPOL_BIND from <linux/mempolicy.h>
+
+/* Block_Header:
+ *
+ *    Sits just before every buffer handed out, so buffer_free and
+ *    buffer_realloc know how it was allocated. Padded to a cache
+ *    line, so a buffer in a mapped block starts on one; a buffer from
+ *    malloc only has malloc's alignment (16 bytes), as realloc could
+ *    not keep any more.
+ */
+struct Block_Header
+{
+  size_t size;			// Usable bytes after the header
+  size_t map_size;		// Bytes mapped (0 if from malloc)
+  char pad[64 - 2 * sizeof(size_t)];
+};
+
+static int __buffer_alloc_initialised = 0;
+static enum buffer_alloc_backend backend = BUFFER_ALLOC_MALLOC;
+static size_t threshold = BUFFER_MAX;
+static int numa_node = -1;
+
+
+/* buffer_alloc_init:
+ *
+ *    Reads the backend settings from the environment. Called
+ *    automatically on first allocation; call it explicitly before
+ *    logging buffer_alloc_describe.
+ */
+void
+buffer_alloc_init(void)
+{
+  if (__buffer_alloc_initialised)
+    return;
+  __buffer_alloc_initialised = 1;
+
+  const char *env = getenv(BUFFER_ALLOC_ENVVAR);
+  if (NULL == env || strcmp(env, "malloc") == 0)
+    backend = BUFFER_ALLOC_MALLOC;
+  else if (strcmp(env, "hugepage") == 0)
+    backend = BUFFER_ALLOC_HUGEPAGE;
+  else
+    ulog(LOG_WARNING, "%s must be \"malloc\" or \"hugepage\" (got '%s')",
+	 BUFFER_ALLOC_ENVVAR, env);
+
+  env = getenv(BUFFER_ALLOC_THRESHOLD_ENVVAR);
+  if (NULL != env)
+    {
+      char *endptr = NULL;
+      long long value = strtoll(env, &endptr, 10);
+      if (*endptr || value < 0)
+	ulog(LOG_WARNING, "%s must be a number of bytes (got '%s')",
+	     BUFFER_ALLOC_THRESHOLD_ENVVAR, env);
+      else
+	threshold = (size_t) value;
+    }
+
+  env = getenv(BUFFER_ALLOC_NODE_ENVVAR);
+  if (NULL != env)
+    {
+      char *endptr = NULL;
+      long value = strtol(env, &endptr, 10);
+      if (*endptr || value < 0 || value >= (long) (8 * sizeof(unsigned long)))
+	ulog(LOG_WARNING, "%s must be a NUMA node number (got '%s')",
+	     BUFFER_ALLOC_NODE_ENVVAR, env);
+      else
+	numa_node = (int) value;
+    }
+
+  return;
+}
+
+
+/* buffer_alloc_set:
+ *
+ *    Selects the backend directly, overriding the environment.
+ *    "numa_node" may be -1 for no binding.
+ */
+void
+buffer_alloc_set(enum buffer_alloc_backend new_backend, size_t new_threshold,
+		 int new_numa_node)
+{
+  __buffer_alloc_initialised = 1;
+  backend = new_backend;
+  threshold = new_threshold;
+  numa_node = new_numa_node;
+  return;
+}
+
+
+/* buffer_alloc_describe:
+ *
+ *    Returns a short description of the backend in use, suitable for
+ *    the start up log message.
+ */
+const char *
+buffer_alloc_describe(void)
+{
+  static char description[STRING_MAX];
+
+  buffer_alloc_init();
+  if (BUFFER_ALLOC_MALLOC == backend)
+    snprintf(description, STRING_MAX, "malloc");
+  else if (numa_node < 0)
+    snprintf(description, STRING_MAX, "hugepage >= %zu bytes", threshold);
+  else
+    snprintf(description, STRING_MAX, "hugepage >= %zu bytes on node %d",
+	     threshold, numa_node);
+  return description;
+}
+
+
+/* map_block:
+ *
+ *    Maps a huge page aligned region big enough for a header and
+ *    "size" bytes, advises the kernel to back it with huge pages and
+ *    binds it to the NUMA node if one was chosen. Returns NULL if
+ *    mapping isn't possible.
+ */
+static struct Block_Header *
+map_block(size_t size)
+{
+#if defined(HAVE_MMAP) && defined(MAP_ANONYMOUS)
+  size_t map_size = size + sizeof(struct Block_Header);
+  map_size = (map_size + HUGEPAGE_SIZE - 1) & ~((size_t) HUGEPAGE_SIZE - 1);
+
+  // Over-map so that the start can be aligned to a huge page
+  size_t over_size = map_size + HUGEPAGE_SIZE;
+  char *over = mmap(NULL, over_size, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (MAP_FAILED == over)
+    {
+      ulog(LOG_WARNING, "mmap of %zu bytes failed (%m)", over_size);
+      return NULL;
+    }
+
+  char *start = (char *) (((size_t) over + HUGEPAGE_SIZE - 1)
+			  & ~((size_t) HUGEPAGE_SIZE - 1));
+  if (start > over)
+    munmap(over, start - over);
+  if (over + over_size > start + map_size)
+    munmap(start + map_size, over + over_size - (start + map_size));
+
+#  if defined(HAVE_MADVISE) && defined(MADV_HUGEPAGE)
+  if (madvise(start, map_size, MADV_HUGEPAGE) != 0)
+    ulog_debug("madvise(MADV_HUGEPAGE) failed (%m)");
+#  endif
+
+#  if defined(SYS_mbind)
+  if (numa_node >= 0)
+    {
+      unsigned long mask = 1UL << numa_node;
+      if (syscall(SYS_mbind, start, map_size, MPOL_BIND_MODE, &mask,
+		  8 * sizeof(mask), 0) != 0)
+	ulog(LOG_WARNING, "mbind to NUMA node %d failed (%m)", numa_node);
+    }
+#  endif
+
+  struct Block_Header *hdr = (struct Block_Header *) start;
+  hdr->size = size;
+  hdr->map_size = map_size;
+  return hdr;
+#else
+  return NULL;
+#endif
+}
+
+
+/* buffer_alloc:
+ *
+ *    Allocates a buffer of "size" bytes from the selected
+ *    backend. Falls back to malloc if mapping fails. Returns NULL if
+ *    there was a memory allocation error.
+ */
+void *
+buffer_alloc(size_t size)
+{
+  struct Block_Header *hdr = NULL;
+
+  buffer_alloc_init();
+  if (BUFFER_ALLOC_HUGEPAGE == backend && size >= threshold)
+    hdr = map_block(size);
+
+  if (NULL == hdr)
+    {
+      hdr = malloc(sizeof(struct Block_Header) + size);
+      if (NULL == hdr)
+	return NULL;
+      hdr->size = size;
+      hdr->map_size = 0;
+    }
+
+  return hdr + 1;
+}
+
+
+/* buffer_realloc:
+ *
+ *    Resizes a buffer from buffer_alloc, preserving its contents.
+ *    Returns the (possibly moved) buffer, or NULL if there was a
+ *    memory allocation error, in which case "ptr" is untouched.
+ */
+void *
+buffer_realloc(void *ptr, size_t size)
+{
+  if (NULL == ptr)
+    return buffer_alloc(size);
+
+  struct Block_Header *hdr = (struct Block_Header *) ptr - 1;
+
+  // Malloc blocks that stay below the threshold can just realloc
+  if (0 == hdr->map_size
+      && (BUFFER_ALLOC_MALLOC == backend || size < threshold))
+    {
+      hdr = realloc(hdr, sizeof(struct Block_Header) + size);
+      if (NULL == hdr)
+	return NULL;
+      hdr->size = size;
+      return hdr + 1;
+    }
+
+  // Mapped blocks may already have room
+  if (hdr->map_size > 0
+      && size + sizeof(struct Block_Header) <= hdr->map_size)
+    {
+      hdr->size = size;
+      return ptr;
+    }
+
+  void *new_ptr = buffer_alloc(size);
+  if (NULL == new_ptr)
+    return NULL;
+  memcpy(new_ptr, ptr, MIN(size, hdr->size));
+  buffer_free(ptr);
+  return new_ptr;
+}
+
+
+/* buffer_free:
+ *
+ *    Returns a buffer from buffer_alloc or buffer_realloc.
+ */
+void
+buffer_free(void *ptr)
+{
+  if (NULL == ptr)
+    return;
+
+  struct Block_Header *hdr = (struct Block_Header *) ptr - 1;
+#ifdef HAVE_MMAP
+  if (hdr->map_size > 0)
+    {
+      munmap(hdr, hdr->map_size);
+      return;
+    }
+#endif
+  free(hdr);
+  return;
+}
@@ -0,0 +1,35 @@
+/* buffer_alloc.h
+ *
+ *    Allocator for large I/O buffers (read buffers and the storage
+ *    behind Stream_Buffer). By default this is plain malloc. Buffers
+ *    at or above a threshold can instead be mapped with mmap, backed
+ *    by transparent huge pages and optionally bound to a NUMA node,
+ *    which cuts TLB misses on bulk replays.
+ *
+ *    The backend is chosen at runtime from the environment:
+ *
+ *      MUMPSIMUS_ALLOC            "malloc" (default) or "hugepage"
+ *      MUMPSIMUS_ALLOC_THRESHOLD  Smallest buffer (bytes) to map
+ *      MUMPSIMUS_ALLOC_NODE       NUMA node to bind mapped buffers to
+ *
+ *    Memory from buffer_alloc must only be passed to buffer_realloc
+ *    and buffer_free, never to realloc or free.
+ */
+#ifndef __BUFFER_ALLOC_H__
+#define __BUFFER_ALLOC_H__
+
+#include <sys/types.h>
+
+enum buffer_alloc_backend
+{ BUFFER_ALLOC_MALLOC, BUFFER_ALLOC_HUGEPAGE };
+
+void buffer_alloc_init(void);
+void buffer_alloc_set(enum buffer_alloc_backend backend, size_t threshold,
+		      int numa_node);
+const char *buffer_alloc_describe(void);
+
+void *buffer_alloc(size_t size);
+void *buffer_realloc(void *ptr, size_t size);
+void buffer_free(void *ptr);
+
+#endif
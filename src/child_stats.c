@@ -0,0 +1,202 @@
+/* child_stats.c:
+ *
+ *    Resource usage of filter commands, per command and Content-Type.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "child_stats.h"
+
+/* Set by the signal child_stats_watch is given. */
+static volatile sig_atomic_t __wanted = 0;
+
+
+struct Child_Stats *
+child_stats_new(void)
+{
+  struct Child_Stats *cs = malloc(sizeof(struct Child_Stats));
+  if (NULL != cs)
+    memset(cs, 0, sizeof(struct Child_Stats));
+  return cs;
+}
+
+void
+child_stats_delete(struct Child_Stats *cs)
+{
+  free(cs);
+  return;
+}
+
+
+/* child_stats_find:
+ *
+ *    Returns the entry for "command" and "type" (already without its
+ *    parameters), adding it if there is room, or else the last entry,
+ *    which is given type "*".
+ */
+static struct Child_Usage *
+child_stats_find(struct Child_Stats *cs, const char *command,
+		 const char *type)
+{
+  for (size_t n = 0; n < cs->count; n++)
+    if (strcmp(cs->usage[n].command, command) == 0
+	&& strcasecmp(cs->usage[n].type, type) == 0)
+      return &cs->usage[n];
+
+  // The last entry is kept for all the rest
+  if (cs->count == CHILD_STATS_MAX)
+    return &cs->usage[CHILD_STATS_MAX - 1];
+  if (cs->count == CHILD_STATS_MAX - 1)
+    type = "*";
+
+  struct Child_Usage *usage = &cs->usage[cs->count++];
+  usage->command = command;
+  strcpy(usage->type, type);
+  return usage;
+}
+
+
+/* child_stats_record:
+ *
+ *    Adds a child of "command", given a message of Content-Type
+ *    "type" (NULL or "" if none), that used "ru" and lived "wall_ns".
+ */
+void
+child_stats_record(struct Child_Stats *cs, const char *command,
+		   const char *type, const struct rusage *ru,
+		   uint64_t wall_ns)
+{
+  char bare[CHILD_STATS_TYPE_MAX] = "-";
+  size_t len = (NULL == type ? 0 : strcspn(type, "; \t"));
+  if (len >= CHILD_STATS_TYPE_MAX)
+    len = CHILD_STATS_TYPE_MAX - 1;
+  if (len > 0)
+    {
+      memcpy(bare, type, len);
+      bare[len] = '\0';
+    }
+
+  struct Child_Usage *usage = child_stats_find(cs, command, bare);
+  usage->children++;
+  usage->user_us += ru->ru_utime.tv_sec * 1000000ULL + ru->ru_utime.tv_usec;
+  usage->sys_us += ru->ru_stime.tv_sec * 1000000ULL + ru->ru_stime.tv_usec;
+  usage->wall_ns += wall_ns;
+  if (ru->ru_maxrss > usage->maxrss_kb)
+    usage->maxrss_kb = ru->ru_maxrss;
+  return;
+}
+
+
+/* child_stats_print:
+ *
+ *    Prints one line of totals.
+ */
+static void
+child_stats_print(const struct Child_Usage *usage, FILE * out,
+		  const char *prefix)
+{
+  fprintf(out, "%s \"%s\" %s children=%llu user_ms=%.3f sys_ms=%.3f "
+	  "wall_ms=%.3f maxrss_kb=%ld\n", prefix, usage->command,
+	  usage->type, (unsigned long long) usage->children,
+	  usage->user_us / 1e3, usage->sys_us / 1e3, usage->wall_ns / 1e6,
+	  usage->maxrss_kb);
+  return;
+}
+
+
+/* child_stats_dump:
+ *
+ *    Prints the totals for each command and type, most CPU first,
+ *    then for each command (as type "all"). Each line starts with
+ *    "prefix".
+ */
+void
+child_stats_dump(const struct Child_Stats *cs, FILE * out,
+		 const char *prefix)
+{
+  bool shown[CHILD_STATS_MAX] = { false };
+  for (size_t n = 0; n < cs->count; n++)
+    {
+      size_t most = cs->count;
+      for (size_t i = 0; i < cs->count; i++)
+	if (!shown[i] && (most == cs->count
+			  || (cs->usage[i].user_us + cs->usage[i].sys_us
+			      > cs->usage[most].user_us
+			      + cs->usage[most].sys_us)))
+	  most = i;
+      shown[most] = true;
+      child_stats_print(&cs->usage[most], out, prefix);
+    }
+
+  for (size_t n = 0; n < cs->count; n++)
+    {
+      bool first = true;
+      for (size_t i = 0; i < n && first; i++)
+	first = (strcmp(cs->usage[i].command, cs->usage[n].command) != 0);
+      if (!first)
+	continue;
+
+      struct Child_Usage all = { cs->usage[n].command, "all", 0, 0, 0, 0, 0 };
+      for (size_t i = n; i < cs->count; i++)
+	if (strcmp(cs->usage[i].command, all.command) == 0)
+	  {
+	    all.children += cs->usage[i].children;
+	    all.user_us += cs->usage[i].user_us;
+	    all.sys_us += cs->usage[i].sys_us;
+	    all.wall_ns += cs->usage[i].wall_ns;
+	    if (cs->usage[i].maxrss_kb > all.maxrss_kb)
+	      all.maxrss_kb = cs->usage[i].maxrss_kb;
+	  }
+      child_stats_print(&all, out, prefix);
+    }
+  fflush(out);
+  return;
+}
+
+
+static void
+on_stats_signal(int signum)
+{
+  __wanted = 1;
+}
+
+
+/* child_stats_watch:
+ *
+ *    Has "signum" ask for the totals (see child_stats_wanted). System
+ *    calls it interrupts are restarted, so the tools need not expect
+ *    EINTR from reads of their commands or waits for them.
+ */
+void
+child_stats_watch(int signum)
+{
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_stats_signal;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  sigaction(signum, &sa, NULL);
+  return;
+}
+
+
+/* child_stats_wanted:
+ *
+ *    True once after the signal has been caught.
+ */
+bool
+child_stats_wanted(void)
+{
+  if (!__wanted)
+    return false;
+  __wanted = 0;
+  return true;
+}
@@ -0,0 +1,49 @@
+/* child_stats.h
+ *
+ *    What the filter commands headers and body start have cost: CPU
+ *    time, peak memory and wall time from spawn to reap (see
+ *    pipe_close), added up per command and per Content-Type of the
+ *    message each child was given. Parameters of the type (such as
+ *    charset) are ignored. Once CHILD_STATS_MAX pairs have been seen,
+ *    any others are added up together as type "*".
+ */
+#ifndef __CHILD_STATS_H__
+#define __CHILD_STATS_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/resource.h>
+
+#define CHILD_STATS_MAX 32
+#define CHILD_STATS_TYPE_MAX 64
+
+struct Child_Usage
+{
+  const char *command;		// Not copied: must outlive the stats
+  char type[CHILD_STATS_TYPE_MAX];
+  uint64_t children;
+  uint64_t user_us;
+  uint64_t sys_us;
+  uint64_t wall_ns;
+  long maxrss_kb;		// Largest of any child
+};
+
+struct Child_Stats
+{
+  struct Child_Usage usage[CHILD_STATS_MAX];
+  size_t count;
+};
+
+struct Child_Stats *child_stats_new(void);
+void child_stats_delete(struct Child_Stats *cs);
+void child_stats_record(struct Child_Stats *cs, const char *command,
+			const char *type, const struct rusage *ru,
+			uint64_t wall_ns);
+void child_stats_dump(const struct Child_Stats *cs, FILE * out,
+		      const char *prefix);
+
+void child_stats_watch(int signum);
+bool child_stats_wanted(void);
+
+#endif /* __CHILD_STATS_H__ */
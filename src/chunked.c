@@ -0,0 +1,201 @@
+/* chunked.c:
+ *
+ *    Chunked transfer coding for output, with small pieces of body
+ *    gathered into larger chunks.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+#include "buffer_alloc.h"
+
+#include "chunked.h"
+
+
+/* chunked_header:
+ *
+ *    Writes the chunk header ("<hex length>\r\n") for a chunk of
+ *    "length" bytes into "buf" (at least CHUNK_HEADER_MAX bytes).
+ *    Returns its size. The digits are counted up front from the
+ *    highest set bit, then filled in from the right.
+ */
+size_t
+chunked_header(char *buf, size_t length)
+{
+  static const char hex[] = "0123456789abcdef";
+  uint64_t v = length;
+  size_t digits = 1;
+  if (v > 0)
+    digits = (64 - __builtin_clzll(v) + 3) / 4;
+
+  for (size_t i = digits; i-- > 0; v >>= 4)
+    buf[i] = hex[v & 0xf];
+  buf[digits] = '\r';
+  buf[digits + 1] = '\n';
+  return digits + 2;
+}
+
+
+/* chunked_write:
+ *
+ *    Writes "length" bytes at "data" to "fd" as one chunk, in one
+ *    writev. Nothing is written for an empty chunk, which would end
+ *    the body. Returns bytes written.
+ */
+ssize_t
+chunked_write(int fd, const char *data, size_t length)
+{
+  char header[CHUNK_HEADER_MAX];
+
+  if (0 == length)
+    return 0;
+
+  struct iovec iov[3];
+  iov[0].iov_base = header;
+  iov[0].iov_len = chunked_header(header, length);
+  iov[1].iov_base = (void *) data;
+  iov[1].iov_len = length;
+  iov[2].iov_base = (void *) "\r\n";
+  iov[2].iov_len = 2;
+  return writev_all(fd, iov, 3);
+}
+
+
+/* chunked_write_end:
+ *
+ *    Writes the last-chunk, with no trailers. Returns bytes written.
+ */
+ssize_t
+chunked_write_end(int fd)
+{
+  return write_all(fd, "0\r\n\r\n", 5);
+}
+
+
+/* chunk_writer_new:
+ *
+ *    Returns a writer that gathers up to "size" bytes between writes,
+ *    or NULL on memory allocation error.
+ */
+struct Chunk_Writer *
+chunk_writer_new(size_t size)
+{
+  struct Chunk_Writer *cw = malloc(sizeof(struct Chunk_Writer));
+  if (cw != NULL)
+    {
+      cw->buffer = buffer_alloc(size);
+      if (NULL == cw->buffer)
+	{
+	  free(cw);
+	  return NULL;
+	}
+      cw->size = size;
+      cw->length = 0;
+      cw->fd = -1;
+      cw->chunked = false;
+    }
+  return cw;
+}
+
+
+/* chunk_writer_delete:
+ *
+ *    Frees the writer. Anything not flushed is lost.
+ */
+void
+chunk_writer_delete(struct Chunk_Writer *cw)
+{
+  buffer_free(cw->buffer);
+  free(cw);
+  return;
+}
+
+
+/* chunk_writer_start:
+ *
+ *    Sends what follows to "fd", chunked or not. Anything gathered
+ *    for the previous output must have been flushed.
+ */
+void
+chunk_writer_start(struct Chunk_Writer *cw, int fd, bool chunked)
+{
+  assert(0 == cw->length);
+  cw->fd = fd;
+  cw->chunked = chunked;
+  return;
+}
+
+
+/* chunk_writer_flush:
+ *
+ *    Writes out what has been gathered (as one chunk when chunked).
+ *    Returns bytes written.
+ */
+ssize_t
+chunk_writer_flush(struct Chunk_Writer *cw)
+{
+  ssize_t written = 0;
+  if (cw->length > 0)
+    {
+      if (cw->chunked)
+	written = chunked_write(cw->fd, cw->buffer, cw->length);
+      else
+	written = write_all(cw->fd, cw->buffer, cw->length);
+      cw->length = 0;
+    }
+  return written;
+}
+
+
+/* chunk_writer_add:
+ *
+ *    Gathers "length" bytes at "at", writing out first if they won't
+ *    fit. Pieces as big as the buffer are written straight out.
+ *    Returns bytes written now (not gathered).
+ */
+ssize_t
+chunk_writer_add(struct Chunk_Writer *cw, const char *at, size_t length)
+{
+  ssize_t written = 0;
+
+  if (cw->length + length > cw->size)
+    written = chunk_writer_flush(cw);
+
+  if (length >= cw->size)
+    {
+      if (cw->chunked)
+	written += chunked_write(cw->fd, at, length);
+      else
+	written += write_all(cw->fd, at, length);
+    }
+  else
+    {
+      memcpy(cw->buffer + cw->length, at, length);
+      cw->length += length;
+    }
+  return written;
+}
+
+
+/* chunk_writer_end:
+ *
+ *    Flushes, and ends a chunked body with the last-chunk. Returns
+ *    bytes written.
+ */
+ssize_t
+chunk_writer_end(struct Chunk_Writer *cw)
+{
+  ssize_t written = chunk_writer_flush(cw);
+  if (cw->chunked)
+    written += chunked_write_end(cw->fd);
+  cw->chunked = false;
+  return written;
+}
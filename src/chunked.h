@@ -0,0 +1,46 @@
+/* chunked.h
+ *
+ *    Writes HTTP message bodies, with chunked transfer coding when
+ *    the head says so. The parser hands a chunked body over one chunk
+ *    at a time, often only a few bytes each; a Chunk_Writer gathers
+ *    those pieces into one buffer and writes it out as a single chunk
+ *    (header, data and CRLF in one writev), so a stream of tiny chunks
+ *    costs a write per buffer rather than per chunk.
+ *
+ *    chunk_writer_start picks the output for the next body and
+ *    chunk_writer_end finishes it (with the last-chunk when chunked).
+ */
+#ifndef __CHUNKED_H__
+#define __CHUNKED_H__
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+// "ffffffffffffffff\r\n"
+#define CHUNK_HEADER_MAX 18
+
+struct Chunk_Writer
+{
+  // Read-only
+  int fd;
+  bool chunked;
+
+  // Private
+  char *buffer;
+  size_t length;
+  size_t size;
+};
+
+size_t chunked_header(char *buf, size_t length);
+ssize_t chunked_write(int fd, const char *data, size_t length);
+ssize_t chunked_write_end(int fd);
+
+struct Chunk_Writer *chunk_writer_new(size_t size);
+void chunk_writer_delete(struct Chunk_Writer *cw);
+void chunk_writer_start(struct Chunk_Writer *cw, int fd, bool chunked);
+ssize_t chunk_writer_add(struct Chunk_Writer *cw, const char *at,
+			 size_t length);
+ssize_t chunk_writer_flush(struct Chunk_Writer *cw);
+ssize_t chunk_writer_end(struct Chunk_Writer *cw);
+
+#endif
@@ -0,0 +1,185 @@
+/* counters.c:
+ *
+ *    Counters published in shared memory for mumpstat.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "counters.h"
+#include "ulog.h"
+
+#define COUNTERS_ENVVAR "MUMPSIMUS_COUNTERS"
+
+static const char *__counter_names[] = {
+#define XX(id, name) #name,
+  COUNTER_MAP(XX)
+#undef XX
+};
+
+// Where the counters are kept until there is a segment
+static struct Counters_Segment __private;
+struct Counters_Segment *counters = &__private;
+
+// shm_open name of the segment, if there is one
+static char __name[NAME_MAX];
+
+
+/* counter_name:
+ *
+ *    Returns the name of counter "id", like "bytes_in".
+ */
+const char *
+counter_name(enum counter_id id)
+{
+  return (id < COUNTER_MAX ? __counter_names[id] : "unknown");
+}
+
+
+/* counters_open:
+ *
+ *    Publishes the counters in a segment named for this process and
+ *    the tool called "ident" (the base name is used), carrying over
+ *    anything counted so far. The segment is removed at exit. If it
+ *    cannot be made, the counters stay private.
+ */
+void
+counters_open(const char *ident)
+{
+  const char *env = getenv(COUNTERS_ENVVAR);
+  if ((NULL != env && strcmp(env, "0") == 0) || counters != &__private)
+    return;
+
+  const char *tool = strrchr(ident, '/');
+  tool = (NULL == tool ? ident : tool + 1);
+  snprintf(__name, sizeof(__name), "/" COUNTERS_PREFIX "%d.%.*s",
+	   (int) getpid(), COUNTERS_TOOL_MAX - 1, tool);
+
+  // A segment left by an earlier process with this pid is stale
+  int fd = shm_open(__name, O_RDWR | O_CREAT | O_EXCL, 0644);
+  if (fd < 0 && EEXIST == errno && shm_unlink(__name) == 0)
+    fd = shm_open(__name, O_RDWR | O_CREAT | O_EXCL, 0644);
+  if (fd < 0)
+    {
+      ulog(LOG_INFO, "Counters not published: shm_open %s: %s", __name,
+	   strerror(errno));
+      __name[0] = '\0';
+      return;
+    }
+
+  struct Counters_Segment *seg = MAP_FAILED;
+  if (ftruncate(fd, sizeof(struct Counters_Segment)) == 0)
+    seg = mmap(NULL, sizeof(struct Counters_Segment),
+	       PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (MAP_FAILED == seg)
+    {
+      ulog(LOG_INFO, "Counters not published: %s: %s", __name,
+	   strerror(errno));
+      shm_unlink(__name);
+      __name[0] = '\0';
+      return;
+    }
+
+  seg->version = COUNTERS_VERSION;
+  seg->count = COUNTER_MAX;
+  seg->pid = getpid();
+  seg->start_ns = counters_now_ns();
+  strncpy(seg->tool, tool, COUNTERS_TOOL_MAX - 1);
+  for (int id = 0; id < COUNTER_MAX; id++)
+    COUNTER_STORE(&seg->counter[id].value,
+		  counter_get(&__private, id));
+#ifdef HAVE_STDATOMIC_H
+  atomic_thread_fence(memory_order_release);
+#endif
+  memcpy(seg->magic, COUNTERS_MAGIC, sizeof(seg->magic));
+
+  counters = seg;
+  atexit(counters_close);
+  ulog(LOG_DEBUG, "Counters published in " COUNTERS_DIR "%s", __name);
+  return;
+}
+
+
+/* counters_close:
+ *
+ *    Removes the segment, keeping the counters privately. Only the
+ *    process that made it removes it, not a child forked since.
+ */
+void
+counters_close(void)
+{
+  if (counters == &__private || counters->pid != getpid())
+    return;
+
+  for (int id = 0; id < COUNTER_MAX; id++)
+    COUNTER_STORE(&__private.counter[id].value, counter_get(counters, id));
+  shm_unlink(__name);
+  munmap(counters, sizeof(struct Counters_Segment));
+  counters = &__private;
+  return;
+}
+
+
+/* counters_attach:
+ *
+ *    Maps the segment "name" (a file name in COUNTERS_DIR) read-only.
+ *    Returns NULL with errno set if it cannot be read, or is not a
+ *    complete segment of this version.
+ */
+const struct Counters_Segment *
+counters_attach(const char *name)
+{
+  char path[NAME_MAX + 1];
+  snprintf(path, sizeof(path), "/%s", name);
+  int fd = shm_open(path, O_RDONLY, 0);
+  if (fd < 0)
+    return NULL;
+
+  struct stat st;
+  const struct Counters_Segment *seg = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size == sizeof(struct Counters_Segment))
+    seg = mmap(NULL, sizeof(struct Counters_Segment), PROT_READ, MAP_SHARED,
+	       fd, 0);
+  else
+    errno = EINVAL;
+  close(fd);
+  if (MAP_FAILED == seg)
+    return NULL;
+
+  if (memcmp(seg->magic, COUNTERS_MAGIC, sizeof(seg->magic)) != 0
+      || COUNTERS_VERSION != seg->version || COUNTER_MAX != seg->count)
+    {
+      counters_detach(seg);
+      errno = EINVAL;
+      return NULL;
+    }
+#ifdef HAVE_STDATOMIC_H
+  atomic_thread_fence(memory_order_acquire);
+#endif
+  return seg;
+}
+
+
+/* counters_detach:
+ *
+ *    Unmaps a segment from counters_attach.
+ */
+void
+counters_detach(const struct Counters_Segment *seg)
+{
+  munmap((void *) seg, sizeof(struct Counters_Segment));
+  return;
+}
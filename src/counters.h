@@ -0,0 +1,127 @@
+/* counters.h
+ *
+ *    Counters each tool keeps while it runs, published in a small
+ *    shared memory segment, /dev/shm/mumpsimus.<pid>.<tool>, for
+ *    mumpstat to read. Each counter has a cache line to itself and is
+ *    only ever written by the tool's main thread, so adding to one is
+ *    a plain load and store; readers map the segment read-only and
+ *    cost the tool nothing.
+ *
+ *    Until counters_open is called, or if the segment cannot be
+ *    made, or MUMPSIMUS_COUNTERS=0, the counters are kept in private
+ *    memory instead.
+ */
+#ifndef __COUNTERS_H__
+#define __COUNTERS_H__
+
+#include <stdint.h>
+#include <time.h>
+
+#ifdef HAVE_STDATOMIC_H
+#  include <stdatomic.h>
+typedef _Atomic uint64_t counter_t;
+#  define COUNTER_LOAD(c) atomic_load_explicit((c), memory_order_relaxed)
+#  define COUNTER_STORE(c, v) atomic_store_explicit((c), (v), memory_order_relaxed)
+#else
+typedef volatile uint64_t counter_t;
+#  define COUNTER_LOAD(c) (*(c))
+#  define COUNTER_STORE(c, v) (*(c) = (v))
+#endif
+
+#define COUNTERS_DIR "/dev/shm"
+#define COUNTERS_PREFIX "mumpsimus."
+#define COUNTERS_MAGIC "mumpctr"
+#define COUNTERS_VERSION 1
+#define COUNTERS_LINE 64
+#define COUNTERS_TOOL_MAX 32
+
+/* Counter ids and names. Times are in ns. The input is stdin (and
+ * log's -p file), the output stdout; waits are the time spent in
+ * reads and writes on them, so a stage starved by the one before it
+ * waits on input, and one held up by the one after it on output. */
+#define COUNTER_MAP(XX)			\
+  XX(BYTES_IN, bytes_in)		\
+  XX(BYTES_OUT, bytes_out)		\
+  XX(MESSAGES, messages)		\
+  XX(PARSE_ERRORS, parse_errors)	\
+  XX(SPAWNS, spawns)			\
+  XX(READ_WAIT_NS, read_wait_ns)	\
+  XX(WRITE_WAIT_NS, write_wait_ns)
+
+enum counter_id
+{
+#define XX(id, name) COUNTER_##id,
+  COUNTER_MAP(XX)
+#undef XX
+  COUNTER_MAX
+};
+
+union Counter
+{
+  counter_t value;
+  char line[COUNTERS_LINE];
+};
+
+/* Counters_Segment:
+ *
+ *    What the segment holds. The head fills the first cache line.
+ *    "magic" is written last, so a reader that finds it sees the rest.
+ */
+struct Counters_Segment
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t count;		// COUNTER_MAX
+  int32_t pid;
+  uint32_t reserved;
+  uint64_t start_ns;		// CLOCK_MONOTONIC
+  char tool[COUNTERS_TOOL_MAX];
+  union Counter counter[COUNTER_MAX];
+};
+
+extern struct Counters_Segment *counters;
+
+void counters_open(const char *ident);
+void counters_close(void);
+const char *counter_name(enum counter_id id);
+const struct Counters_Segment *counters_attach(const char *name);
+void counters_detach(const struct Counters_Segment *seg);
+
+
+/* counter_add:
+ *
+ *    Adds "n" to counter "id". Only the tool's main thread may call
+ *    it.
+ */
+static inline void
+counter_add(enum counter_id id, uint64_t n)
+{
+  counter_t *c = &counters->counter[id].value;
+  COUNTER_STORE(c, COUNTER_LOAD(c) + n);
+}
+
+
+/* counter_get:
+ *
+ *    Returns the value of counter "id" in "seg".
+ */
+static inline uint64_t
+counter_get(const struct Counters_Segment *seg, enum counter_id id)
+{
+  return COUNTER_LOAD((counter_t *) & seg->counter[id].value);
+}
+
+
+/* counters_now_ns:
+ *
+ *    Monotonic clock time in ns, for the waits.
+ */
+static inline uint64_t
+counters_now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+#endif /* __COUNTERS_H__ */
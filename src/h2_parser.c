@@ -0,0 +1,773 @@
+/* h2_parser.c:
+ *
+ *    HTTP/2 frame parser that calls back through http_parser_settings.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "h2_parser.h"
+#include "probes.h"
+#include "ulog.h"
+
+#define H2_MIN(a,b) ((a) < (b) ? (a) : (b))
+
+enum h2_state
+{ H2_STATE_PREFACE, H2_STATE_HEADER, H2_STATE_PREFIX, H2_STATE_PAYLOAD,
+  H2_STATE_PADDING
+};
+
+static const char *method_strings[] = {
+#define XX(num, name, string) #string,
+  HTTP_METHOD_MAP(XX)
+#undef XX
+};
+
+
+/* h2_parser_init:
+ *
+ *    Readies "parser" for a connection's client side (HTTP_REQUEST),
+ *    server side (HTTP_RESPONSE) or either (HTTP_BOTH). Keeps
+ *    parser->data. Returns 0, or -1 if there was a memory allocation
+ *    error. Call h2_parser_free before initialising it again.
+ */
+int
+h2_parser_init(h2_parser * parser, enum http_parser_type type)
+{
+  void *data = parser->data;
+  memset(parser, 0, sizeof(*parser));
+  parser->data = data;
+  parser->type = type;
+  parser->state = (HTTP_RESPONSE == type ? H2_STATE_HEADER
+		   : H2_STATE_PREFACE);
+  parser->hpack = hpack_decoder_new();
+  return (NULL == parser->hpack ? -1 : 0);
+}
+
+
+/* h2_parser_free:
+ *
+ *    Frees the HPACK table and header block buffer.
+ */
+void
+h2_parser_free(h2_parser * parser)
+{
+  if (NULL != parser->hpack)
+    hpack_decoder_delete(parser->hpack);
+  free(parser->block);
+  parser->hpack = NULL;
+  parser->block = NULL;
+  parser->block_size = 0;
+  return;
+}
+
+
+/* h2_detect:
+ *
+ *    Looks at the first "length" bytes of a stream. Returns
+ *    HTTP_REQUEST if they start the HTTP/2 connection preface,
+ *    HTTP_RESPONSE if they are a server's first SETTINGS frame, or -1
+ *    if they are neither (HTTP/1.x never starts with either).
+ */
+int
+h2_detect(const char *at, size_t length)
+{
+  const unsigned char *p = (const unsigned char *) at;
+
+  if (length >= 3 && memcmp(at, H2_PREFACE, H2_MIN(length, H2_PREFACE_LEN))
+      == 0)
+    return HTTP_REQUEST;
+
+  if (length >= H2_FRAME_HEADER_LEN && H2_SETTINGS == p[3] && 0 == p[4]
+      && 0 == (p[5] | p[6] | p[7] | p[8]))
+    {
+      uint32_t frame_length = (p[0] << 16) | (p[1] << 8) | p[2];
+      if (0 == frame_length % 6)
+	return HTTP_RESPONSE;
+    }
+  return -1;
+}
+
+
+/* h2_stream_id:
+ *
+ *    Returns the stream of a parser handed to a callback by
+ *    h2_parser_execute. Only call it for those (http_major is 2).
+ */
+uint32_t
+h2_stream_id(const http_parser * parser)
+{
+  const struct h2_stream *stream =
+    (const struct h2_stream *) ((const char *) parser
+				- offsetof(struct h2_stream, parser));
+  return stream->id;
+}
+
+
+/* fail:
+ *
+ *    Records an error. Returns -1, for callers to pass on.
+ */
+static int
+fail(h2_parser * parser, enum h2_errno err)
+{
+  parser->h2_errno = err;
+  return -1;
+}
+
+
+/* stream_slot:
+ *
+ *    Returns the slot for stream "id". Each peer's streams are odd or
+ *    even, and go up in twos, so consecutive streams of either get
+ *    consecutive slots.
+ */
+static struct h2_stream *
+stream_slot(h2_parser * parser, uint32_t id)
+{
+  return &parser->streams[(id >> 1) & (H2_STREAMS_MAX - 1)];
+}
+
+
+/* find_stream:
+ *
+ *    Returns stream "id", or NULL if it is not open.
+ */
+static struct h2_stream *
+find_stream(h2_parser * parser, uint32_t id)
+{
+  struct h2_stream *stream = stream_slot(parser, id);
+  return (0 != id && stream->id == id ? stream : NULL);
+}
+
+
+/* reset_stream:
+ *
+ *    Readies a stream's parser for a new message.
+ */
+static void
+reset_stream(h2_parser * parser, struct h2_stream *stream)
+{
+  http_parser *hp = &stream->parser;
+  http_parser_init(hp, parser->type);
+  hp->data = parser->data;
+  hp->http_major = 2;
+  hp->http_minor = 0;
+  hp->flags = F_CONNECTION_KEEP_ALIVE;
+  hp->content_length = ULLONG_MAX;
+  stream->headers_done = 0;
+  return;
+}
+
+
+/* open_stream:
+ *
+ *    Returns stream "id", opening it if need be. A stream still in its
+ *    slot is H2_STREAMS_MAX streams old: it was most likely reset in
+ *    the other direction, which this stream may not carry, so its
+ *    slot is taken over.
+ */
+static struct h2_stream *
+open_stream(h2_parser * parser, uint32_t id)
+{
+  struct h2_stream *stream = stream_slot(parser, id);
+  if (stream->id == id)
+    return stream;
+  if (0 != stream->id)
+    ulog(LOG_WARNING, "HTTP/2 stream %u never ended (reset unseen?) -- "
+	 "forgotten for stream %u", stream->id, id);
+
+  stream->id = id;
+  reset_stream(parser, stream);
+  return stream;
+}
+
+
+/* method_lookup:
+ *
+ *    Returns the http_method named by "name", or -1.
+ */
+static int
+method_lookup(const char *name, size_t length)
+{
+  for (size_t m = 0; m < sizeof(method_strings) / sizeof(method_strings[0]);
+       m++)
+    if (strlen(method_strings[m]) == length
+	&& memcmp(method_strings[m], name, length) == 0)
+      return m;
+  return -1;
+}
+
+
+/* is_name:
+ *
+ *    True if the "length" byte name at "name" is "literal".
+ */
+static bool
+is_name(const char *name, size_t length, const char *literal)
+{
+  return (strlen(literal) == length && memcmp(name, literal, length) == 0);
+}
+
+
+/* header_callbacks:
+ *
+ *    Calls on_header_field and on_header_value. Returns 0 or -1.
+ */
+static int
+header_callbacks(h2_parser * parser, http_parser * hp, const char *name,
+		 size_t name_len, const char *value, size_t value_len)
+{
+  const http_parser_settings *settings = parser->settings;
+  hp->header_id = http_header_lookup(name, name_len);
+  if (NULL != settings->on_header_field
+      && settings->on_header_field(hp, name, name_len) != 0)
+    return -1;
+  if (NULL != settings->on_header_value
+      && settings->on_header_value(hp, value, value_len) != 0)
+    return -1;
+  return 0;
+}
+
+
+/* hold_pseudo:
+ *
+ *    Keeps a copy of a pseudo-header that is to be called back, as
+ *    :path may still be to come. Returns 0 or -1.
+ */
+static int
+hold_pseudo(h2_parser * parser, const char *name, size_t name_len,
+	    const char *value, size_t value_len)
+{
+  size_t need = 2 * sizeof(size_t) + name_len + value_len;
+  if (parser->pseudo_len + need > H2_PSEUDO_MAX)
+    return fail(parser, H2_ERR_HEADERS);
+
+  char *p = parser->pseudo + parser->pseudo_len;
+  memcpy(p, &name_len, sizeof(size_t));
+  memcpy(p + sizeof(size_t), &value_len, sizeof(size_t));
+  memcpy(p + 2 * sizeof(size_t), name, name_len);
+  memcpy(p + 2 * sizeof(size_t) + name_len, value, value_len);
+  parser->pseudo_len += need;
+  return 0;
+}
+
+
+/* release_pseudo:
+ *
+ *    Calls back with the pseudo-headers held. Returns 0 or -1.
+ */
+static int
+release_pseudo(h2_parser * parser, http_parser * hp)
+{
+  size_t n = 0;
+  while (n < parser->pseudo_len)
+    {
+      size_t name_len = 0, value_len = 0;
+      const char *p = parser->pseudo + n;
+      memcpy(&name_len, p, sizeof(size_t));
+      memcpy(&value_len, p + sizeof(size_t), sizeof(size_t));
+      p += 2 * sizeof(size_t);
+      if (header_callbacks(parser, hp, p, name_len, p + name_len,
+			   value_len) != 0)
+	return -1;
+      n += 2 * sizeof(size_t) + name_len + value_len;
+    }
+  parser->pseudo_len = 0;
+  return 0;
+}
+
+
+/* on_header:
+ *
+ *    Called by hpack_decode for each header of a stream's block.
+ *    Fills in the stream's parser from :method, :status and
+ *    content-length, and calls back with the rest.
+ */
+static int
+on_header(void *data, const char *name, size_t name_len, const char *value,
+	  size_t value_len)
+{
+  h2_parser *parser = (h2_parser *) data;
+  const http_parser_settings *settings = parser->settings;
+  struct h2_stream *stream = parser->current;
+  http_parser *hp = &stream->parser;
+
+  if (!stream->headers_done && is_name(name, name_len, ":method"))
+    {
+      int method = method_lookup(value, value_len);
+      if (method < 0)
+	return fail(parser, H2_ERR_HEADERS);
+      hp->type = HTTP_REQUEST;
+      hp->method = method;
+      return 0;
+    }
+
+  if (!stream->headers_done && is_name(name, name_len, ":status"))
+    {
+      if (3 != value_len || value[0] < '1' || value[0] > '9'
+	  || value[1] < '0' || value[1] > '9' || value[2] < '0'
+	  || value[2] > '9')
+	return fail(parser, H2_ERR_HEADERS);
+      hp->type = HTTP_RESPONSE;
+      hp->status_code = ((value[0] - '0') * 100 + (value[1] - '0') * 10
+			 + (value[2] - '0'));
+      return 0;
+    }
+
+  if (!stream->headers_done && is_name(name, name_len, ":path"))
+    return (NULL != settings->on_url
+	    && settings->on_url(hp, value, value_len) != 0 ? -1 : 0);
+
+  // Pseudo-headers come first, so those after on_url wait for :path
+  if (!stream->headers_done && name_len > 0 && ':' == name[0])
+    return hold_pseudo(parser, name, name_len, value, value_len);
+  if (release_pseudo(parser, hp) != 0)
+    return -1;
+
+  if (is_name(name, name_len, "content-length"))
+    {
+      uint64_t length = 0;
+      size_t i = 0;
+      for (; i < value_len && value[i] >= '0' && value[i] <= '9'; i++)
+	length = length * 10 + (value[i] - '0');
+      if (i == value_len && value_len > 0 && value_len < 20)
+	hp->content_length = length;
+    }
+
+  return header_callbacks(parser, hp, name, name_len, value, value_len);
+}
+
+
+/* message_complete:
+ *
+ *    Calls on_message_complete for "stream". Returns 0 or -1.
+ */
+static int
+message_complete(h2_parser * parser, struct h2_stream *stream)
+{
+  const http_parser_settings *settings = parser->settings;
+  PROBE2(message__complete, &stream->parser, (int) stream->parser.type);
+  if (NULL != settings->on_message_complete
+      && settings->on_message_complete(&stream->parser) != 0)
+    return fail(parser, H2_ERR_CALLBACK);
+  return 0;
+}
+
+
+/* decode_block:
+ *
+ *    Decodes the header block just finished. The headers of a
+ *    message are called back between on_message_begin and
+ *    on_headers_complete; those of trailers just before
+ *    on_message_complete. A 1xx response is a message of its own and
+ *    the stream carries on. Returns 0 or -1.
+ */
+static int
+decode_block(h2_parser * parser, const char *block, size_t length)
+{
+  const http_parser_settings *settings = parser->settings;
+  uint32_t id = parser->continuation;
+  parser->continuation = 0;
+  parser->block_len = 0;
+
+  // Pushed requests are not called back, but must be decoded
+  if (parser->block_push)
+    return (HPACK_OK == hpack_decode(parser->hpack, block, length, NULL,
+				     NULL) ? 0 : fail(parser, H2_ERR_HPACK));
+
+  struct h2_stream *stream = open_stream(parser, id);
+  parser->current = stream;
+  stream->parser.nread = length;
+
+  bool trailers = stream->headers_done;
+  if (!trailers)
+    PROBE2(message__begin, &stream->parser, (int) stream->parser.type);
+  if (!trailers && NULL != settings->on_message_begin
+      && settings->on_message_begin(&stream->parser) != 0)
+    return fail(parser, H2_ERR_CALLBACK);
+
+  parser->pseudo_len = 0;
+  int rc = hpack_decode(parser->hpack, block, length, on_header, parser);
+  if (HPACK_OK == rc && release_pseudo(parser, &stream->parser) != 0)
+    rc = HPACK_ERR_CALLBACK;
+  if (HPACK_ERR_CALLBACK == rc)
+    return fail(parser, (H2_OK == parser->h2_errno ? H2_ERR_CALLBACK
+			 : parser->h2_errno));
+  else if (HPACK_ERR_MEMORY == rc)
+    return fail(parser, H2_ERR_MEMORY);
+  else if (HPACK_OK != rc)
+    return fail(parser, H2_ERR_HPACK);
+
+  if (!trailers)
+    {
+      stream->headers_done = 1;
+      if (NULL != settings->on_headers_complete
+	  && settings->on_headers_complete(&stream->parser) < 0)
+	return fail(parser, H2_ERR_CALLBACK);
+
+      if (HTTP_RESPONSE == stream->parser.type
+	  && 1 == stream->parser.status_code / 100)
+	{
+	  if (message_complete(parser, stream) != 0)
+	    return -1;
+	  reset_stream(parser, stream);
+	  return 0;
+	}
+    }
+
+  if (parser->block_end_stream)
+    {
+      if (message_complete(parser, stream) != 0)
+	return -1;
+      stream->id = 0;
+    }
+  return 0;
+}
+
+
+/* append_block:
+ *
+ *    Adds a piece of header block. Returns 0 or -1.
+ */
+static int
+append_block(h2_parser * parser, const char *at, size_t length)
+{
+  size_t need = parser->block_len + length;
+  if (need > H2_BLOCK_MAX)
+    return fail(parser, H2_ERR_HEADERS);
+
+  if (need > parser->block_size)
+    {
+      size_t size = (parser->block_size > 0 ? parser->block_size : 4096);
+      while (size < need)
+	size *= 2;
+      char *block = realloc(parser->block, size);
+      if (NULL == block)
+	return fail(parser, H2_ERR_MEMORY);
+      parser->block = block;
+      parser->block_size = size;
+    }
+  memcpy(parser->block + parser->block_len, at, length);
+  parser->block_len += length;
+  return 0;
+}
+
+
+/* is_header_frame:
+ *
+ *    True for frames that carry a header block.
+ */
+static bool
+is_header_frame(h2_parser * parser)
+{
+  return (H2_HEADERS == parser->frame_type
+	  || H2_PUSH_PROMISE == parser->frame_type
+	  || H2_CONTINUATION == parser->frame_type);
+}
+
+
+/* frame_end:
+ *
+ *    Finishes the current frame once its payload (not its padding) is
+ *    in. Returns 0 or -1.
+ */
+static int
+frame_end(h2_parser * parser)
+{
+  parser->state = (parser->padding > 0 ? H2_STATE_PADDING : H2_STATE_HEADER);
+
+  if (is_header_frame(parser) && (parser->flags & H2_FLAG_END_HEADERS)
+      && 0 != parser->continuation)
+    return decode_block(parser, parser->block, parser->block_len);
+
+  if (H2_DATA == parser->frame_type
+      && (parser->flags & H2_FLAG_END_STREAM))
+    {
+      struct h2_stream *stream = find_stream(parser, parser->stream_id);
+      if (NULL != stream)
+	{
+	  if (message_complete(parser, stream) != 0)
+	    return -1;
+	  stream->id = 0;
+	}
+    }
+  return 0;
+}
+
+
+/* payload:
+ *
+ *    Handles the next "length" bytes of payload. DATA goes to on_body
+ *    as it comes; a header block is gathered, unless all of it is
+ *    here in one frame, when it is decoded where it is.
+ */
+static int
+payload(h2_parser * parser, const char *at, size_t length)
+{
+  if (H2_DATA == parser->frame_type)
+    {
+      struct h2_stream *stream = find_stream(parser, parser->stream_id);
+      if (NULL != stream && NULL != parser->settings->on_body
+	  && parser->settings->on_body(&stream->parser, at, length) != 0)
+	return fail(parser, H2_ERR_CALLBACK);
+      return 0;
+    }
+
+  if (!is_header_frame(parser))
+    return 0;
+
+  if (0 == parser->block_len && length == parser->remaining
+      && (parser->flags & H2_FLAG_END_HEADERS))
+    return decode_block(parser, at, length);
+  return append_block(parser, at, length);
+}
+
+
+/* prefix_done:
+ *
+ *    Starts the payload once the fields before it (pad length,
+ *    promised stream and priority) are in. Returns 0 or -1.
+ */
+static int
+prefix_done(h2_parser * parser)
+{
+  uint32_t padding = 0;
+  if (parser->prefix_need > 0 && (parser->flags & H2_FLAG_PADDED))
+    padding = parser->prefix[0];
+  if (parser->prefix_need + padding > parser->length)
+    return fail(parser, H2_ERR_FRAME);
+
+  parser->remaining = parser->length - parser->prefix_need - padding;
+  parser->padding = padding;
+
+  if (H2_HEADERS == parser->frame_type
+      || H2_PUSH_PROMISE == parser->frame_type)
+    {
+      parser->continuation = parser->stream_id;
+      parser->block_push = (H2_PUSH_PROMISE == parser->frame_type);
+      parser->block_end_stream = ((parser->flags & H2_FLAG_END_STREAM) != 0);
+      parser->block_len = 0;
+    }
+  else if (H2_RST_STREAM == parser->frame_type)
+    {
+      struct h2_stream *stream = find_stream(parser, parser->stream_id);
+      if (NULL != stream)
+	stream->id = 0;
+    }
+
+  if (0 == parser->remaining)
+    return frame_end(parser);
+  parser->state = H2_STATE_PAYLOAD;
+  return 0;
+}
+
+
+/* frame_begin:
+ *
+ *    Decodes the frame header just read and checks the frame may come
+ *    here. Returns 0 or -1.
+ */
+static int
+frame_begin(h2_parser * parser)
+{
+  const unsigned char *h = parser->header;
+  parser->length = (h[0] << 16) | (h[1] << 8) | h[2];
+  parser->frame_type = h[3];
+  parser->flags = h[4];
+  parser->stream_id = (((uint32_t) (h[5] & 0x7f) << 24) | (h[6] << 16)
+		       | (h[7] << 8) | h[8]);
+  parser->header_len = 0;
+
+  // Nothing may come between the frames of a header block
+  if ((0 != parser->continuation)
+      != (H2_CONTINUATION == parser->frame_type)
+      || (H2_CONTINUATION == parser->frame_type
+	  && parser->stream_id != parser->continuation))
+    return fail(parser, H2_ERR_CONTINUATION);
+
+  unsigned int need = 0;
+  switch (parser->frame_type)
+    {
+    case H2_DATA:
+      need = ((parser->flags & H2_FLAG_PADDED) ? 1 : 0);
+      break;
+    case H2_HEADERS:
+      need = (((parser->flags & H2_FLAG_PADDED) ? 1 : 0)
+	      + ((parser->flags & H2_FLAG_PRIORITY) ? 5 : 0));
+      break;
+    case H2_PUSH_PROMISE:
+      need = ((parser->flags & H2_FLAG_PADDED) ? 1 : 0) + 4;
+      break;
+    }
+  if (need > parser->length
+      || ((H2_DATA == parser->frame_type || is_header_frame(parser))
+	  && 0 == parser->stream_id))
+    return fail(parser, H2_ERR_FRAME);
+
+  parser->prefix_need = need;
+  parser->prefix_len = 0;
+  if (need > 0)
+    {
+      parser->state = H2_STATE_PREFIX;
+      return 0;
+    }
+  return prefix_done(parser);
+}
+
+
+/* h2_parser_execute:
+ *
+ *    Parses "len" bytes at "data", calling back through "settings".
+ *    Returns the number of bytes parsed. Check h2_errno for errors:
+ *    the byte that caused one may have been counted.
+ */
+size_t
+h2_parser_execute(h2_parser * parser, const http_parser_settings * settings,
+		  const char *data, size_t len)
+{
+  size_t p = 0;
+
+  if (H2_OK != parser->h2_errno)
+    return 0;
+  parser->settings = settings;
+
+  // Which side this is shows from the first byte
+  if (HTTP_BOTH == parser->type && len > 0)
+    {
+      parser->type = (H2_PREFACE[0] == data[0] ? HTTP_REQUEST
+		      : HTTP_RESPONSE);
+      if (HTTP_RESPONSE == parser->type)
+	parser->state = H2_STATE_HEADER;
+    }
+
+  while (p < len)
+    {
+      size_t n = 0;
+      switch (parser->state)
+	{
+	case H2_STATE_PREFACE:
+	  for (; p < len && parser->preface_len < H2_PREFACE_LEN; p++)
+	    if (data[p] != H2_PREFACE[parser->preface_len++])
+	      {
+		fail(parser, H2_ERR_PREFACE);
+		return p;
+	      }
+	  if (H2_PREFACE_LEN == parser->preface_len)
+	    parser->state = H2_STATE_HEADER;
+	  break;
+
+	case H2_STATE_HEADER:
+	  n = H2_MIN(len - p,
+		     (size_t) (H2_FRAME_HEADER_LEN - parser->header_len));
+	  memcpy(parser->header + parser->header_len, data + p, n);
+	  parser->header_len += n;
+	  p += n;
+	  if (H2_FRAME_HEADER_LEN == parser->header_len
+	      && frame_begin(parser) != 0)
+	    return p;
+	  break;
+
+	case H2_STATE_PREFIX:
+	  n = H2_MIN(len - p,
+		     (size_t) (parser->prefix_need - parser->prefix_len));
+	  memcpy(parser->prefix + parser->prefix_len, data + p, n);
+	  parser->prefix_len += n;
+	  p += n;
+	  if (parser->prefix_len == parser->prefix_need
+	      && prefix_done(parser) != 0)
+	    return p;
+	  break;
+
+	case H2_STATE_PAYLOAD:
+	  n = H2_MIN(len - p, parser->remaining);
+	  if (payload(parser, data + p, n) != 0)
+	    return p;
+	  p += n;
+	  parser->remaining -= n;
+	  if (0 == parser->remaining && frame_end(parser) != 0)
+	    return p;
+	  break;
+
+	case H2_STATE_PADDING:
+	  n = H2_MIN(len - p, parser->padding);
+	  p += n;
+	  parser->padding -= n;
+	  if (0 == parser->padding)
+	    parser->state = H2_STATE_HEADER;
+	  break;
+	}
+    }
+
+  return p;
+}
+
+
+/* h2_frame_type_str:
+ *
+ *    Name of a frame type, for logging.
+ */
+const char *
+h2_frame_type_str(enum h2_frame_type type)
+{
+  switch (type)
+    {
+    case H2_DATA:
+      return "DATA";
+    case H2_HEADERS:
+      return "HEADERS";
+    case H2_PRIORITY:
+      return "PRIORITY";
+    case H2_RST_STREAM:
+      return "RST_STREAM";
+    case H2_SETTINGS:
+      return "SETTINGS";
+    case H2_PUSH_PROMISE:
+      return "PUSH_PROMISE";
+    case H2_PING:
+      return "PING";
+    case H2_GOAWAY:
+      return "GOAWAY";
+    case H2_WINDOW_UPDATE:
+      return "WINDOW_UPDATE";
+    case H2_CONTINUATION:
+      return "CONTINUATION";
+    }
+  return "unknown";
+}
+
+
+/* h2_errno_str:
+ *
+ *    Description of a parser error.
+ */
+const char *
+h2_errno_str(enum h2_errno err)
+{
+  switch (err)
+    {
+    case H2_OK:
+      return "success";
+    case H2_ERR_CALLBACK:
+      return "a callback failed";
+    case H2_ERR_PREFACE:
+      return "bad connection preface";
+    case H2_ERR_FRAME:
+      return "frame on stream 0, or too short for its padding or fields";
+    case H2_ERR_CONTINUATION:
+      return "header block interrupted or CONTINUATION out of place";
+    case H2_ERR_HPACK:
+      return "header block could not be decoded";
+    case H2_ERR_HEADERS:
+      return "bad pseudo-header or header block too big";
+    case H2_ERR_MEMORY:
+      return "memory allocation failed";
+    }
+  return "unknown error";
+}
@@ -0,0 +1,155 @@
+/* h2_parser.h
+ *
+ *    HTTP/2 (RFC 7540) frame parser for cleartext connections (h2c),
+ *    one direction at a time. Works like http_parser, and calls back
+ *    through the same http_parser_settings, so a tool's callbacks see
+ *    each stream's request or response as if it were HTTP/1.x:
+ *
+ *      on_message_begin     when a stream's HEADERS arrive
+ *      on_url               with :path
+ *      on_header_field      with each header (HPACK decoded, lower
+ *      on_header_value        case); pseudo-headers other than
+ *                           :method, :path and :status are passed on
+ *                           as they are (":authority"), after on_url
+ *      on_headers_complete  at the end of the header block; the
+ *                           return value only matters if it is -1
+ *      on_body              with each piece of a DATA frame
+ *      on_message_complete  at END_STREAM (after any trailers, which
+ *                           are called back as more header fields)
+ *
+ *    Every stream has its own http_parser, which is what the callbacks
+ *    are given: type, method, status_code, content_length and
+ *    header_id are set as the HTTP/1.x parser sets them, http_major
+ *    is 2, nread is the size of the header block (HPACK coded) and
+ *    data is the h2_parser's. h2_stream_id gives the stream.
+ *    Callbacks for one header block are never interleaved with
+ *    another's; on_body and on_message_complete for different streams
+ *    may be. A stream reset with RST_STREAM just stops.
+ *
+ *    The client's side starts with the connection preface, the
+ *    server's with a SETTINGS frame; a parser initialised with
+ *    HTTP_BOTH tells which from the first byte. Frames other than
+ *    DATA, HEADERS, CONTINUATION and PUSH_PROMISE are skipped (pushed
+ *    requests are decoded, to keep the HPACK table, but not called
+ *    back). Flow control and SETTINGS belong to the endpoints.
+ */
+#ifndef __H2_PARSER_H__
+#define __H2_PARSER_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "http_parser.h"
+#include "hpack.h"
+
+#define H2_PREFACE "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+#define H2_PREFACE_LEN 24
+#define H2_FRAME_HEADER_LEN 9
+
+// Open streams tracked at once; a power of 2
+#define H2_STREAMS_MAX 256
+
+// Largest header block (all its frames) that is decoded
+#define H2_BLOCK_MAX (256 * 1024)
+
+// Room for pseudo-headers held until :path has been called back
+#define H2_PSEUDO_MAX 1024
+
+enum h2_frame_type
+{
+  H2_DATA = 0x0,
+  H2_HEADERS = 0x1,
+  H2_PRIORITY = 0x2,
+  H2_RST_STREAM = 0x3,
+  H2_SETTINGS = 0x4,
+  H2_PUSH_PROMISE = 0x5,
+  H2_PING = 0x6,
+  H2_GOAWAY = 0x7,
+  H2_WINDOW_UPDATE = 0x8,
+  H2_CONTINUATION = 0x9
+};
+
+enum h2_flag
+{
+  H2_FLAG_END_STREAM = 0x1,
+  H2_FLAG_END_HEADERS = 0x4,
+  H2_FLAG_PADDED = 0x8,
+  H2_FLAG_PRIORITY = 0x20
+};
+
+enum h2_errno
+{
+  H2_OK,
+  H2_ERR_CALLBACK,
+  H2_ERR_PREFACE,
+  H2_ERR_FRAME,
+  H2_ERR_CONTINUATION,
+  H2_ERR_HPACK,
+  H2_ERR_HEADERS,
+  H2_ERR_MEMORY
+};
+
+/* h2_stream:
+ *
+ *    An open stream. Private, apart from the parser handed to the
+ *    callbacks.
+ */
+struct h2_stream
+{
+  uint32_t id;			// 0 if the slot is free
+  unsigned int headers_done:1;	// on_headers_complete has been called
+  http_parser parser;
+};
+
+typedef struct h2_parser h2_parser;
+
+struct h2_parser
+{
+  // private
+  unsigned int state:3;
+  unsigned int preface_len:5;
+  unsigned int header_len:4;
+  unsigned int prefix_len:4;
+  unsigned int prefix_need:4;
+  unsigned char header[H2_FRAME_HEADER_LEN];
+  unsigned char prefix[10];	// Pad length, promised stream, priority
+  uint32_t remaining;		// Payload (less padding) still to come
+  uint32_t padding;		// Padding after it
+  uint32_t continuation;	// Stream whose header block is unfinished
+  bool block_push;		// That block is a PUSH_PROMISE's
+  bool block_end_stream;	// Its HEADERS frame ended the stream
+  char *block;			// Header block so far
+  size_t block_len;
+  size_t block_size;
+  struct Hpack_Decoder *hpack;
+  char pseudo[H2_PSEUDO_MAX];	// Held pseudo-headers
+  size_t pseudo_len;
+  const http_parser_settings *settings;
+  struct h2_stream *current;	// Stream being called back
+  struct h2_stream streams[H2_STREAMS_MAX];
+
+  // read-only
+  unsigned int type:2;		// enum http_parser_type
+  uint32_t length;		// Current frame
+  uint8_t frame_type;
+  uint8_t flags;
+  uint32_t stream_id;
+  unsigned int h2_errno:4;	// enum h2_errno
+
+  // public
+  void *data;
+};
+
+int h2_parser_init(h2_parser * parser, enum http_parser_type type);
+void h2_parser_free(h2_parser * parser);
+size_t h2_parser_execute(h2_parser * parser,
+			 const http_parser_settings * settings,
+			 const char *data, size_t len);
+
+int h2_detect(const char *at, size_t length);
+uint32_t h2_stream_id(const http_parser * parser);
+const char *h2_frame_type_str(enum h2_frame_type type);
+const char *h2_errno_str(enum h2_errno err);
+
+#endif
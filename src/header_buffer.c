@@ -0,0 +1,497 @@
+/* header_buffer.c:
+ *
+ *    Accumulates HTTP message tokens as slices into the read buffer,
+ *    copying them only when they would otherwise be lost.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <assert.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "ulog.h"
+#include "util.h"
+
+#include "header_buffer.h"
+
+#ifndef IOV_MAX
+#  define IOV_MAX 1024
+#endif
+
+#define HEADER_SLICES_MIN 32
+
+
+/* header_buffer_new:
+ *
+ *    Creates a new header buffer whose slices may point into
+ *    "read_buffer" (of "read_size" bytes). Returns NULL if there was
+ *    a memory allocation error.
+ */
+struct Header_Buffer *
+header_buffer_new(const char *read_buffer, size_t read_size)
+{
+  struct Header_Buffer *hb = malloc(sizeof(struct Header_Buffer));
+  if (hb != NULL)
+    {
+      hb->base = read_buffer;
+      hb->base_size = read_size;
+      hb->store = NULL;
+      hb->store_size = 0;
+      hb->store_max = 0;
+      hb->count = 0;
+      hb->max = HEADER_SLICES_MIN;
+      hb->slices = malloc(hb->max * sizeof(struct Header_Slice));
+      if (NULL == hb->slices)
+	{
+	  free(hb);
+	  hb = NULL;
+	}
+    }
+  return hb;
+}
+
+
+/* header_buffer_delete:
+ *
+ *    Deallocates internal structures and then the buffer itself.
+ */
+void
+header_buffer_delete(struct Header_Buffer *hb)
+{
+  free(hb->store);
+  free(hb->slices);
+  free(hb);
+  return;
+}
+
+
+/* in_read_buffer:
+ *
+ *    True if the "length" bytes at "at" are inside the read buffer.
+ */
+static int
+in_read_buffer(struct Header_Buffer *hb, const char *at, size_t length)
+{
+  return (hb->base != NULL && at >= hb->base
+	  && at + length <= hb->base + hb->base_size);
+}
+
+
+/* store_append:
+ *
+ *    Copies "length" bytes to the end of the store, growing it if
+ *    needed. "at" may point into the store itself. Returns the offset
+ *    of the copy, or -1 on memory allocation error.
+ */
+static ssize_t
+store_append(struct Header_Buffer *hb, const char *at, size_t length)
+{
+  if (hb->store_size + length > hb->store_max)
+    {
+      // Remember where the source was if it's about to move
+      ssize_t src_offset = -1;
+      if (hb->store != NULL && at >= hb->store
+	  && at < hb->store + hb->store_size)
+	src_offset = at - hb->store;
+
+      size_t new_size = upper_power_of_two(hb->store_size + length);
+      if (new_size < LINE_MAX)
+	new_size = LINE_MAX;
+      char *new_store = realloc(hb->store, new_size);
+      if (NULL == new_store)
+	{
+	  perror("Out of memory in realloc -- header buffer overflow");
+	  return -1;
+	}
+      hb->store = new_store;
+      hb->store_max = new_size;
+      if (src_offset >= 0)
+	at = hb->store + src_offset;
+    }
+
+  ssize_t offset = hb->store_size;
+  memcpy(hb->store + offset, at, length);
+  hb->store_size += length;
+  return offset;
+}
+
+
+/* grow_slices:
+ *
+ *    Makes room for at least one more slice. Returns 0 on success or
+ *    -1 on memory allocation error.
+ */
+static int
+grow_slices(struct Header_Buffer *hb)
+{
+  if (hb->count < hb->max)
+    return 0;
+
+  size_t new_max = hb->max * 2;
+  struct Header_Slice *new_slices =
+    realloc(hb->slices, new_max * sizeof(struct Header_Slice));
+  if (NULL == new_slices)
+    {
+      perror("Out of memory in realloc -- too many headers");
+      return -1;
+    }
+  hb->slices = new_slices;
+  hb->max = new_max;
+  return 0;
+}
+
+
+/* header_buffer_add:
+ *
+ *    Adds a token delivered by the parser. If the last token was of
+ *    the same type, this is a continuation of it: contiguous pieces
+ *    in the read buffer are merged without copying; otherwise both
+ *    pieces are joined in the store. Returns 0 on success or -1 on
+ *    memory allocation error.
+ */
+int
+header_buffer_add(struct Header_Buffer *hb, enum header_token_type type,
+		  const char *at, size_t length)
+{
+  assert(hb != NULL);
+  assert(at != NULL || length == 0);
+
+  struct Header_Slice *last =
+    (hb->count > 0 ? &hb->slices[hb->count - 1] : NULL);
+
+  if (NULL != last && last->type == type)
+    {
+      // Continues in the read buffer right where the last piece ended
+      if (!last->owned && in_read_buffer(hb, at, length)
+	  && at == hb->base + last->offset + last->length)
+	{
+	  last->length += length;
+	  return 0;
+	}
+
+      // Otherwise the whole token must live at the end of the store
+      if (!last->owned || last->offset + last->length != hb->store_size)
+	{
+	  const char *src =
+	    (last->owned ? hb->store : hb->base) + last->offset;
+	  ssize_t offset = store_append(hb, src, last->length);
+	  if (offset < 0)
+	    return -1;
+	  last->offset = offset;
+	  last->owned = 1;
+	}
+      if (store_append(hb, at, length) < 0)
+	return -1;
+      last->length += length;
+      return 0;
+    }
+
+  // New token
+  if (grow_slices(hb) != 0)
+    return -1;
+
+  struct Header_Slice *slice = &hb->slices[hb->count];
+  slice->type = type;
+  slice->tag = 0;
+  slice->length = length;
+  if (in_read_buffer(hb, at, length))
+    {
+      slice->owned = 0;
+      slice->offset = at - hb->base;
+    }
+  else
+    {
+      ssize_t offset = store_append(hb, at, length);
+      if (offset < 0)
+	return -1;
+      slice->owned = 1;
+      slice->offset = offset;
+    }
+  hb->count++;
+
+  return 0;
+}
+
+
+/* header_buffer_retain:
+ *
+ *    Must be called before the read buffer is overwritten. Copies
+ *    every token still pointing into the read buffer into the store.
+ */
+void
+header_buffer_retain(struct Header_Buffer *hb)
+{
+  assert(hb != NULL);
+
+  for (size_t i = 0; i < hb->count; i++)
+    {
+      struct Header_Slice *slice = &hb->slices[i];
+      if (slice->owned)
+	continue;
+
+      ssize_t offset =
+	store_append(hb, hb->base + slice->offset, slice->length);
+      if (offset < 0)
+	{
+	  ulog(LOG_ERR, "Could not retain header token -- dropping it");
+	  slice->length = 0;
+	  offset = 0;
+	}
+      slice->offset = offset;
+      slice->owned = 1;
+    }
+  return;
+}
+
+
+/* header_buffer_clear:
+ *
+ *    Forgets all tokens, ready for the next message. Does not free
+ *    any memory.
+ */
+void
+header_buffer_clear(struct Header_Buffer *hb)
+{
+  assert(hb != NULL);
+  hb->count = 0;
+  hb->store_size = 0;
+  return;
+}
+
+
+/* header_buffer_count:
+ *
+ *    Returns the number of tokens (URL, fields and values) stored.
+ */
+size_t
+header_buffer_count(struct Header_Buffer *hb)
+{
+  return hb->count;
+}
+
+
+/* header_buffer_token:
+ *
+ *    Returns a pointer to token "idx" and sets "length". The token
+ *    is not NUL terminated, and the pointer is only valid until the
+ *    next call that modifies the header buffer.
+ */
+const char *
+header_buffer_token(struct Header_Buffer *hb, size_t idx, size_t *length)
+{
+  assert(idx < hb->count);
+  struct Header_Slice *slice = &hb->slices[idx];
+  *length = slice->length;
+  return (slice->owned ? hb->store : hb->base) + slice->offset;
+}
+
+
+/* header_buffer_url:
+ *
+ *    Returns the URL (requests) or status text (responses) and sets
+ *    "length". Returns NULL with length 0 if there was none.
+ */
+const char *
+header_buffer_url(struct Header_Buffer *hb, size_t *length)
+{
+  for (size_t i = 0; i < hb->count; i++)
+    {
+      if (HB_URL == hb->slices[i].type)
+	return header_buffer_token(hb, i, length);
+    }
+  *length = 0;
+  return NULL;
+}
+
+
+/* header_buffer_type:
+ *
+ *    Returns the type (URL, field or value) of token "idx".
+ */
+enum header_token_type
+header_buffer_type(struct Header_Buffer *hb, size_t idx)
+{
+  assert(idx < hb->count);
+  return hb->slices[idx].type;
+}
+
+
+/* header_buffer_tag:
+ *
+ *    Returns the caller's tag for token "idx" (0 unless set).
+ */
+unsigned int
+header_buffer_tag(struct Header_Buffer *hb, size_t idx)
+{
+  assert(idx < hb->count);
+  return hb->slices[idx].tag;
+}
+
+
+/* header_buffer_set_tag:
+ *
+ *    Sets the caller's tag for token "idx". Only the low 8 bits are
+ *    kept.
+ */
+void
+header_buffer_set_tag(struct Header_Buffer *hb, size_t idx, unsigned int tag)
+{
+  assert(idx < hb->count);
+  hb->slices[idx].tag = tag;
+  return;
+}
+
+
+/* header_buffer_set:
+ *
+ *    Replaces the content of token "idx" with a copy of the "length"
+ *    bytes at "at", which may point at another token. Returns 0 on
+ *    success or -1 on memory allocation error.
+ */
+int
+header_buffer_set(struct Header_Buffer *hb, size_t idx, const char *at,
+		  size_t length)
+{
+  assert(idx < hb->count);
+  assert(at != NULL || length == 0);
+
+  ssize_t offset = store_append(hb, at, length);
+  if (offset < 0)
+    return -1;
+
+  struct Header_Slice *slice = &hb->slices[idx];
+  slice->owned = 1;
+  slice->offset = offset;
+  slice->length = length;
+  return 0;
+}
+
+
+/* header_buffer_insert:
+ *
+ *    Inserts a copy of the "length" bytes at "at" as a new token
+ *    before token "idx" ("idx" equal to the count appends). The new
+ *    token is never merged with its neighbours. Returns 0 on success
+ *    or -1 on memory allocation error.
+ */
+int
+header_buffer_insert(struct Header_Buffer *hb, size_t idx,
+		     enum header_token_type type, const char *at,
+		     size_t length)
+{
+  assert(idx <= hb->count);
+  assert(at != NULL || length == 0);
+
+  if (grow_slices(hb) != 0)
+    return -1;
+  ssize_t offset = store_append(hb, at, length);
+  if (offset < 0)
+    return -1;
+
+  memmove(&hb->slices[idx + 1], &hb->slices[idx],
+	  (hb->count - idx) * sizeof(struct Header_Slice));
+  struct Header_Slice *slice = &hb->slices[idx];
+  slice->type = type;
+  slice->owned = 1;
+  slice->tag = 0;
+  slice->offset = offset;
+  slice->length = length;
+  hb->count++;
+  return 0;
+}
+
+
+/* header_buffer_remove:
+ *
+ *    Removes "n" tokens starting at token "idx". Their bytes stay in
+ *    the store until the buffer is cleared.
+ */
+void
+header_buffer_remove(struct Header_Buffer *hb, size_t idx, size_t n)
+{
+  assert(idx + n <= hb->count);
+
+  memmove(&hb->slices[idx], &hb->slices[idx + n],
+	  (hb->count - idx - n) * sizeof(struct Header_Slice));
+  hb->count -= n;
+  return;
+}
+
+
+/* header_buffer_write_line:
+ *
+ *    Writes "prefix", the URL (or status text) and "suffix" to "fd"
+ *    with a single writev. Returns bytes written.
+ */
+ssize_t
+header_buffer_write_line(struct Header_Buffer *hb, int fd,
+			 const char *prefix, const char *suffix)
+{
+  size_t url_len = 0;
+  const char *url = header_buffer_url(hb, &url_len);
+
+  struct iovec iov[3];
+  iov[0].iov_base = (void *) prefix;
+  iov[0].iov_len = strlen(prefix);
+  iov[1].iov_base = (void *) url;
+  iov[1].iov_len = url_len;
+  iov[2].iov_base = (void *) suffix;
+  iov[2].iov_len = strlen(suffix);
+
+  return writev_all(fd, iov, 3);
+}
+
+
+/* header_buffer_write:
+ *
+ *    Writes tokens "first" up to (not including) "last" to "fd" as
+ *    header lines ("Field: value\r\n"), skipping the URL. Returns
+ *    bytes written.
+ */
+ssize_t
+header_buffer_write(struct Header_Buffer *hb, int fd, size_t first,
+		    size_t last)
+{
+  struct iovec iov[IOV_MAX];
+  ssize_t total = 0;
+  int n = 0;
+
+  if (last > hb->count)
+    last = hb->count;
+
+  for (size_t i = first; i < last; i++)
+    {
+      if (HB_URL == hb->slices[i].type)
+	continue;
+
+      size_t length = 0;
+      iov[n].iov_base = (void *) header_buffer_token(hb, i, &length);
+      iov[n].iov_len = length;
+      n++;
+      if (HB_FIELD == hb->slices[i].type)
+	iov[n].iov_base = ": ";
+      else
+	iov[n].iov_base = "\r\n";
+      iov[n].iov_len = 2;
+      n++;
+
+      if (n >= IOV_MAX - 1)
+	{
+	  total += writev_all(fd, iov, n);
+	  n = 0;
+	}
+    }
+
+  if (n > 0)
+    total += writev_all(fd, iov, n);
+
+  return total;
+}
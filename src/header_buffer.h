@@ -0,0 +1,82 @@
+/* header_buffer.h
+ *
+ *    Accumulates the URL (or status text) and header fields and
+ *    values of a HTTP message without copying them. Each token is
+ *    kept as an (offset, length) slice into the caller's read
+ *    buffer. Tokens are only copied into the header buffer's own
+ *    storage when the read buffer is about to be reused (see
+ *    header_buffer_retain), or when the parser delivers a token in
+ *    pieces that are not contiguous.
+ */
+#ifndef __HEADER_BUFFER_H__
+#define __HEADER_BUFFER_H__
+
+#include <sys/types.h>
+
+enum header_token_type
+{ HB_URL, HB_FIELD, HB_VALUE };
+
+/* Header_Slice:
+ *
+ *    One token. If 'owned' is set then 'offset' is into the header
+ *    buffer's store, otherwise it is into the read buffer. 'tag' is
+ *    free for the caller (http_message keeps the header id there).
+ */
+struct Header_Slice
+{
+  unsigned int type:2;		// enum header_token_type
+  unsigned int owned:1;
+  unsigned int tag:8;
+  size_t offset;
+  size_t length;
+};
+
+/* Header_Buffer:
+ *
+ *    All members should be treated as 'private'.
+ */
+struct Header_Buffer
+{
+  // private
+  const char *base;		// Read buffer that unowned slices point into
+  size_t base_size;		// Size of read buffer
+  char *store;			// Copies of tokens that outlived the read buffer
+  size_t store_size;
+  size_t store_max;
+  struct Header_Slice *slices;
+  size_t count;
+  size_t max;
+};
+
+struct Header_Buffer *header_buffer_new(const char *read_buffer,
+					size_t read_size);
+void header_buffer_delete(struct Header_Buffer *hb);
+
+int header_buffer_add(struct Header_Buffer *hb, enum header_token_type type,
+		      const char *at, size_t length);
+void header_buffer_retain(struct Header_Buffer *hb);
+void header_buffer_clear(struct Header_Buffer *hb);
+
+size_t header_buffer_count(struct Header_Buffer *hb);
+const char *header_buffer_token(struct Header_Buffer *hb, size_t idx,
+				size_t *length);
+const char *header_buffer_url(struct Header_Buffer *hb, size_t *length);
+enum header_token_type header_buffer_type(struct Header_Buffer *hb,
+					  size_t idx);
+unsigned int header_buffer_tag(struct Header_Buffer *hb, size_t idx);
+void header_buffer_set_tag(struct Header_Buffer *hb, size_t idx,
+			   unsigned int tag);
+
+int header_buffer_set(struct Header_Buffer *hb, size_t idx, const char *at,
+		      size_t length);
+int header_buffer_insert(struct Header_Buffer *hb, size_t idx,
+			 enum header_token_type type, const char *at,
+			 size_t length);
+void header_buffer_remove(struct Header_Buffer *hb, size_t idx, size_t n);
+
+ssize_t header_buffer_write_line(struct Header_Buffer *hb, int fd,
+				 const char *prefix, const char *suffix);
+ssize_t header_buffer_write(struct Header_Buffer *hb, int fd, size_t first,
+			    size_t last);
+
+#endif
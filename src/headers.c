@@ -10,8 +10,10 @@
 #include <fcntl.h>
 #include <getopt.h>
 #include <paths.h>
+#include <signal.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -21,9 +23,19 @@
 #include "http_parser.h"
 #include "util.h"
 #include "ulog.h"
+#include "counters.h"
 #include "stream_buffer.h"
+#include "http_message.h"
+#include "method_queue.h"
+#include "tunnel.h"
+#include "buffer_alloc.h"
 #include "pipes.h"
+#include "child_stats.h"
+#include "stage_timing.h"
+#include "probes.h"
 
+// Starts each line of the -R report
+#define CHILD_STATS_PREFIX "headers: [children]"
 
 
 struct headers_settings
@@ -31,37 +43,42 @@ struct headers_settings
   int fd_in;
   int fd_out;
   int fd_pipe;
-  char *url;
-  struct Stream_Buffer *sbuf;
+  struct Http_Message *msg;
+  struct Method_Queue *methods;
+  struct Tunnel tunnel;
   struct Pipe_Handle *ph;
+  const char *pipe_cmd;
+  struct Child_Stats *children;	// NULL unless -R
+  struct Stage_Timing timing;
 };
 
 
 
+/* cb_message_begin:
+ *
+ *    Called when a new HTTP message starts.
+ */
+int
+cb_message_begin(http_parser * parser)
+{
+  struct headers_settings *hset = (struct headers_settings *) parser->data;
+  stage_timing_begin(&hset->timing);
+  return 0;
+}
+
+
 /* cb_url: 
  *
  *    Callback from http_parser, called when URL read. Preserves the
- *    URL for later.
+ *    URL for later. The parser may deliver the URL in pieces.
  */
 int
 cb_url(http_parser * parser, const char *at, size_t length)
 {
   struct headers_settings *hset = (struct headers_settings *) parser->data;
 
-  // Safely copy URL to buffer provided.
-  if (length < URL_MAX)
-    {
-      strncpy(hset->url, at, length);
-      hset->url[length] = '\0';
-    }
-  else
-    {
-      strncpy(hset->url, at, URL_MAX - 1);
-      hset->url[URL_MAX - 1] = '\0';
-      ulog(LOG_ERR, "URL exceeded %zd bytes and was truncated", URL_MAX);
-    }
-  ulog_debug("Recorded URL of HTTP message: %s", hset->url);
-  return 0;
+  ulog_debug("URL of HTTP message: %.*s", (int) length, at);
+  return http_message_on_url(hset->msg, at, length);
 }
 
 
@@ -69,51 +86,42 @@ cb_url(http_parser * parser, const char *at, size_t length)
  *     
  *    Called by http_parser_execute when the header has completed. At
  *    this point we want to write the headers to the pipe command, and
- *    flush the output buffer by resetting the pipe.
+ *    flush the output buffer by resetting the pipe. Returns 1 if the
+ *    message has no body (see method_queue_skip_body).
  *
  */
 int
 cb_headers_complete(http_parser * parser)
 {
   struct headers_settings *hset = (struct headers_settings *) parser->data;
+  PROBE3(headers__complete, parser, (int) parser->type, parser->nread);
 
-  // Using a temporary string to build HTTP message start
-  char *str = malloc (STRING_MAX);
-  if (NULL == str)
-    {
-      perror("Error in malloc");
-      return -1;
-    }
-
-  // Build the HTTP message start based on message type
-  if (HTTP_REQUEST == parser->type)
-  {
-    snprintf (str, STRING_MAX, "%s %s HTTP/%d.%d\r\n",
-	      http_method_str (parser->method),
-	      hset->url, parser->http_major, parser->http_minor);
-  }
-  else
-  {
-    snprintf (str, STRING_MAX, "HTTP/%d.%d %d %s\r\n",
-	      parser->http_major,
-	      parser->http_minor, parser->status_code, hset->url);
-  }
+  http_message_on_headers_complete(hset->msg, parser);
 
   // Headers are written to the pipe
   int fd = hset->fd_pipe;
   ulog_debug("cb_headers_complete(parser=%X, parser->type=%d) -> fd=%d",
 	     parser, parser->type, fd);
 
-  // Write the start of the HTTP message
-  write_all(fd, str, strlen(str));
-
-  // Append blank line to end of HTTP headers, then write the buffered HTTP
-  // headers message.
-  stream_buffer_add(hset->sbuf, "\r\n", 2);
-  stream_buffer_write(hset->sbuf, fd);
-
-  // Free mem & short pause... (TODO: Fix)
-  free(str);
+  // The command given the message was started with the last one
+  stage_timing_spawned(&hset->timing, hset->ph->fork_ns);
+  stage_timing_end(&hset->timing);
+  stage_timing_insert(&hset->timing, hset->msg, false);
+
+  // Write the start of the HTTP message, then the HTTP headers and
+  // the blank line that ends them.
+  http_message_write_head(hset->msg, fd);
+
+  // The Content-Type the command was given, before it is cleared
+  char type[CHILD_STATS_TYPE_MAX] = "";
+  size_t type_len = 0;
+  const char *type_at =
+    http_message_get(hset->msg, HTTP_HEADER_CONTENT_TYPE, &type_len);
+  if (NULL != hset->children && NULL != type_at)
+    snprintf(type, sizeof(type), "%.*s", (int) type_len, type_at);
+  http_message_clear(hset->msg);
+
+  // Short pause... (TODO: Fix)
   usleep(7000);
 
 
@@ -123,8 +131,12 @@ cb_headers_complete(http_parser * parser)
       perror("Broken pipe");
       return -1;
     }
+  hset->fd_pipe = pipe_write_fileno(hset->ph);
+  if (NULL != hset->children)
+    child_stats_record(hset->children, hset->pipe_cmd, type,
+		       &hset->ph->rusage, hset->ph->wall_ns);
 
-  return 0;
+  return method_queue_skip_body(hset->methods, parser);
 }
 
 /* cb_message_complete:
@@ -135,7 +147,13 @@ cb_headers_complete(http_parser * parser)
 int
 cb_message_complete(http_parser * parser)
 {
+  struct headers_settings *hset = (struct headers_settings *) parser->data;
+
   ulog_debug("HTTP message complete");
+  counter_add(COUNTER_MESSAGES, 1);
+  http_message_clear(hset->msg);
+  // Headers have gone already: any protocol switch is passed through
+  tunnel_after_message(&hset->tunnel, parser, NULL);
   http_parser_init(parser, HTTP_BOTH);
   return 0;
 }
@@ -144,58 +162,43 @@ cb_message_complete(http_parser * parser)
 /* cb_status_complete:
  *
  *    Called when the HTTP status has been read. Take opportunity to
- *    record the URL (pointed to by "at").
+ *    record the status text (pointed to by "at").
  */
 int
 cb_status_complete(http_parser * parser, const char *at, size_t length)
 {
   struct headers_settings *hset = (struct headers_settings *) parser->data;
 
-  // Safely copy URL to allocated space
-  if (length < URL_MAX)
-    {
-      strncpy(hset->url, at, length);
-      hset->url[length] = '\0';
-    }
-  else
-    {
-      strncpy(hset->url, at, URL_MAX - 1);
-      hset->url[URL_MAX] = '\0';
-    }
-  ulog_debug("HTTP response status: %s", hset->url);
-  return 0;
+  ulog_debug("HTTP response status: %.*s", (int) length, at);
+  return http_message_on_url(hset->msg, at, length);
 }
 
 
 /* cb_header_field:
  *
  *    Called when HTTP parser has read a header field. The parser will
- *    discard this but we need it to output it again. So we add it to
- *    our output (stream) buffer. Also need to add the colon and
- *    trailing space.
+ *    discard this but we need it to output it again. So we keep it in
+ *    the message (the colon and trailing space are added back on
+ *    output).
  */
 int
 cb_header_field(http_parser * parser, const char *at, size_t length)
 {
   struct headers_settings *hset = (struct headers_settings *) parser->data;
-  stream_buffer_add(hset->sbuf, at, length);
-  stream_buffer_add(hset->sbuf, ": ", 2);
-  return 0;
+  return http_message_on_header_field(hset->msg, parser, at, length);
 }
 
 /* cb_header_value:
  *
  *    Companion to above function, called when a value for a header
- *    has been read. Append this to the same output stream buffer. Parser
- *    has stripped the trailing newline sequence so need to add that.
+ *    has been read. Keep this in the same message. Parser has stripped
+ *    the trailing newline sequence, which is added back on output.
  */
 int
 cb_header_value(http_parser * parser, const char *at, size_t length)
 {
   struct headers_settings *hset = (struct headers_settings *) parser->data;
-  stream_buffer_add(hset->sbuf, at, length);
-  stream_buffer_add(hset->sbuf, "\r\n", 2);
-  return 0;
+  return http_message_on_header_value(hset->msg, at, length);
 }
 
 
@@ -208,6 +211,7 @@ int
 cb_body(http_parser * parser, const char *at, size_t length)
 {
   struct headers_settings *hset = (struct headers_settings *) parser->data;
+  PROBE2(body, parser, length);
 
   int fd = hset->fd_out;
   ulog_debug("cb_body(parser=%X, at=%X, length=%zd) -> fd=%d", parser, at,
@@ -223,33 +227,49 @@ cb_body(http_parser * parser, const char *at, size_t length)
 /* pipe_http_messages:
  *
  *     Want to read from stdin ---> send it to pipe's stdin.  Read
- *     from pipe's stdout ---> send it to my stdout.
+ *     from pipe's stdout ---> send it to my stdout. What each child
+ *     of "pipe_cmd" used is added to "children", if not NULL. If
+ *     "timing", X-Mumpsimus-Timing is added to each message.
  */
 int
-pipe_http_messages(int fd_in, int fd_out, struct Pipe_Handle *ph)
+pipe_http_messages(int fd_in, int fd_out, struct Pipe_Handle *ph,
+		   const char *pipe_cmd, struct Child_Stats *children,
+		   bool timing)
 {
   int errors = 0;
   int rc = EX_OK;
 
 
+  // Buffer for reading data from stdin
+  char *buffer = buffer_alloc(BUFFER_MAX);
+  if (NULL == buffer)
+    {
+      perror("Error from malloc");
+      return -1;
+    }
+
   // This struct will hold inforamtion we need on each callback
   struct headers_settings hset;
   hset.fd_in = fd_in;
   hset.fd_out = fd_out;
   hset.fd_pipe = pipe_write_fileno(ph);
-  hset.url = malloc(URL_MAX);
-  hset.sbuf = stream_buffer_new();
+  hset.msg = http_message_new(buffer, BUFFER_MAX);
+  hset.methods = method_queue_new();
+  tunnel_start(&hset.tunnel);
   hset.ph = ph;
-  if (NULL == hset.url || NULL == hset.sbuf)
+  hset.pipe_cmd = pipe_cmd;
+  hset.children = children;
+  stage_timing_init(&hset.timing, (timing ? "headers" : NULL));
+  if (NULL == hset.msg || NULL == hset.methods)
     {
-      perror("Error in malloc or stream buffer");
+      perror("Error in malloc or http message");
       return -1;
     }
-  hset.url[0] = '\0';
 
   // This struct sets up callbacks for the HTTP parser
   http_parser_settings settings;
   http_parser_settings_init(&settings);
+  settings.on_message_begin = cb_message_begin;
   settings.on_header_field = cb_header_field;
   settings.on_header_value = cb_header_value;
   settings.on_headers_complete = cb_headers_complete;
@@ -264,26 +284,22 @@ pipe_http_messages(int fd_in, int fd_out, struct Pipe_Handle *ph)
   parser.data = (void *) &hset;
 
 
-  // Buffer for reading data from stdin
-  char *buffer = malloc(BUFFER_MAX);
-  if (NULL == buffer)
-    {
-      perror("Error from malloc");
-      return -1;
-    }
-
-
   ssize_t last_parsed = 0;
   ssize_t bytes_read = 0;
   char *buf_ptr = buffer;
   bool do_reads = true;
   do
     {
+      // Headers still pending point into the buffer. Keep them.
+      http_message_retain(hset.msg);
+
       // Read data from stdin
       memset(buffer, 0, BUFFER_MAX);
       buf_ptr = buffer;
-      bytes_read = read(fd_in, buffer, BUFFER_MAX);
+      bytes_read = read_input(fd_in, buffer, BUFFER_MAX);
       ulog_debug("Read %zd bytes from fd=%d", bytes_read, fd_in);
+      if (NULL != children && child_stats_wanted())
+	child_stats_dump(children, stderr, CHILD_STATS_PREFIX);
 
       // Handle error or eof
       if (bytes_read < 0)
@@ -305,20 +321,25 @@ pipe_http_messages(int fd_in, int fd_out, struct Pipe_Handle *ph)
 	  // Repeatedly call http_parser_execute while there is data left in the buffer
 	  while ((bytes_read > 0) && (errors <= 0))
 	    {
+	      // After a protocol switch (or if it is HTTP/2) the rest is
+	      // not HTTP/1.x
+	      tunnel_resolve(&hset.tunnel, buf_ptr, bytes_read);
+	      if (TUNNEL_OPEN == hset.tunnel.state)
+		{
+		  if (hset.tunnel.h2c)
+		    ulog(LOG_WARNING, "HTTP/2 (h2c) stream -- headers in it "
+			 "are passed through untransformed");
+		  tunnel_pass(fd_in, fd_out, buf_ptr, bytes_read);
+		  do_reads = false;
+		  break;
+		}
 
 	      last_parsed =
 		http_parser_execute(&parser, &settings, buf_ptr, bytes_read);
 	      ulog_debug("Parsed %zd bytes out of %zd bytes remaining",
 			 last_parsed, bytes_read);
 
-	      // TODO: Have to handle connection upgrade
-	      if (parser.upgrade)
-		{
-		  ulog(LOG_ERR,
-		       "Parser requested HTTP connection upgrade but that's not implemented yet!");
-		  errors++;
-		}
-	      else if (last_parsed > 0)
+	      if (last_parsed > 0)
 		{
 		  // Some data was parsed. Advance to next part of buffer
 		  bytes_read -= last_parsed;
@@ -328,6 +349,7 @@ pipe_http_messages(int fd_in, int fd_out, struct Pipe_Handle *ph)
 		{
 		  // Parser returned an error condition
 		  errors++;
+		  counter_add(COUNTER_PARSE_ERRORS, 1);
 		  ulog(LOG_ERR,
 		       "Parser error reading HTTP stream type %d: %s (%s). Next char is %c (%d)",
 		       parser.type,
@@ -343,10 +365,9 @@ pipe_http_messages(int fd_in, int fd_out, struct Pipe_Handle *ph)
   while (do_reads && (errors <= 0));
 
   // We allocated these
-  free(buffer);
-  free(hset.url);
-  hset.url = NULL;
-  stream_buffer_delete(hset.sbuf);
+  buffer_free(buffer);
+  http_message_delete(hset.msg);
+  method_queue_delete(hset.methods);
 
   if (errors > 0)
     rc = EX_IOERR;
@@ -364,7 +385,10 @@ usage(const char *ident, const char *message)
 {
   if (message != NULL)
     fprintf(stderr, "error: %s\n", message);
-  fprintf(stderr, "usage: %s -c command\n", ident);
+  fprintf(stderr, "usage: %s [-R] [-T] -c command\n", ident);
+  fprintf(stderr,
+	  "\t-R\treport what the commands used, per Content-Type, at exit or on SIGUSR1\n"
+	  "\t-T\tadd X-Mumpsimus-Timing to each message\n");
   exit(EX_USAGE);
 }
 
@@ -383,11 +407,13 @@ main(int argc, char *argv[])
 {
   int rc = EX_OK;		// Exit code to return to environment
   char *pipe_cmd = NULL;	// Pointer to command line to pipe output through
+  struct Child_Stats *children = NULL;	// What its children used, if -R
+  bool timing = false;		// Add X-Mumpsimus-Timing
 
 
   // Process command line arguments
   int c = 0;
-  while ((c = getopt(argc, argv, "c:")) != -1)
+  while ((c = getopt(argc, argv, "c:RT")) != -1)
     {
       switch (c)
 	{
@@ -396,6 +422,18 @@ main(int argc, char *argv[])
 	    usage(argv[0], "Must pass a command to -c");
 	  pipe_cmd = optarg;
 	  break;
+	case 'R':
+	  if (NULL == children)
+	    children = child_stats_new();
+	  if (NULL == children)
+	    {
+	      perror("Error from malloc");
+	      return EX_OSERR;
+	    }
+	  break;
+	case 'T':
+	  timing = true;
+	  break;
 	case '?':
 	  usage(argv[0], NULL);
 	  break;
@@ -418,7 +456,11 @@ main(int argc, char *argv[])
 
   // Initialise logging tool and begin debug log message
   ulog_init(argv[0]);
-  ulog(LOG_INFO, "Piping all HTTP headers through %s", pipe_cmd);
+  counters_open(argv[0]);
+  ulog(LOG_INFO, "Piping all HTTP headers through %s (buffers: %s)",
+       pipe_cmd, buffer_alloc_describe());
+  if (NULL != children)
+    child_stats_watch(SIGUSR1);
 
 
   struct Pipe_Handle *ph = pipe_handle_new();
@@ -436,10 +478,19 @@ main(int argc, char *argv[])
   else
     {
       ulog(LOG_INFO, "%s: Opened pipe to: %s", argv[0], pipe_cmd);
-      rc = pipe_http_messages(STDIN_FILENO, STDOUT_FILENO, ph);
+      rc = pipe_http_messages(STDIN_FILENO, STDOUT_FILENO, ph, pipe_cmd,
+			      children, timing);
       pipe_close(ph);
+      if (NULL != children)
+	{
+	  // The last child was given no message
+	  child_stats_record(children, pipe_cmd, NULL, &ph->rusage,
+			     ph->wall_ns);
+	  child_stats_dump(children, stderr, CHILD_STATS_PREFIX);
+	}
       pipe_handle_delete(ph);
     }
+  child_stats_delete(children);
 
   ulog_close();
 
@@ -0,0 +1,110 @@
+/* histogram.c:
+ *
+ *    Log bucketed histograms.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <string.h>
+
+#include "histogram.h"
+
+
+/* histogram_init:
+ *
+ *    Empties "h".
+ */
+void
+histogram_init(struct Histogram *h)
+{
+  memset(h, 0, sizeof(struct Histogram));
+  h->min = UINT64_MAX;
+  return;
+}
+
+
+/* histogram_bucket:
+ *
+ *    Returns the bucket "value" is counted in. Small values are their
+ *    own bucket; larger ones are placed by their top
+ *    HISTOGRAM_SUB_BITS + 1 bits.
+ */
+size_t
+histogram_bucket(uint64_t value)
+{
+  if (value < HISTOGRAM_SUB_COUNT)
+    return value;
+  int shift = 63 - __builtin_clzll(value) - HISTOGRAM_SUB_BITS;
+  return (shift + 1) * HISTOGRAM_SUB_COUNT
+    + ((value >> shift) - HISTOGRAM_SUB_COUNT);
+}
+
+
+/* histogram_bucket_high:
+ *
+ *    Returns the highest value counted in "bucket".
+ */
+uint64_t
+histogram_bucket_high(size_t bucket)
+{
+  if (bucket < HISTOGRAM_SUB_COUNT)
+    return bucket;
+  int shift = bucket / HISTOGRAM_SUB_COUNT - 1;
+  uint64_t top = HISTOGRAM_SUB_COUNT + bucket % HISTOGRAM_SUB_COUNT;
+  return ((top + 1) << shift) - 1;
+}
+
+
+/* histogram_record:
+ *
+ *    Counts "value".
+ */
+void
+histogram_record(struct Histogram *h, uint64_t value)
+{
+  h->buckets[histogram_bucket(value)]++;
+  h->count++;
+  h->sum += value;
+  if (value < h->min)
+    h->min = value;
+  if (value > h->max)
+    h->max = value;
+  return;
+}
+
+
+/* histogram_percentile:
+ *
+ *    Returns the value "percent" of those counted are at or below (to
+ *    the precision of the buckets, and no more than the largest
+ *    counted), or 0 if nothing has been counted.
+ */
+uint64_t
+histogram_percentile(const struct Histogram *h, double percent)
+{
+  if (0 == h->count)
+    return 0;
+
+  // The nearest rank: the smallest that covers "percent" of counts
+  double exact = percent / 100.0 * h->count;
+  uint64_t rank = (uint64_t) exact;
+  if (rank < exact || rank < 1)
+    rank++;
+  if (rank > h->count)
+    rank = h->count;
+
+  uint64_t seen = 0;
+  for (size_t b = 0; b < HISTOGRAM_BUCKETS; b++)
+    {
+      seen += h->buckets[b];
+      if (seen >= rank)
+	{
+	  uint64_t high = histogram_bucket_high(b);
+	  return (high < h->max ? high : h->max);
+	}
+    }
+  return h->max;
+}
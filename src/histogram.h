@@ -0,0 +1,35 @@
+/* histogram.h
+ *
+ *    Log bucketed histograms, after HdrHistogram. Values below
+ *    HISTOGRAM_SUB_COUNT have a bucket each; every power of two above
+ *    that is split into HISTOGRAM_SUB_COUNT buckets, so any value is
+ *    known to within 1/16th. Recording a value costs a count of
+ *    leading zeros and an increment; percentiles are read by walking
+ *    the buckets.
+ */
+#ifndef __HISTOGRAM_H__
+#define __HISTOGRAM_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HISTOGRAM_SUB_BITS 4
+#define HISTOGRAM_SUB_COUNT (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_COUNT)
+
+struct Histogram
+{
+  uint64_t count;
+  uint64_t min;
+  uint64_t max;
+  uint64_t sum;
+  uint64_t buckets[HISTOGRAM_BUCKETS];
+};
+
+void histogram_init(struct Histogram *h);
+size_t histogram_bucket(uint64_t value);
+uint64_t histogram_bucket_high(size_t bucket);
+void histogram_record(struct Histogram *h, uint64_t value);
+uint64_t histogram_percentile(const struct Histogram *h, double percent);
+
+#endif /* __HISTOGRAM_H__ */
@@ -0,0 +1,520 @@
+/* hpack.c:
+ *
+ *    Decodes HPACK header blocks: the static and dynamic tables,
+ *    integers, and Huffman coded strings.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hpack.h"
+
+#define HPACK_STATIC_MAX 61
+#define HPACK_HUFFMAN_SYMBOLS 257
+#define HPACK_HUFFMAN_EOS 256
+#define HPACK_HUFFMAN_LONGEST 30
+
+// RFC 7541 counts 32 bytes of overhead per dynamic table entry
+#define HPACK_ENTRY_OVERHEAD 32
+
+struct Hpack_Static
+{
+  const char *name;
+  const char *value;
+};
+
+/* RFC 7541 Appendix A */
+static const struct Hpack_Static static_table[HPACK_STATIC_MAX + 1] = {
+  {NULL, NULL},
+  {":authority", ""},
+  {":method", "GET"},
+  {":method", "POST"},
+  {":path", "/"},
+  {":path", "/index.html"},
+  {":scheme", "http"},
+  {":scheme", "https"},
+  {":status", "200"},
+  {":status", "204"},
+  {":status", "206"},
+  {":status", "304"},
+  {":status", "400"},
+  {":status", "404"},
+  {":status", "500"},
+  {"accept-charset", ""},
+  {"accept-encoding", "gzip, deflate"},
+  {"accept-language", ""},
+  {"accept-ranges", ""},
+  {"accept", ""},
+  {"access-control-allow-origin", ""},
+  {"age", ""},
+  {"allow", ""},
+  {"authorization", ""},
+  {"cache-control", ""},
+  {"content-disposition", ""},
+  {"content-encoding", ""},
+  {"content-language", ""},
+  {"content-length", ""},
+  {"content-location", ""},
+  {"content-range", ""},
+  {"content-type", ""},
+  {"cookie", ""},
+  {"date", ""},
+  {"etag", ""},
+  {"expect", ""},
+  {"expires", ""},
+  {"from", ""},
+  {"host", ""},
+  {"if-match", ""},
+  {"if-modified-since", ""},
+  {"if-none-match", ""},
+  {"if-range", ""},
+  {"if-unmodified-since", ""},
+  {"last-modified", ""},
+  {"link", ""},
+  {"location", ""},
+  {"max-forwards", ""},
+  {"proxy-authenticate", ""},
+  {"proxy-authorization", ""},
+  {"range", ""},
+  {"referer", ""},
+  {"refresh", ""},
+  {"retry-after", ""},
+  {"server", ""},
+  {"set-cookie", ""},
+  {"strict-transport-security", ""},
+  {"transfer-encoding", ""},
+  {"user-agent", ""},
+  {"vary", ""},
+  {"via", ""},
+  {"www-authenticate", ""},
+};
+
+
+/* Code length of each symbol (RFC 7541 Appendix B). The code is
+ * canonical -- codes of one length are consecutive, in symbol order,
+ * and follow on from the shorter ones -- so the lengths are all that
+ * is needed to decode it.
+ */
+static const uint8_t huffman_lengths[HPACK_HUFFMAN_SYMBOLS] = {
+  13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+  28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+  6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+  5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+  13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+  7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+  15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+  6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+  20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+  24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+  22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+  21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+  26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+  19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+  20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+  26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+  30,
+};
+
+static uint32_t first_code[HPACK_HUFFMAN_LONGEST + 1];
+static uint16_t first_symbol[HPACK_HUFFMAN_LONGEST + 1];
+static uint16_t code_count[HPACK_HUFFMAN_LONGEST + 1];
+static uint16_t symbols[HPACK_HUFFMAN_SYMBOLS];
+static bool huffman_ready = false;
+
+
+/* huffman_init:
+ *
+ *    Works out the first code of each length, and the symbols in
+ *    code order, from the code lengths.
+ */
+static void
+huffman_init(void)
+{
+  if (huffman_ready)
+    return;
+
+  memset(code_count, 0, sizeof(code_count));
+  for (int sym = 0; sym < HPACK_HUFFMAN_SYMBOLS; sym++)
+    code_count[huffman_lengths[sym]]++;
+
+  uint32_t code = 0;
+  uint16_t n = 0;
+  for (int len = 1; len <= HPACK_HUFFMAN_LONGEST; len++)
+    {
+      first_code[len] = code;
+      first_symbol[len] = n;
+      for (int sym = 0; sym < HPACK_HUFFMAN_SYMBOLS; sym++)
+	if (huffman_lengths[sym] == len)
+	  symbols[n++] = sym;
+      code = (code + code_count[len]) << 1;
+    }
+
+  huffman_ready = true;
+  return;
+}
+
+
+/* hpack_huffman_decode:
+ *
+ *    Decodes the "length" Huffman coded bytes at "src" into "dst",
+ *    which must have room for length * 8 / 5 bytes. Returns the
+ *    decoded length, or -1 if the string is not validly coded or
+ *    padded.
+ */
+ssize_t
+hpack_huffman_decode(char *dst, const unsigned char *src, size_t length)
+{
+  huffman_init();
+
+  char *out = dst;
+  uint32_t code = 0;
+  unsigned int bits = 0;
+  for (size_t i = 0; i < length; i++)
+    {
+      for (int b = 7; b >= 0; b--)
+	{
+	  code = (code << 1) | ((src[i] >> b) & 1);
+	  bits++;
+	  if (code - first_code[bits] < code_count[bits])
+	    {
+	      uint16_t sym = symbols[first_symbol[bits] + code
+				     - first_code[bits]];
+	      if (HPACK_HUFFMAN_EOS == sym)
+		return -1;
+	      *out++ = sym;
+	      code = 0;
+	      bits = 0;
+	    }
+	  else if (bits >= HPACK_HUFFMAN_LONGEST)
+	    return -1;
+	}
+    }
+
+  // Padding is the first (up to 7) bits of EOS, which are all ones
+  if (bits > 7 || code != (1U << bits) - 1)
+    return -1;
+  return out - dst;
+}
+
+
+/* hpack_decoder_new:
+ *
+ *    Returns a decoder with an empty dynamic table of the default
+ *    size, or NULL if there was a memory allocation error.
+ */
+struct Hpack_Decoder *
+hpack_decoder_new(void)
+{
+  huffman_init();
+
+  struct Hpack_Decoder *hd = malloc(sizeof(struct Hpack_Decoder));
+  if (NULL == hd)
+    return NULL;
+
+  hd->capacity = HPACK_TABLE_SIZE / HPACK_ENTRY_OVERHEAD;
+  hd->entries = malloc(hd->capacity * sizeof(struct Hpack_Entry));
+  hd->scratch_size = 0;
+  hd->scratch = NULL;
+  if (NULL == hd->entries)
+    {
+      free(hd);
+      return NULL;
+    }
+  hd->newest = 0;
+  hd->count = 0;
+  hd->size = 0;
+  hd->max_size = HPACK_TABLE_SIZE;
+  return hd;
+}
+
+
+/* evict:
+ *
+ *    Drops the oldest entries until the table is no bigger than
+ *    "size".
+ */
+static void
+evict(struct Hpack_Decoder *hd, size_t size)
+{
+  while (hd->size > size)
+    {
+      size_t oldest = (hd->newest + hd->capacity - (hd->count - 1))
+	% hd->capacity;
+      struct Hpack_Entry *e = &hd->entries[oldest];
+      hd->size -= e->name_len + e->value_len + HPACK_ENTRY_OVERHEAD;
+      free(e->name);
+      hd->count--;
+    }
+  return;
+}
+
+
+/* hpack_decoder_delete:
+ *
+ *    Frees the dynamic table, scratch space and the decoder.
+ */
+void
+hpack_decoder_delete(struct Hpack_Decoder *hd)
+{
+  evict(hd, 0);
+  free(hd->entries);
+  free(hd->scratch);
+  free(hd);
+  return;
+}
+
+
+/* grow_entries:
+ *
+ *    Doubles the ring, oldest entry first. Returns 0, or -1 if there
+ *    was a memory allocation error.
+ */
+static int
+grow_entries(struct Hpack_Decoder *hd)
+{
+  size_t capacity = hd->capacity * 2;
+  struct Hpack_Entry *entries = malloc(capacity * sizeof(struct Hpack_Entry));
+  if (NULL == entries)
+    return -1;
+
+  for (size_t i = 0; i < hd->count; i++)
+    entries[i] = hd->entries[(hd->newest + hd->capacity - (hd->count - 1)
+			      + i) % hd->capacity];
+  free(hd->entries);
+  hd->entries = entries;
+  hd->capacity = capacity;
+  hd->newest = (hd->count > 0 ? hd->count - 1 : 0);
+  return 0;
+}
+
+
+/* add_entry:
+ *
+ *    Adds a copy of "name: value" as dynamic entry 1, evicting old
+ *    entries to make room. The copy is made first, as "name" may be
+ *    an entry about to go. An entry too big for the table empties it.
+ *    Returns 0, or -1 if there was a memory allocation error.
+ */
+static int
+add_entry(struct Hpack_Decoder *hd, const char *name, size_t name_len,
+	  const char *value, size_t value_len)
+{
+  size_t size = name_len + value_len + HPACK_ENTRY_OVERHEAD;
+  if (size > hd->max_size)
+    {
+      evict(hd, 0);
+      return 0;
+    }
+
+  char *copy = malloc(name_len + value_len + 1);
+  if (NULL == copy)
+    return -1;
+  memcpy(copy, name, name_len);
+  memcpy(copy + name_len, value, value_len);
+
+  evict(hd, hd->max_size - size);
+  if (hd->count == hd->capacity && grow_entries(hd) != 0)
+    {
+      free(copy);
+      return -1;
+    }
+
+  if (hd->count > 0)
+    hd->newest = (hd->newest + 1) % hd->capacity;
+  struct Hpack_Entry *e = &hd->entries[hd->newest];
+  e->name = copy;
+  e->name_len = name_len;
+  e->value_len = value_len;
+  hd->count++;
+  hd->size += size;
+  return 0;
+}
+
+
+/* lookup:
+ *
+ *    Finds entry "index" of the static then dynamic tables. Returns
+ *    0, or -1 if there is no such entry.
+ */
+static int
+lookup(struct Hpack_Decoder *hd, size_t index, const char **name,
+       size_t *name_len, const char **value, size_t *value_len)
+{
+  if (0 == index)
+    return -1;
+
+  if (index <= HPACK_STATIC_MAX)
+    {
+      *name = static_table[index].name;
+      *name_len = strlen(*name);
+      *value = static_table[index].value;
+      *value_len = strlen(*value);
+      return 0;
+    }
+
+  index -= HPACK_STATIC_MAX;
+  if (index > hd->count)
+    return -1;
+  struct Hpack_Entry *e =
+    &hd->entries[(hd->newest + hd->capacity - (index - 1)) % hd->capacity];
+  *name = e->name;
+  *name_len = e->name_len;
+  *value = e->name + e->name_len;
+  *value_len = e->value_len;
+  return 0;
+}
+
+
+/* decode_int:
+ *
+ *    Decodes an integer with a "prefix" bit prefix at *p, and moves
+ *    *p past it. Returns 0, or -1 if it is cut short or too big.
+ */
+static int
+decode_int(const unsigned char **p, const unsigned char *end,
+	   unsigned int prefix, size_t *value)
+{
+  const unsigned char *q = *p;
+  if (q >= end)
+    return -1;
+
+  size_t max = (1U << prefix) - 1;
+  size_t v = *q++ & max;
+  if (v == max)
+    {
+      unsigned int shift = 0;
+      do
+	{
+	  if (q >= end || shift > 28)
+	    return -1;
+	  v += (size_t) (*q & 0x7f) << shift;
+	  shift += 7;
+	}
+      while (*q++ & 0x80);
+    }
+
+  *p = q;
+  *value = v;
+  return 0;
+}
+
+
+/* decode_string:
+ *
+ *    Decodes a string literal at *p, and moves *p past it. Plain
+ *    strings are left where they are; Huffman coded ones are decoded
+ *    into the scratch space at *used, which is moved past them.
+ *    Returns 0, or -1 if the string is cut short or badly coded.
+ */
+static int
+decode_string(struct Hpack_Decoder *hd, const unsigned char **p,
+	      const unsigned char *end, size_t *used, const char **str,
+	      size_t *length)
+{
+  if (*p >= end)
+    return -1;
+
+  bool huffman = ((**p & 0x80) != 0);
+  size_t n = 0;
+  if (decode_int(p, end, 7, &n) != 0 || n > (size_t) (end - *p))
+    return -1;
+
+  if (huffman)
+    {
+      ssize_t decoded = hpack_huffman_decode(hd->scratch + *used, *p, n);
+      if (decoded < 0)
+	return -1;
+      *str = hd->scratch + *used;
+      *length = decoded;
+      *used += decoded;
+    }
+  else
+    {
+      *str = (const char *) *p;
+      *length = n;
+    }
+  *p += n;
+  return 0;
+}
+
+
+/* hpack_decode:
+ *
+ *    Decodes the "length" byte header block at "block", calling "cb"
+ *    (if not NULL) with "data" for each header. Returns HPACK_OK, or
+ *    an hpack_result error.
+ */
+int
+hpack_decode(struct Hpack_Decoder *hd, const char *block, size_t length,
+	     hpack_header_cb cb, void *data)
+{
+  const unsigned char *p = (const unsigned char *) block;
+  const unsigned char *end = p + length;
+
+  // Decoded strings are never longer than 8/5 of the block
+  size_t need = length / 5 * 8 + 8;
+  if (need > hd->scratch_size)
+    {
+      char *scratch = realloc(hd->scratch, need);
+      if (NULL == scratch)
+	return HPACK_ERR_MEMORY;
+      hd->scratch = scratch;
+      hd->scratch_size = need;
+    }
+
+  while (p < end)
+    {
+      const char *name = NULL;
+      const char *value = NULL;
+      size_t name_len = 0, value_len = 0, index = 0, used = 0;
+      bool indexing = false;
+
+      if (*p & 0x80)
+	{
+	  // Indexed header field
+	  if (decode_int(&p, end, 7, &index) != 0
+	      || lookup(hd, index, &name, &name_len, &value, &value_len) != 0)
+	    return HPACK_ERR_DECODE;
+	}
+      else if (0x20 == (*p & 0xe0))
+	{
+	  // Dynamic table size update
+	  if (decode_int(&p, end, 5, &index) != 0
+	      || index > HPACK_TABLE_LIMIT)
+	    return HPACK_ERR_DECODE;
+	  hd->max_size = index;
+	  evict(hd, index);
+	  continue;
+	}
+      else
+	{
+	  // Literal, with incremental indexing, without, or never indexed
+	  indexing = (0x40 == (*p & 0xc0));
+	  if (decode_int(&p, end, (indexing ? 6 : 4), &index) != 0)
+	    return HPACK_ERR_DECODE;
+	  if (index > 0)
+	    {
+	      if (lookup(hd, index, &name, &name_len, &value, &value_len) != 0)
+		return HPACK_ERR_DECODE;
+	    }
+	  else if (decode_string(hd, &p, end, &used, &name, &name_len) != 0)
+	    return HPACK_ERR_DECODE;
+	  if (decode_string(hd, &p, end, &used, &value, &value_len) != 0)
+	    return HPACK_ERR_DECODE;
+	}
+
+      // Call back before adding: the entry may push "name" out
+      if (NULL != cb && cb(data, name, name_len, value, value_len) != 0)
+	return HPACK_ERR_CALLBACK;
+      if (indexing && add_entry(hd, name, name_len, value, value_len) != 0)
+	return HPACK_ERR_MEMORY;
+    }
+
+  return HPACK_OK;
+}
@@ -0,0 +1,70 @@
+/* hpack.h
+ *
+ *    HPACK (RFC 7541) header block decoder, for HTTP/2 HEADERS,
+ *    PUSH_PROMISE and CONTINUATION frames. Each direction of a
+ *    connection has its own decoder, because each keeps a dynamic
+ *    table that later blocks refer back to: every block must be
+ *    decoded, in order, even if its headers are not wanted.
+ *
+ *    hpack_decode calls back once per header with its name and value.
+ *    These point into the block, the decoder's tables or its scratch
+ *    space and are only valid during the callback. Names are lower
+ *    case, as HTTP/2 requires.
+ */
+#ifndef __HPACK_H__
+#define __HPACK_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// Default dynamic table size (SETTINGS_HEADER_TABLE_SIZE)
+#define HPACK_TABLE_SIZE 4096
+
+// Largest dynamic table size update the decoder honours
+#define HPACK_TABLE_LIMIT 65536
+
+enum hpack_result
+{
+  HPACK_OK = 0,
+  HPACK_ERR_CALLBACK = 1,	// The callback returned non-zero
+  HPACK_ERR_DECODE = -1,	// Malformed block; the table is now lost
+  HPACK_ERR_MEMORY = -2
+};
+
+typedef int (*hpack_header_cb) (void *data, const char *name,
+				size_t name_len, const char *value,
+				size_t value_len);
+
+struct Hpack_Entry
+{
+  char *name;			// Name, then value, in one allocation
+  size_t name_len;
+  size_t value_len;
+};
+
+/* Hpack_Decoder:
+ *
+ *    All members should be treated as 'private'.
+ */
+struct Hpack_Decoder
+{
+  struct Hpack_Entry *entries;	// Dynamic table, a ring
+  size_t capacity;		// Entries the ring can hold
+  size_t newest;		// Ring index of dynamic entry 1
+  size_t count;
+  size_t size;			// RFC 7541 size of the entries
+  size_t max_size;		// Current limit, from the encoder
+  char *scratch;		// Huffman decoded strings
+  size_t scratch_size;
+};
+
+struct Hpack_Decoder *hpack_decoder_new(void);
+void hpack_decoder_delete(struct Hpack_Decoder *hd);
+int hpack_decode(struct Hpack_Decoder *hd, const char *block, size_t length,
+		 hpack_header_cb cb, void *data);
+
+ssize_t hpack_huffman_decode(char *dst, const unsigned char *src,
+			     size_t length);
+
+#endif
@@ -0,0 +1,156 @@
+/* http_header_hash.h
+ *
+ *    Generated by build-aux/gen-header-hash.pl from HTTP_HEADER_MAP in
+ *    http_parser.h. Do not edit.
+ */
+#define HTTP_HEADER_HASH_SEED 0x0000051dU
+#define HTTP_HEADER_HASH_BITS 8
+
+static const uint8_t header_hash_slots[256] = {
+  0, 0, 50, 0, 0, 0, 0, 0, 0, 0, 27, 0, 18, 0, 0, 0,
+  0, 0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 56, 45, 0, 1, 9,
+  0, 0, 25, 0, 0, 34, 0, 31, 0, 12, 0, 40, 0, 0, 35, 0,
+  0, 0, 53, 0, 59, 0, 55, 8, 0, 0, 0, 0, 43, 0, 0, 0,
+  7, 52, 0, 0, 0, 0, 0, 36, 61, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 17, 3, 0, 60, 0, 0, 0, 24, 0, 42, 0, 0, 0, 0,
+  57, 58, 0, 0, 0, 0, 0, 0, 0, 0, 0, 37, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 28, 0, 0, 0, 13, 23, 44, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 39, 0, 0, 0,
+  0, 0, 0, 0, 48, 38, 0, 22, 0, 0, 0, 0, 0, 14, 51, 46,
+  0, 0, 0, 29, 0, 0, 0, 0, 6, 0, 0, 0, 47, 0, 54, 0,
+  0, 0, 0, 0, 20, 0, 0, 0, 0, 0, 21, 19, 0, 0, 0, 0,
+  4, 15, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 41, 0, 0, 0,
+  11, 0, 0, 16, 10, 0, 0, 0, 0, 30, 5, 0, 0, 0, 0, 0,
+  0, 0, 0, 32, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 33, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 49, 0, 0, 0, 0, 26, 0,
+};
+
+static const uint32_t header_hashes[] = {
+  0,
+  0x331f2101U,	/* Accept */
+  0xdf730c60U,	/* Accept-Charset */
+  0xe4a2faf1U,	/* Accept-Encoding */
+  0x1e6eabaeU,	/* Accept-Language */
+  0x6db4e66eU,	/* Accept-Ranges */
+  0xb68c5924U,	/* Age */
+  0xdc8acacaU,	/* Allow */
+  0x08e124d6U,	/* Authorization */
+  0x42aa23b5U,	/* Cache-Control */
+  0xbce58f31U,	/* Connection */
+  0x40d4ea04U,	/* Content-Disposition */
+  0x28c9c7e0U,	/* Content-Encoding */
+  0x0571f20bU,	/* Content-Language */
+  0x99b81b25U,	/* Content-Length */
+  0x51b71876U,	/* Content-Location */
+  0x331147c2U,	/* Content-Range */
+  0xb50f7a5dU,	/* Content-Type */
+  0xdf5b6957U,	/* Cookie */
+  0x10ea6e51U,	/* Date */
+  0x456c33d8U,	/* ETag */
+  0x275a02e0U,	/* Expect */
+  0xf2fcba6bU,	/* Expires */
+  0xc098abe3U,	/* Forwarded */
+  0x26d4cb8dU,	/* From */
+  0xb4a5c587U,	/* Host */
+  0xaa93b96dU,	/* HTTP2-Settings */
+  0x73485942U,	/* If-Match */
+  0x91f79b81U,	/* If-Modified-Since */
+  0x425c5dffU,	/* If-None-Match */
+  0xfbbf3c66U,	/* If-Range */
+  0xbaf598d2U,	/* If-Unmodified-Since */
+  0xfafbd818U,	/* Keep-Alive */
+  0xe5dd8e33U,	/* Last-Modified */
+  0x7a2b9a0eU,	/* Location */
+  0xe4490c67U,	/* Origin */
+  0x304aa90dU,	/* Pragma */
+  0xab5ccf37U,	/* Proxy-Authenticate */
+  0xef862913U,	/* Proxy-Authorization */
+  0x93d2045eU,	/* Proxy-Connection */
+  0x1d8144aaU,	/* Range */
+  0x5b827b4eU,	/* Referer */
+  0xcf45d61eU,	/* Retry-After */
+  0x4fa7939bU,	/* Sec-WebSocket-Accept */
+  0x53f5ff89U,	/* Sec-WebSocket-Extensions */
+  0x6792578eU,	/* Sec-WebSocket-Key */
+  0x25cc3653U,	/* Sec-WebSocket-Protocol */
+  0xb37590d9U,	/* Sec-WebSocket-Version */
+  0x69fe766aU,	/* Server */
+  0x2cb95040U,	/* Set-Cookie */
+  0x8668146aU,	/* TE */
+  0xc6167688U,	/* Trailer */
+  0xd195a8d4U,	/* Transfer-Encoding */
+  0x9aad3c9fU,	/* Upgrade */
+  0xfd487be6U,	/* User-Agent */
+  0xef7bed4dU,	/* Vary */
+  0x7610a80bU,	/* Via */
+  0xa8674807U,	/* Warning */
+  0xda1bc17aU,	/* WWW-Authenticate */
+  0x74f4b1c0U,	/* X-Forwarded-For */
+  0x76f4f9a1U,	/* X-Forwarded-Proto */
+  0x40111b59U,	/* X-Requested-With */
+};
+
+static const char *header_lower_names[] = {
+  "",
+  "accept",
+  "accept-charset",
+  "accept-encoding",
+  "accept-language",
+  "accept-ranges",
+  "age",
+  "allow",
+  "authorization",
+  "cache-control",
+  "connection",
+  "content-disposition",
+  "content-encoding",
+  "content-language",
+  "content-length",
+  "content-location",
+  "content-range",
+  "content-type",
+  "cookie",
+  "date",
+  "etag",
+  "expect",
+  "expires",
+  "forwarded",
+  "from",
+  "host",
+  "http2-settings",
+  "if-match",
+  "if-modified-since",
+  "if-none-match",
+  "if-range",
+  "if-unmodified-since",
+  "keep-alive",
+  "last-modified",
+  "location",
+  "origin",
+  "pragma",
+  "proxy-authenticate",
+  "proxy-authorization",
+  "proxy-connection",
+  "range",
+  "referer",
+  "retry-after",
+  "sec-websocket-accept",
+  "sec-websocket-extensions",
+  "sec-websocket-key",
+  "sec-websocket-protocol",
+  "sec-websocket-version",
+  "server",
+  "set-cookie",
+  "te",
+  "trailer",
+  "transfer-encoding",
+  "upgrade",
+  "user-agent",
+  "vary",
+  "via",
+  "warning",
+  "www-authenticate",
+  "x-forwarded-for",
+  "x-forwarded-proto",
+  "x-requested-with",
+};
@@ -0,0 +1,398 @@
+/* http_message.c:
+ *
+ *    Builds a HTTP message head from the parser callbacks, looks up
+ *    headers by id and rewrites them.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <assert.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "util.h"
+
+#include "http_message.h"
+
+
+/* http_message_new:
+ *
+ *    Creates an empty message whose tokens may point into
+ *    "read_buffer" (of "read_size" bytes). Returns NULL if there was
+ *    a memory allocation error.
+ */
+struct Http_Message *
+http_message_new(const char *read_buffer, size_t read_size)
+{
+  struct Http_Message *msg = malloc(sizeof(struct Http_Message));
+  if (msg != NULL)
+    {
+      msg->tokens = header_buffer_new(read_buffer, read_size);
+      if (NULL == msg->tokens)
+	{
+	  free(msg);
+	  return NULL;
+	}
+      http_message_clear(msg);
+    }
+  return msg;
+}
+
+
+/* http_message_delete:
+ *
+ *    Deallocates the tokens and then the message itself.
+ */
+void
+http_message_delete(struct Http_Message *msg)
+{
+  header_buffer_delete(msg->tokens);
+  free(msg);
+  return;
+}
+
+
+/* http_message_clear:
+ *
+ *    Forgets the current message, ready for the next. Does not free
+ *    any memory.
+ */
+void
+http_message_clear(struct Http_Message *msg)
+{
+  assert(msg != NULL);
+
+  header_buffer_clear(msg->tokens);
+  for (int i = 0; i < HTTP_HEADER_MAX; i++)
+    msg->index[i] = -1;
+
+  msg->type = HTTP_REQUEST;
+  msg->method = 0;
+  msg->status_code = 0;
+  msg->http_major = 1;
+  msg->http_minor = 1;
+  msg->content_length = ULLONG_MAX;
+  msg->chunked = false;
+  msg->keep_alive = false;
+  msg->upgrade = false;
+  msg->head_complete = false;
+  return;
+}
+
+
+/* http_message_retain:
+ *
+ *    Must be called before the read buffer is overwritten (see
+ *    header_buffer_retain).
+ */
+void
+http_message_retain(struct Http_Message *msg)
+{
+  header_buffer_retain(msg->tokens);
+  return;
+}
+
+
+/* first_field:
+ *
+ *    Token index of header 0. The URL or status text, when there is
+ *    one, always comes first.
+ */
+static size_t
+first_field(struct Http_Message *msg)
+{
+  if (header_buffer_count(msg->tokens) > 0
+      && HB_URL == header_buffer_type(msg->tokens, 0))
+    return 1;
+  return 0;
+}
+
+
+/* reindex:
+ *
+ *    Rebuilds the header id index after headers were inserted or
+ *    removed.
+ */
+static void
+reindex(struct Http_Message *msg)
+{
+  for (int i = 0; i < HTTP_HEADER_MAX; i++)
+    msg->index[i] = -1;
+
+  size_t count = http_message_header_count(msg);
+  for (size_t n = count; n-- > 0;)
+    msg->index[http_message_header_id(msg, n)] = n;
+  msg->index[HTTP_HEADER_UNKNOWN] = -1;
+  return;
+}
+
+
+/* http_message_on_url:
+ *
+ *    Call from on_url (requests) or on_status (responses). The
+ *    parser may deliver the token in pieces. Returns 0 on success.
+ */
+int
+http_message_on_url(struct Http_Message *msg, const char *at, size_t length)
+{
+  return header_buffer_add(msg->tokens, HB_URL, at, length);
+}
+
+
+/* http_message_on_header_field:
+ *
+ *    Call from on_header_field. The parser only sets header_id on the
+ *    call that completes the name, so the id is (re)recorded on every
+ *    piece. Returns 0 on success.
+ */
+int
+http_message_on_header_field(struct Http_Message *msg, http_parser * parser,
+			     const char *at, size_t length)
+{
+  if (header_buffer_add(msg->tokens, HB_FIELD, at, length) != 0)
+    return -1;
+
+  size_t idx = header_buffer_count(msg->tokens) - 1;
+  header_buffer_set_tag(msg->tokens, idx, parser->header_id);
+
+  if (HTTP_HEADER_UNKNOWN != parser->header_id
+      && msg->index[parser->header_id] < 0)
+    msg->index[parser->header_id] = (idx - first_field(msg)) / 2;
+
+  return 0;
+}
+
+
+/* http_message_on_header_value:
+ *
+ *    Call from on_header_value. Returns 0 on success.
+ */
+int
+http_message_on_header_value(struct Http_Message *msg, const char *at,
+			     size_t length)
+{
+  return header_buffer_add(msg->tokens, HB_VALUE, at, length);
+}
+
+
+/* http_message_on_headers_complete:
+ *
+ *    Call from on_headers_complete. Copies the start line and body
+ *    framing out of the parser.
+ */
+void
+http_message_on_headers_complete(struct Http_Message *msg,
+				 http_parser * parser)
+{
+  msg->type = parser->type;
+  msg->method = parser->method;
+  msg->status_code = parser->status_code;
+  msg->http_major = parser->http_major;
+  msg->http_minor = parser->http_minor;
+  msg->content_length = parser->content_length;
+  msg->chunked = ((parser->flags & F_CHUNKED) != 0);
+  msg->keep_alive = (http_should_keep_alive(parser) != 0);
+  msg->upgrade = (parser->upgrade != 0);
+  msg->head_complete = true;
+  return;
+}
+
+
+/* http_message_url:
+ *
+ *    Returns the URL (requests) or status text (responses) and sets
+ *    "length". Returns NULL with length 0 if there was none.
+ */
+const char *
+http_message_url(struct Http_Message *msg, size_t *length)
+{
+  if (first_field(msg) > 0)
+    return header_buffer_token(msg->tokens, 0, length);
+  *length = 0;
+  return NULL;
+}
+
+
+/* http_message_header_count:
+ *
+ *    Returns the number of headers (field and value pairs).
+ */
+size_t
+http_message_header_count(struct Http_Message *msg)
+{
+  return (header_buffer_count(msg->tokens) - first_field(msg) + 1) / 2;
+}
+
+
+/* http_message_find:
+ *
+ *    Returns the number of the first header with "id", or -1 if there
+ *    is none. HTTP_HEADER_UNKNOWN is never found.
+ */
+ssize_t
+http_message_find(struct Http_Message *msg, enum http_header_id id)
+{
+  assert(id < HTTP_HEADER_MAX);
+  return msg->index[id];
+}
+
+
+/* http_message_header_id:
+ *
+ *    Returns the id of header "n" (HTTP_HEADER_UNKNOWN if the name is
+ *    not well known).
+ */
+enum http_header_id
+http_message_header_id(struct Http_Message *msg, size_t n)
+{
+  return header_buffer_tag(msg->tokens, first_field(msg) + 2 * n);
+}
+
+
+/* http_message_field:
+ *
+ *    Returns the name of header "n" as sent, and sets "length". Not
+ *    NUL terminated, and only valid until the message is modified.
+ */
+const char *
+http_message_field(struct Http_Message *msg, size_t n, size_t *length)
+{
+  return header_buffer_token(msg->tokens, first_field(msg) + 2 * n, length);
+}
+
+
+/* http_message_value:
+ *
+ *    Returns the value of header "n" and sets "length". A header whose
+ *    value has not arrived yet has an empty value.
+ */
+const char *
+http_message_value(struct Http_Message *msg, size_t n, size_t *length)
+{
+  size_t idx = first_field(msg) + 2 * n + 1;
+  if (idx >= header_buffer_count(msg->tokens))
+    {
+      *length = 0;
+      return "";
+    }
+  return header_buffer_token(msg->tokens, idx, length);
+}
+
+
+/* http_message_get:
+ *
+ *    Returns the value of the first header with "id" and sets
+ *    "length", or NULL if there is no such header.
+ */
+const char *
+http_message_get(struct Http_Message *msg, enum http_header_id id,
+		 size_t *length)
+{
+  ssize_t n = http_message_find(msg, id);
+  if (n < 0)
+    {
+      *length = 0;
+      return NULL;
+    }
+  return http_message_value(msg, n, length);
+}
+
+
+/* http_message_set_value:
+ *
+ *    Replaces the value of header "n" with a copy of "value". Returns
+ *    0 on success or -1 on memory allocation error.
+ */
+int
+http_message_set_value(struct Http_Message *msg, size_t n, const char *value,
+		       size_t length)
+{
+  assert(n < http_message_header_count(msg));
+  return header_buffer_set(msg->tokens, first_field(msg) + 2 * n + 1, value,
+			   length);
+}
+
+
+/* http_message_insert:
+ *
+ *    Inserts a copy of header "field: value" before header "n" ("n"
+ *    equal to the header count appends). Returns 0 on success or -1
+ *    on memory allocation error.
+ */
+int
+http_message_insert(struct Http_Message *msg, size_t n, const char *field,
+		    size_t field_length, const char *value,
+		    size_t value_length)
+{
+  assert(n <= http_message_header_count(msg));
+
+  size_t idx = first_field(msg) + 2 * n;
+  if (header_buffer_insert(msg->tokens, idx, HB_FIELD, field, field_length)
+      != 0)
+    return -1;
+  if (header_buffer_insert(msg->tokens, idx + 1, HB_VALUE, value,
+			   value_length) != 0)
+    {
+      header_buffer_remove(msg->tokens, idx, 1);
+      return -1;
+    }
+  header_buffer_set_tag(msg->tokens, idx,
+			http_header_lookup(field, field_length));
+
+  reindex(msg);
+  return 0;
+}
+
+
+/* http_message_remove:
+ *
+ *    Removes header "n".
+ */
+void
+http_message_remove(struct Http_Message *msg, size_t n)
+{
+  assert(n < http_message_header_count(msg));
+
+  size_t idx = first_field(msg) + 2 * n;
+  size_t tokens = (idx + 1 < header_buffer_count(msg->tokens) ? 2 : 1);
+  header_buffer_remove(msg->tokens, idx, tokens);
+  reindex(msg);
+  return;
+}
+
+
+/* http_message_write_head:
+ *
+ *    Writes the request or status line, the headers and the blank
+ *    line that ends them to "fd". Returns bytes written.
+ */
+ssize_t
+http_message_write_head(struct Http_Message *msg, int fd)
+{
+  char prefix[LINE_MAX];
+  char suffix[LINE_MAX];
+
+  if (HTTP_REQUEST == msg->type)
+    {
+      snprintf(prefix, LINE_MAX, "%s ", http_method_str(msg->method));
+      snprintf(suffix, LINE_MAX, " HTTP/%d.%d\r\n", msg->http_major,
+	       msg->http_minor);
+    }
+  else
+    {
+      snprintf(prefix, LINE_MAX, "HTTP/%d.%d %d ", msg->http_major,
+	       msg->http_minor, msg->status_code);
+      snprintf(suffix, LINE_MAX, "\r\n");
+    }
+
+  ssize_t total = header_buffer_write_line(msg->tokens, fd, prefix, suffix);
+  total += header_buffer_write(msg->tokens, fd, 0, SIZE_MAX);
+  total += write_all(fd, "\r\n", 2);
+  return total;
+}
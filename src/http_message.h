@@ -0,0 +1,87 @@
+/* http_message.h
+ *
+ *    A parsed HTTP message head, built once per message from the
+ *    http_parser callbacks and shared by the tools. Holds the start
+ *    line, the header fields and values as slices into the read
+ *    buffer (see header_buffer.h), an index from well known header id
+ *    to the first header with that id, and the body framing the
+ *    parser worked out. Tools query and rewrite the message, then
+ *    write its head back out, instead of re-accumulating header text.
+ *
+ *    Headers are numbered from 0 in the order they arrived.
+ */
+#ifndef __HTTP_MESSAGE_H__
+#define __HTTP_MESSAGE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "http_parser.h"
+#include "header_buffer.h"
+
+/* Http_Message:
+ *
+ *    Start line and framing members are read-only, and only valid
+ *    once http_message_on_headers_complete has been called. The rest
+ *    should be treated as 'private'.
+ */
+struct Http_Message
+{
+  // Start line
+  unsigned int type:2;		// HTTP_REQUEST or HTTP_RESPONSE
+  unsigned int method:8;	// enum http_method (requests)
+  unsigned int status_code:16;	// Responses
+  unsigned short http_major;
+  unsigned short http_minor;
+
+  // Body framing
+  uint64_t content_length;	// ULLONG_MAX if there was none
+  bool chunked;
+  bool keep_alive;
+  bool upgrade;
+  bool head_complete;
+
+  // private
+  struct Header_Buffer *tokens;	// URL (or status text), fields and values
+  ssize_t index[HTTP_HEADER_MAX];	// First header number per id, or -1
+};
+
+struct Http_Message *http_message_new(const char *read_buffer,
+				      size_t read_size);
+void http_message_delete(struct Http_Message *msg);
+void http_message_clear(struct Http_Message *msg);
+void http_message_retain(struct Http_Message *msg);
+
+int http_message_on_url(struct Http_Message *msg, const char *at,
+			size_t length);
+int http_message_on_header_field(struct Http_Message *msg,
+				 http_parser * parser, const char *at,
+				 size_t length);
+int http_message_on_header_value(struct Http_Message *msg, const char *at,
+				 size_t length);
+void http_message_on_headers_complete(struct Http_Message *msg,
+				      http_parser * parser);
+
+const char *http_message_url(struct Http_Message *msg, size_t *length);
+size_t http_message_header_count(struct Http_Message *msg);
+ssize_t http_message_find(struct Http_Message *msg, enum http_header_id id);
+enum http_header_id http_message_header_id(struct Http_Message *msg,
+					   size_t n);
+const char *http_message_field(struct Http_Message *msg, size_t n,
+			       size_t *length);
+const char *http_message_value(struct Http_Message *msg, size_t n,
+			       size_t *length);
+const char *http_message_get(struct Http_Message *msg, enum http_header_id id,
+			     size_t *length);
+
+int http_message_set_value(struct Http_Message *msg, size_t n,
+			   const char *value, size_t length);
+int http_message_insert(struct Http_Message *msg, size_t n,
+			const char *field, size_t field_length,
+			const char *value, size_t value_length);
+void http_message_remove(struct Http_Message *msg, size_t n);
+
+ssize_t http_message_write_head(struct Http_Message *msg, int fd);
+
+#endif
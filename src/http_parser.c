@@ -22,6 +22,8 @@
  * IN THE SOFTWARE.
  */
 #include "http_parser.h"
+#include "http_scan.h"		/* [HISSO] */
+#include "probes.h"		/* [HISSO] */
 #include <assert.h>
 #include <stddef.h>
 #include <ctype.h>
@@ -81,12 +83,28 @@ do {                                                                 \
 #endif
 
 
+/* [HISSO] Which callbacks this build of the parser supports */
+#ifndef HTTP_PARSER_CALLBACKS
+# define HTTP_PARSER_CALLBACKS HTTP_CB_ALL
+#endif
+#define CALLBACK_COMPILED(FOR) ((HTTP_PARSER_CALLBACKS) & HTTP_CB_##FOR)
+
+/* [HISSO] Tracepoints (see probes.h) at the notify callbacks, which
+ * fire whether or not this build makes the callback */
+#define PROBE_NOTIFY_message_begin(P)                                \
+  PROBE2(message__begin, (P), (int) (P)->type)
+#define PROBE_NOTIFY_message_complete(P)                             \
+  PROBE2(message__complete, (P), (int) (P)->type)
+#define PROBE_NOTIFY_chunk_header(P)
+#define PROBE_NOTIFY_chunk_complete(P)
+
 /* Run the notify callback FOR, returning ER if it fails */
 #define CALLBACK_NOTIFY_(FOR, ER)                                    \
 do {                                                                 \
   assert(HTTP_PARSER_ERRNO(parser) == HPE_OK);                       \
+  PROBE_NOTIFY_##FOR(parser);                                        \
                                                                      \
-  if (LIKELY(settings->on_##FOR)) {                                  \
+  if (CALLBACK_COMPILED(FOR) && LIKELY(settings->on_##FOR)) {        \
     parser->state = CURRENT_STATE();                                 \
     if (UNLIKELY(0 != settings->on_##FOR(parser))) {                 \
       SET_ERRNO(HPE_CB_##FOR);                                       \
@@ -111,7 +129,7 @@ do {                                                                 \
 do {                                                                 \
   assert(HTTP_PARSER_ERRNO(parser) == HPE_OK);                       \
                                                                      \
-  if (FOR##_mark) {                                                  \
+  if (CALLBACK_COMPILED(FOR) && FOR##_mark) {                        \
     if (LIKELY(settings->on_##FOR)) {                                \
       parser->state = CURRENT_STATE();                               \
       if (UNLIKELY(0 !=                                              \
@@ -140,7 +158,7 @@ do {                                                                 \
 /* Set the mark FOR; non-destructive if mark is already set */
 #define MARK(FOR)                                                    \
 do {                                                                 \
-  if (!FOR##_mark) {                                                 \
+  if (CALLBACK_COMPILED(FOR) && !FOR##_mark) {                       \
     FOR##_mark = p;                                                  \
   }                                                                  \
 } while (0)
@@ -183,6 +201,75 @@ static const char *method_strings[] = {
 };
 
 
+/* [HISSO] Well known header names, by enum http_header_id */
+static const char *header_strings[] = {
+#define XX(num, name, string) #string,
+  HTTP_HEADER_MAP (XX)
+#undef XX
+};
+
+#include "http_header_hash.h"	/* [HISSO] */
+
+/* [HISSO] FNV-1a over the lowercased name, and its table slot */
+#define HEADER_HASH_FOLD(h, c) (((h) ^ (uint8_t) (c)) * 16777619U)
+#define HEADER_HASH_SLOT(h)                                          \
+  (((h) ^ ((h) >> 16)) & ((1U << HTTP_HEADER_HASH_BITS) - 1))
+
+
+/* [HISSO] header_id_lookup:
+ *
+ * Finds the well known header whose name has hash "hash" and length
+ * "len". The last "tail_len" bytes of the name are at "tail" (all of
+ * it, unless the name was split across calls) and are compared
+ * exactly. Earlier pieces of a split name were compared by
+ * header_id_narrow, and only ids still set in "match" can be found.
+ */
+static uint8_t
+header_id_lookup (uint32_t hash, size_t len, const char *tail,
+		  size_t tail_len, uint64_t match)
+{
+  uint8_t id = header_hash_slots[HEADER_HASH_SLOT (hash)];
+
+  if (id == HTTP_HEADER_UNKNOWN || header_hashes[id] != hash)
+    return HTTP_HEADER_UNKNOWN;
+  if (!(match & ((uint64_t) 1 << id)))
+    return HTTP_HEADER_UNKNOWN;
+  if (strlen (header_lower_names[id]) != len || tail_len > len)
+    return HTTP_HEADER_UNKNOWN;
+  if (!http_scan_caseeq (tail, header_lower_names[id] + len - tail_len,
+			 tail_len))
+    return HTTP_HEADER_UNKNOWN;
+  return id;
+}
+
+/* Each id is a bit of http_parser.header_match */
+typedef char header_match_fits[HTTP_HEADER_MAX <= 64 ? 1 : -1];
+
+/* [HISSO] header_id_narrow:
+ *
+ * A name is being split across calls: "piece" is its part in this
+ * call, ending "len" bytes into the name. Returns "match" without the
+ * ids of the well known names that this piece rules out, so the part
+ * header_id_lookup no longer sees is still compared exactly.
+ */
+static uint64_t
+header_id_narrow (uint64_t match, size_t len, const char *piece,
+		  size_t piece_len)
+{
+  for (int id = 1; id < HTTP_HEADER_MAX; id++)
+  {
+    if (!(match & ((uint64_t) 1 << id)))
+      continue;
+    if (strlen (header_lower_names[id]) < len
+	|| !http_scan_caseeq (piece,
+			      header_lower_names[id] + len - piece_len,
+			      piece_len))
+      match &= ~((uint64_t) 1 << id);
+  }
+  return match;
+}
+
+
 /* Tokens as defined by rfc 2616. Also lowercases them.
  *        token       = 1*<any CHAR except CTLs or separators>
  *     separators     = "(" | ")" | "<" | ">" | "@"
@@ -297,7 +384,9 @@ enum state
     s_header_field_start, s_header_field, s_header_value_discard_ws,
     s_header_value_discard_ws_almost_done, s_header_value_discard_lws,
     s_header_value_start, s_header_value, s_header_value_lws,
-    s_header_almost_done, s_chunk_size_start, s_chunk_size,
+    s_header_almost_done, s_header_skip_name, s_header_skip,
+    s_header_skip_almost_done, s_header_skip_lws,
+    s_chunk_size_start, s_chunk_size,
     s_chunk_parameters, s_chunk_size_almost_done, s_headers_almost_done,
     s_headers_done
     /* Important: 's_headers_done' must be the last 'header' state. All
@@ -577,6 +666,33 @@ parse_url_char (enum state s, const char ch)
   return s_dead;
 }
 
+/* [HISSO] callbacks_compiled:
+ *
+ *    Returns 0 if "settings" has a callback this build of the parser
+ *    does not make (see HTTP_PARSER_CALLBACKS).
+ */
+static int
+callbacks_compiled (const http_parser_settings * settings)
+{
+#define CHECK_CALLBACK(FOR)                                          \
+  if (settings->on_##FOR && !CALLBACK_COMPILED(FOR))                 \
+    return 0;
+
+  CHECK_CALLBACK (message_begin);
+  CHECK_CALLBACK (url);
+  CHECK_CALLBACK (status);
+  CHECK_CALLBACK (header_field);
+  CHECK_CALLBACK (header_value);
+  CHECK_CALLBACK (headers_complete);
+  CHECK_CALLBACK (body);
+  CHECK_CALLBACK (message_complete);
+  CHECK_CALLBACK (chunk_header);
+  CHECK_CALLBACK (chunk_complete);
+#undef CHECK_CALLBACK
+  return 1;
+}
+
+
 size_t
 http_parser_execute (http_parser * parser,
 		     const http_parser_settings * settings,
@@ -590,6 +706,7 @@ http_parser_execute (http_parser * parser,
   const char *url_mark = 0;
   const char *body_mark = 0;
   const char *status_mark = 0;
+  const char *field_continued = 0;
   enum state p_state = (enum state) parser->state;
 
   /* We're in an error state. Don't bother doing anything. */
@@ -622,10 +739,15 @@ http_parser_execute (http_parser * parser,
   }
 
 
+  assert (callbacks_compiled (settings));
+
   if (CURRENT_STATE () == s_header_field)
-    header_field_mark = data;
+  {
+    field_continued = data;
+    MARK (header_field);
+  }
   if (CURRENT_STATE () == s_header_value)
-    header_value_mark = data;
+    MARK (header_value);
   switch (CURRENT_STATE ())
   {
   case s_req_path:
@@ -639,10 +761,10 @@ http_parser_execute (http_parser * parser,
   case s_req_query_string:
   case s_req_fragment_start:
   case s_req_fragment:
-    url_mark = data;
+    MARK (url);
     break;
   case s_res_status:
-    status_mark = data;
+    MARK (status);
     break;
   default:
     break;
@@ -906,6 +1028,20 @@ http_parser_execute (http_parser * parser,
       }
 
     case s_res_status:
+      {
+	/* [HISSO] Skip over the status text in bulk */
+	const char *stop = http_scan_crlf (p, data + len);
+	if (stop == data + len)
+	{
+	  COUNT_HEADER_SIZE (stop - p - 1);
+	  p = stop - 1;
+	  break;
+	}
+	COUNT_HEADER_SIZE (stop - p);
+	p = stop;
+	ch = *p;
+      }
+
       if (ch == CR)
       {
 	UPDATE_STATE (s_res_line_almost_done);
@@ -1190,6 +1326,24 @@ http_parser_execute (http_parser * parser,
     case s_req_fragment_start:
     case s_req_fragment:
       {
+	/* [HISSO] Plain URL characters leave these states unchanged,
+	 * so skip over them in bulk */
+	if (CURRENT_STATE () == s_req_path
+	    || CURRENT_STATE () == s_req_query_string
+	    || CURRENT_STATE () == s_req_fragment)
+	{
+	  const char *stop = http_scan_url (p, data + len);
+	  if (stop == data + len)
+	  {
+	    COUNT_HEADER_SIZE (stop - p - 1);
+	    p = stop - 1;
+	    break;
+	  }
+	  COUNT_HEADER_SIZE (stop - p);
+	  p = stop;
+	  ch = *p;
+	}
+
 	switch (ch)
 	{
 	case ' ':
@@ -1372,9 +1526,22 @@ http_parser_execute (http_parser * parser,
 	  goto error;
 	}
 
+	/* [HISSO] The framing headers all start with one of these */
+	if (parser->framing_only && c != 'c' && c != 'p' && c != 't'
+	    && c != 'u')
+	{
+	  UPDATE_STATE (s_header_skip_name);
+	  REEXECUTE ();
+	}
+
 	MARK (header_field);
 
 	parser->index = 0;
+	/* [HISSO] Start the name's hash for header_id_lookup */
+	parser->header_id = HTTP_HEADER_UNKNOWN;
+	parser->header_hash = HEADER_HASH_FOLD (HTTP_HEADER_HASH_SEED, c);
+	parser->header_len = 1;
+	parser->header_match = ~(uint64_t) 0;
 	UPDATE_STATE (s_header_field);
 
 	switch (c)
@@ -1405,6 +1572,7 @@ http_parser_execute (http_parser * parser,
     case s_header_field:
       {
 	const char *start = p;
+	uint32_t hash = parser->header_hash;	/* [HISSO] */
 	for (; p != data + len; p++)
 	{
 	  ch = *p;
@@ -1413,6 +1581,10 @@ http_parser_execute (http_parser * parser,
 	  if (!c)
 	    break;
 
+	  /* [HISSO] */
+	  if (CALLBACK_COMPILED (header_field))
+	    hash = HEADER_HASH_FOLD (hash, c);
+
 	  switch (parser->header_state)
 	  {
 	  case h_general:
@@ -1535,6 +1707,13 @@ http_parser_execute (http_parser * parser,
 
 	COUNT_HEADER_SIZE (p - start);
 
+	/* [HISSO] */
+	parser->header_hash = hash;
+	if ((size_t) parser->header_len + (p - start) > UINT8_MAX)
+	  parser->header_len = UINT8_MAX;
+	else
+	  parser->header_len += (p - start);
+
 	if (p == data + len)
 	{
 	  --p;
@@ -1543,6 +1722,22 @@ http_parser_execute (http_parser * parser,
 
 	if (ch == ':')
 	{
+	  /* [HISSO] Not a framing header after all. Unless some of the
+	   * name was already called back, skip the rest of the line.
+	   */
+	  if (parser->framing_only && parser->header_state == h_general
+	      && header_field_mark != field_continued)
+	  {
+	    header_field_mark = 0;
+	    UPDATE_STATE (s_header_skip);
+	    break;
+	  }
+
+	  /* [HISSO] Only the on_header_field callback can see the id */
+	  if (CALLBACK_COMPILED (header_field))
+	    parser->header_id =
+	      header_id_lookup (hash, parser->header_len, header_field_mark,
+				p - header_field_mark, parser->header_match);
 	  UPDATE_STATE (s_header_value_discard_ws);
 	  CALLBACK_DATA (header_field);
 	  break;
@@ -1671,29 +1866,17 @@ http_parser_execute (http_parser * parser,
 	  {
 	  case h_general:
 	    {
-	      const char *p_cr;
-	      const char *p_lf;
+	      const char *stop;
 	      size_t limit = data + len - p;
 
 	      limit = MIN (limit, HTTP_MAX_HEADER_SIZE);
 
-	      p_cr = (const char *) memchr (p, CR, limit);
-	      p_lf = (const char *) memchr (p, LF, limit);
-	      if (p_cr != NULL)
-	      {
-		if (p_lf != NULL && p_cr >= p_lf)
-		  p = p_lf;
-		else
-		  p = p_cr;
-	      }
-	      else if (UNLIKELY (p_lf != NULL))
-	      {
-		p = p_lf;
-	      }
-	      else
-	      {
+	      /* [HISSO] One pass for whichever of CR or LF comes first */
+	      stop = http_scan_crlf (p, p + limit);
+	      if (stop == p + limit)
 		p = data + len;
-	      }
+	      else
+		p = stop;
 	      --p;
 
 	      break;
@@ -1912,6 +2095,76 @@ http_parser_execute (http_parser * parser,
 	REEXECUTE ();
       }
 
+    /* [HISSO] Framing only: find the end of the line with memchr */
+    case s_header_skip_name:
+      {
+	/* [HISSO] Framing only: the name is still checked as
+	 * s_header_field checks it, so a bad line fails either way */
+	const char *start = p;
+	for (; p != data + len && TOKEN (*p); p++);
+
+	COUNT_HEADER_SIZE (p - start);
+
+	if (p == data + len)
+	{
+	  --p;
+	  break;
+	}
+
+	if (UNLIKELY (*p != ':'))
+	{
+	  SET_ERRNO (HPE_INVALID_HEADER_TOKEN);
+	  goto error;
+	}
+
+	UPDATE_STATE (s_header_skip);
+	break;
+      }
+
+    case s_header_skip:
+      {
+	/* [HISSO] Framing only: find the end of the value in one pass */
+	const char *stop = http_scan_crlf (p, data + len);
+
+	if (stop == data + len)
+	{
+	  COUNT_HEADER_SIZE (data + len - 1 - p);
+	  p = data + len - 1;
+	  break;
+	}
+
+	COUNT_HEADER_SIZE (stop - p);
+	p = stop;
+	if (*p == CR)
+	{
+	  UPDATE_STATE (s_header_skip_almost_done);
+	  break;
+	}
+
+	UPDATE_STATE (s_header_skip_lws);
+	break;
+      }
+
+    case s_header_skip_almost_done:
+      {
+	STRICT_CHECK (ch != LF);
+	UPDATE_STATE (s_header_skip_lws);
+	break;
+      }
+
+    case s_header_skip_lws:
+      {
+	/* A folded line carries on the skipped header */
+	if (ch == ' ' || ch == '\t')
+	{
+	  UPDATE_STATE (s_header_skip);
+	  break;
+	}
+
+	UPDATE_STATE (s_header_field_start);
+	REEXECUTE ();
+      }
+
     case s_header_value_discard_ws_almost_done:
       {
 	STRICT_CHECK (ch != LF);
@@ -1968,11 +2221,15 @@ http_parser_execute (http_parser * parser,
 
 	UPDATE_STATE (s_headers_done);
 
-	/* Set this here so that on_headers_complete() callbacks can see it */
+	/* Set this here so that on_headers_complete() callbacks can see it.
+	 * [HISSO] A response only switches with 101: any other may just
+	 * advertise an upgrade (as a 200 with "Upgrade: h2,h2c" does).
+	 */
 	parser->upgrade =
-	  ((parser->flags & (F_UPGRADE | F_CONNECTION_UPGRADE)) ==
-	   (F_UPGRADE | F_CONNECTION_UPGRADE) ||
-	   parser->method == HTTP_CONNECT);
+	  (((parser->flags & (F_UPGRADE | F_CONNECTION_UPGRADE)) ==
+	    (F_UPGRADE | F_CONNECTION_UPGRADE)
+	    && (parser->type == HTTP_REQUEST || parser->status_code == 101))
+	   || parser->method == HTTP_CONNECT);
 
 	/* Here we call the headers_complete callback. This is somewhat
 	 * different than other callbacks because if the user returns 1, we
@@ -2129,17 +2386,32 @@ http_parser_execute (http_parser * parser,
 
     case s_chunk_size_start:
       {
+	const char *stop;
+	uint64_t size;
+
 	assert (parser->nread == 1);
 	assert (parser->flags & F_CHUNKED);
 
-	unhex_val = unhex[(unsigned char) ch];
-	if (UNLIKELY (unhex_val == -1))
+	/* [HISSO] All the digits in the buffer at once (any more come
+	 * one at a time in s_chunk_size)
+	 */
+	stop = http_scan_hex (p, data + len, &size);
+	if (UNLIKELY (stop == p))
 	{
 	  SET_ERRNO (HPE_INVALID_CHUNK_SIZE);
 	  goto error;
 	}
 
-	parser->content_length = unhex_val;
+	/* Overflow? The limit s_chunk_size tests before its last digit. */
+	if (UNLIKELY ((ULLONG_MAX - 16) / 16 < (size >> 4)))
+	{
+	  SET_ERRNO (HPE_INVALID_CONTENT_LENGTH);
+	  goto error;
+	}
+
+	COUNT_HEADER_SIZE (stop - p - 1);
+	parser->content_length = size;
+	p = stop - 1;
 	UPDATE_STATE (s_chunk_size);
 	break;
       }
@@ -2279,6 +2551,13 @@ http_parser_execute (http_parser * parser,
 	   (url_mark ? 1 : 0) +
 	   (body_mark ? 1 : 0) + (status_mark ? 1 : 0)) <= 1);
 
+  /* [HISSO] The name goes on in the next call, where this piece of it
+   * is gone: compare it against the well known names now */
+  if (CALLBACK_COMPILED (header_field) && header_field_mark)
+    parser->header_match =
+      header_id_narrow (parser->header_match, parser->header_len,
+			header_field_mark, p - header_field_mark);
+
   CALLBACK_DATA_NOADVANCE (header_field);
   CALLBACK_DATA_NOADVANCE (header_value);
   CALLBACK_DATA_NOADVANCE (url);
@@ -2348,6 +2627,26 @@ http_should_keep_alive (const http_parser * parser)
 }
 
 
+/* [HISSO] */
+const char *
+http_header_str (enum http_header_id h)
+{
+  return ELEM_AT (header_strings, h, "<unknown>");
+}
+
+/* [HISSO] Hashes the name as the parser does while reading it */
+enum http_header_id
+http_header_lookup (const char *name, size_t len)
+{
+  if (len == 0)
+    return HTTP_HEADER_UNKNOWN;
+
+  uint32_t hash = HTTP_HEADER_HASH_SEED;
+  for (size_t i = 0; i < len; i++)
+    hash = HEADER_HASH_FOLD (hash, TOKEN (name[i]));
+  return header_id_lookup (hash, len, name, len, ~(uint64_t) 0);
+}
+
 const char *
 http_method_str (enum http_method m)
 {
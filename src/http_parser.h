@@ -129,6 +129,86 @@ extern "C"
   };
 
 
+/* [HISSO] Well known header names. While a header is being parsed,
+ * parser->header_id holds its HTTP_HEADER_* value (HTTP_HEADER_UNKNOWN
+ * for any other name). It is set before the on_header_field call that
+ * completes the name, and stays set through on_header_value. Names are
+ * matched case-insensitively and exactly. The lookup table is
+ * generated from this map by build-aux/gen-header-hash.pl.
+ */
+#define HTTP_HEADER_MAP(XX)                                   \
+  XX(0,  UNKNOWN,                  <unknown>)                 \
+  XX(1,  ACCEPT,                   Accept)                    \
+  XX(2,  ACCEPT_CHARSET,           Accept-Charset)            \
+  XX(3,  ACCEPT_ENCODING,          Accept-Encoding)           \
+  XX(4,  ACCEPT_LANGUAGE,          Accept-Language)           \
+  XX(5,  ACCEPT_RANGES,            Accept-Ranges)             \
+  XX(6,  AGE,                      Age)                       \
+  XX(7,  ALLOW,                    Allow)                     \
+  XX(8,  AUTHORIZATION,            Authorization)             \
+  XX(9,  CACHE_CONTROL,            Cache-Control)             \
+  XX(10, CONNECTION,               Connection)                \
+  XX(11, CONTENT_DISPOSITION,      Content-Disposition)       \
+  XX(12, CONTENT_ENCODING,         Content-Encoding)          \
+  XX(13, CONTENT_LANGUAGE,         Content-Language)          \
+  XX(14, CONTENT_LENGTH,           Content-Length)            \
+  XX(15, CONTENT_LOCATION,         Content-Location)          \
+  XX(16, CONTENT_RANGE,            Content-Range)             \
+  XX(17, CONTENT_TYPE,             Content-Type)              \
+  XX(18, COOKIE,                   Cookie)                    \
+  XX(19, DATE,                     Date)                      \
+  XX(20, ETAG,                     ETag)                      \
+  XX(21, EXPECT,                   Expect)                    \
+  XX(22, EXPIRES,                  Expires)                   \
+  XX(23, FORWARDED,                Forwarded)                 \
+  XX(24, FROM,                     From)                      \
+  XX(25, HOST,                     Host)                      \
+  XX(26, HTTP2_SETTINGS,           HTTP2-Settings)            \
+  XX(27, IF_MATCH,                 If-Match)                  \
+  XX(28, IF_MODIFIED_SINCE,        If-Modified-Since)         \
+  XX(29, IF_NONE_MATCH,            If-None-Match)             \
+  XX(30, IF_RANGE,                 If-Range)                  \
+  XX(31, IF_UNMODIFIED_SINCE,      If-Unmodified-Since)       \
+  XX(32, KEEP_ALIVE,               Keep-Alive)                \
+  XX(33, LAST_MODIFIED,            Last-Modified)             \
+  XX(34, LOCATION,                 Location)                  \
+  XX(35, ORIGIN,                   Origin)                    \
+  XX(36, PRAGMA,                   Pragma)                    \
+  XX(37, PROXY_AUTHENTICATE,       Proxy-Authenticate)        \
+  XX(38, PROXY_AUTHORIZATION,      Proxy-Authorization)       \
+  XX(39, PROXY_CONNECTION,         Proxy-Connection)          \
+  XX(40, RANGE,                    Range)                     \
+  XX(41, REFERER,                  Referer)                   \
+  XX(42, RETRY_AFTER,              Retry-After)               \
+  XX(43, SEC_WEBSOCKET_ACCEPT,     Sec-WebSocket-Accept)      \
+  XX(44, SEC_WEBSOCKET_EXTENSIONS, Sec-WebSocket-Extensions)  \
+  XX(45, SEC_WEBSOCKET_KEY,        Sec-WebSocket-Key)         \
+  XX(46, SEC_WEBSOCKET_PROTOCOL,   Sec-WebSocket-Protocol)    \
+  XX(47, SEC_WEBSOCKET_VERSION,    Sec-WebSocket-Version)     \
+  XX(48, SERVER,                   Server)                    \
+  XX(49, SET_COOKIE,               Set-Cookie)                \
+  XX(50, TE,                       TE)                        \
+  XX(51, TRAILER,                  Trailer)                   \
+  XX(52, TRANSFER_ENCODING,        Transfer-Encoding)         \
+  XX(53, UPGRADE,                  Upgrade)                   \
+  XX(54, USER_AGENT,               User-Agent)                \
+  XX(55, VARY,                     Vary)                      \
+  XX(56, VIA,                      Via)                       \
+  XX(57, WARNING,                  Warning)                   \
+  XX(58, WWW_AUTHENTICATE,         WWW-Authenticate)          \
+  XX(59, X_FORWARDED_FOR,          X-Forwarded-For)           \
+  XX(60, X_FORWARDED_PROTO,        X-Forwarded-Proto)         \
+  XX(61, X_REQUESTED_WITH,         X-Requested-With)          \
+
+  enum http_header_id
+  {
+#define XX(num, name, string) HTTP_HEADER_##name = num,
+    HTTP_HEADER_MAP (XX)
+#undef XX
+    HTTP_HEADER_MAX
+  };
+
+
   enum http_parser_type
   { HTTP_REQUEST, HTTP_RESPONSE, HTTP_BOTH };
 
@@ -213,6 +293,9 @@ extern "C"
 
     uint32_t nread;		/* # bytes read in various scenarios */
     uint64_t content_length;	/* # bytes in body (0 if no Content-Length header) */
+    uint32_t header_hash;	/* [HISSO] hash of header name so far */
+    uint8_t header_len;		/* [HISSO] header name length so far (saturates) */
+    uint64_t header_match;	/* [HISSO] well known ids a split name may be */
 
   /** READ-ONLY **/
     unsigned short http_major;
@@ -220,6 +303,7 @@ extern "C"
     unsigned int status_code:16;	/* responses only */
     unsigned int method:8;	/* requests only */
     unsigned int http_errno:7;
+    unsigned int header_id:8;	/* [HISSO] enum http_header_id of header */
     unsigned short body_had_extra_byte;	/* [HISSO] */
 
     /* 1 = Upgrade header was present and the parser has exited because of that.
@@ -230,10 +314,34 @@ extern "C"
     unsigned int upgrade:1;
 
   /** PUBLIC **/
+    /* [HISSO] 1 = only the framing headers (Connection, Content-Length,
+     * Proxy-Connection, Transfer-Encoding and Upgrade) are parsed and
+     * called back; other header lines are skipped unseen, though still
+     * checked, so a message is framed (or fails) as in a full parse.
+     * Set after http_parser_init(), which clears it.
+     */
+    unsigned int framing_only:1;
     void *data;			/* A pointer to get hook to the "connection" or "socket" object */
   };
 
 
+  /* [HISSO] Callbacks compiled into the parser. http_parser.c built
+   * with -DHTTP_PARSER_CALLBACKS='(HTTP_CB_url|HTTP_CB_body)' (say)
+   * has the tests and marks for the other callbacks compiled out, and
+   * those must then be left NULL. The default is all of them.
+   */
+#define HTTP_CB_message_begin    (1 << 0)
+#define HTTP_CB_url              (1 << 1)
+#define HTTP_CB_status           (1 << 2)
+#define HTTP_CB_header_field     (1 << 3)
+#define HTTP_CB_header_value     (1 << 4)
+#define HTTP_CB_headers_complete (1 << 5)
+#define HTTP_CB_body             (1 << 6)
+#define HTTP_CB_message_complete (1 << 7)
+#define HTTP_CB_chunk_header     (1 << 8)
+#define HTTP_CB_chunk_complete   (1 << 9)
+#define HTTP_CB_ALL              ((1 << 10) - 1)
+
   struct http_parser_settings
   {
     http_cb on_message_begin;
@@ -313,6 +421,14 @@ extern "C"
  */
   int http_should_keep_alive (const http_parser * parser);
 
+/* [HISSO] Returns a string version of a header id ("Content-Length"). */
+  const char *http_header_str (enum http_header_id h);
+
+/* [HISSO] Returns the id of the header named "name" (any case), or
+ * HTTP_HEADER_UNKNOWN. For headers that don't come from the parser,
+ * such as HTTP/2's. */
+  enum http_header_id http_header_lookup (const char *name, size_t len);
+
 /* Returns a string version of the HTTP method. */
   const char *http_method_str (enum http_method m);
 
@@ -0,0 +1,433 @@
+/* http_scan.c:
+ *
+ *    Bulk byte scanners for http_parser, with SSE4.2 and AVX2
+ *    versions selected at run time.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(HAVE_IMMINTRIN_H) && defined(__GNUC__) \
+  && (defined(__x86_64__) || defined(__i386__))
+#  define HTTP_SCAN_X86 1
+#  include <immintrin.h>
+#endif
+
+#include "http_scan.h"
+
+#define HTTP_SCAN_ENVVAR "MUMPSIMUS_SCAN"
+
+#define IS_CRLF(c) ((c) == '\r' || (c) == '\n')
+#define IS_URL_STOP(c) \
+  ((unsigned char) (c) <= ' ' || (unsigned char) (c) >= 0x7f \
+   || (c) == '?' || (c) == '#')
+
+
+/* Scalar versions: also used for the tails of the vector versions */
+static const char *
+scan_crlf_scalar(const char *p, const char *end)
+{
+  for (; p < end; p++)
+    {
+      if (IS_CRLF(*p))
+	break;
+    }
+  return p;
+}
+
+static const char *
+scan_url_scalar(const char *p, const char *end)
+{
+  for (; p < end; p++)
+    {
+      if (IS_URL_STOP(*p))
+	break;
+    }
+  return p;
+}
+
+static void
+unmask_scalar(char *p, size_t len, const unsigned char mask[4],
+	      size_t offset)
+{
+  for (size_t i = 0; i < len; i++)
+    p[i] ^= mask[(offset + i) & 3];
+}
+
+static const char *
+scan_hex_scalar(const char *p, const char *end, uint64_t * value)
+{
+  uint64_t v = 0;
+  const char *stop = (end - p > 16 ? p + 16 : end);
+  for (; p < stop; p++)
+    {
+      int c = (unsigned char) *p;
+      if (c >= '0' && c <= '9')
+	v = (v << 4) | (c - '0');
+      else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+	v = (v << 4) | ((c | 0x20) - 'a' + 10);
+      else
+	break;
+    }
+  *value = v;
+  return p;
+}
+
+
+#ifdef HTTP_SCAN_X86
+
+/* The mask from "offset" on as a little endian word, so that it lines
+ * up with every 4 bytes of the payload from "p" */
+static uint32_t
+mask_word(const unsigned char mask[4], size_t offset)
+{
+  uint32_t word = 0;
+  for (int i = 3; i >= 0; i--)
+    word = (word << 8) | mask[(offset + i) & 3];
+  return word;
+}
+
+
+/* SSE4.2 versions: PCMPESTRI finds the first byte in (or, for URLs,
+ * not in) a small set of characters or ranges, 16 bytes at a time.
+ */
+__attribute__ ((target("sse4.2")))
+static const char *
+scan_crlf_sse42(const char *p, const char *end)
+{
+  const __m128i set = _mm_setr_epi8('\r', '\n', 0, 0, 0, 0, 0, 0,
+				    0, 0, 0, 0, 0, 0, 0, 0);
+  for (; end - p >= 16; p += 16)
+    {
+      __m128i data = _mm_loadu_si128((const __m128i *) p);
+      int idx = _mm_cmpestri(set, 2, data, 16,
+			     _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY
+			     | _SIDD_LEAST_SIGNIFICANT);
+      if (idx < 16)
+	return p + idx;
+    }
+  return scan_crlf_scalar(p, end);
+}
+
+__attribute__ ((target("sse4.2")))
+static const char *
+scan_url_sse42(const char *p, const char *end)
+{
+  // Plain URL characters: '!'-'"', '$'-'>', '@'-'~'
+  const __m128i ranges = _mm_setr_epi8('!', '"', '$', '>', '@', '~', 0, 0,
+				       0, 0, 0, 0, 0, 0, 0, 0);
+  for (; end - p >= 16; p += 16)
+    {
+      __m128i data = _mm_loadu_si128((const __m128i *) p);
+      int idx = _mm_cmpestri(ranges, 6, data, 16,
+			     _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES
+			     | _SIDD_NEGATIVE_POLARITY
+			     | _SIDD_LEAST_SIGNIFICANT);
+      if (idx < 16)
+	return p + idx;
+    }
+  return scan_url_scalar(p, end);
+}
+
+/* Hex: PCMPESTRI finds the end of the digits in the first 16 bytes,
+ * then each digit becomes its nibble ((c & 0xf), plus 9 for letters),
+ * PMADDUBSW packs pairs of nibbles into bytes and those 8 bytes,
+ * byte swapped, are the value of 16 digits. Zeroing, then shifting
+ * out, the unused digits leaves the value of the ones there were.
+ * AVX2 has nothing to add for 16 bytes, so this serves for both.
+ */
+__attribute__ ((target("sse4.2")))
+static const char *
+scan_hex_sse42(const char *p, const char *end, uint64_t * value)
+{
+  if (end - p < 16)
+    return scan_hex_scalar(p, end, value);
+
+  const __m128i ranges = _mm_setr_epi8('0', '9', 'A', 'F', 'a', 'f', 0, 0,
+				       0, 0, 0, 0, 0, 0, 0, 0);
+  __m128i data = _mm_loadu_si128((const __m128i *) p);
+  int digits = _mm_cmpestri(ranges, 6, data, 16,
+			    _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES
+			    | _SIDD_NEGATIVE_POLARITY
+			    | _SIDD_LEAST_SIGNIFICANT);
+  if (0 == digits)
+    {
+      *value = 0;
+      return p;
+    }
+
+  __m128i nibbles = _mm_and_si128(data, _mm_set1_epi8(0x0f));
+  __m128i letters = _mm_and_si128(_mm_srli_epi16(data, 6),
+				  _mm_set1_epi8(0x01));
+  nibbles = _mm_add_epi8(nibbles,
+			 _mm_mullo_epi16(letters, _mm_set1_epi16(9)));
+  // Bytes after the digits may not be nibbles ('g' would be 16)
+  const __m128i lanes = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11,
+				      12, 13, 14, 15);
+  nibbles = _mm_and_si128(nibbles,
+			  _mm_cmpgt_epi8(_mm_set1_epi8(digits), lanes));
+  __m128i pairs = _mm_maddubs_epi16(nibbles, _mm_set1_epi16(0x0110));
+  __m128i bytes = _mm_packus_epi16(pairs, pairs);
+
+  uint64_t v = 0;
+  _mm_storel_epi64((__m128i *) & v, bytes);
+  v = __builtin_bswap64(v);
+  *value = (16 == digits ? v : v >> (4 * (16 - digits)));
+  return p + digits;
+}
+
+
+/* AVX2 versions: compare 32 bytes at a time and take the lowest set
+ * bit of the combined mask.
+ */
+__attribute__ ((target("avx2")))
+static const char *
+scan_crlf_avx2(const char *p, const char *end)
+{
+  const __m256i cr = _mm256_set1_epi8('\r');
+  const __m256i lf = _mm256_set1_epi8('\n');
+  for (; end - p >= 32; p += 32)
+    {
+      __m256i data = _mm256_loadu_si256((const __m256i *) p);
+      __m256i hit = _mm256_or_si256(_mm256_cmpeq_epi8(data, cr),
+				    _mm256_cmpeq_epi8(data, lf));
+      uint32_t mask = (uint32_t) _mm256_movemask_epi8(hit);
+      if (mask != 0)
+	return p + __builtin_ctz(mask);
+    }
+  return scan_crlf_scalar(p, end);
+}
+
+__attribute__ ((target("avx2")))
+static const char *
+scan_url_avx2(const char *p, const char *end)
+{
+  // Signed compare: bytes <= ' ' and bytes >= 0x80 are both "< '!'"
+  const __m256i bang = _mm256_set1_epi8('!');
+  const __m256i del = _mm256_set1_epi8(0x7f);
+  const __m256i query = _mm256_set1_epi8('?');
+  const __m256i hash = _mm256_set1_epi8('#');
+  for (; end - p >= 32; p += 32)
+    {
+      __m256i data = _mm256_loadu_si256((const __m256i *) p);
+      __m256i hit = _mm256_cmpgt_epi8(bang, data);
+      hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(data, del));
+      hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(data, query));
+      hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(data, hash));
+      uint32_t mask = (uint32_t) _mm256_movemask_epi8(hit);
+      if (mask != 0)
+	return p + __builtin_ctz(mask);
+    }
+  return scan_url_scalar(p, end);
+}
+
+/* Unmasking is a plain XOR with the mask repeated across a vector;
+ * 16 and 32 are multiples of 4 so the mask stays lined up.
+ */
+__attribute__ ((target("sse4.2")))
+static void
+unmask_sse42(char *p, size_t len, const unsigned char mask[4], size_t offset)
+{
+  const __m128i key = _mm_set1_epi32(mask_word(mask, offset));
+  size_t i = 0;
+  for (; len - i >= 16; i += 16)
+    {
+      __m128i data = _mm_loadu_si128((const __m128i *) (p + i));
+      _mm_storeu_si128((__m128i *) (p + i), _mm_xor_si128(data, key));
+    }
+  unmask_scalar(p + i, len - i, mask, offset + i);
+}
+
+__attribute__ ((target("avx2")))
+static void
+unmask_avx2(char *p, size_t len, const unsigned char mask[4], size_t offset)
+{
+  const __m256i key = _mm256_set1_epi32(mask_word(mask, offset));
+  size_t i = 0;
+  for (; len - i >= 32; i += 32)
+    {
+      __m256i data = _mm256_loadu_si256((const __m256i *) (p + i));
+      _mm256_storeu_si256((__m256i *) (p + i), _mm256_xor_si256(data, key));
+    }
+  unmask_scalar(p + i, len - i, mask, offset + i);
+}
+
+#endif /* HTTP_SCAN_X86 */
+
+
+/* http_scan_caseeq:
+ *
+ *    Case-insensitive compare by setting bit 0x20 on every byte. For
+ *    tokens against letters, digits and '-' that only folds case
+ *    (the non-token bytes it would confuse, like CR with '-', can't
+ *    appear). SSE2 is always there on x86_64, so no dispatch.
+ */
+int
+http_scan_caseeq(const char *p, const char *lower, size_t len)
+{
+#if defined(HTTP_SCAN_X86) && defined(__SSE2__)
+  const __m128i fold = _mm_set1_epi8(0x20);
+  for (; len >= 16; len -= 16, p += 16, lower += 16)
+    {
+      __m128i a = _mm_or_si128(_mm_loadu_si128((const __m128i *) p), fold);
+      __m128i b = _mm_loadu_si128((const __m128i *) lower);
+      if (_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) != 0xffff)
+	return 0;
+    }
+#endif
+  for (; len > 0; len--, p++, lower++)
+    {
+      if ((*p | 0x20) != *lower)
+	return 0;
+    }
+  return 1;
+}
+
+
+/* Dispatch: the scanners in use start out as resolvers that pick an
+ * implementation on first call.
+ */
+static const char *resolve_crlf(const char *p, const char *end);
+static const char *resolve_url(const char *p, const char *end);
+static void resolve_unmask(char *p, size_t len, const unsigned char mask[4],
+			   size_t offset);
+static const char *resolve_hex(const char *p, const char *end,
+			       uint64_t * value);
+
+static const char *(*scan_crlf) (const char *, const char *) = resolve_crlf;
+static const char *(*scan_url) (const char *, const char *) = resolve_url;
+static void (*scan_unmask) (char *, size_t, const unsigned char *, size_t) =
+  resolve_unmask;
+static const char *(*scan_hex) (const char *, const char *, uint64_t *) =
+  resolve_hex;
+static const char *scan_impl = NULL;
+
+
+/* http_scan_select:
+ *
+ *    Selects the implementation named "impl" ("scalar", "sse4.2" or
+ *    "avx2"), or the best one the CPU supports if "impl" is NULL.
+ *    Returns 0 on success or -1 if "impl" is unknown or not
+ *    supported, in which case the selection is unchanged.
+ */
+int
+http_scan_select(const char *impl)
+{
+#ifdef HTTP_SCAN_X86
+  __builtin_cpu_init();
+  int has_avx2 = __builtin_cpu_supports("avx2");
+  int has_sse42 = __builtin_cpu_supports("sse4.2");
+
+  if ((NULL == impl && has_avx2)
+      || (NULL != impl && strcmp(impl, "avx2") == 0 && has_avx2))
+    {
+      scan_crlf = scan_crlf_avx2;
+      scan_url = scan_url_avx2;
+      scan_unmask = unmask_avx2;
+      scan_hex = scan_hex_sse42;
+      scan_impl = "avx2";
+      return 0;
+    }
+  if ((NULL == impl && has_sse42)
+      || (NULL != impl && strcmp(impl, "sse4.2") == 0 && has_sse42))
+    {
+      scan_crlf = scan_crlf_sse42;
+      scan_url = scan_url_sse42;
+      scan_unmask = unmask_sse42;
+      scan_hex = scan_hex_sse42;
+      scan_impl = "sse4.2";
+      return 0;
+    }
+#endif
+
+  if (NULL == impl || strcmp(impl, "scalar") == 0)
+    {
+      scan_crlf = scan_crlf_scalar;
+      scan_url = scan_url_scalar;
+      scan_unmask = unmask_scalar;
+      scan_hex = scan_hex_scalar;
+      scan_impl = "scalar";
+      return 0;
+    }
+
+  return -1;
+}
+
+
+/* http_scan_impl:
+ *
+ *    Returns the name of the implementation in use.
+ */
+const char *
+http_scan_impl(void)
+{
+  if (NULL == scan_impl)
+    resolve_crlf(NULL, NULL);
+  return scan_impl;
+}
+
+
+static const char *
+resolve_crlf(const char *p, const char *end)
+{
+  if (NULL == scan_impl && http_scan_select(getenv(HTTP_SCAN_ENVVAR)) != 0)
+    http_scan_select(NULL);
+  return scan_crlf(p, end);
+}
+
+static const char *
+resolve_url(const char *p, const char *end)
+{
+  if (NULL == scan_impl && http_scan_select(getenv(HTTP_SCAN_ENVVAR)) != 0)
+    http_scan_select(NULL);
+  return scan_url(p, end);
+}
+
+static void
+resolve_unmask(char *p, size_t len, const unsigned char mask[4],
+	       size_t offset)
+{
+  if (NULL == scan_impl && http_scan_select(getenv(HTTP_SCAN_ENVVAR)) != 0)
+    http_scan_select(NULL);
+  scan_unmask(p, len, mask, offset);
+}
+
+static const char *
+resolve_hex(const char *p, const char *end, uint64_t * value)
+{
+  if (NULL == scan_impl && http_scan_select(getenv(HTTP_SCAN_ENVVAR)) != 0)
+    http_scan_select(NULL);
+  return scan_hex(p, end, value);
+}
+
+
+const char *
+http_scan_crlf(const char *p, const char *end)
+{
+  return scan_crlf(p, end);
+}
+
+const char *
+http_scan_url(const char *p, const char *end)
+{
+  return scan_url(p, end);
+}
+
+void
+http_scan_unmask(char *p, size_t len, const unsigned char mask[4],
+		 size_t offset)
+{
+  scan_unmask(p, len, mask, offset);
+}
+
+const char *
+http_scan_hex(const char *p, const char *end, uint64_t * value)
+{
+  return scan_hex(p, end, value);
+}
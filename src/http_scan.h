@@ -0,0 +1,42 @@
+/* http_scan.h
+ *
+ *    Bulk byte scanners for http_parser. Each scans forward from "p"
+ *    and returns a pointer to the first byte the parser has to look
+ *    at one at a time, or "end" if there is none. On x86 the SSE4.2
+ *    or AVX2 version is picked at run time from what the CPU
+ *    supports, with a portable scalar version otherwise. Set
+ *    MUMPSIMUS_SCAN to "scalar", "sse4.2" or "avx2" to override.
+ */
+#ifndef __HTTP_SCAN_H__
+#define __HTTP_SCAN_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* First CR or LF */
+const char *http_scan_crlf(const char *p, const char *end);
+
+/* First byte that is not a plain URL character: a control character,
+ * space, DEL, a byte with the high bit set, '?' or '#'. */
+const char *http_scan_url(const char *p, const char *end);
+
+/* True if the "len" bytes at "p" equal "lower" ignoring case. Only
+ * exact for header name tokens compared with names made of letters,
+ * digits and '-'. */
+int http_scan_caseeq(const char *p, const char *lower, size_t len);
+
+/* XORs the "len" bytes at "p" in place with the 4 byte WebSocket
+ * "mask", starting at byte "offset" of the mask (so a payload can be
+ * unmasked in pieces). Masking and unmasking are the same. */
+void http_scan_unmask(char *p, size_t len, const unsigned char mask[4],
+		      size_t offset);
+
+/* Parses the hex digits at "p" (at most 16 of them, which is as many
+ * as fit in 64 bits) into "value". Returns a pointer to the byte after
+ * the last digit parsed: "p" if there were none. */
+const char *http_scan_hex(const char *p, const char *end, uint64_t * value);
+
+int http_scan_select(const char *impl);
+const char *http_scan_impl(void);
+
+#endif
@@ -9,16 +9,33 @@
 #endif
 
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sysexits.h>
+#include <sys/time.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "ulog.h"
 #include "util.h"
+#include "counters.h"
+#include "buffer_alloc.h"
 #include "http_parser.h"
+#include "http_message.h"
+#include "method_queue.h"
+#include "tunnel.h"
+#include "ws_parser.h"
+#include "h2_parser.h"
+#include "access_log.h"
+#include "message_stats.h"
+#include "transaction_queue.h"
+#include "probes.h"
 
 #define ANSI_COLOR_RED     "\x1b[31m"
 #define ANSI_COLOR_GREEN   "\x1b[32m"
@@ -36,49 +53,139 @@
 void
 usage(const char *ident)
 {
-  fprintf(stderr, "usage: %s [-qv]\n\t-q\tquiet\n\t-v\tverbose\n", ident);
+  fprintf(stderr, "usage: %s [-aqv] [-s 1/N] [-r rate] [-o file [-F json|bin]] "
+	  "[-H] [-I seconds] [-p file [-P file]]\n"
+	  "\t-a\tparse all headers, even when not verbose\n"
+	  "\t-q\tquiet\n"
+	  "\t-v\tverbose\n"
+	  "\t-s\tprint the headers of only 1 in N messages when verbose\n"
+	  "\t-r\tprint the headers of at most rate messages a second\n"
+	  "\t-o\tappend a record per message to file, instead of logging\n"
+	  "\t\tit on stderr (unless verbose)\n"
+	  "\t-F\trecord format: json (default) or bin (see mumplog)\n"
+	  "\t-H\tkeep histograms of message sizes and intervals, printed\n"
+	  "\t\ton SIGUSR1 and at exit\n"
+	  "\t-I\tprint the histograms every so many seconds as well\n"
+	  "\t-p\tread the responses to stdin's requests from file (a FIFO,\n"
+	  "\t\tor /dev/fd/N), and report each transaction's timing\n"
+	  "\t-P\techo those responses to file\n",
+	  ident);
   exit(EX_USAGE);
 }
 
 
 
 
+/* Which messages have their headers printed when verbose: 1 in
+ * "every" of them, at most "rate" a second (if not 0). The rate is
+ * kept by a token bucket holding up to a second's worth (or one).
+ *
+ *    seen        Messages begun.
+ *    dumped      Messages whose headers were printed.
+ *    tokens      Messages that may be printed now.
+ *    last_ns     When the bucket was last topped up (monotonic).
+ */
+struct Log_Sampler
+{
+  unsigned long every;
+  double rate;
+  unsigned long long seen;
+  unsigned long long dumped;
+  double tokens;
+  uint64_t last_ns;
+};
+
+
 /* Use this struct with http_parser to persist some data
  * without resorting to globals.
  *
- *    url         String buffer to store last seen URL.
- *    headers     String buffer to store header fields and values.
+ *    url         String buffer to store last seen request URL.
+ *    msg         URL and headers of the current message.
+ *    methods     Methods of requests not yet answered.
+ *    tunnel      Whether the stream has switched protocols.
+ *    ws_text     The WebSocket message being framed is text.
  *    message     String buffer for last log message.
  *    volume      Remembers what level of logging caller wants.
+ *    framing_only  Only the framing headers need parsing.
+ *    access_log  Where records go, or NULL.
+ *    begin_ns    When the current message began (for records).
+ *    header_bytes  Its head's size, once complete.
+ *    body_bytes  Its body's size so far.
+ *    stats       Histograms of messages, or NULL.
+ *    type        Messages expected: HTTP_BOTH, or one direction's.
+ *    transactions  Requests awaiting responses, when both directions
+ *                are read (shared by them), or NULL.
+ *    mono_begin_ns  When the current message began (monotonic).
+ *    sampler     Which messages' headers to print when verbose
+ *                (shared by both directions), or NULL for all.
+ *    all_headers  Parse all headers, even of messages not sampled.
+ *    dump_headers  The current message's headers are to be printed.
+ *    dump        Where verbose output is put together, grown as
+ *                needed and kept for the next message.
+ *    dump_max    Its size.
  *
  * log_data_init allocates memory for the above string buffers.
  * log_data_free frees that same memory. Caller must malloc &
- * free the struct itself.
+ * free the struct itself. The message is created once the read
+ * buffer it points into is known.
  */
 struct Log_Data
 {
   char *url;
-  char *headers;
+  struct Http_Message *msg;
+  struct Method_Queue *methods;
+  struct Tunnel tunnel;
+  bool ws_text;
   char *message;
   int volume;			// 0=quiet; 1=normal; 2=verbose 
+  bool framing_only;
+  struct Access_Log *access_log;
+  uint64_t begin_ns;
+  uint64_t header_bytes;
+  uint64_t body_bytes;
+  struct Message_Stats *stats;
+  enum http_parser_type type;
+  struct Transaction_Queue *transactions;
+  uint64_t mono_begin_ns;
+  struct Log_Sampler *sampler;
+  bool all_headers;
+  bool dump_headers;
+  char *dump;
+  size_t dump_max;
 };
 
 void
 log_data_init(struct Log_Data *log_data)
 {
   log_data->volume = 1;
+  log_data->framing_only = true;
+  log_data->access_log = NULL;
+  log_data->begin_ns = 0;
+  log_data->header_bytes = 0;
+  log_data->body_bytes = 0;
+  log_data->stats = NULL;
+  log_data->type = HTTP_BOTH;
+  log_data->transactions = NULL;
+  log_data->mono_begin_ns = 0;
+  log_data->sampler = NULL;
+  log_data->all_headers = false;
+  log_data->dump_headers = true;
+  log_data->dump = NULL;
+  log_data->dump_max = 0;
 
   log_data->url = malloc(URL_MAX);
-  log_data->headers = malloc(BUFFER_MAX);
+  log_data->msg = NULL;
+  log_data->methods = method_queue_new();
+  tunnel_start(&log_data->tunnel);
+  log_data->ws_text = false;
   log_data->message = malloc(STRING_MAX);
-  if ((NULL == log_data->url) || (NULL == log_data->headers)
+  if ((NULL == log_data->url) || (NULL == log_data->methods)
       || (NULL == log_data->message))
     {
       perror("Error from malloc");
       abort();
     }
   log_data->url[0] = '\0';
-  log_data->headers[0] = '\0';
   return;
 }
 
@@ -86,10 +193,13 @@ void
 log_data_free(struct Log_Data *log_data)
 {
   free(log_data->url);
-  free(log_data->headers);
   free(log_data->message);
+  free(log_data->dump);
+  method_queue_delete(log_data->methods);
   log_data->url = NULL;
-  log_data->headers = NULL;
+  log_data->methods = NULL;
+  log_data->message = NULL;
+  log_data->dump = NULL;
   return;
 }
 
@@ -120,19 +230,257 @@ log_highlight(FILE * outf, const int turn_highlight_on)
 }
 
 
-/* cb_log_message_complete: 
+/* now_ns:
  *
- *    Callback from http_parser, called when http message has been
- *    processed. A good time to extract some relevant log information.
+ *    Wall clock time in ns since the epoch.
  */
-int
-cb_log_message_complete(http_parser * parser)
+static uint64_t
+now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+/* monotonic_ns:
+ *
+ *    Monotonic clock time in ns, for intervals.
+ */
+static uint64_t
+monotonic_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+/* log_sample:
+ *
+ *    Decides, as a message begins at "now", whether its headers are
+ *    printed. Returns true if so.
+ */
+static bool
+log_sample(struct Log_Sampler *sampler, uint64_t now)
+{
+  if (0 != sampler->seen++ % sampler->every)
+    return false;
+
+  if (sampler->rate > 0)
+    {
+      sampler->tokens += (now - sampler->last_ns) * sampler->rate / 1e9;
+      sampler->last_ns = now;
+      sampler->tokens = MIN(sampler->tokens, MAX(sampler->rate, 1));
+      if (sampler->tokens < 1)
+	return false;
+      sampler->tokens -= 1;
+    }
+  sampler->dumped++;
+  return true;
+}
+
+
+/* Set by SIGUSR1, and SIGALRM with -I, when the histograms are
+ * wanted. They are printed between reads. */
+static volatile sig_atomic_t stats_wanted = 0;
+
+static void
+on_stats_signal(int signum)
+{
+  stats_wanted = 1;
+}
+
+
+/* log_stats_if_wanted:
+ *
+ *    Prints the histograms if a signal has asked for them.
+ */
+void
+log_stats_if_wanted(struct Log_Data *log_data)
+{
+  if (!stats_wanted || NULL == log_data->stats)
+    return;
+  stats_wanted = 0;
+  message_stats_dump(log_data->stats, stderr, __FILE__ ": [stats]",
+		     monotonic_ns());
+  return;
+}
+
+
+/* log_stats_start:
+ *
+ *    Keeps histograms from now on, printed on SIGUSR1 and every
+ *    "interval" seconds (if not 0). The signals interrupt reads
+ *    rather than restart them, so the histograms are printed even if
+ *    the input is idle.
+ */
+void
+log_stats_start(struct Log_Data *log_data, long interval)
+{
+  log_data->stats = message_stats_new(monotonic_ns());
+  if (NULL == log_data->stats)
+    {
+      perror("Error from malloc");
+      abort();
+    }
+
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_stats_signal;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGUSR1, &sa, NULL);
+  if (interval > 0)
+    {
+      sigaction(SIGALRM, &sa, NULL);
+      struct itimerval timer;
+      timer.it_interval.tv_sec = interval;
+      timer.it_interval.tv_usec = 0;
+      timer.it_value = timer.it_interval;
+      setitimer(ITIMER_REAL, &timer, NULL);
+    }
+  return;
+}
+
+
+/* log_record:
+ *
+ *    Writes a record of the message "parser" has parsed (so far) on
+ *    "stream" to the access log, with "error" if it failed.
+ */
+void
+log_record(http_parser * parser, struct Log_Data *log_data, uint32_t stream,
+	   const char *error)
+{
+  struct Access_Record rec;
+  rec.type = (HTTP_RESPONSE == parser->type ? HTTP_RESPONSE : HTTP_REQUEST);
+  rec.method = parser->method;
+  rec.status_code = parser->status_code;
+  rec.http_major = parser->http_major;
+  rec.http_minor = parser->http_minor;
+  rec.stream = stream;
+  rec.begin_ns = log_data->begin_ns;
+  rec.end_ns = now_ns();
+  rec.header_bytes = log_data->header_bytes;
+  rec.body_bytes = log_data->body_bytes;
+  rec.url = log_data->url;
+  rec.url_len = strlen(log_data->url);
+  if (HTTP_REQUEST == rec.type)
+    rec.url = http_message_url(log_data->msg, &rec.url_len);
+  if (NULL == rec.url)
+    rec.url_len = 0;
+  rec.error = error;
+  rec.error_len = (NULL == error ? 0 : strlen(error));
+
+  if (access_log_write(log_data->access_log, &rec) != 0)
+    ulog(LOG_ERR, "Could not write access log: %s", strerror(errno));
+  return;
+}
+
+
+/* log_dump_append:
+ *
+ *    Copies "length" bytes at "at" to the verbose output at "end",
+ *    growing it if needed. Returns the new end.
+ */
+static size_t
+log_dump_append(struct Log_Data *log_data, size_t end, const char *at,
+		size_t length)
+{
+  if (end + length > log_data->dump_max)
+    {
+      size_t new_max = MAX(log_data->dump_max * 2, end + length);
+      new_max = MAX(new_max, STRING_MAX);
+      char *dump = realloc(log_data->dump, new_max);
+      if (NULL == dump)
+	{
+	  perror("Error from realloc");
+	  abort();
+	}
+      log_data->dump = dump;
+      log_data->dump_max = new_max;
+    }
+  if (length > 0)
+    memcpy(log_data->dump + end, at, length);
+  return end + length;
+}
+
+#define log_dump_literal(log_data, end, s) \
+  log_dump_append((log_data), (end), (s), sizeof(s) - 1)
+
+
+/* log_dump_headers:
+ *
+ *    Prints the headers of the message just parsed, put together
+ *    first so that they go out in one write however many there are.
+ *    The headers are slices of what was read (see http_message.h), so
+ *    nothing is allocated for each one.
+ */
+void
+log_dump_headers(struct Log_Data *log_data)
+{
+  struct Http_Message *msg = log_data->msg;
+  size_t end = log_dump_literal(log_data, 0, __FILE__ ": [begin headers]\n");
+  for (size_t n = 0; n < http_message_header_count(msg); n++)
+    {
+      size_t field_len = 0, value_len = 0;
+      const char *field = http_message_field(msg, n, &field_len);
+      const char *value = http_message_value(msg, n, &value_len);
+      end = log_dump_literal(log_data, end, "\t");
+      end = log_dump_append(log_data, end, field, field_len);
+      end = log_dump_literal(log_data, end, ": ");
+      end = log_dump_append(log_data, end, value, value_len);
+      end = log_dump_literal(log_data, end, "\r\n");
+    }
+  end = log_dump_literal(log_data, end, __FILE__ ": [end headers]\n");
+  write_all(STDERR_FILENO, log_data->dump, end);
+  return;
+}
+
+
+/* log_message:
+ *
+ *    Logs the message just parsed, and its headers if verbose. HTTP/2
+ *    messages are marked with their stream. With an access log, only
+ *    verbose output goes to stderr as well.
+ */
+void
+log_message(http_parser * parser, struct Log_Data *log_data)
 {
-  struct Log_Data *log_data = (struct Log_Data *) parser->data;
   char *str = log_data->message;
 
+  counter_add(COUNTER_MESSAGES, 1);
+  if (NULL != log_data->stats
+      && message_stats_record(log_data->stats, parser,
+			      log_data->header_bytes, log_data->body_bytes,
+			      monotonic_ns()) != 0)
+    {
+      perror("Error from malloc");
+      abort();
+    }
+
+  // Responses are logged with the URL of the last request
+  if (HTTP_REQUEST == parser->type)
+    {
+      size_t length = 0;
+      const char *url = http_message_url(log_data->msg, &length);
+      if (length >= URL_MAX)
+	length = URL_MAX - 1;
+      if (NULL != url)
+	memcpy(log_data->url, url, length);
+      log_data->url[length] = '\0';
+    }
+
+  if (NULL != log_data->access_log)
+    {
+      log_record(parser, log_data, (2 == parser->http_major
+				    ? h2_stream_id(parser) : 0), NULL);
+      if (log_data->volume < 2)
+	return;
+    }
+
   // Build log message
-  if (0 == parser->type)
+  if (HTTP_REQUEST == parser->type)
     {
       snprintf(str, STRING_MAX, "[req] %s %s HTTP/%d.%d",
 	       http_method_str(parser->method),
@@ -149,6 +497,12 @@ cb_log_message_complete(http_parser * parser)
 	       ((log_data->url == NULL
 		 || !log_data->url[0]) ? "unknown" : log_data->url));
     }
+  if (2 == parser->http_major)
+    {
+      size_t length = strlen(str);
+      snprintf(str + length, STRING_MAX - length, " (stream %u)",
+	       h2_stream_id(parser));
+    }
 
   // Quiet (volume == 1) means log message type and basic status
   ulog(LOG_INFO, "cb_log_message_complete: %s (nread=%zd)", str,
@@ -160,16 +514,117 @@ cb_log_message_complete(http_parser * parser)
       log_highlight(stderr, 0);
     }
 
-  // Verbose (volume == 2) means log whole headers
-  if (log_data->volume > 1)
-    fprintf(stderr, "%s: [begin headers]\n%s%s: [end headers]\n", __FILE__,
-	    log_data->headers, __FILE__);
+  // Verbose (volume == 2) means log whole headers, of the messages
+  // sampled
+  if (log_data->volume > 1 && log_data->dump_headers)
+    log_dump_headers(log_data);
+  return;
+}
+
+
+/* log_pair_response:
+ *
+ *    Takes the request the final response "parser" has parsed
+ *    answers into "txn", and logs the response with its URL. Returns
+ *    false for an interim (1xx) response, or one nothing asked for.
+ */
+bool
+log_pair_response(http_parser * parser, struct Log_Data *log_data,
+		  struct Transaction *txn)
+{
+  if (parser->status_code < 200 && 101 != parser->status_code)
+    return false;
+  if (!transaction_queue_pop(log_data->transactions, txn))
+    {
+      ulog(LOG_WARNING, "Response %d has no request to answer",
+	   parser->status_code);
+      return false;
+    }
+
+  size_t length = MIN(txn->url_len, URL_MAX - 1);
+  memcpy(log_data->url, txn->url, length);
+  log_data->url[length] = '\0';
+  return true;
+}
+
+
+/* log_transaction:
+ *
+ *    Reports the time to first byte and upstream latency of a
+ *    transaction whose response has just completed at "now". Both
+ *    are measured from the end of the request (or its start, if the
+ *    response began first).
+ */
+void
+log_transaction(http_parser * parser, struct Log_Data *log_data,
+		const struct Transaction *txn, uint64_t now)
+{
+  uint64_t sent = (0 != txn->end_ns ? txn->end_ns : txn->begin_ns);
+  uint64_t ttfb = (log_data->mono_begin_ns > sent
+		   ? log_data->mono_begin_ns - sent : 0);
+  uint64_t latency = (now > sent ? now - sent : 0);
+
+  if (NULL != log_data->stats
+      && message_stats_record_transaction(log_data->stats, parser, ttfb,
+					  latency) != 0)
+    {
+      perror("Error from malloc");
+      abort();
+    }
+  if (log_data->volume > 0)
+    {
+      log_highlight(stderr, 1);
+      fprintf(stderr, "%s: [txn] %s %.*s %d ttfb_us=%llu latency_us=%llu\n",
+	      __FILE__, http_method_str(txn->method), (int) txn->url_len,
+	      txn->url, parser->status_code,
+	      (unsigned long long) ttfb / 1000,
+	      (unsigned long long) latency / 1000);
+      log_highlight(stderr, 0);
+    }
+  return;
+}
+
+
+/* cb_log_message_complete: 
+ *
+ *    Callback from http_parser, called when http message has been
+ *    processed. A good time to extract some relevant log information.
+ *    HTTP/2 messages were logged with their headers (streams take
+ *    turns), so only trailers are left to forget.
+ */
+int
+cb_log_message_complete(http_parser * parser)
+{
+  struct Log_Data *log_data = (struct Log_Data *) parser->data;
+
+  if (2 == parser->http_major)
+    {
+      http_message_clear(log_data->msg);
+      return 0;
+    }
+
+  // With both directions read, requests are paired with responses
+  struct Transaction txn;
+  bool answered = (NULL != log_data->transactions
+		   && HTTP_RESPONSE == parser->type
+		   && log_pair_response(parser, log_data, &txn));
+
+  log_message(parser, log_data);
+
+  if (NULL != log_data->transactions && HTTP_REQUEST == parser->type)
+    transaction_queue_end(log_data->transactions, parser->method,
+			  log_data->url, strlen(log_data->url),
+			  monotonic_ns());
+  else if (answered)
+    log_transaction(parser, log_data, &txn, monotonic_ns());
 
   // Don't need these any more
-  log_data->headers[0] = '\0';
+  tunnel_after_message(&log_data->tunnel, parser, log_data->msg);
+  http_message_clear(log_data->msg);
 
   // Restart parser for next message type
-  http_parser_init(parser, HTTP_BOTH);
+  http_parser_init(parser, log_data->type);
+  parser->framing_only = log_data->framing_only;
 
   return 0;
 }
@@ -184,9 +639,82 @@ int
 cb_log_url(http_parser * parser, const char *at, size_t length)
 {
   struct Log_Data *log_data = (struct Log_Data *) parser->data;
-  size_t copylen = (length < URL_MAX ? length : URL_MAX);
-  strncpy(log_data->url, at, copylen);
-  log_data->url[copylen] = '\0';
+  return http_message_on_url(log_data->msg, at, length);
+}
+
+
+/* cb_log_headers_complete:
+ *
+ *    Callback from http_parser when the headers have been read. Tells
+ *    the parser when a response has no body, so that a response to a
+ *    HEAD request doesn't swallow the next message. HTTP/2 frames
+ *    every body, and the next header block may be another stream's,
+ *    so its messages are logged now.
+ */
+int
+cb_log_headers_complete(http_parser * parser)
+{
+  struct Log_Data *log_data = (struct Log_Data *) parser->data;
+  log_data->header_bytes = parser->nread;
+  PROBE3(headers__complete, parser, (int) parser->type, parser->nread);
+
+  if (2 == parser->http_major)
+    {
+      log_data->body_bytes = (ULLONG_MAX == parser->content_length ? 0
+			      : parser->content_length);
+      log_message(parser, log_data);
+      http_message_clear(log_data->msg);
+      return 0;
+    }
+  return method_queue_skip_body(log_data->methods, parser);
+}
+
+
+/* cb_log_message_begin:
+ *
+ *    Callback from http_parser when a message starts. Notes the time
+ *    for its record (only set with an access log, histograms, both
+ *    directions or sampling), and queues a request to pair with its
+ *    response. When verbose output is sampled, decides now whether
+ *    the message's headers are printed: if not, the parser skips all
+ *    but the framing headers, and the rest are never kept.
+ */
+int
+cb_log_message_begin(http_parser * parser)
+{
+  struct Log_Data *log_data = (struct Log_Data *) parser->data;
+  log_data->begin_ns = now_ns();
+  log_data->mono_begin_ns = monotonic_ns();
+  if (NULL != log_data->sampler)
+    {
+      log_data->dump_headers = log_sample(log_data->sampler,
+					  log_data->mono_begin_ns);
+      parser->framing_only = (log_data->framing_only
+			      || (!log_data->dump_headers
+				  && !log_data->all_headers));
+    }
+  if (NULL != log_data->transactions && HTTP_REQUEST == parser->type
+      && 2 != parser->http_major)
+    transaction_queue_begin(log_data->transactions,
+			    log_data->mono_begin_ns);
+  log_data->header_bytes = 0;
+  log_data->body_bytes = 0;
+  return 0;
+}
+
+
+/* cb_log_body:
+ *
+ *    Callback from http_parser with a piece of body. Counts it for
+ *    the message's record (only set with an access log, histograms or
+ *    both directions).
+ */
+int
+cb_log_body(http_parser * parser, const char *at, size_t length)
+{
+  struct Log_Data *log_data = (struct Log_Data *) parser->data;
+  log_data->body_bytes += length;
+  PROBE2(body, parser, length);
   return 0;
 }
 
@@ -194,167 +722,485 @@ cb_log_url(http_parser * parser, const char *at, size_t length)
 /* cb_log_header_field: 
  *
  *    Called from http_parser, when a header field has been read. Adds
- *    this to our own buffer for later logging.
+ *    this to the message for later logging. HTTP/2 has no upgrades
+ *    to watch for, so the headers of a message not sampled are not
+ *    kept at all.
  */
 int
 cb_log_header_field(http_parser * parser, const char *at, size_t length)
 {
   struct Log_Data *log_data = (struct Log_Data *) parser->data;
-
-  char *new_field = strndup(at, length);
-  strlcat(log_data->headers, "\t", BUFFER_MAX);
-  strlcat(log_data->headers, new_field, BUFFER_MAX);
-  strlcat(log_data->headers, ": ", BUFFER_MAX);
-  free(new_field);
-  return 0;
+  if (!log_data->dump_headers && 2 == parser->http_major)
+    return 0;
+  return http_message_on_header_field(log_data->msg, parser, at, length);
 }
 
 
 /* cb_log_header_value: 
  *
  *    Called from http_parser, when a header field's value has been
- *    read. Adds this to our own buffer for later logging.
+ *    read. Adds this to the message for later logging.
  */
 int
 cb_log_header_value(http_parser * parser, const char *at, size_t length)
 {
   struct Log_Data *log_data = (struct Log_Data *) parser->data;
+  if (!log_data->dump_headers && 2 == parser->http_major)
+    return 0;
+  return http_message_on_header_value(log_data->msg, at, length);
+}
 
-  char *new_value = strndup(at, length);
-  strlcat(log_data->headers, new_value, BUFFER_MAX);
-  strlcat(log_data->headers, "\r\n", BUFFER_MAX);
-  free(new_value);
-  return 0;
+
+/* cb_log_frame_header:
+ *
+ *    Called by ws_parser for each WebSocket frame after an upgrade.
+ *    Reports the frame. Only text payloads are printed (verbose), so
+ *    only they are unmasked; returning 1 leaves the rest alone.
+ */
+int
+cb_log_frame_header(ws_parser * ws)
+{
+  struct Log_Data *log_data = (struct Log_Data *) ws->data;
+
+  if (log_data->volume > 0)
+    {
+      log_highlight(stderr, 1);
+      fprintf(stderr, "%s: [ws] %s%s %llu bytes%s\n", __FILE__,
+	      ws_opcode_str(ws->opcode), (ws->fin ? "" : " (fragment)"),
+	      (unsigned long long) ws->payload_length,
+	      (ws->masked ? " masked" : ""));
+      log_highlight(stderr, 0);
+    }
+
+  // Continuation frames carry on the message the last data frame began
+  if (WS_OP_TEXT == ws->opcode || WS_OP_BINARY == ws->opcode)
+    log_data->ws_text = (WS_OP_TEXT == ws->opcode);
+
+  bool print_payload = (log_data->volume > 1 && ws->payload_length > 0
+			&& (WS_OP_TEXT == ws->opcode
+			    || (WS_OP_CONTINUATION == ws->opcode
+				&& log_data->ws_text)));
+  if (print_payload)
+    fprintf(stderr, "\t");
+  return (print_payload ? 0 : 1);
 }
 
 
-/* cb_log_body
+/* cb_log_frame_payload:
  *
- *    Called everytime the parser iterates over a HTTP message body. Nothing
- *    very interesting to do here except report the bytes.
+ *    Prints (unmasked) text frame payloads when verbose.
  */
 int
-cb_log_body(http_parser * parser, const char *at, size_t length)
+cb_log_frame_payload(ws_parser * ws, const char *at, size_t length)
 {
-  //struct Log_Data *log_data = (struct Log_Data*)parser->data;
-  ulog_debug("cb_log_body called (len=%zd)", length);
+  struct Log_Data *log_data = (struct Log_Data *) ws->data;
+
+  if (log_data->volume > 1 && !ws->raw)
+    {
+      fprintf(stderr, "%.*s", (int) length, at);
+      if (length == ws->remaining)
+	fprintf(stderr, "\n");
+    }
   return 0;
 }
 
 
-/* pass_http_messages: 
- * 
- *    Reading from fd_in, echo bytes to fd_out and print "interesting"
- *    messages about the HTTP header being consumed.
+/* Log_Stream: one direction of HTTP traffic being logged.
+ *
+ *    fd_in, fd_out  Where bytes are read from, and echoed to.
+ *    log_data    The direction's callback data.
+ *    reading     Until EOF or an error.
+ *    opaque      A tunnel not being followed: bytes are only echoed.
+ *    errors, rc  Errors seen, and the exit code they call for.
+ *
+ * log_stream_open sets up the parsers and read buffer, and
+ * log_stream_close frees them. log_stream_read reads once.
  */
-int
-pass_http_messages(int fd_in, int fd_out, struct Log_Data *log_data)
+struct Log_Stream
 {
-  int rc = 0;
-  int errors = 0;
+  int fd_in;
+  int fd_out;
+  struct Log_Data *log_data;
+  bool reading;
+  bool opaque;
+  int errors;
+  int rc;
 
-  // Struct holds the callback settings for the parser
   http_parser_settings settings;
-  http_parser_settings_init(&settings);
-  settings.on_url = cb_log_url;
-  settings.on_message_complete = cb_log_message_complete;
-  settings.on_body = cb_log_body;
-  if (log_data->volume > 1)
+  http_parser parser;
+  ws_parser_settings ws_settings;
+  ws_parser ws;
+  h2_parser h2;
+  char *buffer;
+};
+
+void
+log_stream_open(struct Log_Stream *ls, int fd_in, int fd_out,
+		struct Log_Data *log_data)
+{
+  ls->fd_in = fd_in;
+  ls->fd_out = fd_out;
+  ls->log_data = log_data;
+  ls->reading = true;
+  ls->opaque = false;
+  ls->errors = 0;
+  ls->rc = 0;
+
+  // Struct holds the callback settings for the parser
+  http_parser_settings *settings = &ls->settings;
+  http_parser_settings_init(settings);
+  settings->on_url = cb_log_url;
+  settings->on_headers_complete = cb_log_headers_complete;
+  settings->on_message_complete = cb_log_message_complete;
+  // Headers are kept for verbose output, and to see which protocol
+  // an upgrade switches to
+  if (log_data->volume > 0)
+    {
+      settings->on_header_field = cb_log_header_field;
+      settings->on_header_value = cb_log_header_value;
+    }
+  // Records, histograms and transactions also need the time and size
+  // of each message; sampling decides as each begins
+  if (NULL != log_data->access_log || NULL != log_data->stats
+      || NULL != log_data->transactions || NULL != log_data->sampler)
     {
-      settings.on_header_field = cb_log_header_field;
-      settings.on_header_value = cb_log_header_value;
+      settings->on_message_begin = cb_log_message_begin;
+      settings->on_body = cb_log_body;
     }
 
   // Struct holds parser instance, including our callback data
-  http_parser parser;
-  http_parser_init(&parser, HTTP_BOTH);
-  parser.data = (void *) log_data;
+  http_parser_init(&ls->parser, log_data->type);
+  ls->parser.data = (void *) log_data;
+  ls->parser.framing_only = log_data->framing_only;
+
+  // Frame parser for after an upgrade to WebSocket
+  ws_parser_settings_init(&ls->ws_settings);
+  ls->ws_settings.on_frame_header = cb_log_frame_header;
+  ls->ws_settings.on_payload = cb_log_frame_payload;
+  ls->ws.data = (void *) log_data;
+  ws_parser_init(&ls->ws);
 
+  // Stream parser for HTTP/2, which uses the same callbacks
+  ls->h2.data = (void *) log_data;
+  if (h2_parser_init(&ls->h2, log_data->type) != 0)
+    {
+      perror("Error from malloc");
+      abort();
+    }
 
-  // Buffer for reading from stdin
-  char *buffer = malloc(BUFFER_MAX);
-  if (buffer == NULL)
+  // Buffer for reading from fd_in
+  ls->buffer = buffer_alloc(BUFFER_MAX);
+  if (ls->buffer == NULL)
     {
       perror("Error from malloc");
       abort();
     }
+  log_data->msg = http_message_new(ls->buffer, BUFFER_MAX);
+  if (NULL == log_data->msg)
+    {
+      perror("Error from malloc");
+      abort();
+    }
+  return;
+}
 
+void
+log_stream_close(struct Log_Stream *ls)
+{
+  // We allocated these
+  h2_parser_free(&ls->h2);
+  http_message_delete(ls->log_data->msg);
+  ls->log_data->msg = NULL;
+  buffer_free(ls->buffer);
+  ls->buffer = NULL;
+  return;
+}
+
+
+/* log_stream_read:
+ *
+ *    Reads once from the stream, echoes what was read, and prints
+ *    "interesting" messages about the HTTP being consumed. Clears
+ *    "reading" at EOF or on an error.
+ */
+void
+log_stream_read(struct Log_Stream *ls)
+{
+  struct Log_Data *log_data = ls->log_data;
+  http_parser *parser = &ls->parser;
+  h2_parser *h2 = &ls->h2;
+  char *buffer = ls->buffer;
+  int fd_in = ls->fd_in;
+  int fd_out = ls->fd_out;
   ssize_t last_parsed = 0;
-  ssize_t bytes_read = 0;
+
+  // Tokens still pending point into the buffer. Keep them.
+  http_message_retain(log_data->msg);
+
+  // Read data from fd_in
+  memset(buffer, 0, BUFFER_MAX);
   char *buf_ptr = buffer;
-  bool do_reads = true;
-  do
+  ssize_t bytes_read = read_input(fd_in, buffer, BUFFER_MAX);
+  while (bytes_read < 0 && EINTR == errno)
+    {
+      log_stats_if_wanted(log_data);
+      bytes_read = read_input(fd_in, buffer, BUFFER_MAX);
+    }
+  ulog(LOG_DEBUG, "Read %zd bytes from fd=%d", bytes_read, fd_in);
+
+  // Handle error or eof
+  if (bytes_read < 0)
+    {
+      ls->errors++;
+      ls->reading = false;
+      ulog(LOG_ERR, "Read returned error %d (%s)", errno, strerror(errno));
+    }
+  else if (0 == bytes_read)
     {
-      // Read data from stdin
-      memset(buffer, 0, BUFFER_MAX);
-      buf_ptr = buffer;
-      bytes_read = read(fd_in, buffer, BUFFER_MAX);
-      ulog(LOG_DEBUG, "Read %zd bytes from fd=%d", bytes_read, fd_in);
+      // let http parser know we are done
+      if (!ls->opaque)
+	http_parser_execute(parser, &ls->settings, buf_ptr, 0);
+      ulog(LOG_DEBUG, "Read returned EOF. Have told parser.");
+      ls->reading = false;
+    }
+  else
+    {
+      // We always echo to fd_out directly what we've read
+      write_all(fd_out, buffer, bytes_read);
+      ulog(LOG_DEBUG, "Wrote %zd bytes to fd=%d", bytes_read, fd_out);
 
-      // Handle error or eof
-      if (bytes_read < 0)
+      // Repeatedly call http_parser_execute while there is data left in the buffer
+      while ((bytes_read > 0) && (ls->errors <= 0) && !ls->opaque)
 	{
-	  errors++;
-	  do_reads = false;
-	  ulog(LOG_ERR, "Read returned error %d (%s)", errno,
-	       strerror(errno));
-	}
-      else if (0 == bytes_read)
+	  // After a protocol switch the rest is not HTTP/1.x (and what
+	  // was read has been echoed already). WebSocket frames and
+	  // HTTP/2 are followed unless there is nothing to report
+	  // (HTTP/2 messages still have records and histograms). With
+	  // another direction to read as well, the rest is echoed a read
+	  // at a time rather than passed through in one go.
+	  tunnel_resolve(&log_data->tunnel, buf_ptr, bytes_read);
+	  bool in_tunnel = (TUNNEL_OPEN == log_data->tunnel.state);
+	  bool in_h2 = (in_tunnel && log_data->tunnel.h2c);
+	  bool quiet = (0 == log_data->volume
+			&& !(in_h2 && (NULL != log_data->access_log
+				       || NULL != log_data->stats)));
+	  if (in_tunnel && (quiet || (!in_h2 && !log_data->tunnel.websocket)))
+	    {
+	      if (NULL != log_data->transactions)
+		{
+		  ls->opaque = true;
+		  break;
+		}
+	      tunnel_pass(fd_in, fd_out, NULL, 0);
+	      ls->reading = false;
+	      break;
+	    }
+
+	  // Call parser
+	  if (in_h2)
+	    {
+	      last_parsed =
+		h2_parser_execute(h2, &ls->settings, buf_ptr, bytes_read);
+	      if (H2_OK != h2->h2_errno)
+		last_parsed = 0;
+	    }
+	  else if (in_tunnel)
+	    last_parsed =
+	      ws_parser_execute(&ls->ws, &ls->ws_settings, buf_ptr,
+				bytes_read);
+	  else
+	    last_parsed =
+	      http_parser_execute(parser, &ls->settings, buf_ptr, bytes_read);
+	  ulog(LOG_DEBUG, "Parsed %zd bytes from %zd\n", last_parsed,
+	       bytes_read);
+
+	  if (last_parsed > 0)
+	    {
+	      // Some data was parsed. Advance buffer.
+	      bytes_read -= last_parsed;
+	      buf_ptr += last_parsed;
+	    }
+	  else if (in_h2)
+	    {
+	      ls->errors++;
+	      counter_add(COUNTER_PARSE_ERRORS, 1);
+	      ulog(LOG_ERR, "Parser error reading HTTP/2 stream: %s "
+		   "(%s frame on stream %u)", h2_errno_str(h2->h2_errno),
+		   h2_frame_type_str(h2->frame_type), h2->stream_id);
+	      ls->rc = EX_IOERR;
+	      if (NULL != log_data->access_log)
+		{
+		  http_parser stream;
+		  http_parser_init(&stream, h2->type);
+		  stream.http_major = 2;
+		  log_record(&stream, log_data, h2->stream_id,
+			     h2_errno_str(h2->h2_errno));
+		}
+	    }
+	  else if (in_tunnel)
+	    {
+	      ls->errors++;
+	      counter_add(COUNTER_PARSE_ERRORS, 1);
+	      ulog(LOG_ERR, "Parser error reading WebSocket stream: %s",
+		   ws_errno_str(ls->ws.ws_errno));
+	      ls->rc = EX_IOERR;
+	    }
+	  else
+	    {
+	      // Parser returned an error condition
+	      ls->errors++;
+	      counter_add(COUNTER_PARSE_ERRORS, 1);
+	      ulog(LOG_ERR,
+		   "Parser error reading HTTP stream type %d: %s (%s). Next char is %c (%d)",
+		   parser->type,
+		   http_errno_description(HTTP_PARSER_ERRNO(parser)),
+		   http_errno_name(HTTP_PARSER_ERRNO(parser)), *buf_ptr,
+		   *buf_ptr);
+	      ls->rc = EX_IOERR;
+	      if (NULL != log_data->access_log)
+		log_record(parser, log_data, 0,
+			   http_errno_name(HTTP_PARSER_ERRNO(parser)));
+	    }
+	}			// while (bytes_read > 0) && (errors <= 0)
+    }				// if...else
+
+  // Records go out a read at a time
+  if (NULL != log_data->access_log
+      && access_log_flush(log_data->access_log) != 0)
+    ulog(LOG_ERR, "Could not write access log: %s", strerror(errno));
+  log_stats_if_wanted(log_data);
+
+  if (ls->errors > 0)
+    ls->reading = false;
+  return;
+}
+
+
+/* pass_http_messages: 
+ * 
+ *    Reading from fd_in, echo bytes to fd_out and print "interesting"
+ *    messages about the HTTP header being consumed.
+ */
+int
+pass_http_messages(int fd_in, int fd_out, struct Log_Data *log_data)
+{
+  struct Log_Stream ls;
+  log_stream_open(&ls, fd_in, fd_out, log_data);
+  while (ls.reading)
+    log_stream_read(&ls);
+  log_stream_close(&ls);
+  return ls.rc;
+}
+
+
+/* pass_paired_messages:
+ *
+ *    Logs both directions of a connection: requests from req_in to
+ *    req_out, and responses from res_in to res_out, reading whichever
+ *    is ready. Each direction stops at its own EOF or error.
+ */
+int
+pass_paired_messages(int req_in, int req_out, int res_in, int res_out,
+		     struct Log_Data *requests, struct Log_Data *responses)
+{
+  struct Log_Stream ls[2];
+  log_stream_open(&ls[0], req_in, req_out, requests);
+  log_stream_open(&ls[1], res_in, res_out, responses);
+
+  while (ls[0].reading || ls[1].reading)
+    {
+      struct pollfd fds[2];
+      for (int n = 0; n < 2; n++)
 	{
-	  // let http parser know we are done
-	  last_parsed = http_parser_execute(&parser, &settings, buf_ptr, 0);
-	  ulog(LOG_DEBUG, "Read returned EOF. Have told parser.");
-	  do_reads = false;
+	  fds[n].fd = (ls[n].reading ? ls[n].fd_in : -1);
+	  fds[n].events = POLLIN;
+	  fds[n].revents = 0;
 	}
-      else
+      if (poll(fds, 2, -1) < 0)
 	{
-	  // Repeatedly call http_parser_execute while there is data left in the buffer
-	  while ((bytes_read > 0) && (errors <= 0))
+	  if (EINTR == errno)
 	    {
+	      log_stats_if_wanted(requests);
+	      continue;
+	    }
+	  ulog(LOG_ERR, "poll returned error %d (%s)", errno,
+	       strerror(errno));
+	  ls[0].rc = EX_OSERR;
+	  break;
+	}
 
-	      // We always echo to stdout directly what we've read
-	      write_all(fd_out, buffer, bytes_read);
-	      ulog(LOG_DEBUG, "Wrote %zd bytes to fd=%d", bytes_read, fd_out);
+      // Requests first, so a response can find its request
+      for (int n = 0; n < 2; n++)
+	if (fds[n].revents & (POLLIN | POLLHUP | POLLERR))
+	  log_stream_read(&ls[n]);
+    }
 
-	      // Call parser
-	      last_parsed =
-		http_parser_execute(&parser, &settings, buf_ptr, bytes_read);
-	      ulog(LOG_DEBUG, "Parsed %zd bytes from %zd\n", last_parsed,
-		   bytes_read);
+  log_stream_close(&ls[0]);
+  log_stream_close(&ls[1]);
+  return (0 != ls[0].rc ? ls[0].rc : ls[1].rc);
+}
 
-	      // TODO: Have to handle connection upgrade
-	      if (parser.upgrade)
-		{
-		  ulog(LOG_ERR,
-		       "Parser requested HTTP connection upgrade but that's not implemented yet!");
-		  errors++;
-		}
-	      else if (last_parsed > 0)
-		{
-		  // Some data was parsed. Advance buffer.
-		  bytes_read -= last_parsed;
-		  buf_ptr += last_parsed;
-		}
-	      else
-		{
-		  // Parser returned an error condition
-		  errors++;
-		  ulog(LOG_ERR,
-		       "Parser error reading HTTP stream type %d: %s (%s). Next char is %c (%d)",
-		       parser.type,
-		       http_errno_description(HTTP_PARSER_ERRNO(&parser)),
-		       http_errno_name(HTTP_PARSER_ERRNO(&parser)), *buf_ptr,
-		       *buf_ptr);
-		  rc = EX_IOERR;
-		}
-	    }			// while (bytes_read > 0) && (errors <= 0)
-	}			// if...else
+
+/* log_both_directions:
+ *
+ *    Logs requests from stdin to stdout, and the responses to them
+ *    read from "paired_in" (a FIFO, say, or /dev/fd/N) and echoed to
+ *    "paired_out" if given, pairing each response with its request.
+ *    Returns 0, or a sysexits code.
+ */
+int
+log_both_directions(struct Log_Data *requests, const char *paired_in,
+		    const char *paired_out)
+{
+  int res_in = open(paired_in, O_RDONLY);
+  if (res_in < 0)
+    {
+      ulog(LOG_ERR, "Could not open %s: %s", paired_in, strerror(errno));
+      return EX_NOINPUT;
+    }
+  int res_out = open((NULL == paired_out ? "/dev/null" : paired_out),
+		     O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (res_out < 0)
+    {
+      ulog(LOG_ERR, "Could not open %s: %s", paired_out, strerror(errno));
+      close(res_in);
+      return EX_CANTCREAT;
     }
-  while (do_reads && (errors <= 0));
 
-  // We allocated these
-  free(buffer);
+  // The responses share the requests' outputs, and their methods (to
+  // frame responses to HEAD)
+  struct Log_Data responses;
+  log_data_init(&responses);
+  responses.volume = requests->volume;
+  responses.framing_only = requests->framing_only;
+  responses.access_log = requests->access_log;
+  responses.stats = requests->stats;
+  responses.sampler = requests->sampler;
+  responses.all_headers = requests->all_headers;
+  method_queue_delete(responses.methods);
+  responses.methods = requests->methods;
+  responses.type = HTTP_RESPONSE;
+  requests->type = HTTP_REQUEST;
+  requests->transactions = transaction_queue_new();
+  if (NULL == requests->transactions)
+    {
+      perror("Error from malloc");
+      abort();
+    }
+  responses.transactions = requests->transactions;
 
+  int rc = pass_paired_messages(STDIN_FILENO, STDOUT_FILENO, res_in, res_out,
+				requests, &responses);
+  if (transaction_queue_count(requests->transactions) > 0)
+    ulog(LOG_INFO, "%zd requests were not answered",
+	 transaction_queue_count(requests->transactions));
+
+  close(res_in);
+  close(res_out);
+  transaction_queue_delete(requests->transactions);
+  requests->transactions = NULL;
+  responses.methods = NULL;
+  log_data_free(&responses);
   return rc;
 }
 
@@ -372,13 +1218,60 @@ main(int argc, char *argv[])
 
   // Process command line arguments
   int c = 0;
-  while ((c = getopt(argc, argv, "qv")) != -1)
+  bool all_headers = false;
+  const char *access_path = NULL;
+  int access_format = ACCESS_LOG_JSON;
+  bool histograms = false;
+  long stats_interval = 0;
+  char *endptr = NULL;
+  const char *paired_in = NULL;
+  const char *paired_out = NULL;
+  struct Log_Sampler sampler = { 1, 0, 0, 0, 0, 0 };
+  while ((c = getopt(argc, argv, "aqvs:r:o:F:HI:p:P:")) != -1)
     {
       switch (c)
 	{
+	case 'a':
+	  all_headers = true;
+	  break;
+	case 'o':
+	  access_path = optarg;
+	  break;
+	case 'F':
+	  access_format = access_log_format_lookup(optarg);
+	  if (access_format < 0)
+	    usage(argv[0]);
+	  break;
+	case 'H':
+	  histograms = true;
+	  break;
+	case 'I':
+	  histograms = true;
+	  stats_interval = strtol(optarg, &endptr, 10);
+	  if (*endptr || stats_interval < 1)
+	    usage(argv[0]);
+	  break;
+	case 'p':
+	  paired_in = optarg;
+	  break;
+	case 'P':
+	  paired_out = optarg;
+	  break;
 	case 'q':
 	  log_data.volume = 0;
 	  break;
+	case 'r':
+	  sampler.rate = strtod(optarg, &endptr);
+	  if (*endptr || !(sampler.rate > 0))
+	    usage(argv[0]);
+	  break;
+	case 's':
+	  if (strncmp(optarg, "1/", 2) != 0)
+	    usage(argv[0]);
+	  sampler.every = strtoul(optarg + 2, &endptr, 10);
+	  if (*endptr || sampler.every < 1 || '-' == optarg[2])
+	    usage(argv[0]);
+	  break;
 	case 'v':
 	  log_data.volume = 2;
 	  break;
@@ -386,11 +1279,60 @@ main(int argc, char *argv[])
 	  usage(argv[0]);
 	}
     }
+  if (NULL != paired_out && NULL == paired_in)
+    usage(argv[0]);
+
+  // Only verbose output shows headers other than those that frame the
+  // message, so the parser can skip the rest
+  log_data.framing_only = (log_data.volume < 2 && !all_headers);
+  log_data.all_headers = all_headers;
+
+  // Sampling starts with a full bucket, so the first message is
+  // printed
+  if (log_data.volume > 1 && (sampler.every > 1 || sampler.rate > 0))
+    {
+      sampler.tokens = MAX(sampler.rate, 1);
+      sampler.last_ns = monotonic_ns();
+      log_data.sampler = &sampler;
+    }
 
   ulog_init(argv[0]);
+  counters_open(argv[0]);
+  if (NULL != access_path)
+    {
+      log_data.access_log = access_log_open(access_path, access_format);
+      if (NULL == log_data.access_log)
+	{
+	  ulog(LOG_ERR, "Could not open %s: %s", access_path,
+	       strerror(errno));
+	  exit(EX_CANTCREAT);
+	}
+    }
+  if (histograms)
+    log_stats_start(&log_data, stats_interval);
+  ulog(LOG_INFO, "Logging HTTP messages at volume %d (%s headers; buffers: %s)",
+       log_data.volume, (log_data.framing_only ? "framing" : "all"),
+       buffer_alloc_describe());
 
-  int rc = pass_http_messages(STDIN_FILENO, STDOUT_FILENO, &log_data);
+  int rc = (NULL == paired_in
+	    ? pass_http_messages(STDIN_FILENO, STDOUT_FILENO, &log_data)
+	    : log_both_directions(&log_data, paired_in, paired_out));
+  if (NULL != log_data.access_log
+      && access_log_close(log_data.access_log) != 0)
+    {
+      ulog(LOG_ERR, "Could not write access log to %s", access_path);
+      rc = (0 == rc ? EX_IOERR : rc);
+    }
 
+  if (NULL != log_data.sampler)
+    ulog(LOG_INFO, "Printed the headers of %llu of %llu messages",
+	 sampler.dumped, sampler.seen);
+  if (NULL != log_data.stats)
+    {
+      stats_wanted = 1;
+      log_stats_if_wanted(&log_data);
+      message_stats_delete(log_data.stats);
+    }
   log_data_free(&log_data);
   ulog_close();
 
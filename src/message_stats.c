@@ -0,0 +1,174 @@
+/* message_stats.c:
+ *
+ *    Histograms of message sizes and intervals, by method and status
+ *    class.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <stdlib.h>
+
+#include "message_stats.h"
+
+static const char *metric_names[STATS_METRICS] = {
+  "size", "header", "body", "interval_us", "ttfb_us", "latency_us"
+};
+
+static const char *class_names[STATS_CLASSES] = {
+  "other", "1xx", "2xx", "3xx", "4xx", "5xx"
+};
+
+
+/* message_stats_new:
+ *
+ *    Returns empty statistics started at "now_ns", or NULL if there
+ *    was a memory allocation error.
+ */
+struct Message_Stats *
+message_stats_new(uint64_t now_ns)
+{
+  struct Message_Stats *stats = calloc(1, sizeof(struct Message_Stats));
+  if (NULL == stats)
+    return NULL;
+  stats->start_ns = now_ns;
+  return stats;
+}
+
+
+void
+message_stats_delete(struct Message_Stats *stats)
+{
+  for (size_t g = 0; g < STATS_GROUPS; g++)
+    free(stats->groups[g]);
+  free(stats);
+  return;
+}
+
+
+/* group_of:
+ *
+ *    Returns the group a message is counted in.
+ */
+static size_t
+group_of(const http_parser * parser)
+{
+  if (HTTP_RESPONSE != parser->type)
+    return (parser->method < STATS_METHODS ? parser->method : HTTP_GET);
+
+  size_t class = parser->status_code / 100;
+  return STATS_METHODS + (class < STATS_CLASSES ? class : 0);
+}
+
+
+/* group_histograms:
+ *
+ *    Returns the histograms of the group a message is counted in,
+ *    allocating them the first time, or NULL if that fails.
+ */
+static struct Histogram *
+group_histograms(struct Message_Stats *stats, const http_parser * parser)
+{
+  size_t g = group_of(parser);
+  struct Histogram *h = stats->groups[g];
+  if (NULL == h)
+    {
+      h = malloc(STATS_METRICS * sizeof(struct Histogram));
+      if (NULL == h)
+	return NULL;
+      for (int m = 0; m < STATS_METRICS; m++)
+	histogram_init(&h[m]);
+      stats->groups[g] = h;
+    }
+  return h;
+}
+
+
+/* message_stats_record:
+ *
+ *    Counts the message "parser" has just parsed, which completed at
+ *    "now_ns" (monotonic). Returns 0, or -1 if there was a memory
+ *    allocation error.
+ */
+int
+message_stats_record(struct Message_Stats *stats, const http_parser * parser,
+		     uint64_t header_bytes, uint64_t body_bytes,
+		     uint64_t now_ns)
+{
+  struct Histogram *h = group_histograms(stats, parser);
+  if (NULL == h)
+    return -1;
+
+  histogram_record(&h[STATS_SIZE], header_bytes + body_bytes);
+  histogram_record(&h[STATS_HEADER], header_bytes);
+  histogram_record(&h[STATS_BODY], body_bytes);
+  if (stats->messages > 0 && now_ns >= stats->last_ns)
+    histogram_record(&h[STATS_INTERVAL], (now_ns - stats->last_ns) / 1000);
+  stats->last_ns = now_ns;
+  stats->messages++;
+  return 0;
+}
+
+
+/* message_stats_record_transaction:
+ *
+ *    Counts the times of the transaction the response "parser" has
+ *    just completed. Returns 0, or -1 if there was a memory
+ *    allocation error.
+ */
+int
+message_stats_record_transaction(struct Message_Stats *stats,
+				 const http_parser * parser, uint64_t ttfb_ns,
+				 uint64_t latency_ns)
+{
+  struct Histogram *h = group_histograms(stats, parser);
+  if (NULL == h)
+    return -1;
+  histogram_record(&h[STATS_TTFB], ttfb_ns / 1000);
+  histogram_record(&h[STATS_LATENCY], latency_ns / 1000);
+  return 0;
+}
+
+
+/* message_stats_dump:
+ *
+ *    Prints a summary line, then a line per metric of each group seen
+ *    so far, each line starting with "prefix".
+ */
+void
+message_stats_dump(const struct Message_Stats *stats, FILE * out,
+		   const char *prefix, uint64_t now_ns)
+{
+  uint64_t elapsed_ms = (now_ns - stats->start_ns) / 1000000;
+  fprintf(out, "%s %llu messages in %llu.%03llus\n", prefix,
+	  (unsigned long long) stats->messages,
+	  (unsigned long long) elapsed_ms / 1000,
+	  (unsigned long long) elapsed_ms % 1000);
+
+  for (size_t g = 0; g < STATS_GROUPS; g++)
+    {
+      const struct Histogram *h = stats->groups[g];
+      if (NULL == h)
+	continue;
+      const char *group = (g < STATS_METHODS ? http_method_str(g)
+			   : class_names[g - STATS_METHODS]);
+      for (int m = 0; m < STATS_METRICS; m++)
+	{
+	  if (0 == h[m].count)
+	    continue;
+	  fprintf(out,
+		  "%s %s %s n=%llu min=%llu p50=%llu p90=%llu p99=%llu max=%llu\n",
+		  prefix, group, metric_names[m],
+		  (unsigned long long) h[m].count,
+		  (unsigned long long) h[m].min,
+		  (unsigned long long) histogram_percentile(&h[m], 50),
+		  (unsigned long long) histogram_percentile(&h[m], 90),
+		  (unsigned long long) histogram_percentile(&h[m], 99),
+		  (unsigned long long) h[m].max);
+	}
+    }
+  fflush(out);
+  return;
+}
@@ -0,0 +1,59 @@
+/* message_stats.h
+ *
+ *    Distributions of HTTP message sizes, and of the time between one
+ *    message and the next, kept for requests by method and for
+ *    responses by status class. Responses paired with their requests
+ *    also have their time to first byte and latency. Recording a message costs a few
+ *    histogram increments (and one allocation the first time a
+ *    method or class is seen). The summary is cumulative: each dump
+ *    covers every message since the start.
+ */
+#ifndef __MESSAGE_STATS_H__
+#define __MESSAGE_STATS_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "histogram.h"
+#include "http_parser.h"
+
+enum message_stats_metric
+{
+  STATS_SIZE,			// whole message, bytes
+  STATS_HEADER,			// head, bytes
+  STATS_BODY,			// body, bytes
+  STATS_INTERVAL,		// since the message before, us
+  STATS_TTFB,			// response's first byte after request, us
+  STATS_LATENCY,		// response complete after request, us
+  STATS_METRICS
+};
+
+// Groups: a request method each, then responses by status class
+// (other, 1xx .. 5xx)
+#define XX(num, name, string) + 1
+enum
+{ STATS_METHODS = 0 HTTP_METHOD_MAP(XX) };
+#undef XX
+#define STATS_CLASSES 6
+#define STATS_GROUPS (STATS_METHODS + STATS_CLASSES)
+
+struct Message_Stats
+{
+  struct Histogram *groups[STATS_GROUPS];	// STATS_METRICS each
+  uint64_t start_ns;
+  uint64_t last_ns;
+  uint64_t messages;
+};
+
+struct Message_Stats *message_stats_new(uint64_t now_ns);
+void message_stats_delete(struct Message_Stats *stats);
+int message_stats_record(struct Message_Stats *stats,
+			 const http_parser * parser, uint64_t header_bytes,
+			 uint64_t body_bytes, uint64_t now_ns);
+int message_stats_record_transaction(struct Message_Stats *stats,
+				     const http_parser * parser,
+				     uint64_t ttfb_ns, uint64_t latency_ns);
+void message_stats_dump(const struct Message_Stats *stats, FILE * out,
+			const char *prefix, uint64_t now_ns);
+
+#endif /* __MESSAGE_STATS_H__ */
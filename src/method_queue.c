@@ -0,0 +1,143 @@
+/* method_queue.c:
+ *
+ *    FIFO of outstanding request methods, used to frame responses.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "ulog.h"
+
+#include "method_queue.h"
+
+
+/* method_queue_new:
+ *
+ *    Returns a new empty queue, or NULL on memory allocation error.
+ */
+struct Method_Queue *
+method_queue_new(void)
+{
+  struct Method_Queue *mq = malloc(sizeof(struct Method_Queue));
+  if (mq != NULL)
+    {
+      mq->last_method = -1;
+      mq->head = 0;
+      mq->count = 0;
+    }
+  return mq;
+}
+
+
+/* method_queue_delete:
+ *
+ *    Frees the queue.
+ */
+void
+method_queue_delete(struct Method_Queue *mq)
+{
+  free(mq);
+  return;
+}
+
+
+/* method_queue_push:
+ *
+ *    Records the method of a request that is waiting for a
+ *    response. If more than METHOD_QUEUE_MAX requests are
+ *    outstanding the oldest is forgotten (and its response will be
+ *    framed by its headers alone). That is usual, not a problem, in a
+ *    stream of requests only, which never drains the queue.
+ */
+void
+method_queue_push(struct Method_Queue *mq, enum http_method method)
+{
+  assert(mq != NULL);
+
+  if (mq->count >= METHOD_QUEUE_MAX)
+    {
+      ulog_debug("More than %d requests outstanding -- forgetting %s",
+		 METHOD_QUEUE_MAX, http_method_str(mq->methods[mq->head]));
+      mq->head = (mq->head + 1) % METHOD_QUEUE_MAX;
+      mq->count--;
+    }
+
+  mq->methods[(mq->head + mq->count) % METHOD_QUEUE_MAX] = method;
+  mq->count++;
+  return;
+}
+
+
+/* method_queue_pop:
+ *
+ *    Removes and returns the oldest outstanding request method, or -1
+ *    if there is none (say, a stream of responses only).
+ */
+int
+method_queue_pop(struct Method_Queue *mq)
+{
+  assert(mq != NULL);
+
+  if (0 == mq->count)
+    return -1;
+
+  int method = mq->methods[mq->head];
+  mq->head = (mq->head + 1) % METHOD_QUEUE_MAX;
+  mq->count--;
+  return method;
+}
+
+
+/* method_queue_count:
+ *
+ *    Returns the number of requests still waiting for a response.
+ */
+size_t
+method_queue_count(struct Method_Queue *mq)
+{
+  return mq->count;
+}
+
+
+/* method_queue_skip_body:
+ *
+ *    Call from on_headers_complete and return its result. Requests
+ *    are queued. A response takes the oldest request off the queue
+ *    (except interim 1xx responses, which are followed by the final
+ *    one) and returns 1 to tell the parser there is no body if the
+ *    request was a HEAD or the status is 1xx, 204 or 304. A 2xx
+ *    response to CONNECT has no body either, and is flagged as an
+ *    upgrade: the connection is a tunnel from then on.
+ */
+int
+method_queue_skip_body(struct Method_Queue *mq, http_parser * parser)
+{
+  if (HTTP_REQUEST == parser->type)
+    {
+      method_queue_push(mq, parser->method);
+      return 0;
+    }
+
+  unsigned int status = parser->status_code;
+  if (status >= 100 && status < 200 && status != 101)
+    return 1;
+
+  mq->last_method = method_queue_pop(mq);
+  if (HTTP_HEAD == mq->last_method)
+    {
+      ulog_debug("Response to HEAD request -- skipping body");
+      return 1;
+    }
+  if (HTTP_CONNECT == mq->last_method && status >= 200 && status < 300)
+    {
+      parser->upgrade = 1;
+      return 1;
+    }
+
+  return (204 == status || 304 == status || 101 == status) ? 1 : 0;
+}
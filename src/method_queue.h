@@ -0,0 +1,41 @@
+/* method_queue.h
+ *
+ *    Remembers the methods of requests that have not been answered
+ *    yet, so a response can be matched to its request. Tools call
+ *    method_queue_skip_body from on_headers_complete: it records
+ *    request methods, and for responses returns 1 (skip the body)
+ *    when the request was a HEAD or the status never has a body
+ *    (1xx, 204 and 304), whatever Content-Length says.
+ *
+ *    Requests are queued when the tool sees them in its own stream,
+ *    or may be pushed from a side channel with method_queue_push.
+ *    Pipelined requests are answered in order, so this is a FIFO.
+ */
+#ifndef __METHOD_QUEUE_H__
+#define __METHOD_QUEUE_H__
+
+#include <sys/types.h>
+
+#include "http_parser.h"
+
+#define METHOD_QUEUE_MAX 256
+
+struct Method_Queue
+{
+  // Read-only
+  int last_method;		// Request method of the last response, or -1
+
+  // Private
+  unsigned char methods[METHOD_QUEUE_MAX];
+  size_t head;
+  size_t count;
+};
+
+struct Method_Queue *method_queue_new(void);
+void method_queue_delete(struct Method_Queue *mq);
+void method_queue_push(struct Method_Queue *mq, enum http_method method);
+int method_queue_pop(struct Method_Queue *mq);
+size_t method_queue_count(struct Method_Queue *mq);
+int method_queue_skip_body(struct Method_Queue *mq, http_parser * parser);
+
+#endif
@@ -0,0 +1,153 @@
+/*
+ * mumplog.c -- print the binary records written by "log -F bin" as
+ * the JSON lines "log -F json" would have written.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <unistd.h>
+
+#include "ulog.h"
+#include "util.h"
+#include "access_log.h"
+
+
+/* usage:
+ *
+ *    print usage message and abort. Does not return.
+ */
+void
+usage(const char *ident)
+{
+  fprintf(stderr, "usage: %s [file ...]\n\tReads stdin if no files are given\n",
+	  ident);
+  exit(EX_USAGE);
+}
+
+
+/* decode_log:
+ *
+ *    Reads the binary log on "fd_in" and writes its records to "out"
+ *    as JSON. Returns 0, or a sysexits code.
+ */
+int
+decode_log(int fd_in, const char *name, struct Access_Log *out)
+{
+  char *buffer = malloc(BUFFER_MAX);
+  if (NULL == buffer)
+    {
+      perror("Error from malloc");
+      abort();
+    }
+
+  int rc = 0;
+  size_t used = 0;
+  size_t records = 0;
+  bool checked = false;
+  ssize_t bytes_read = 0;
+  do
+    {
+      bytes_read = read(fd_in, buffer + used, BUFFER_MAX - used);
+      if (bytes_read < 0)
+	{
+	  ulog(LOG_ERR, "%s: read returned error %d (%s)", name, errno,
+	       strerror(errno));
+	  rc = EX_IOERR;
+	  break;
+	}
+      used += bytes_read;
+
+      size_t p = 0;
+      if (!checked && (used >= ACCESS_LOG_MAGIC_LEN || 0 == bytes_read))
+	{
+	  if (used < ACCESS_LOG_MAGIC_LEN
+	      || memcmp(buffer, ACCESS_LOG_MAGIC, ACCESS_LOG_MAGIC_LEN) != 0)
+	    {
+	      ulog(LOG_ERR, "%s: not a binary log from log -F bin", name);
+	      rc = EX_DATAERR;
+	      break;
+	    }
+	  checked = true;
+	  p = ACCESS_LOG_MAGIC_LEN;
+	}
+
+      // Whole records are printed; a partial one waits for the rest
+      ssize_t size = 0;
+      struct Access_Record rec;
+      while (checked
+	     && (size = access_log_decode(buffer + p, used - p, &rec)) > 0)
+	{
+	  access_log_write(out, &rec);
+	  p += size;
+	  records++;
+	}
+      if (size < 0 || (0 == bytes_read && p < used && checked))
+	{
+	  ulog(LOG_ERR, "%s: bad record after %zd records", name, records);
+	  rc = EX_DATAERR;
+	  break;
+	}
+      memmove(buffer, buffer + p, used - p);
+      used -= p;
+    }
+  while (bytes_read > 0);
+
+  ulog(LOG_INFO, "%s: %zd records", name, records);
+  free(buffer);
+  return rc;
+}
+
+
+/* main:
+ *
+ *    Decodes each file named, or stdin. Returns 0 if all OK,
+ *    otherwise non-zero if a log could not be read.
+ */
+int
+main(int argc, char *argv[])
+{
+  int c = 0;
+  while ((c = getopt(argc, argv, "")) != -1)
+    usage(argv[0]);
+
+  ulog_init(argv[0]);
+  struct Access_Log *out = access_log_fdopen(STDOUT_FILENO, ACCESS_LOG_JSON);
+  if (NULL == out)
+    {
+      perror("Error from malloc");
+      abort();
+    }
+
+  int rc = 0;
+  if (optind == argc)
+    rc = decode_log(STDIN_FILENO, "stdin", out);
+  for (int n = optind; n < argc && 0 == rc; n++)
+    {
+      int fd = open(argv[n], O_RDONLY);
+      if (fd < 0)
+	{
+	  ulog(LOG_ERR, "Could not open %s: %s", argv[n], strerror(errno));
+	  rc = EX_NOINPUT;
+	}
+      else
+	{
+	  rc = decode_log(fd, argv[n], out);
+	  close(fd);
+	}
+    }
+
+  if (access_log_close(out) != 0 && 0 == rc)
+    rc = EX_IOERR;
+  ulog_close();
+  return rc;
+}
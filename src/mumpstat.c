@@ -0,0 +1,299 @@
+/*
+ * mumpstat.c -- show the counters of the tools running now, like
+ * top: throughput, messages, errors and spawns per stage, and how
+ * much of its time each stage spends waiting on its input and on its
+ * output.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sysexits.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ulog.h"
+#include "util.h"
+#include "counters.h"
+
+#define CLEAR_SCREEN "\x1b[H\x1b[2J"
+
+
+/* usage:
+ *
+ *    print usage message and abort. Does not return.
+ */
+void
+usage(const char *ident)
+{
+  fprintf(stderr,
+	  "usage: %s [-c] [-i seconds] [-n count]\n\t-c\tremove the counters left by tools that have died\n\t-i\tseconds between updates (default 1)\n\t-n\tstop after so many updates\n",
+	  ident);
+  exit(EX_USAGE);
+}
+
+
+/* A stage's counters when they were last shown.
+ *
+ *    name        File name of its segment in COUNTERS_DIR.
+ *    pid, tool   Whose they are.
+ *    values      Counter values.
+ *    when        When they were read (monotonic).
+ *    seen        Still there at the last update.
+ */
+struct Stage
+{
+  char name[NAME_MAX + 1];
+  int pid;
+  char tool[COUNTERS_TOOL_MAX];
+  uint64_t values[COUNTER_MAX];
+  uint64_t when;
+  bool seen;
+};
+
+struct Stages
+{
+  struct Stage *stage;
+  size_t count;
+  size_t max;
+};
+
+
+/* stages_find:
+ *
+ *    Returns the stage with segment "name", adding it (with counters
+ *    at zero since "start_ns") if it is new.
+ */
+struct Stage *
+stages_find(struct Stages *stages, const char *name, uint64_t start_ns)
+{
+  for (size_t n = 0; n < stages->count; n++)
+    if (strcmp(stages->stage[n].name, name) == 0)
+      return &stages->stage[n];
+
+  if (stages->count == stages->max)
+    {
+      size_t new_max = MAX(stages->max * 2, 16);
+      struct Stage *stage = realloc(stages->stage,
+				    new_max * sizeof(struct Stage));
+      if (NULL == stage)
+	{
+	  perror("Error from realloc");
+	  abort();
+	}
+      stages->stage = stage;
+      stages->max = new_max;
+    }
+  struct Stage *stage = &stages->stage[stages->count++];
+  memset(stage, 0, sizeof(struct Stage));
+  strncpy(stage->name, name, NAME_MAX);
+  stage->when = start_ns;
+  return stage;
+}
+
+
+/* compare_stages:
+ *
+ *    Orders stages by pid, which is usually their order in the
+ *    pipeline.
+ */
+static int
+compare_stages(const void *a, const void *b)
+{
+  const struct Stage *sa = a, *sb = b;
+  return (sa->pid > sb->pid) - (sa->pid < sb->pid);
+}
+
+
+/* rate:
+ *
+ *    Returns how much "value" grew a second between readings.
+ */
+static double
+rate(uint64_t value, uint64_t before, uint64_t elapsed_ns)
+{
+  return (0 == elapsed_ns ? 0 : (value - before) * 1e9 / elapsed_ns);
+}
+
+
+/* stage_print:
+ *
+ *    Reads the counters of a stage from "seg" and prints how they
+ *    have changed since they were last read.
+ */
+void
+stage_print(struct Stage *stage, const struct Counters_Segment *seg)
+{
+  uint64_t values[COUNTER_MAX];
+  for (int id = 0; id < COUNTER_MAX; id++)
+    values[id] = counter_get(seg, id);
+  uint64_t now = counters_now_ns();
+  uint64_t elapsed = now - stage->when;
+
+  stage->pid = seg->pid;
+  memcpy(stage->tool, seg->tool, COUNTERS_TOOL_MAX);
+  stage->tool[COUNTERS_TOOL_MAX - 1] = '\0';
+
+  // Waits are shares of the time, as percentages
+  double in_wait = rate(values[COUNTER_READ_WAIT_NS],
+			stage->values[COUNTER_READ_WAIT_NS], elapsed) / 1e7;
+  double out_wait = rate(values[COUNTER_WRITE_WAIT_NS],
+			 stage->values[COUNTER_WRITE_WAIT_NS], elapsed) / 1e7;
+  printf("%-8d %-10s %10.2f %10.2f %10.1f %8llu %8llu %7.1f%% %7.1f%%\n",
+	 stage->pid, stage->tool,
+	 rate(values[COUNTER_BYTES_IN], stage->values[COUNTER_BYTES_IN],
+	      elapsed) / (1024 * 1024),
+	 rate(values[COUNTER_BYTES_OUT], stage->values[COUNTER_BYTES_OUT],
+	      elapsed) / (1024 * 1024),
+	 rate(values[COUNTER_MESSAGES], stage->values[COUNTER_MESSAGES],
+	      elapsed), (unsigned long long) values[COUNTER_PARSE_ERRORS],
+	 (unsigned long long) values[COUNTER_SPAWNS], MIN(in_wait, 100),
+	 MIN(out_wait, 100));
+
+  memcpy(stage->values, values, sizeof(values));
+  stage->when = now;
+  return;
+}
+
+
+/* show_stages:
+ *
+ *    Prints a line for each tool running. The first time a tool is
+ *    seen its rates are since it started; after that, since the last
+ *    update. Segments of tools that have died are skipped, or
+ *    removed if "clean". Returns 0, or a sysexits code.
+ */
+int
+show_stages(struct Stages *stages, bool clean)
+{
+  DIR *dir = opendir(COUNTERS_DIR);
+  if (NULL == dir)
+    {
+      ulog(LOG_ERR, "Could not open %s: %s", COUNTERS_DIR, strerror(errno));
+      return EX_UNAVAILABLE;
+    }
+
+  for (size_t n = 0; n < stages->count; n++)
+    stages->stage[n].seen = false;
+
+  struct dirent *entry = NULL;
+  while ((entry = readdir(dir)) != NULL)
+    {
+      if (strncmp(entry->d_name, COUNTERS_PREFIX,
+		  strlen(COUNTERS_PREFIX)) != 0)
+	continue;
+      const struct Counters_Segment *seg = counters_attach(entry->d_name);
+      if (NULL == seg)
+	continue;
+
+      if (kill(seg->pid, 0) != 0 && ESRCH == errno)
+	{
+	  if (clean)
+	    {
+	      char path[NAME_MAX + 2];
+	      snprintf(path, sizeof(path), "/%s", entry->d_name);
+	      shm_unlink(path);
+	      ulog(LOG_INFO, "Removed %s of pid %d, which has died",
+		   entry->d_name, seg->pid);
+	    }
+	}
+      else
+	{
+	  struct Stage *stage = stages_find(stages, entry->d_name,
+					    seg->start_ns);
+	  stage->seen = true;
+	  stage->pid = seg->pid;
+	}
+      counters_detach(seg);
+    }
+  closedir(dir);
+
+  // Forget the stages that have gone, and show the rest in order
+  size_t kept = 0;
+  for (size_t n = 0; n < stages->count; n++)
+    if (stages->stage[n].seen)
+      stages->stage[kept++] = stages->stage[n];
+  stages->count = kept;
+  qsort(stages->stage, stages->count, sizeof(struct Stage), compare_stages);
+
+  if (isatty(STDOUT_FILENO))
+    printf(CLEAR_SCREEN);
+  printf("%-8s %-10s %10s %10s %10s %8s %8s %8s %8s\n", "PID", "TOOL",
+	 "IN MB/s", "OUT MB/s", "MSG/s", "ERRORS", "SPAWNS", "IN-WAIT",
+	 "OUT-WAIT");
+  for (size_t n = 0; n < stages->count; n++)
+    {
+      const struct Counters_Segment *seg =
+	counters_attach(stages->stage[n].name);
+      if (NULL == seg)
+	continue;
+      stage_print(&stages->stage[n], seg);
+      counters_detach(seg);
+    }
+  fflush(stdout);
+  return 0;
+}
+
+
+/* main:
+ *
+ *    Shows the stages every so often. Returns 0, or non-zero if the
+ *    counters could not be read.
+ */
+int
+main(int argc, char *argv[])
+{
+  int c = 0;
+  bool clean = false;
+  long interval = 1;
+  long updates = 0;
+  char *endptr = NULL;
+  while ((c = getopt(argc, argv, "ci:n:")) != -1)
+    {
+      switch (c)
+	{
+	case 'c':
+	  clean = true;
+	  break;
+	case 'i':
+	  interval = strtol(optarg, &endptr, 10);
+	  if (*endptr || interval < 1)
+	    usage(argv[0]);
+	  break;
+	case 'n':
+	  updates = strtol(optarg, &endptr, 10);
+	  if (*endptr || updates < 1)
+	    usage(argv[0]);
+	  break;
+	default:
+	  usage(argv[0]);
+	}
+    }
+  if (optind != argc)
+    usage(argv[0]);
+
+  ulog_init(argv[0]);
+  struct Stages stages = { NULL, 0, 0 };
+  int rc = 0;
+  for (long n = 0; 0 == rc && (0 == updates || n < updates); n++)
+    {
+      if (n > 0)
+	sleep(interval);
+      rc = show_stages(&stages, clean);
+    }
+
+  free(stages.stage);
+  ulog_close();
+  return rc;
+}
@@ -4,6 +4,10 @@
  *
  */
 
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -12,6 +16,7 @@
 
 #include "util.h"
 #include "ulog.h"
+#include "counters.h"
 
 int
 main(int argc, char *argv[])
@@ -33,6 +38,7 @@ main(int argc, char *argv[])
     }
 
   ulog_init(argv[0]);
+  counters_open(argv[0]);
 
   if (strcmp(argv[0] + strlen(argv[0]) - 4, "null") == 0)
     do_writes = 0;
@@ -45,7 +51,7 @@ main(int argc, char *argv[])
   do
     {
       memset(buf, 0, BUFFER_MAX);
-      br = read(STDIN_FILENO, buf, BUFFER_MAX);
+      br = read_input(STDIN_FILENO, buf, BUFFER_MAX);
       ulog_debug("Read %zd bytes from fd=%d", br, STDIN_FILENO);
 
       if (br > 0)
@@ -6,6 +6,7 @@
 #endif
 
 #include <assert.h>
+#include <errno.h>
 #include <paths.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -23,6 +24,8 @@
 
 #include "pipes.h"
 #include "ulog.h"
+#include "counters.h"
+#include "probes.h"
 
 
 /* pipe_handle_new:
@@ -41,6 +44,10 @@ pipe_handle_new(void)
     {
       ph->state = PIPES_CLOSED;
       ph->child_pid = 0;
+      memset(&ph->rusage, 0, sizeof(ph->rusage));
+      ph->spawn_ns = 0;
+      ph->fork_ns = 0;
+      ph->wall_ns = 0;
       ph->pipe_fds[0] = STDIN_FILENO;
       ph->pipe_fds[1] = STDOUT_FILENO;
       ph->bipipe_fds[0] = 0;
@@ -119,6 +126,7 @@ pipe_open(struct Pipe_Handle *ph, const char *command_line)
 
 
   // Fork here. 
+  ph->spawn_ns = counters_now_ns();
   ph->child_pid = fork();
   if (-1 == ph->child_pid)
     {
@@ -166,6 +174,9 @@ pipe_open(struct Pipe_Handle *ph, const char *command_line)
     {
       // Am parent. I send data, so don't need read end of pipe.
       close(ph->pipe_fds[0]);
+      ph->fork_ns = counters_now_ns() - ph->spawn_ns;
+      PROBE2(pipe__spawn, ph->child_pid, ph->command_line);
+      counter_add(COUNTER_SPAWNS, 1);
       ulog(LOG_INFO,
 	   "Parent has set up its end. Child is pid=%d. Pipe fd=%d ",
 	   ph->child_pid, ph->pipe_fds[1]);
@@ -237,6 +248,7 @@ pipe_open2(struct Pipe_Handle *ph, const char *command_line)
 
 
   // Fork here. 
+  ph->spawn_ns = counters_now_ns();
   ph->child_pid = fork();
   if (-1 == ph->child_pid)
     {
@@ -293,6 +305,9 @@ pipe_open2(struct Pipe_Handle *ph, const char *command_line)
       // Am parent. I send data, so don't need read end of pipe1 or write end of pipe2.
       close(ph->pipe_fds[0]);
       close(ph->bipipe_fds[1]);
+      ph->fork_ns = counters_now_ns() - ph->spawn_ns;
+      PROBE2(pipe__spawn, ph->child_pid, ph->command_line);
+      counter_add(COUNTER_SPAWNS, 1);
       ulog(LOG_INFO,
 	   "Parent has set up its end. Child is pid=%d. Pipe fd=%d ",
 	   ph->child_pid, ph->pipe_fds[1]);
@@ -303,6 +318,87 @@ pipe_open2(struct Pipe_Handle *ph, const char *command_line)
 }
 
 
+/* pipe_open_fds:
+ *
+ *    Run "command_line" with its stdin and stdout attached directly
+ *    to the caller's descriptors "fd_in" and "fd_out" -- no pipes are
+ *    created. Useful when the input is already in a (seekable) file
+ *    such as a memfd, and the output should land in another one.
+ *
+ *    "fd_in" should already be positioned where the child is to
+ *    start reading. The parent is expected to call pipe_close to
+ *    wait for the child to finish before using "fd_out".
+ *
+ *    Will update the pipe handle "ph" with new state
+ *    information. Returns 0 on success, non-zero on error.
+ */
+int
+pipe_open_fds(struct Pipe_Handle *ph, const char *command_line, int fd_in,
+	      int fd_out)
+{
+  // Expect handle initialised and pipe not opened yet.
+  assert(ph != NULL);
+  assert(PIPES_CLOSED == ph->state);
+
+  // Copy this for later. 
+  strncpy(ph->command_line, command_line, ARG_MAX);
+  ph->state = PIPES_OPENING;
+
+  // Fork here. 
+  ph->spawn_ns = counters_now_ns();
+  ph->child_pid = fork();
+  if (-1 == ph->child_pid)
+    {
+      perror("Unable to fork");
+      ph->state = PIPES_CLOSED;
+      return -1;
+    }
+
+  if (0 == ph->child_pid)
+    {
+      // Am child. Point stdin and stdout at the descriptors given.
+      if (dup2(fd_in, STDIN_FILENO) != STDIN_FILENO)
+	{
+	  perror("Could not dup2 descriptor to stdin");
+	  abort();
+	}
+      if (dup2(fd_out, STDOUT_FILENO) != STDOUT_FILENO)
+	{
+	  perror("Could not dup2 descriptor to stdout");
+	  abort();
+	}
+
+      // Exec here
+      ulog(LOG_INFO, "Child has set up its end. About to exec: %s -c %s",
+	   _PATH_BSHELL, ph->command_line);
+      if (execl(_PATH_BSHELL, _PATH_BSHELL, "-c", ph->command_line, NULL) ==
+	  -1)
+	{
+	  ulog(LOG_ERR, "Child was not able to exec: %s -c %s", _PATH_BSHELL,
+	       ph->command_line);
+	  perror("Error in execl");
+	  abort();
+	}
+
+      // Child should never get here!
+      perror("Unreachable code reached!");
+      abort();
+    }
+  else
+    {
+      ph->fork_ns = counters_now_ns() - ph->spawn_ns;
+      PROBE2(pipe__spawn, ph->child_pid, ph->command_line);
+      counter_add(COUNTER_SPAWNS, 1);
+      ulog(LOG_INFO,
+	   "Parent has set up its end. Child is pid=%d. In fd=%d; Out fd=%d",
+	   ph->child_pid, fd_in, fd_out);
+    }
+
+  ph->state = PIPES_OPEN_FDS;
+  return 0;
+}
+
+
 /* pipe_send_eof:
  *
  *    Closes the "write" end of the pipe, which will signal the EOF
@@ -329,8 +425,9 @@ pipe_send_eof(struct Pipe_Handle *ph)
 /* pipe_close:
  *
  *    Closes the pipe(s) which is expected to terminate the piped
- *    process. Closes both uni and bi-directional pipes. Returns 0 on
- *    success, non-zero on error.
+ *    process. Closes both uni and bi-directional pipes. The child's
+ *    resource usage and wall time are left in the handle. Returns 0
+ *    on success, non-zero on error.
  */
 int
 pipe_close(struct Pipe_Handle *ph)
@@ -340,29 +437,41 @@ pipe_close(struct Pipe_Handle *ph)
   assert(ph != NULL);
   assert(ph->state > PIPES_CLOSED);
 
-  // Close pipe handle (parent already closes pipe_fds[0] above)
-  close(ph->pipe_fds[1]);
+  // Close pipe handle (parent already closes pipe_fds[0] above). A
+  // child attached to caller's descriptors has no pipes of ours.
+  if (PIPES_OPEN_FDS != ph->state)
+    close(ph->pipe_fds[1]);
 
   // Bi-directional pipes need second pipe closed as well
   if (PIPES_OPEN_BI == ph->state)
     close(ph->bipipe_fds[0]);
 
-  ulog_debug("Parent waiting for child %d to exit (waitpid)", ph->child_pid);
+  ulog_debug("Parent waiting for child %d to exit (wait4)", ph->child_pid);
 
   // Child just got an EOF. Wait for child process (pipe) to terminate
   int stat_loc = 0;
-  pid_t reaped_pid = waitpid(ph->child_pid, &stat_loc, 0);
+  pid_t reaped_pid = 0;
+  do
+    reaped_pid = wait4(ph->child_pid, &stat_loc, 0, &ph->rusage);
+  while (-1 == reaped_pid && EINTR == errno);
+  ph->wall_ns = counters_now_ns() - ph->spawn_ns;
+  PROBE2(pipe__reap, ph->child_pid, (reaped_pid == -1 ? -1 : stat_loc));
   ulog_debug
-    ("waitpid(%d) returned %d. (exited=%d; signalled=%d; stopped=%d)",
+    ("wait4(%d) returned %d. (exited=%d; signalled=%d; stopped=%d; "
+     "user=%ld.%06lds; sys=%ld.%06lds; maxrss=%ldkB; wall=%.6fs)",
      ph->child_pid, reaped_pid, WIFEXITED(stat_loc), WIFSIGNALED(stat_loc),
-     WIFSTOPPED(stat_loc));
+     WIFSTOPPED(stat_loc), (long) ph->rusage.ru_utime.tv_sec,
+     (long) ph->rusage.ru_utime.tv_usec, (long) ph->rusage.ru_stime.tv_sec,
+     (long) ph->rusage.ru_stime.tv_usec, ph->rusage.ru_maxrss,
+     ph->wall_ns / 1e9);
 
   // Log what happened to child
   if (reaped_pid == -1)
     {
       ulog(LOG_ERR, "Child process %d could not be reaped (%m)",
 	   ph->child_pid);
-      perror("Error returned by waitpid");
+      perror("Error returned by wait4");
+      memset(&ph->rusage, 0, sizeof(ph->rusage));
     }
   else if (WIFEXITED(stat_loc))
     {
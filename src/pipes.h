@@ -5,17 +5,24 @@
 # include "config.h"
 #endif
 
+#include <stdint.h>
+#include <sys/resource.h>
 #include <sys/types.h>
 
 
 enum pipe_states
-{ PIPES_CLOSED, PIPES_OPENING, PIPES_OPEN_UNI, PIPES_OPEN_BI, PIPES_WIDOWED };
+{ PIPES_CLOSED, PIPES_OPENING, PIPES_OPEN_UNI, PIPES_OPEN_BI, PIPES_WIDOWED,
+  PIPES_OPEN_FDS };
 
 struct Pipe_Handle
 {
   // Read-only
   unsigned int state;		// enum pipe_states
   pid_t child_pid;
+  struct rusage rusage;		// Of the child, once pipe_close reaps it
+  uint64_t spawn_ns;		// When the child was started (monotonic)
+  uint64_t fork_ns;		// ...and how long the fork took us
+  uint64_t wall_ns;		// ...and how long it ran, once reaped
 
   // Private
   int pipe_fds[2];
@@ -28,6 +35,8 @@ struct Pipe_Handle *pipe_handle_new(void);
 void pipe_handle_delete(struct Pipe_Handle *ph);
 int pipe_open(struct Pipe_Handle *ph, const char *pipe_cmd);
 int pipe_open2(struct Pipe_Handle *ph, const char *pipe_cmd);
+int pipe_open_fds(struct Pipe_Handle *ph, const char *pipe_cmd, int fd_in,
+		  int fd_out);
 int pipe_close(struct Pipe_Handle *ph);
 int pipe_reset(struct Pipe_Handle *ph);
 void pipe_send_eof(struct Pipe_Handle *ph);
@@ -0,0 +1,41 @@
+/* probes.h
+ *
+ *    Static tracepoints (USDT) for perf and bpftrace, under the
+ *    provider "mumpsimus". Where <sys/sdt.h> is available each is a
+ *    single nop until a tracer attaches; elsewhere they compile to
+ *    nothing. List them with "perf list sdt_mumpsimus:*" (after "perf
+ *    buildid-cache --add <tool>") or "bpftrace -l 'usdt:<tool>:*'".
+ *
+ *    Probe                 Arguments
+ *    message__begin        parser, type (0 request, 1 response)
+ *    message__complete     parser, type
+ *    headers__complete     parser, type, header bytes
+ *    body                  parser, bytes delivered
+ *    pipe__spawn           child pid, command line
+ *    pipe__reap            child pid, wait status (-1 if not reaped)
+ *    write__short          fd, bytes wanted, bytes written, errno
+ *
+ *    HTTP/2 streams fire the message and headers probes as HTTP/1
+ *    messages do, with the stream's own parser.
+ */
+#ifndef __PROBES_H__
+#define __PROBES_H__
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#ifdef HAVE_SYS_SDT_H
+#  include <sys/sdt.h>
+#  define PROBE1(name, a) DTRACE_PROBE1(mumpsimus, name, a)
+#  define PROBE2(name, a, b) DTRACE_PROBE2(mumpsimus, name, a, b)
+#  define PROBE3(name, a, b, c) DTRACE_PROBE3(mumpsimus, name, a, b, c)
+#  define PROBE4(name, a, b, c, d) DTRACE_PROBE4(mumpsimus, name, a, b, c, d)
+#else
+#  define PROBE1(name, a) do { } while (0)
+#  define PROBE2(name, a, b) do { } while (0)
+#  define PROBE3(name, a, b, c) do { } while (0)
+#  define PROBE4(name, a, b, c, d) do { } while (0)
+#endif
+
+#endif /* __PROBES_H__ */
@@ -0,0 +1,115 @@
+/* stage_timing.c:
+ *
+ *    The X-Mumpsimus-Timing header of each message (see -T).
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include "counters.h"
+#include "stage_timing.h"
+
+
+/* stage_timing_init:
+ *
+ *    Timing is off if "tool" is NULL; the other calls then do nothing.
+ */
+void
+stage_timing_init(struct Stage_Timing *timing, const char *tool)
+{
+  memset(timing, 0, sizeof(struct Stage_Timing));
+  timing->tool = tool;
+  timing->out_mark = counter_get(counters, COUNTER_WRITE_WAIT_NS);
+  return;
+}
+
+
+/* stage_timing_begin:
+ *
+ *    Called when a message starts.
+ */
+void
+stage_timing_begin(struct Stage_Timing *timing)
+{
+  if (NULL == timing->tool)
+    return;
+  timing->begin_ns = counters_now_ns();
+  timing->end_ns = 0;
+  timing->spawn_ns = 0;
+  timing->late_spawn_ns = 0;
+  return;
+}
+
+
+/* stage_timing_end:
+ *
+ *    Called once the message has all been read.
+ */
+void
+stage_timing_end(struct Stage_Timing *timing)
+{
+  if (NULL == timing->tool)
+    return;
+  timing->end_ns = counters_now_ns();
+  return;
+}
+
+
+/* stage_timing_spawned:
+ *
+ *    Adds the time forking a command for the message took.
+ */
+void
+stage_timing_spawned(struct Stage_Timing *timing, uint64_t fork_ns)
+{
+  if (NULL == timing->tool)
+    return;
+  timing->spawn_ns += fork_ns;
+  if (0 != timing->end_ns)
+    timing->late_spawn_ns += fork_ns;
+  return;
+}
+
+
+/* stage_timing_insert:
+ *
+ *    Adds the timing header after the message's others, just before
+ *    its head goes out. "piped" is true if the body about to follow
+ *    is the command's output. Returns 0, or -1 if it could not be
+ *    added.
+ */
+int
+stage_timing_insert(struct Stage_Timing *timing, struct Http_Message *msg,
+		    bool piped)
+{
+  if (NULL == timing->tool)
+    return 0;
+
+  uint64_t now = counters_now_ns();
+  uint64_t end = (0 == timing->end_ns ? now : timing->end_ns);
+  uint64_t xform = 0;
+  if (piped && now - end > timing->late_spawn_ns)
+    xform = now - end - timing->late_spawn_ns;
+  uint64_t out_mark = counter_get(counters, COUNTER_WRITE_WAIT_NS);
+
+  char value[128];
+  int length = snprintf(value, sizeof(value),
+			"%s;in=%llu;spawn=%llu;xform=%llu;out=%llu",
+			timing->tool,
+			(unsigned long long) (end - timing->begin_ns),
+			(unsigned long long) timing->spawn_ns,
+			(unsigned long long) xform,
+			(unsigned long long) (out_mark - timing->out_mark));
+  timing->out_mark = out_mark;
+  if (length < 0 || (size_t) length >= sizeof(value))
+    return -1;
+
+  return http_message_insert(msg, http_message_header_count(msg),
+			     STAGE_TIMING_FIELD, strlen(STAGE_TIMING_FIELD),
+			     value, length);
+}
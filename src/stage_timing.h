@@ -0,0 +1,47 @@
+/* stage_timing.h
+ *
+ *    How long a stage (body or headers) held a message, added to the
+ *    message itself with -T as
+ *
+ *        X-Mumpsimus-Timing: <tool>;in=<ns>;spawn=<ns>;xform=<ns>;out=<ns>
+ *
+ *    so that a log further down can break the latency of a chain down
+ *    per stage. Each stage appends its own, in pipeline order.
+ *
+ *    in      From the start of the message until it had been read
+ *            (or until its head went out, if that was sooner).
+ *    spawn   Forking the command given the message.
+ *    xform   From then until the command's output was ready. 0 where
+ *            the output goes straight on (headers, body -C).
+ *    out     Time spent writing to stdout since the last head went
+ *            out, which is back-pressure from the next stage. A
+ *            message's own writing comes after its head.
+ */
+#ifndef __STAGE_TIMING_H__
+#define __STAGE_TIMING_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "http_message.h"
+
+#define STAGE_TIMING_FIELD "X-Mumpsimus-Timing"
+
+struct Stage_Timing
+{
+  const char *tool;		// NULL unless -T
+  uint64_t begin_ns;		// When the message began
+  uint64_t end_ns;		// ...and when it had been read (0 until then)
+  uint64_t spawn_ns;		// Forking its command
+  uint64_t late_spawn_ns;	// ...of which after it had been read
+  uint64_t out_mark;		// Write wait counted when the last head went out
+};
+
+void stage_timing_init(struct Stage_Timing *timing, const char *tool);
+void stage_timing_begin(struct Stage_Timing *timing);
+void stage_timing_end(struct Stage_Timing *timing);
+void stage_timing_spawned(struct Stage_Timing *timing, uint64_t fork_ns);
+int stage_timing_insert(struct Stage_Timing *timing,
+			struct Http_Message *msg, bool piped);
+
+#endif /* __STAGE_TIMING_H__ */
@@ -16,6 +16,7 @@
 
 #include "ulog.h"
 #include "util.h"
+#include "buffer_alloc.h"
 
 #include "stream_buffer.h"
 
@@ -31,7 +32,7 @@ stream_buffer_new()
   struct Stream_Buffer *buf = malloc(sizeof(struct Stream_Buffer));
   if (buf != NULL)
     {
-      buf->head = malloc(BUFFER_MAX);
+      buf->head = buffer_alloc(BUFFER_MAX);
       buf->max_size = BUFFER_MAX;
       buf->tail = buf->head;
       buf->curr_size = 0;
@@ -48,7 +49,7 @@ stream_buffer_new()
 void
 stream_buffer_delete(struct Stream_Buffer *buf)
 {
-  free(buf->head);
+  buffer_free(buf->head);
   free(buf);
   return;
 }
@@ -75,7 +76,7 @@ stream_buffer_add(struct Stream_Buffer * buf, const char *nbuff,
 
       ulog_debug("Reallocating buffer from %ld to %ld bytes", buf->max_size,
 		 new_size);
-      char *new_buff = realloc(buf->head, new_size);
+      char *new_buff = buffer_realloc(buf->head, new_size);
       if (NULL == new_buff)
 	{
 	  perror("Out of memory in realloc -- buffer overflow");
@@ -102,6 +103,40 @@ stream_buffer_add(struct Stream_Buffer * buf, const char *nbuff,
 }
 
 
+/* stream_buffer_reserve:
+ *
+ *    Makes sure at least 'length' more bytes can be added without
+ *    reallocating. Unlike stream_buffer_add, the buffer grows to
+ *    exactly the size needed, so callers that know how much is coming
+ *    avoid both repeated doubling and over-allocation. Never
+ *    shrinks. Returns 0 on success or -1 on memory allocation error.
+ */
+int
+stream_buffer_reserve(struct Stream_Buffer *buf, const size_t length)
+{
+  assert(buf != NULL);
+  assert(buf->head != NULL);
+
+  if (buf->curr_size + length <= buf->max_size)
+    return 0;
+
+  size_t new_size = buf->curr_size + length;
+  ulog_debug("Reserving buffer from %ld to %ld bytes", buf->max_size,
+	     new_size);
+  char *new_buff = buffer_realloc(buf->head, new_size);
+  if (NULL == new_buff)
+    {
+      perror("Out of memory in realloc -- cannot reserve buffer");
+      return -1;
+    }
+
+  buf->head = new_buff;
+  buf->tail = buf->head + buf->curr_size;
+  buf->max_size = new_size;
+  return 0;
+}
+
+
 /* stream_buffer_clear: 
  * 
  *    Empties the buffer, but resetting its contents to empty
@@ -128,6 +163,17 @@ stream_buffer_size(struct Stream_Buffer * buf)
 }
 
 
+/* stream_buffer_capacity:
+ *
+ *    Returns the total space allocated to the buffer.
+ */
+size_t
+stream_buffer_capacity(struct Stream_Buffer * buf)
+{
+  return buf->max_size;
+}
+
+
 /* stream_buffer_write: 
  *
  *    Dumps the contents of the buffer onto file descriptor 'fd'.
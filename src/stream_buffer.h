@@ -28,6 +28,7 @@ void stream_buffer_delete(struct Stream_Buffer *buf);
 
 size_t stream_buffer_add(struct Stream_Buffer *buf, const char *nbuff,
 			 const size_t length);
+int stream_buffer_reserve(struct Stream_Buffer *buf, const size_t length);
 
 void stream_buffer_clear(struct Stream_Buffer *buf);
 size_t stream_buffer_write(struct Stream_Buffer *buf, int fd);
@@ -35,5 +36,6 @@ size_t stream_buffer_write_to(struct Stream_Buffer *buf, int fd,
 			      size_t length);
 
 size_t stream_buffer_size(struct Stream_Buffer *buf);
+size_t stream_buffer_capacity(struct Stream_Buffer *buf);
 
 #endif
@@ -0,0 +1,133 @@
+/* transaction_queue.c:
+ *
+ *    FIFO of requests waiting for their responses, with their times.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ulog.h"
+
+#include "transaction_queue.h"
+
+
+/* transaction_queue_new:
+ *
+ *    Returns a new empty queue, or NULL on memory allocation error.
+ */
+struct Transaction_Queue *
+transaction_queue_new(void)
+{
+  struct Transaction_Queue *tq = malloc(sizeof(struct Transaction_Queue));
+  if (tq != NULL)
+    {
+      tq->head = 0;
+      tq->count = 0;
+    }
+  return tq;
+}
+
+
+/* transaction_queue_delete:
+ *
+ *    Frees the queue.
+ */
+void
+transaction_queue_delete(struct Transaction_Queue *tq)
+{
+  free(tq);
+  return;
+}
+
+
+/* transaction_queue_begin:
+ *
+ *    Queues a request that began at "now_ns". If more than
+ *    TRANSACTION_QUEUE_MAX are outstanding the oldest is forgotten.
+ */
+void
+transaction_queue_begin(struct Transaction_Queue *tq, uint64_t now_ns)
+{
+  assert(tq != NULL);
+
+  if (tq->count >= TRANSACTION_QUEUE_MAX)
+    {
+      ulog(LOG_WARNING, "More than %d requests outstanding -- forgetting "
+	   "the oldest", TRANSACTION_QUEUE_MAX);
+      tq->head = (tq->head + 1) % TRANSACTION_QUEUE_MAX;
+      tq->count--;
+    }
+
+  struct Transaction *txn =
+    &tq->transactions[(tq->head + tq->count) % TRANSACTION_QUEUE_MAX];
+  txn->method = HTTP_GET;
+  txn->begin_ns = now_ns;
+  txn->end_ns = 0;
+  txn->url_len = 0;
+  tq->count++;
+  return;
+}
+
+
+/* transaction_queue_end:
+ *
+ *    Completes the newest request, which was a "method" for "url"
+ *    (kept up to TRANSACTION_URL_MAX bytes).
+ */
+void
+transaction_queue_end(struct Transaction_Queue *tq, enum http_method method,
+		      const char *url, size_t url_len, uint64_t now_ns)
+{
+  assert(tq != NULL);
+
+  if (0 == tq->count)
+    return;
+  struct Transaction *txn =
+    &tq->transactions[(tq->head + tq->count - 1) % TRANSACTION_QUEUE_MAX];
+  txn->method = method;
+  txn->end_ns = now_ns;
+  txn->url_len = (url_len < TRANSACTION_URL_MAX ? url_len
+		  : TRANSACTION_URL_MAX);
+  if (NULL != url)
+    memcpy(txn->url, url, txn->url_len);
+  else
+    txn->url_len = 0;
+  return;
+}
+
+
+/* transaction_queue_pop:
+ *
+ *    Removes the oldest request into "txn". Returns false if there is
+ *    none (a response nothing asked for).
+ */
+bool
+transaction_queue_pop(struct Transaction_Queue *tq, struct Transaction *txn)
+{
+  assert(tq != NULL);
+
+  if (0 == tq->count)
+    return false;
+  *txn = tq->transactions[tq->head];
+  tq->head = (tq->head + 1) % TRANSACTION_QUEUE_MAX;
+  tq->count--;
+  return true;
+}
+
+
+/* transaction_queue_count:
+ *
+ *    Returns the number of requests not yet answered.
+ */
+size_t
+transaction_queue_count(struct Transaction_Queue *tq)
+{
+  assert(tq != NULL);
+  return tq->count;
+}
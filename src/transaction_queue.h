@@ -0,0 +1,49 @@
+/* transaction_queue.h
+ *
+ *    Pairs responses with their requests when both directions of a
+ *    connection are read by one tool. Requests are queued as they
+ *    begin and marked when complete; each final response takes the
+ *    oldest (HTTP/1.1 answers in order), giving the times a
+ *    transaction's upstream latency and time to first byte are
+ *    measured from. Times are CLOCK_MONOTONIC ns.
+ */
+#ifndef __TRANSACTION_QUEUE_H__
+#define __TRANSACTION_QUEUE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "http_parser.h"
+
+#define TRANSACTION_QUEUE_MAX 256
+#define TRANSACTION_URL_MAX 256
+
+struct Transaction
+{
+  enum http_method method;
+  uint64_t begin_ns;		// request began
+  uint64_t end_ns;		// request complete, or 0 if not yet
+  size_t url_len;
+  char url[TRANSACTION_URL_MAX];
+};
+
+struct Transaction_Queue
+{
+  // Private
+  struct Transaction transactions[TRANSACTION_QUEUE_MAX];
+  size_t head;
+  size_t count;
+};
+
+struct Transaction_Queue *transaction_queue_new(void);
+void transaction_queue_delete(struct Transaction_Queue *tq);
+void transaction_queue_begin(struct Transaction_Queue *tq, uint64_t now_ns);
+void transaction_queue_end(struct Transaction_Queue *tq,
+			   enum http_method method, const char *url,
+			   size_t url_len, uint64_t now_ns);
+bool transaction_queue_pop(struct Transaction_Queue *tq,
+			   struct Transaction *txn);
+size_t transaction_queue_count(struct Transaction_Queue *tq);
+
+#endif
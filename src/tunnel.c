@@ -0,0 +1,181 @@
+/* tunnel.c:
+ *
+ *    Switches a HTTP stream to raw passthrough after an upgrade.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include "ulog.h"
+#include "util.h"
+
+#include "h2_parser.h"
+
+#include "tunnel.h"
+
+
+/* tunnel_init:
+ *
+ *    Starts a stream as plain HTTP.
+ */
+void
+tunnel_init(struct Tunnel *tunnel)
+{
+  tunnel->state = TUNNEL_NONE;
+  tunnel->websocket = 0;
+  tunnel->h2c = 0;
+  return;
+}
+
+
+/* tunnel_start:
+ *
+ *    Starts a stream that may turn out to be HTTP/2 (see
+ *    tunnel_resolve).
+ */
+void
+tunnel_start(struct Tunnel *tunnel)
+{
+  tunnel_init(tunnel);
+  tunnel->state = TUNNEL_START;
+  return;
+}
+
+
+/* is_upgrade_to:
+ *
+ *    True if "msg" (which may be NULL, or hold no headers) asks for
+ *    or agrees to an upgrade to "protocol".
+ */
+static int
+is_upgrade_to(struct Http_Message *msg, const char *protocol)
+{
+  size_t length = 0;
+  const char *value = NULL;
+  if (NULL != msg)
+    value = http_message_get(msg, HTTP_HEADER_UPGRADE, &length);
+  return (NULL != value && length >= strlen(protocol)
+	  && strncasecmp(value, protocol, strlen(protocol)) == 0);
+}
+
+
+/* tunnel_after_message:
+ *
+ *    Updates the state once a message is complete. An upgrade
+ *    request leaves the tunnel pending, for tunnel_resolve to decide.
+ *    An upgrade response (101, or 2xx to CONNECT -- see
+ *    method_queue_skip_body) opens it. Any other response, including
+ *    one that only advertises an upgrade, closes a pending one.
+ */
+void
+tunnel_after_message(struct Tunnel *tunnel, http_parser * parser,
+		     struct Http_Message *msg)
+{
+  if (HTTP_REQUEST == parser->type)
+    {
+      if (parser->upgrade)
+	{
+	  tunnel->state = TUNNEL_PENDING;
+	  tunnel->websocket = is_upgrade_to(msg, "websocket");
+	  tunnel->h2c = is_upgrade_to(msg, "h2c");
+	}
+      return;
+    }
+
+  unsigned int status = parser->status_code;
+  if (parser->upgrade && (101 == status || (status >= 200 && status < 300)))
+    {
+      tunnel->state = TUNNEL_OPEN;
+      tunnel->websocket = is_upgrade_to(msg, "websocket");
+      tunnel->h2c = is_upgrade_to(msg, "h2c");
+      ulog(LOG_INFO, "Protocol switched to %s -- rest of stream is not HTTP",
+	   (tunnel->websocket ? "WebSocket"
+	    : (tunnel->h2c ? "HTTP/2" : "a tunnel")));
+      return;
+    }
+  tunnel_init(tunnel);
+  return;
+}
+
+
+/* is_request_line:
+ *
+ *    True if the "length" bytes at "at" could start a request line:
+ *    a method in capitals, then a space. WebSocket frames from a
+ *    client cannot (their second byte has the mask bit set).
+ */
+static bool
+is_request_line(const char *at, size_t length)
+{
+  for (size_t n = 0; n < length && n < 24; n++)
+    {
+      if (' ' == at[n])
+	return (n > 0);
+      if ((at[n] < 'A' || at[n] > 'Z') && '-' != at[n] && '_' != at[n])
+	return false;
+    }
+  return true;
+}
+
+
+/* tunnel_resolve:
+ *
+ *    Decides a pending tunnel from the next "length" bytes of input:
+ *    a response to the upgrade request starts with "HTTP/"; another
+ *    request means the stream only carries requests and the upgrade
+ *    may have been declined; anything else (including the HTTP/2
+ *    preface) is already the new protocol. At the start of a stream,
+ *    decides whether it is HTTP/2 instead of HTTP/1.x.
+ */
+void
+tunnel_resolve(struct Tunnel *tunnel, const char *at, size_t length)
+{
+  if (TUNNEL_START == tunnel->state && length > 0)
+    {
+      tunnel_init(tunnel);
+      if (h2_detect(at, length) >= 0)
+	{
+	  ulog(LOG_INFO, "Stream is HTTP/2 (h2c) -- not HTTP/1.x");
+	  tunnel->state = TUNNEL_OPEN;
+	  tunnel->h2c = 1;
+	}
+      return;
+    }
+
+  if (TUNNEL_PENDING != tunnel->state || 0 == length)
+    return;
+
+  if (memcmp(at, "HTTP/", MIN(length, 5)) == 0
+      || (h2_detect(at, length) < 0 && is_request_line(at, length)))
+    {
+      tunnel_init(tunnel);
+      return;
+    }
+
+  ulog(LOG_INFO, "Upgrade request not answered in stream -- "
+       "rest of stream is not HTTP");
+  tunnel->state = TUNNEL_OPEN;
+  return;
+}
+
+
+/* tunnel_pass:
+ *
+ *    Writes the "length" bytes at "at" that were read but not parsed,
+ *    then copies the rest of fd_in to fd_out (with splice(2) where it
+ *    can). Returns bytes copied from fd_in.
+ */
+ssize_t
+tunnel_pass(int fd_in, int fd_out, const char *at, size_t length)
+{
+  if (length > 0)
+    write_all(fd_out, at, length);
+  return pass_through(fd_in, fd_out);
+}
@@ -0,0 +1,44 @@
+/* tunnel.h
+ *
+ *    Tracks whether a HTTP stream has switched protocols: after a 101
+ *    Switching Protocols response, or a 2xx response to CONNECT, the
+ *    rest of the stream is not HTTP and is passed through untouched.
+ *
+ *    Tools call tunnel_after_message from on_message_complete (before
+ *    re-initialising the parser), and tunnel_resolve before handing
+ *    each piece of input to the parser. If the message's headers
+ *    named "websocket" as the new protocol, the tunnel is flagged so
+ *    tools can follow its frames (see ws_parser.h); likewise "h2c"
+ *    (see h2_parser.h).
+ *
+ *    A tunnel set up with tunnel_start also looks at the first bytes
+ *    of the stream: HTTP/2 with prior knowledge (the connection
+ *    preface, or the server's SETTINGS) is a h2c tunnel from the
+ *    start.
+ */
+#ifndef __TUNNEL_H__
+#define __TUNNEL_H__
+
+#include <sys/types.h>
+
+#include "http_parser.h"
+#include "http_message.h"
+
+enum tunnel_state
+{ TUNNEL_NONE, TUNNEL_PENDING, TUNNEL_OPEN, TUNNEL_START };
+
+struct Tunnel
+{
+  unsigned int state:2;		// enum tunnel_state
+  unsigned int websocket:1;
+  unsigned int h2c:1;
+};
+
+void tunnel_init(struct Tunnel *tunnel);
+void tunnel_start(struct Tunnel *tunnel);
+void tunnel_after_message(struct Tunnel *tunnel, http_parser * parser,
+			  struct Http_Message *msg);
+void tunnel_resolve(struct Tunnel *tunnel, const char *at, size_t length);
+ssize_t tunnel_pass(int fd_in, int fd_out, const char *at, size_t length);
+
+#endif
@@ -1,14 +1,33 @@
 /*
  * ulog.c: Common logging functions for programs.
  *
- * Currently just using / supporting syslog.
+ * Messages go to syslog (and stderr), stderr alone or a file, by way
+ * of a ring drained by a background thread where threads and C11
+ * atomics are available.
  *
  */
 
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <fcntl.h>
 #include <stdarg.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
 #include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_STDATOMIC_H) \
+  && defined(HAVE_PTHREAD_CREATE)
+#  define ULOG_ASYNC_SUPPORTED 1
+#  include <pthread.h>
+#  include <stdatomic.h>
+#endif
 
 #include "ulog.h"
 
@@ -17,43 +36,357 @@
 # define LOG_PERROR 0
 #endif
 
+#define ULOG_ENVVAR "ULOG_LEVEL"
+#define ULOG_TARGET_ENVVAR "ULOG_TARGET"
+#define ULOG_ASYNC_ENVVAR "ULOG_ASYNC"
+
+// Longest message; longer ones are cut
+#define ULOG_LINE_MAX 512
+
+// Messages the ring holds; a power of 2
+#define ULOG_RING_SLOTS 256
+
+// How often the drain thread looks at the ring when not woken
+#define ULOG_DRAIN_NS (10 * 1000 * 1000)
+
+#define ULOG_IDENT_MAX 64
+
+enum ulog_target
+{ ULOG_TARGET_SYSLOG, ULOG_TARGET_STDERR, ULOG_TARGET_FILE };
+
+// Until ulog_init sets it, every message reaches ulog_write, which
+// calls ulog_init and checks again
+int ulog_mask = ~0;
+
 static int __logger_initialised = 0;
+static enum ulog_target __target = ULOG_TARGET_SYSLOG;
+static int __target_fd = STDERR_FILENO;
+static char __ident[ULOG_IDENT_MAX];
+static char __prefix[ULOG_IDENT_MAX + 32];
+static size_t __prefix_len = 0;
+
+
+/* set_prefix:
+ *
+ *    Sets the "ident[pid]: " put before messages not sent to syslog
+ *    (as syslog's LOG_PERROR does).
+ */
+static void
+set_prefix(void)
+{
+  int n = snprintf(__prefix, sizeof(__prefix), "%s[%d]: ", __ident,
+		   (int) getpid());
+  __prefix_len = (n < 0 ? 0 : strlen(__prefix));
+  return;
+}
+
+
+/* emit:
+ *
+ *    Writes out one formatted message.
+ */
+static void
+emit(int priority, const char *text, size_t length)
+{
+  if (ULOG_TARGET_SYSLOG == __target)
+    {
+      syslog(priority, "%.*s", (int) length, text);
+      return;
+    }
+
+  struct iovec iov[3];
+  iov[0].iov_base = __prefix;
+  iov[0].iov_len = __prefix_len;
+  iov[1].iov_base = (char *) text;
+  iov[1].iov_len = length;
+  iov[2].iov_base = "\n";
+  iov[2].iov_len = 1;
+  if (writev(__target_fd, iov, 3) < 0)
+    return;
+  return;
+}
+
+
+#ifdef ULOG_ASYNC_SUPPORTED
+
+/* Ulog_Slot:
+ *
+ *    One message in the ring. A slot is free for the writer whose
+ *    position equals seq, and ready for the drain thread once seq is
+ *    that position plus one.
+ */
+struct Ulog_Slot
+{
+  atomic_size_t seq;
+  int priority;
+  size_t length;
+  char text[ULOG_LINE_MAX];
+};
+
+static struct Ulog_Slot *__ring = NULL;
+static atomic_size_t __ring_tail;	// Next position to write
+static size_t __ring_head = 0;	// Next to drain (drain thread only)
+static atomic_ullong __dropped;
+static atomic_bool __stopping;
+static atomic_bool __async_running;
+static pthread_t __drainer;
+static pthread_mutex_t __wake_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t __wake = PTHREAD_COND_INITIALIZER;
+static bool __atfork_set = false;
+
+
+/* ring_push:
+ *
+ *    Formats a message into the next free slot, or counts it as
+ *    dropped if there is none. Never blocks. The drain thread is
+ *    woken early after every half ring of messages.
+ */
+static void
+ring_push(int priority, const char *message, va_list args)
+{
+  struct Ulog_Slot *slot = NULL;
+  size_t pos = atomic_load_explicit(&__ring_tail, memory_order_relaxed);
+  for (;;)
+    {
+      slot = &__ring[pos & (ULOG_RING_SLOTS - 1)];
+      size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+      if (seq == pos)
+	{
+	  if (atomic_compare_exchange_weak_explicit
+	      (&__ring_tail, &pos, pos + 1, memory_order_relaxed,
+	       memory_order_relaxed))
+	    break;
+	}
+      else if ((ssize_t) (seq - pos) < 0)
+	{
+	  atomic_fetch_add_explicit(&__dropped, 1, memory_order_relaxed);
+	  return;
+	}
+      else
+	pos = atomic_load_explicit(&__ring_tail, memory_order_relaxed);
+    }
+
+  int n = vsnprintf(slot->text, ULOG_LINE_MAX, message, args);
+  slot->priority = priority;
+  slot->length = (n < 0 ? 0 : (n >= ULOG_LINE_MAX ? ULOG_LINE_MAX - 1 : n));
+  atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+
+  if (0 == (pos + 1) % (ULOG_RING_SLOTS / 2))
+    pthread_cond_signal(&__wake);
+  return;
+}
+
+
+/* ring_drain:
+ *
+ *    Writes out the messages that are ready, in order.
+ */
+static void
+ring_drain(void)
+{
+  for (;;)
+    {
+      struct Ulog_Slot *slot = &__ring[__ring_head & (ULOG_RING_SLOTS - 1)];
+      size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+      if (seq != __ring_head + 1)
+	break;
+      emit(slot->priority, slot->text, slot->length);
+      atomic_store_explicit(&slot->seq, __ring_head + ULOG_RING_SLOTS,
+			    memory_order_release);
+      __ring_head++;
+    }
+  return;
+}
+
+
+/* drain_thread:
+ *
+ *    Empties the ring every ULOG_DRAIN_NS, or when woken, until
+ *    ulog_close. Reports messages dropped since it last looked.
+ */
+static void *
+drain_thread(void *unused)
+{
+  unsigned long long reported = 0;
+  for (;;)
+    {
+      bool stop = atomic_load(&__stopping);
+      ring_drain();
+
+      unsigned long long dropped = atomic_load(&__dropped);
+      if (dropped != reported)
+	{
+	  char text[ULOG_LINE_MAX];
+	  int n = snprintf(text, sizeof(text),
+			   "ulog: %llu messages dropped (ring full)",
+			   dropped - reported);
+	  emit(LOG_WARNING, text, (n < 0 ? 0 : n));
+	  reported = dropped;
+	}
+      if (stop)
+	break;
+
+      struct timespec until;
+      clock_gettime(CLOCK_REALTIME, &until);
+      until.tv_nsec += ULOG_DRAIN_NS;
+      if (until.tv_nsec >= 1000000000)
+	{
+	  until.tv_sec++;
+	  until.tv_nsec -= 1000000000;
+	}
+      pthread_mutex_lock(&__wake_lock);
+      if (!atomic_load(&__stopping))
+	pthread_cond_timedwait(&__wake, &__wake_lock, &until);
+      pthread_mutex_unlock(&__wake_lock);
+    }
+  return NULL;
+}
+
+
+/* after_fork_child:
+ *
+ *    A forked child has no drain thread: it writes its messages
+ *    itself (the parent drains what was in the ring).
+ */
+static void
+after_fork_child(void)
+{
+  atomic_store(&__async_running, false);
+  set_prefix();
+  return;
+}
 
+
+/* async_start:
+ *
+ *    Sets up the ring and starts the drain thread. Messages are
+ *    written synchronously if that fails.
+ */
+static void
+async_start(void)
+{
+  __ring = malloc(ULOG_RING_SLOTS * sizeof(struct Ulog_Slot));
+  if (NULL == __ring)
+    return;
+  for (size_t n = 0; n < ULOG_RING_SLOTS; n++)
+    atomic_init(&__ring[n].seq, n);
+  atomic_init(&__ring_tail, 0);
+  atomic_init(&__dropped, 0);
+  atomic_init(&__stopping, false);
+  __ring_head = 0;
+
+  if (!__atfork_set)
+    __atfork_set = (pthread_atfork(NULL, NULL, after_fork_child) == 0);
+  if (pthread_create(&__drainer, NULL, drain_thread, NULL) != 0)
+    {
+      free(__ring);
+      __ring = NULL;
+      return;
+    }
+  atomic_store(&__async_running, true);
+  return;
+}
+
+
+/* async_stop:
+ *
+ *    Stops the drain thread once it has written out the ring.
+ */
+static void
+async_stop(void)
+{
+  if (!atomic_load(&__async_running))
+    return;
+  atomic_store(&__async_running, false);
+
+  pthread_mutex_lock(&__wake_lock);
+  atomic_store(&__stopping, true);
+  pthread_cond_signal(&__wake);
+  pthread_mutex_unlock(&__wake_lock);
+  pthread_join(__drainer, NULL);
+
+  free(__ring);
+  __ring = NULL;
+  return;
+}
+
+#endif /* ULOG_ASYNC_SUPPORTED */
+
+
+/* ulog_write:
+ *
+ *    Logs a message that ulog has let through.
+ */
 void
-ulog(int priority, const char *message, ...)
+ulog_write(int priority, const char *message, ...)
 {
   va_list args;
 
   if (!__logger_initialised)
-    ulog_init(__FILE__);
+    {
+      ulog_init(__FILE__);
+      if (!(ulog_mask & LOG_MASK(LOG_PRI(priority))))
+	return;
+    }
 
   va_start(args, message);
-  vsyslog(priority, message, args);
+#ifdef ULOG_ASYNC_SUPPORTED
+  if (atomic_load_explicit(&__async_running, memory_order_relaxed))
+    {
+      ring_push(priority, message, args);
+      va_end(args);
+      return;
+    }
+#endif
+
+  char text[ULOG_LINE_MAX];
+  int n = vsnprintf(text, sizeof(text), message, args);
   va_end(args);
+  emit(priority, text, (n < 0 ? 0 : (n >= ULOG_LINE_MAX ? ULOG_LINE_MAX - 1
+				      : n)));
+}
+
+
+/* ulog_dropped:
+ *
+ *    Messages dropped so far because the ring was full.
+ */
+unsigned long long
+ulog_dropped(void)
+{
+#ifdef ULOG_ASYNC_SUPPORTED
+  return atomic_load(&__dropped);
+#else
+  return 0;
+#endif
 }
 
 
 void
 ulog_close(void)
 {
-  if (__logger_initialised)
+  if (!__logger_initialised)
+    return;
+
+#ifdef ULOG_ASYNC_SUPPORTED
+  async_stop();
+#endif
+  if (ULOG_TARGET_SYSLOG == __target)
     closelog();
+  else if (ULOG_TARGET_FILE == __target)
+    close(__target_fd);
+  __target = ULOG_TARGET_SYSLOG;
+  __target_fd = STDERR_FILENO;
   __logger_initialised = 0;
-  return;
 }
 
 
-#define ULOG_ENVVAR "ULOG_LEVEL"
-
 void
 ulog_init(const char *ident)
 {
   if (__logger_initialised)
     return;
 
-  /* logging PID and logging to stderr seems generally useful for now */
-  openlog(ident, LOG_PID | LOG_PERROR, LOG_USER);
-
   int default_log_level = LOG_WARNING;
   if (getenv(ULOG_ENVVAR) != NULL)
     {
@@ -70,10 +403,43 @@ ulog_init(const char *ident)
       else
 	default_log_level = (int) level;
     }
-  setlogmask(LOG_UPTO(default_log_level));
+  ulog_mask = LOG_UPTO(default_log_level);
+
+  snprintf(__ident, sizeof(__ident), "%s", ident);
+  set_prefix();
+
+  /* logging PID and logging to stderr seems generally useful for now */
+  const char *target = getenv(ULOG_TARGET_ENVVAR);
+  __target = ULOG_TARGET_SYSLOG;
+  __target_fd = STDERR_FILENO;
+  if (NULL != target && strcmp(target, "stderr") == 0)
+    __target = ULOG_TARGET_STDERR;
+  else if (NULL != target && target[0] && strcmp(target, "syslog") != 0)
+    {
+      __target_fd = open(target, O_WRONLY | O_CREAT | O_APPEND, 0644);
+      __target = ULOG_TARGET_FILE;
+      if (__target_fd < 0)
+	{
+	  fprintf(stderr, "%s: WARNING -- cannot open %s=%s; using stderr\n",
+		  ident, ULOG_TARGET_ENVVAR, target);
+	  __target = ULOG_TARGET_STDERR;
+	  __target_fd = STDERR_FILENO;
+	}
+    }
+  if (ULOG_TARGET_SYSLOG == __target)
+    {
+      openlog(ident, LOG_PID | LOG_PERROR, LOG_USER);
+      setlogmask(ulog_mask);
+    }
 
   __logger_initialised = 1;
   atexit(ulog_close);
 
+#ifdef ULOG_ASYNC_SUPPORTED
+  const char *async = getenv(ULOG_ASYNC_ENVVAR);
+  if (NULL == async || strcmp(async, "0") != 0)
+    async_start();
+#endif
+
   return;
 }
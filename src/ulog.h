@@ -1,9 +1,33 @@
+/* ulog.h
+ *
+ *    Logging for the tools, at syslog priorities. ULOG_LEVEL (0-7)
+ *    sets the lowest priority logged; the default is LOG_WARNING.
+ *    ulog checks it before anything else, so a message below the
+ *    level costs neither formatting nor evaluating its arguments.
+ *
+ *    Messages are formatted into a lock-free ring and written out by
+ *    a background thread, so logging never waits on its output.
+ *    ULOG_TARGET picks where they go: "syslog" (the default, also
+ *    copied to stderr), "stderr", or a file to append to. If the ring
+ *    is full, messages are dropped and counted, and the count is
+ *    logged once there is room again. ulog_close writes out whatever
+ *    is left. ULOG_ASYNC=0 writes each message as it is logged
+ *    instead, as does a forked child.
+ */
 #ifndef __ULOG_H__
 #define __ULOG_H__
 
 #include <stdarg.h>
 #include <syslog.h>
 
+extern int ulog_mask;
+
+#define ulog(priority, ...)						\
+  do {									\
+    if (ulog_mask & LOG_MASK(LOG_PRI(priority)))			\
+      ulog_write((priority), __VA_ARGS__);				\
+  } while (0)
+
 #define ulog_debug(...) ulog(LOG_DEBUG, __VA_ARGS__)
 #ifdef DEBUG
 # define ulog_ping(x) ulog(LOG_DEBUG, "%s(%d): ping! (%s)", __FILE__, __LINE__, x)
@@ -12,7 +36,8 @@
 #endif
 
 void ulog_init(const char *ident);
-void ulog(int priority, const char *message, ...);
+void ulog_write(int priority, const char *message, ...);
+unsigned long long ulog_dropped(void);
 void ulog_close(void);
 
 
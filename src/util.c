@@ -3,13 +3,33 @@
  *
  */
 
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <paths.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <limits.h>
+#include <sys/uio.h>
+
+#ifdef HAVE_SYS_MMAN_H
+#  include <sys/mman.h>
+#endif
+#ifdef HAVE_SYS_SENDFILE_H
+#  include <sys/sendfile.h>
+#endif
 
 #include "util.h"
+#include "probes.h"
+#include "counters.h"
+
+#define SPLICE_MAX (1024 * 1024)
 
 
 /*
@@ -38,18 +58,58 @@ upper_power_of_two(const size_t n)
   return v;
 }
 
+/*
+ * read_input: read(2) from the tool's input, counting the bytes read
+ * and the time spent waiting for them (see counters.h).
+ */
+ssize_t
+read_input(const int fd, char *buf, const size_t count)
+{
+  uint64_t begin = counters_now_ns();
+  ssize_t br = read(fd, buf, count);
+  counter_add(COUNTER_READ_WAIT_NS, counters_now_ns() - begin);
+  if (br > 0)
+    counter_add(COUNTER_BYTES_IN, br);
+  return br;
+}
+
+
+/*
+ * count_output: Counts bytes written to stdout since "begin", and the
+ * time that took.
+ */
+static void
+count_output(const int fd, ssize_t bytes, uint64_t begin)
+{
+  if (STDOUT_FILENO != fd)
+    return;
+  counter_add(COUNTER_WRITE_WAIT_NS, counters_now_ns() - begin);
+  counter_add(COUNTER_BYTES_OUT, bytes);
+}
+
+
 /* 
  * write_all: Will retry interrupted write(2) calls until either an error
- * occurs or all bytes successfully written.
+ * occurs or all bytes successfully written. What is written to stdout
+ * is counted as the tool's output.
  */
 ssize_t
 write_all(const int fd, const char *buf, const ssize_t bytes_to_write)
 {
   ssize_t total_bytes = 0;
   ssize_t nw = 0;
+  uint64_t begin = (STDOUT_FILENO == fd ? counters_now_ns() : 0);
   do
     {
       nw = write(fd, buf + total_bytes, bytes_to_write - total_bytes);
+      if (nw < 0 && EINTR == errno)
+	{
+	  nw = 0;
+	  continue;
+	}
+      if (nw < bytes_to_write - total_bytes)
+	PROBE4(write__short, fd, bytes_to_write - total_bytes, nw,
+	       (nw < 0 ? errno : 0));
       if (nw < 0)
 	perror("Could not write buffer");
       else
@@ -57,12 +117,61 @@ write_all(const int fd, const char *buf, const ssize_t bytes_to_write)
     }
   while ((nw >= 0) && (total_bytes < bytes_to_write));
 
+  count_output(fd, total_bytes, begin);
+  return total_bytes;
+}
+
+
+/* 
+ * writev_all: Like write_all, but for a gather array. Retries partial
+ * writes until every iovec has been written or an error occurs. The
+ * caller's iovec array is modified. Returns total bytes written.
+ */
+#ifndef IOV_MAX
+#  define IOV_MAX 1024
+#endif
+ssize_t
+writev_all(const int fd, struct iovec *iov, int iovcnt)
+{
+  ssize_t total_bytes = 0;
+  ssize_t nw = 0;
+  uint64_t begin = (STDOUT_FILENO == fd ? counters_now_ns() : 0);
+
+  while (iovcnt > 0)
+    {
+      nw = writev(fd, iov, MIN(iovcnt, IOV_MAX));
+      if (nw < 0 && EINTR == errno)
+	continue;
+      if (nw < 0)
+	{
+	  perror("Could not write buffer");
+	  break;
+	}
+      total_bytes += nw;
+
+      // Skip what has been written, and adjust a partly written iovec
+      while (iovcnt > 0 && (size_t) nw >= iov->iov_len)
+	{
+	  nw -= iov->iov_len;
+	  iov++;
+	  iovcnt--;
+	}
+      if (iovcnt > 0)
+	{
+	  iov->iov_base = (char *) iov->iov_base + nw;
+	  iov->iov_len -= nw;
+	}
+    }
+
+  count_output(fd, total_bytes, begin);
   return total_bytes;
 }
 
 
 /* 
  * pass_through: Reading from fd_in, echo all bytes to fd_out until EOF.
+ * Uses splice(2) so the data stays in the kernel when one side is a
+ * pipe, otherwise copies through a buffer.
  */
 ssize_t
 pass_through(const int fd_in, const int fd_out)
@@ -71,6 +180,32 @@ pass_through(const int fd_in, const int fd_out)
   ssize_t br = 0;
   ssize_t total_bytes = 0;
 
+#ifdef HAVE_SPLICE
+  do
+    {
+      br = splice(fd_in, NULL, fd_out, NULL, SPLICE_MAX,
+		  SPLICE_F_MOVE | SPLICE_F_MORE);
+      if (br > 0)
+	total_bytes += br;
+    }
+  while (br > 0 || (br < 0 && errno == EINTR));
+
+  // Spliced bytes are counted, but not the time (see counters.h)
+  if (STDIN_FILENO == fd_in)
+    counter_add(COUNTER_BYTES_IN, total_bytes);
+  if (STDOUT_FILENO == fd_out)
+    counter_add(COUNTER_BYTES_OUT, total_bytes);
+
+  // EINVAL means neither side is a pipe: fall back to copying
+  if (br == 0)
+    return total_bytes;
+  if (errno != EINVAL)
+    {
+      perror("Error splicing data");
+      return total_bytes;
+    }
+#endif
+
   buf = malloc(BUFFER_MAX);
   if (buf == NULL)
     {
@@ -81,17 +216,18 @@ pass_through(const int fd_in, const int fd_out)
   do
     {
       memset(buf, 0, BUFFER_MAX);
-      br = read(fd_in, buf, BUFFER_MAX);
+      br = (STDIN_FILENO == fd_in ? read_input(fd_in, buf, BUFFER_MAX)
+	    : read(fd_in, buf, BUFFER_MAX));
       if (br > 0)
 	{
 	  total_bytes += write_all(fd_out, buf, br);
 	}
-      else if (br < 0)
+      else if (br < 0 && errno != EINTR)
 	{
 	  perror("Error reading data");
 	}
     }
-  while (br > 0);
+  while (br > 0 || (br < 0 && errno == EINTR));
 
   free(buf);
 
@@ -99,6 +235,105 @@ pass_through(const int fd_in, const int fd_out)
 }
 
 
+/*
+ * memfd_open: Returns a new anonymous, seekable file descriptor for
+ * holding a message body, or -1 on error. Uses memfd_create(2) where
+ * available (so the descriptor can be sealed), otherwise falls back
+ * to an unlinked temporary file.
+ */
+int
+memfd_open(const char *name)
+{
+  int fd = -1;
+
+#ifdef HAVE_MEMFD_CREATE
+  fd = memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd >= 0)
+    return fd;
+#endif
+
+  char path[] = _PATH_TMP "mumpsimus.XXXXXX";
+  fd = mkstemp(path);
+  if (fd >= 0)
+    {
+      unlink(path);
+      fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+  else
+    perror("Could not create temporary file");
+
+  return fd;
+}
+
+
+/*
+ * memfd_seal: Makes a memfd read-only by adding write, grow and
+ * shrink seals, then rewinds it so it can be handed to a reader.
+ * Returns 0 if the seals were applied; -1 if the platform or file
+ * type does not support sealing (the file is still rewound).
+ */
+int
+memfd_seal(const int fd)
+{
+  int rc = -1;
+
+#ifdef F_ADD_SEALS
+  rc = fcntl(fd, F_ADD_SEALS,
+	     F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+#endif
+
+  lseek(fd, 0, SEEK_SET);
+  return rc;
+}
+
+
+/*
+ * sendfile_all: Copies 'count' bytes from the start of fd_in to
+ * fd_out, using sendfile(2) so the data does not pass through user
+ * space. Falls back to pread/write where sendfile is not available
+ * or refuses the descriptors. Returns the number of bytes sent.
+ */
+ssize_t
+sendfile_all(const int fd_out, const int fd_in, const size_t count)
+{
+  off_t offset = 0;
+  ssize_t nw = 0;
+
+#ifdef HAVE_SENDFILE
+  uint64_t begin = (STDOUT_FILENO == fd_out ? counters_now_ns() : 0);
+  while ((size_t) offset < count)
+    {
+      nw = sendfile(fd_out, fd_in, &offset, count - offset);
+      if (nw < 0 && errno == EINTR)
+	continue;
+      if (nw <= 0)
+	break;
+    }
+  count_output(fd_out, offset, begin);
+  if ((size_t) offset == count)
+    return offset;
+#endif
+
+  // Fallback: copy through a buffer
+  char *buf = malloc(BUFFER_MAX);
+  if (buf == NULL)
+    {
+      perror("Error from malloc");
+      return offset;
+    }
+  while ((size_t) offset < count)
+    {
+      nw = pread(fd_in, buf, MIN(BUFFER_MAX, count - offset), offset);
+      if (nw <= 0)
+	break;
+      offset += write_all(fd_out, buf, nw);
+    }
+  free(buf);
+
+  return offset;
+}
+
+
 #ifndef HAVE_STRLCAT
 /*
  * Copyright (c) 1998 Todd C. Miller <Todd.Miller@courtesan.com>
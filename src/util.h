@@ -12,6 +12,7 @@
 #define __UTIL_H__
 
 #include <sys/types.h>
+#include <sys/uio.h>
 
 #ifdef HAVE_CONFIG_H
 # include "config.h"
@@ -33,6 +34,7 @@
 #endif
 
 #define MIN(a,b) ((a) < (b) ? (a) : (b))
+#define MAX(a,b) ((a) > (b) ? (a) : (b))
 
 
 
@@ -40,9 +42,14 @@
  * Function prototypes.
  */
 size_t upper_power_of_two(const size_t n);
+ssize_t read_input(const int fd, char *buf, const size_t count);
 ssize_t write_all(const int fd, const char *buf,
 		  const ssize_t bytes_to_write);
+ssize_t writev_all(const int fd, struct iovec *iov, int iovcnt);
 ssize_t pass_through(const int fd_in, const int fd_out);
+int memfd_open(const char *name);
+int memfd_seal(const int fd);
+ssize_t sendfile_all(const int fd_out, const int fd_in, const size_t count);
 
 #ifndef HAVE_STRLCAT
 size_t strlcat(char *dst, const char *src, size_t siz);
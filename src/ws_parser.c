@@ -0,0 +1,301 @@
+/* ws_parser.c:
+ *
+ *    WebSocket frame parser with in place (SIMD) unmasking.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <string.h>
+
+#include "http_scan.h"
+
+#include "ws_parser.h"
+
+#define WS_MIN(a,b) ((a) < (b) ? (a) : (b))
+
+enum ws_state
+{ WS_STATE_HEADER, WS_STATE_PAYLOAD };
+
+
+/* ws_parser_init:
+ *
+ *    Readies "parser" for the first frame. Keeps parser->data.
+ */
+void
+ws_parser_init(ws_parser * parser)
+{
+  void *data = parser->data;
+  memset(parser, 0, sizeof(*parser));
+  parser->data = data;
+  parser->state = WS_STATE_HEADER;
+  parser->header_need = 2;
+  return;
+}
+
+
+/* ws_parser_settings_init:
+ *
+ *    Clears all callbacks.
+ */
+void
+ws_parser_settings_init(ws_parser_settings * settings)
+{
+  memset(settings, 0, sizeof(*settings));
+  return;
+}
+
+
+/* header_size:
+ *
+ *    Total header size implied by the second header byte.
+ */
+static unsigned int
+header_size(unsigned char second)
+{
+  unsigned int size = 2;
+  if (126 == (second & 0x7f))
+    size += 2;
+  else if (127 == (second & 0x7f))
+    size += 8;
+  if (second & 0x80)
+    size += 4;
+  return size;
+}
+
+
+/* decode_header:
+ *
+ *    Fills in the frame members from the raw header. Returns 0, or
+ *    -1 with ws_errno set if the frame is not allowed.
+ */
+static int
+decode_header(ws_parser * parser)
+{
+  const unsigned char *h = parser->header;
+  unsigned int n = 2;
+
+  parser->fin = (h[0] >> 7) & 1;
+  parser->rsv = (h[0] >> 4) & 7;
+  parser->opcode = h[0] & 0x0f;
+  parser->masked = (h[1] >> 7) & 1;
+
+  uint64_t length = h[1] & 0x7f;
+  if (126 == length)
+    {
+      length = ((uint64_t) h[2] << 8) | h[3];
+      n = 4;
+    }
+  else if (127 == length)
+    {
+      length = 0;
+      for (n = 2; n < 10; n++)
+	length = (length << 8) | h[n];
+      if (length >> 63)
+	{
+	  parser->ws_errno = WS_ERR_LENGTH;
+	  return -1;
+	}
+    }
+  parser->payload_length = length;
+  parser->remaining = length;
+
+  if (parser->masked)
+    memcpy(parser->mask, h + n, 4);
+  else
+    memset(parser->mask, 0, 4);
+
+  // Control frames are short and never fragmented
+  if ((parser->opcode & 0x8) && (!parser->fin || length > 125))
+    {
+      parser->ws_errno = WS_ERR_CONTROL;
+      return -1;
+    }
+
+  return 0;
+}
+
+
+/* frame_complete:
+ *
+ *    Calls on_frame_complete and readies the parser for the next
+ *    frame. Returns 0, or -1 if the callback failed.
+ */
+static int
+frame_complete(ws_parser * parser, const ws_parser_settings * settings)
+{
+  int rc = 0;
+  if (settings->on_frame_complete && settings->on_frame_complete(parser))
+    {
+      parser->ws_errno = WS_ERR_CALLBACK;
+      rc = -1;
+    }
+
+  parser->state = WS_STATE_HEADER;
+  parser->header_len = 0;
+  parser->header_need = 2;
+  parser->raw = 0;
+  return rc;
+}
+
+
+/* ws_parser_execute:
+ *
+ *    Parses "len" bytes at "data", unmasking payloads in place.
+ *    Returns the number of bytes parsed, which is less than "len"
+ *    only on error (see ws_errno).
+ */
+size_t
+ws_parser_execute(ws_parser * parser, const ws_parser_settings * settings,
+		  char *data, size_t len)
+{
+  size_t p = 0;
+
+  if (WS_OK != parser->ws_errno)
+    return 0;
+
+  while (p < len)
+    {
+      if (WS_STATE_HEADER == parser->state)
+	{
+	  while (p < len && parser->header_len < parser->header_need)
+	    {
+	      parser->header[parser->header_len++] = data[p++];
+	      if (2 == parser->header_len)
+		parser->header_need = header_size(parser->header[1]);
+	    }
+	  if (parser->header_len < parser->header_need)
+	    break;
+
+	  if (decode_header(parser) != 0)
+	    return p;
+
+	  if (settings->on_frame_header)
+	    {
+	      int rc = settings->on_frame_header(parser);
+	      if (rc < 0 || rc > 1)
+		{
+		  parser->ws_errno = WS_ERR_CALLBACK;
+		  return p;
+		}
+	      parser->raw = rc;
+	    }
+
+	  if (0 == parser->remaining)
+	    {
+	      if (frame_complete(parser, settings) != 0)
+		return p;
+	      continue;
+	    }
+	  parser->state = WS_STATE_PAYLOAD;
+	}
+
+      // Payload
+      size_t n = WS_MIN(len - p, parser->remaining);
+      if (parser->masked && !parser->raw)
+	http_scan_unmask(data + p, n, parser->mask,
+			 (parser->payload_length - parser->remaining) & 3);
+      if (settings->on_payload && settings->on_payload(parser, data + p, n))
+	{
+	  parser->ws_errno = WS_ERR_CALLBACK;
+	  return p;
+	}
+      p += n;
+      parser->remaining -= n;
+
+      if (0 == parser->remaining && frame_complete(parser, settings) != 0)
+	return p;
+    }
+
+  return p;
+}
+
+
+/* ws_frame_header:
+ *
+ *    Writes a frame header for a payload of "length" bytes into "buf"
+ *    (at least WS_FRAME_HEADER_MAX bytes), masked with "mask" unless
+ *    it is NULL. Returns the header size.
+ */
+size_t
+ws_frame_header(unsigned char *buf, unsigned int fin, enum ws_opcode opcode,
+		uint64_t length, const unsigned char *mask)
+{
+  size_t n = 2;
+
+  buf[0] = (fin ? 0x80 : 0) | (opcode & 0x0f);
+  if (length < 126)
+    buf[1] = length;
+  else if (length <= 0xffff)
+    {
+      buf[1] = 126;
+      buf[2] = length >> 8;
+      buf[3] = length & 0xff;
+      n = 4;
+    }
+  else
+    {
+      buf[1] = 127;
+      for (int i = 0; i < 8; i++)
+	buf[2 + i] = (length >> (56 - 8 * i)) & 0xff;
+      n = 10;
+    }
+
+  if (NULL != mask)
+    {
+      buf[1] |= 0x80;
+      memcpy(buf + n, mask, 4);
+      n += 4;
+    }
+  return n;
+}
+
+
+/* ws_opcode_str:
+ *
+ *    Name of a frame opcode, for logging.
+ */
+const char *
+ws_opcode_str(enum ws_opcode opcode)
+{
+  switch (opcode)
+    {
+    case WS_OP_CONTINUATION:
+      return "continuation";
+    case WS_OP_TEXT:
+      return "text";
+    case WS_OP_BINARY:
+      return "binary";
+    case WS_OP_CLOSE:
+      return "close";
+    case WS_OP_PING:
+      return "ping";
+    case WS_OP_PONG:
+      return "pong";
+    }
+  return "reserved";
+}
+
+
+/* ws_errno_str:
+ *
+ *    Description of a parser error.
+ */
+const char *
+ws_errno_str(enum ws_errno err)
+{
+  switch (err)
+    {
+    case WS_OK:
+      return "success";
+    case WS_ERR_CALLBACK:
+      return "the on_* callback failed";
+    case WS_ERR_LENGTH:
+      return "payload length too large";
+    case WS_ERR_CONTROL:
+      return "control frame fragmented or too long";
+    }
+  return "unknown error";
+}
@@ -0,0 +1,93 @@
+/* ws_parser.h
+ *
+ *    WebSocket (RFC 6455) frame parser, for the stream after an
+ *    Upgrade: websocket. Works like http_parser: feed it bytes with
+ *    ws_parser_execute as they arrive and it calls back
+ *
+ *      on_frame_header    when a frame's header has been read; the
+ *                         fin, opcode, masked, mask and
+ *                         payload_length members describe it. Return
+ *                         1 to have the payload delivered still
+ *                         masked (it is then not touched at all).
+ *      on_payload         with each piece of the payload. Masked
+ *                         payloads are unmasked in place in the
+ *                         caller's buffer, with SIMD where possible
+ *                         (see http_scan_unmask).
+ *      on_frame_complete  after the last byte of the payload.
+ *
+ *    Any callback may return -1 to stop the parser with an error.
+ */
+#ifndef __WS_PARSER_H__
+#define __WS_PARSER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define WS_FRAME_HEADER_MAX 14
+
+enum ws_opcode
+{
+  WS_OP_CONTINUATION = 0x0,
+  WS_OP_TEXT = 0x1,
+  WS_OP_BINARY = 0x2,
+  WS_OP_CLOSE = 0x8,
+  WS_OP_PING = 0x9,
+  WS_OP_PONG = 0xA
+};
+
+enum ws_errno
+{
+  WS_OK,
+  WS_ERR_CALLBACK,
+  WS_ERR_LENGTH,
+  WS_ERR_CONTROL
+};
+
+typedef struct ws_parser ws_parser;
+typedef struct ws_parser_settings ws_parser_settings;
+typedef int (*ws_cb) (ws_parser *);
+typedef int (*ws_data_cb) (ws_parser *, const char *at, size_t length);
+
+struct ws_parser
+{
+  // private
+  unsigned int state:2;
+  unsigned int header_len:4;
+  unsigned int header_need:4;
+  unsigned int raw:1;		// Deliver payload masked
+  uint64_t remaining;		// Payload bytes still to come
+
+  // read-only
+  unsigned char header[WS_FRAME_HEADER_MAX];	// Raw header bytes
+  unsigned int fin:1;
+  unsigned int rsv:3;
+  unsigned int opcode:4;	// enum ws_opcode
+  unsigned int masked:1;
+  unsigned char mask[4];
+  uint64_t payload_length;
+  unsigned int ws_errno:2;	// enum ws_errno
+
+  // public
+  void *data;
+};
+
+struct ws_parser_settings
+{
+  ws_cb on_frame_header;
+  ws_data_cb on_payload;
+  ws_cb on_frame_complete;
+};
+
+void ws_parser_init(ws_parser * parser);
+void ws_parser_settings_init(ws_parser_settings * settings);
+size_t ws_parser_execute(ws_parser * parser,
+			 const ws_parser_settings * settings, char *data,
+			 size_t len);
+
+size_t ws_frame_header(unsigned char *buf, unsigned int fin,
+		       enum ws_opcode opcode, uint64_t length,
+		       const unsigned char *mask);
+const char *ws_opcode_str(enum ws_opcode opcode);
+const char *ws_errno_str(enum ws_errno err);
+
+#endif
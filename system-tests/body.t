@@ -5,7 +5,7 @@ use strict;
 
 use lib './lib', './system-tests/lib';
 
-use Test::Command tests => 46;
+use Test::Command tests => 84;
 use Test::More;
 
 BEGIN {
@@ -127,6 +127,286 @@ do {
 };
 
 
+# 47-52: memfd handoff (-m) transforms the body like the pipe does
+do {
+    my $expected_req = qx{ cat $HEAD_TEST_FILE };
+    my $expected_res = qx{ cat $BODY_TEST_FILE };
+    if ( $expected_res =~ m/(.*)\r\n\r\n(.*)/sg ) {
+	$expected_res = $1 . "\r\n\r\n" . uc($2);
+    }
+    my $expected = $expected_req . $expected_res . $expected_req . $expected_res;
+
+    my $cmd = Test::Command->new( cmd => qq{ cat @DOUBLE_TEST_FILES | $COMMAND -m -c "$TRANSFORM" | $REMOVE_MUMPS_HEADS } );
+    stress_test($cmd, 'HTTP req/res x 2 TR test (memfd)', $expected);
+};
+
+
+# 53-54: memfd handoff gives the command a seekable stdin, and
+# Content-Length follows the new body
+do {
+    my $expected = qx{ cat $BODY_TEST_FILE };
+    my ($expected_length, $old_length);
+    if ( $expected =~ m/(.*)\r\n\r\n(.*)/sg ) {
+	$old_length = length($2);
+	$expected_length = length($2) * 2;
+    }
+
+    my $cmd = Test::Command->new( cmd => qq{ cat $BODY_TEST_FILE | $COMMAND -m -c "cat; cat /dev/stdin" } );
+    like( $cmd->stdout_value, qr/^Content-Length: $expected_length/m, 
+	  "Content-Length updated correctly to $expected_length (memfd)" );
+    like( $cmd->stdout_value, qr/^X-Mumpsimus-Original-Content-Length: $old_length/m, 
+	  "Original-Length reported as $old_length (memfd)" );
+};
+
+
+# 55-57: command is only started for messages with a body to pipe --
+# the GET requests and the non-matching response must not spawn it
+do {
+    my $spawn_log = "/tmp/mumpsimus-body-spawns.$$";
+    unlink($spawn_log);
+    my $expected = qx{ cat @DOUBLE_TEST_FILES };
+
+    my $cmd = Test::Command->new( cmd => qq{ cat @DOUBLE_TEST_FILES | $COMMAND -c "echo x >> $spawn_log; cat" | $REMOVE_MUMPS_HEADS } );
+    $cmd->stdout_is_eq( $expected, 'body passes requests and responses with lazy pipe' );
+    is( qx{ cat $spawn_log | wc -l } + 0, 2, 'command spawned once per response body only' );
+    unlink($spawn_log);
+
+    $cmd = Test::Command->new( cmd => qq{ cat @DOUBLE_TEST_FILES | $COMMAND -t xxx-no-such-type -c "echo x >> $spawn_log; cat" } );
+    $cmd->run();
+    ok( ! -e $spawn_log, 'command never spawned when no Content-Type matches' );
+    unlink($spawn_log);
+};
+
+
+# 58-60: only the real Content-Length header is rewritten -- names
+# that merely start with "Content" are left alone
+do {
+    my $input = "HTTP/1.1 200 OK\r\nContent: x\r\nContent-Lengthy: y\r\n"
+	. "Content-Length: 5\r\n\r\nhello";
+    my $cmd = Test::Command->new( cmd => qq{ printf '$input' | $COMMAND -c "$TRANSFORM" } );
+    like( $cmd->stdout_value, qr/^Content: x\r\nContent-Lengthy: y\r\nContent-Length: 5\r\nX-Mumpsimus-Original-Content-Length: 5\r\n/m,
+	  'Content-Length rewritten, other Content* headers kept' );
+    like( $cmd->stdout_value, qr/\r\n\r\nHELLO$/, 'body was transformed' );
+    $cmd->exit_is_num( 0, 'body exited normally' );
+};
+
+
+# 61-62: a response to a HEAD request has no body to pipe, so the
+# next message isn't taken for it
+do {
+    my $head_req = qx{ find @SEARCH_DIR -name sample-request-head.txt 2>/dev/null };   chomp($head_req);
+    my $head_res = qx{ find @SEARCH_DIR -name sample-response-head.txt 2>/dev/null };  chomp($head_res);
+    my $expected = qx{ cat $head_req $HEAD_TEST_FILE $head_res };
+
+    my $cmd = Test::Command->new( cmd => qq{ cat $head_req $HEAD_TEST_FILE $head_res $BODY_TEST_FILE | $COMMAND -c "$TRANSFORM" } );
+    like( $cmd->stdout_value, qr/^\Q$expected\EHTTP\/1.1 302 Found\r\n/, 'HEAD response passed unchanged' );
+    $cmd->exit_is_num( 0, 'body exited normally after HEAD response' );
+};
+
+
+# 63-68: after CONNECT the rest of the stream passes through
+# untransformed; after a WebSocket upgrade text messages are
+do {
+    # Bytes after the switch: binary, and text that would parse as HTTP
+    my $TUNNEL_FILE = "/tmp/mumpsimus-tunnel.$$";
+    open(my $tfh, '>', $TUNNEL_FILE) or die "Can't write $TUNNEL_FILE: $!";
+    binmode($tfh);
+    print $tfh "\x16\x03\x01\x00\xa5\x01\x00\x00\xa1\x03\x03", map(chr, 0..255),
+        "GET /not-http HTTP/1.1\r\nHost: x\r\n\r\n";
+    close($tfh);
+    my $CONNECT_REQ = qx{ find @SEARCH_DIR -name sample-request-connect.txt 2>/dev/null };    chomp($CONNECT_REQ);
+    my $CONNECT_RES = qx{ find @SEARCH_DIR -name sample-response-connect.txt 2>/dev/null };   chomp($CONNECT_RES);
+    my $WS_REQ = qx{ find @SEARCH_DIR -name sample-request-websocket.txt 2>/dev/null };        chomp($WS_REQ);
+    my $WS_RES = qx{ find @SEARCH_DIR -name sample-response-101.txt 2>/dev/null };            chomp($WS_RES);
+
+    my @files = ( $CONNECT_REQ, $CONNECT_RES, $TUNNEL_FILE );
+    # Heads are written back out with CRLF line ends
+    my $expected = `cat @files`;
+    $expected =~ s/^(.*?\n\r?\n)/(my $h = $1) =~ s{\r?\n}{\r\n}g; $h/se;
+    my $cmd = Test::Command->new( cmd => qq{ cat @files | $COMMAND -c "$TRANSFORM" } );
+    $cmd->stdout_is_eq( $expected, "body passes tunnel through after CONNECT" );
+    $cmd->exit_is_num( 0, 'body exited normally after tunnel' );
+    unlink($TUNNEL_FILE);
+
+    # A masked text message in two fragments with a ping between, a
+    # binary frame with text in it, and a close
+    sub ws_frame {
+        my ($fin, $op, $payload, $mask) = @_;
+        my $len = length($payload);
+        my $mbit = defined($mask) ? 0x80 : 0;
+        my $frame = chr(($fin ? 0x80 : 0) | $op);
+        if ($len < 126) { $frame .= chr($mbit | $len); }
+        elsif ($len < 65536) { $frame .= chr($mbit | 126) . pack('n', $len); }
+        else { $frame .= chr($mbit | 127) . pack('Q>', $len); }
+        if (defined($mask)) {
+            $frame .= $mask;
+            $payload ^= substr($mask x (int($len / 4) + 1), 0, $len);
+        }
+        return $frame . $payload;
+    }
+    my $mask = "\x37\xfa\x21\x3d";
+    my $binary = ws_frame(1, 2, "binary text " x 20);
+    my $close = ws_frame(1, 8, "\x03\xe8");
+    my $WS_FILE = "/tmp/mumpsimus-ws.$$";
+    open(my $wfh, '>', $WS_FILE) or die "Can't write $WS_FILE: $!";
+    binmode($wfh);
+    print $wfh ws_frame(0, 1, "Hello, " x 20, $mask), ws_frame(1, 9, "", $mask),
+        ws_frame(1, 0, "websocket", "\x01\x02\x03\x04"), $binary, $close;
+    close($wfh);
+
+    # The message is sent on as one frame, with the first key
+    $expected = `cat $WS_REQ $WS_RES`;
+    $expected =~ s/\r?\n/\r\n/g;
+    $expected .= ws_frame(1, 9, "", $mask) . ws_frame(1, 1, ("HELLO, " x 20) . "WEBSOCKET", $mask) . $binary . $close;
+    $cmd = Test::Command->new( cmd => qq{ cat $WS_REQ $WS_RES $WS_FILE | $COMMAND -c "$TRANSFORM" } );
+    $cmd->stdout_is_eq( $expected, "body transforms WebSocket text messages only" );
+    $cmd->exit_is_num( 0, 'body exited normally after WebSocket frames' );
+
+    # Unmasked (server) frames stay unmasked
+    open($wfh, '>', $WS_FILE) or die "Can't write $WS_FILE: $!";
+    binmode($wfh);
+    print $wfh ws_frame(1, 1, "server says hi"), $close;
+    close($wfh);
+    $expected = `cat $WS_REQ $WS_RES`;
+    $expected =~ s/\r?\n/\r\n/g;
+    $expected .= ws_frame(1, 1, "SERVER SAYS HI") . $close;
+    $cmd = Test::Command->new( cmd => qq{ cat $WS_REQ $WS_RES $WS_FILE | $COMMAND -c "$TRANSFORM" } );
+    $cmd->stdout_is_eq( $expected, "body transforms unmasked text frames" );
+    $cmd->exit_is_num( 0, 'body exited normally after unmasked frames' );
+    unlink($WS_FILE);
+};
+
+
+# 69-72: chunked bodies -- piped ones get a Content-Length (or with -C
+# are chunked again as the command outputs them), unpiped ones keep
+# their chunking with many tiny chunks gathered into one
+do {
+    my $head = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\nContent-Type: text/plain\r\n\r\n";
+    my $CHUNK_FILE = "/tmp/mumpsimus-chunked.$$";
+    open(my $cfh, '>', $CHUNK_FILE) or die "Can't write $CHUNK_FILE: $!";
+    binmode($cfh);
+    print $cfh $head, join('', map { "3\r\nabc\r\n" } 1..100), "0\r\n\r\n";
+    close($cfh);
+
+    my $body = "ABC" x 100;
+    my $expected = "HTTP/1.1 200 OK\r\nContent-Length: 300\r\n"
+        . "X-Mumpsimus-Original-Transfer-Encoding: chunked\r\n"
+        . "Content-Type: text/plain\r\n\r\n$body";
+    my $cmd = Test::Command->new( cmd => qq{ $COMMAND -c "$TRANSFORM" < $CHUNK_FILE } );
+    $cmd->stdout_is_eq( $expected, "piped chunked body is sent with a Content-Length" );
+
+    $expected = $head . sprintf("%x\r\n%s\r\n", length($body), $body) . "0\r\n\r\n";
+    $cmd = Test::Command->new( cmd => qq{ $COMMAND -C -c "$TRANSFORM" < $CHUNK_FILE } );
+    $cmd->stdout_is_eq( $expected, "with -C piped body is chunked" );
+
+    $expected = $head . sprintf("%x\r\n%s\r\n", 300, "abc" x 100) . "0\r\n\r\n";
+    $cmd = Test::Command->new( cmd => qq{ $COMMAND -t no/match -c "$TRANSFORM" < $CHUNK_FILE } );
+    $cmd->stdout_is_eq( $expected, "unpiped chunked body is gathered into one chunk" );
+
+    open($cfh, '>', $CHUNK_FILE) or die "Can't write $CHUNK_FILE: $!";
+    print $cfh $head, "0\r\n\r\n";
+    close($cfh);
+    $cmd = Test::Command->new( cmd => qq{ $COMMAND -t no/match -c "$TRANSFORM" < $CHUNK_FILE } );
+    $cmd->stdout_is_eq( $head . "0\r\n\r\n", "empty chunked body keeps its last-chunk" );
+    unlink($CHUNK_FILE);
+};
+
+
+# 73-74: HTTP/2 passes through unmodified, with a warning
+do {
+    # A request with prior knowledge: preface, SETTINGS, HEADERS, DATA
+    my $H2_FILE = "/tmp/mumpsimus-h2.$$";
+    open(my $hfh, '>', $H2_FILE) or die "Can't write $H2_FILE: $!";
+    binmode($hfh);
+    print $hfh "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n", "\x00\x00\x00\x04\x00\x00\x00\x00\x00",
+        "\x00\x00\x16\x01\x04\x00\x00\x00\x01\x83\x86\x84\x00\x0ccontent-type\x04text",
+        "\x00\x00\x0b\x00\x01\x00\x00\x00\x01hello world";
+    close($hfh);
+    my $cmd = Test::Command->new( cmd => qq{ $COMMAND -c "$TRANSFORM" < $H2_FILE } );
+    $cmd->stdout_is_file( $H2_FILE, 'body passes HTTP/2 through' );
+    $cmd->stderr_like( qr/HTTP\/2 \(h2c\) stream -- bodies in it are passed through untransformed/,
+                       'body warns that HTTP/2 is not transformed' );
+    unlink($H2_FILE);
+};
+
+
+# 75-76: with -R what the commands used is reported at exit, per
+# Content-Type and for all
+my $cmd = Test::Command->new( cmd => qq{ cat @TEST_FILES | $COMMAND -R -c "$TRANSFORM" } );
+$cmd->stderr_like( qr{^body: \[children\] "\Q$TRANSFORM\E" text/html children=1 user_ms=[\d.]+ sys_ms=[\d.]+ wall_ms=[\d.]+ maxrss_kb=\d+$}m,
+		   'body -R reports the command per Content-Type' );
+$cmd->stderr_like( qr{^body: \[children\] "\Q$TRANSFORM\E" all children=1 }m, 'body -R reports all children of the command' );
+
+
+# 77-79: with -T each message says how long body held it
+$cmd = Test::Command->new( cmd => qq{ cat @TEST_FILES | $COMMAND -T -c "$TRANSFORM" } );
+$cmd->stdout_like( qr{\AGET [^\n]*\n(?:[^\r]*\r\n)*X-Mumpsimus-Timing: body;in=\d+;spawn=0;xform=0;out=\d+\r\n\r\n}m,
+		   'body -T times a request without a body' );
+$cmd->stdout_like( qr{^X-Mumpsimus-Timing: body;in=\d+;spawn=[1-9]\d*;xform=[1-9]\d*;out=\d+\r\n\r\n<HTML>}m,
+		   'body -T times a piped body' );
+$cmd = Test::Command->new( cmd => qq{ $COMMAND -c "$TRANSFORM" < $BODY_TEST_FILE } );
+$cmd->stdout_unlike( qr{X-Mumpsimus-Timing}, 'body adds no timing without -T' );
+
+
+# 80-81: a chunk size too big for 64 bits is an error, not a crash
+do {
+    my $CHUNK_FILE = "/tmp/mumpsimus-chunked.$$";
+    open(my $cfh, '>', $CHUNK_FILE) or die "Can't write $CHUNK_FILE: $!";
+    print $cfh "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\nffffffffffffffff\r\nabc";
+    close($cfh);
+    my $cmd = Test::Command->new( cmd => qq{ ULOG_LEVEL=0 $COMMAND -c "$TRANSFORM" < $CHUNK_FILE } );
+    $cmd->exit_is_num( 74, 'body rejects an overflowing chunk size' );
+    $cmd = Test::Command->new( cmd => qq{ ULOG_LEVEL=0 $COMMAND -t no/match -c "$TRANSFORM" < $CHUNK_FILE } );
+    $cmd->exit_is_num( 74, 'body rejects an overflowing chunk size it does not pipe' );
+    unlink($CHUNK_FILE);
+};
+
+
+# 82: an unpiped chunked body goes on as each read arrives, so a
+# stream of events is not held until the next one
+do {
+    my $head = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\nContent-Type: text/event-stream\r\n\r\n";
+    my $FIRST_FILE = "/tmp/mumpsimus-events.$$";
+    open(my $efh, '>', $FIRST_FILE) or die "Can't write $FIRST_FILE: $!";
+    print $efh $head, "9\r\ndata: 1\n\n\r\n";
+    close($efh);
+    my $expected = $head . "9\r\ndata: 1\n\n\r\n";
+    my $cmd = Test::Command->new( cmd => qq{ ( cat $FIRST_FILE; sleep 2; printf '0\\r\\n\\r\\n' ) | $COMMAND -t no/match -c "$TRANSFORM" | timeout 1 head -c } . length($expected) );
+    $cmd->stdout_is_eq( $expected, 'first event is sent on before the stream goes on' );
+    unlink($FIRST_FILE);
+};
+
+# 83: WebSocket text messages with RSV bits (permessage-deflate) pass
+# through untouched; plain ones after them are still transformed
+do {
+    my $WS_REQ = qx{ find @SEARCH_DIR -name sample-request-websocket.txt 2>/dev/null };        chomp($WS_REQ);
+    my $WS_RES = qx{ find @SEARCH_DIR -name sample-response-101.txt 2>/dev/null };            chomp($WS_RES);
+    my $mask = "\x37\xfa\x21\x3d";
+    my $deflated = ws_frame(0, 1, "\xf2\x48\xcd\xc9", $mask);
+    substr($deflated, 0, 1) = chr(ord($deflated) | 0x40);
+    $deflated .= ws_frame(1, 0, "\xc9\x07\x00", $mask);
+    my $WS_FILE = "/tmp/mumpsimus-ws.$$";
+    open(my $wfh, '>', $WS_FILE) or die "Can't write $WS_FILE: $!";
+    binmode($wfh);
+    print $wfh $deflated, ws_frame(1, 1, "plain", $mask);
+    close($wfh);
+    my $expected = `cat $WS_REQ $WS_RES`;
+    $expected =~ s/\r?\n/\r\n/g;
+    $expected .= $deflated . ws_frame(1, 1, "PLAIN", $mask);
+    my $cmd = Test::Command->new( cmd => qq{ cat $WS_REQ $WS_RES $WS_FILE | $COMMAND -c "$TRANSFORM" } );
+    $cmd->stdout_is_eq( $expected, "body passes compressed WebSocket messages through" );
+    unlink($WS_FILE);
+};
+
+
+# 84: a header name split across reads whose hash is that of
+# Content-Length is not taken for it
+do {
+    my $expected = "HTTP/1.1 200 OK\r\nSesacl0-Length: 999\r\nContent-Length: 11\r\nX-Mumpsimus-Original-Content-Length: 5\r\n\r\nhello-world";
+    my $cmd = Test::Command->new( cmd => qq{ ( printf 'HTTP/1.1 200 OK\\r\\nSesacl0'; sleep 1; printf -- '-Length: 999\\r\\nContent-Length: 5\\r\\n\\r\\nhello' ) | $COMMAND -c 'sed s/hello/hello-world/' } );
+    $cmd->stdout_is_eq( $expected, 'split header name colliding with Content-Length' );
+};
+
 # stress_test: 6 tests
 #
 #    For the $cmd given, run the command 11 times, testing each time
@@ -5,7 +5,7 @@ use strict;
 
 use lib './lib', './system-tests/lib';
 
-use Test::Command tests => 30;
+use Test::Command tests => 40;
 use Test::More;
 
 BEGIN {
@@ -62,6 +62,94 @@ stress_test($cmd, 'HTTP req/res x 2 SED test', $expected);
 
 
 
+# 31-32: after CONNECT the rest of the stream passes through unparsed
+do {
+    # Bytes after the switch: binary, and text that would parse as HTTP
+    my $TUNNEL_FILE = "/tmp/mumpsimus-tunnel.$$";
+    open(my $tfh, '>', $TUNNEL_FILE) or die "Can't write $TUNNEL_FILE: $!";
+    binmode($tfh);
+    print $tfh "\x16\x03\x01\x00\xa5\x01\x00\x00\xa1\x03\x03", map(chr, 0..255),
+        "GET /not-http HTTP/1.1\r\nHost: x\r\n\r\n";
+    close($tfh);
+    my $CONNECT_REQ = qx{ find @SEARCH_DIR -name sample-request-connect.txt 2>/dev/null };    chomp($CONNECT_REQ);
+    my $CONNECT_RES = qx{ find @SEARCH_DIR -name sample-response-connect.txt 2>/dev/null };   chomp($CONNECT_RES);
+    my $WS_REQ = qx{ find @SEARCH_DIR -name sample-request-websocket.txt 2>/dev/null };        chomp($WS_REQ);
+    my $WS_RES = qx{ find @SEARCH_DIR -name sample-response-101.txt 2>/dev/null };            chomp($WS_RES);
+
+    my @files = ( $CONNECT_REQ, $CONNECT_RES, $TUNNEL_FILE );
+    # Heads are written back out with CRLF line ends
+    my $expected = `cat @files`;
+    $expected =~ s/^(.*?\n\r?\n)/(my $h = $1) =~ s{\r?\n}{\r\n}g; $h/se;
+    my $cmd = Test::Command->new( cmd => qq{ cat @files | $COMMAND -c cat } );
+    $cmd->stdout_is_eq( $expected, 'headers passes tunnel through after CONNECT' );
+    $cmd->exit_is_num( 0, 'headers exited normally after tunnel' );
+    unlink($TUNNEL_FILE);
+};
+
+
+# 33-34: HTTP/2 passes through unmodified, with a warning
+do {
+    # A request with prior knowledge: preface, SETTINGS, HEADERS, DATA
+    my $H2_FILE = "/tmp/mumpsimus-h2.$$";
+    open(my $hfh, '>', $H2_FILE) or die "Can't write $H2_FILE: $!";
+    binmode($hfh);
+    print $hfh "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n", "\x00\x00\x00\x04\x00\x00\x00\x00\x00",
+        "\x00\x00\x16\x01\x04\x00\x00\x00\x01\x83\x86\x84\x00\x0ccontent-type\x04text",
+        "\x00\x00\x0b\x00\x01\x00\x00\x00\x01hello world";
+    close($hfh);
+    my $cmd = Test::Command->new( cmd => qq{ $COMMAND -c "sed -e s/text/html/" < $H2_FILE } );
+    $cmd->stdout_is_file( $H2_FILE, 'headers passes HTTP/2 through' );
+    $cmd->stderr_like( qr/HTTP\/2 \(h2c\) stream -- headers in it are passed through untransformed/,
+                       'headers warns that HTTP/2 is not transformed' );
+    unlink($H2_FILE);
+};
+
+
+# 35-36: with -R what the commands used is reported at exit, per
+# Content-Type and for all (two requests and two responses, the last
+# child being given no message)
+$cmd = Test::Command->new( cmd => qq{ cat @TEST_FILES | $COMMAND -R -c cat } );
+$cmd->stderr_like( qr{^headers: \[children\] "cat" text/html children=2 user_ms=[\d.]+ sys_ms=[\d.]+ wall_ms=[\d.]+ maxrss_kb=\d+$}m,
+		   'headers -R reports the command per Content-Type' );
+$cmd->stderr_like( qr{^headers: \[children\] "cat" all children=5 }m, 'headers -R reports all children of the command' );
+
+
+# 37-38: with -T each message says how long headers held it, after
+# any timing added by stages before
+$cmd = Test::Command->new( cmd => qq{ body -T -c cat < $BODY_TEST_FILE | $COMMAND -T -c cat } );
+$cmd->stdout_like( qr{^X-Mumpsimus-Timing: body;in=\d+;spawn=\d+;xform=\d+;out=\d+\r\nX-Mumpsimus-Timing: headers;in=\d+;spawn=\d+;xform=0;out=\d+\r\n\r\n}m,
+		   'headers -T adds its timing after the last stage' );
+$cmd->exit_is_num( 0, 'headers -T exited normally' );
+
+
+# 39: a 200 that only advertises an upgrade does not switch protocols,
+# so a response in a later read is still rewritten
+do {
+    my $ADVERTISE = "/tmp/mumpsimus-advertise.$$";
+    open(my $afh, '>', $ADVERTISE) or die "Can't write $ADVERTISE: $!";
+    print $afh "HTTP/1.1 200 OK\r\nServer: gws\r\nUpgrade: h2,h2c\r\nConnection: Upgrade\r\nContent-Length: 5\r\n\r\nhello";
+    close($afh);
+    my $cmd = Test::Command->new( cmd => qq{ ( cat $ADVERTISE; sleep 1; cat $BODY_TEST_FILE ) | $COMMAND -c "sed -e 's/^Server: gws/Server: banana/'" } );
+    my $servers = () = $cmd->stdout_value =~ /^Server: banana\r$/mg;
+    is( $servers, 2, 'headers rewrites responses after an advertised upgrade' );
+    unlink($ADVERTISE);
+};
+
+
+# 40: a long stream of requests only (never answered) is no cause for
+# warnings
+do {
+    my $requests = qx{ cat $HEAD_TEST_FILE } x 300;
+    my $REQUESTS_FILE = "/tmp/mumpsimus-requests.$$";
+    open(my $rfh, '>', $REQUESTS_FILE) or die "Can't write $REQUESTS_FILE: $!";
+    print $rfh $requests;
+    close($rfh);
+    my $cmd = Test::Command->new( cmd => qq{ $COMMAND -c cat < $REQUESTS_FILE } );
+    $cmd->stderr_is_eq( '', 'headers gives no warnings for 300 requests' );
+    unlink($REQUESTS_FILE);
+};
+
+
 # stress_test: 6 tests
 #
 #    For the $cmd given, run the command 11 times, testing each time
@@ -10,7 +10,7 @@ use strict;
 
 use lib './lib', './system-tests/lib';
 
-use Test::Command tests => 19;
+use Test::Command tests => 70;
 use Test::More;
 
 BEGIN {
@@ -67,3 +67,237 @@ $cmd->exit_is_num(0, 'log exited with zero for concatenated http messages (quads
 @stderr_lines = split /\n/, $cmd->stderr_value;
 is( $#stderr_lines+1, $#TEST_FILES+1, '1 log message for each http message generated (quads)');
 
+
+# 20-24: a response to a HEAD request has no body, whatever its
+# Content-Length says, and neither does a 304
+my $HEAD_REQ_FILE = qx{ find @SEARCH_DIR -name sample-request-head.txt 2>/dev/null };   chomp($HEAD_REQ_FILE);
+my $HEAD_RES_FILE = qx{ find @SEARCH_DIR -name sample-response-head.txt 2>/dev/null };  chomp($HEAD_RES_FILE);
+my $NOT_MODIFIED_FILE = qx{ find @SEARCH_DIR -name sample-response-304.txt 2>/dev/null }; chomp($NOT_MODIFIED_FILE);
+my @PIPELINED_FILES = ( $HEAD_REQ_FILE, $HEAD_TEST_FILE, $HEAD_RES_FILE, $BODY_TEST_FILE );
+$expected = `cat @PIPELINED_FILES`;
+$cmd = Test::Command->new( cmd => "cat @PIPELINED_FILES | log" );
+$cmd->stdout_is_eq($expected, 'log does not corrupt pipelined HEAD and GET');
+$cmd->exit_is_num(0, 'log exited with zero for pipelined HEAD and GET');
+@stderr_lines = split /\n/, $cmd->stderr_value;
+is( $#stderr_lines+1, 4, '1 log message for each pipelined http message');
+like( $stderr_lines[3], qr/\[res\] HTTP\/1.1 302/, 'response after HEAD response was framed' );
+
+$cmd = Test::Command->new( cmd => "cat $NOT_MODIFIED_FILE $BODY_TEST_FILE | log" );
+@stderr_lines = split /\n/, $cmd->stderr_value;
+is( $#stderr_lines+1, 2, '304 with Content-Length has no body');
+
+# 25-34: after CONNECT the rest of the stream passes through unparsed;
+# after a WebSocket upgrade each frame is reported
+# Bytes after the switch: binary, and text that would parse as HTTP
+my $TUNNEL_FILE = "/tmp/mumpsimus-tunnel.$$";
+open(my $tfh, '>', $TUNNEL_FILE) or die "Can't write $TUNNEL_FILE: $!";
+binmode($tfh);
+print $tfh "\x16\x03\x01\x00\xa5\x01\x00\x00\xa1\x03\x03", map(chr, 0..255),
+    "GET /not-http HTTP/1.1\r\nHost: x\r\n\r\n";
+close($tfh);
+# WebSocket frames: a masked text message in two fragments with a ping
+# between, a binary frame and a close
+sub ws_frame {
+    my ($fin, $op, $payload, $mask) = @_;
+    my $len = length($payload);
+    my $mbit = defined($mask) ? 0x80 : 0;
+    my $frame = chr(($fin ? 0x80 : 0) | $op);
+    if ($len < 126) { $frame .= chr($mbit | $len); }
+    elsif ($len < 65536) { $frame .= chr($mbit | 126) . pack('n', $len); }
+    else { $frame .= chr($mbit | 127) . pack('Q>', $len); }
+    if (defined($mask)) {
+        $frame .= $mask;
+        $payload ^= substr($mask x (int($len / 4) + 1), 0, $len);
+    }
+    return $frame . $payload;
+}
+my $WS_FILE = "/tmp/mumpsimus-ws.$$";
+open(my $wfh, '>', $WS_FILE) or die "Can't write $WS_FILE: $!";
+binmode($wfh);
+print $wfh ws_frame(0, 1, "Hello, ", "\x37\xfa\x21\x3d"),
+    ws_frame(1, 9, "", "\x37\xfa\x21\x3d"),
+    ws_frame(1, 0, "websocket", "\x01\x02\x03\x04"),
+    ws_frame(1, 2, join('', map(chr, 0..255)) x 2),
+    ws_frame(1, 8, "\x03\xe8");
+close($wfh);
+my $CONNECT_REQ = qx{ find @SEARCH_DIR -name sample-request-connect.txt 2>/dev/null };    chomp($CONNECT_REQ);
+my $CONNECT_RES = qx{ find @SEARCH_DIR -name sample-response-connect.txt 2>/dev/null };   chomp($CONNECT_RES);
+my $WS_REQ = qx{ find @SEARCH_DIR -name sample-request-websocket.txt 2>/dev/null };        chomp($WS_REQ);
+my $WS_RES = qx{ find @SEARCH_DIR -name sample-response-101.txt 2>/dev/null };            chomp($WS_RES);
+
+foreach my $stream ( [ $CONNECT_REQ, $CONNECT_RES, $TUNNEL_FILE ], [ $CONNECT_REQ, $TUNNEL_FILE ], [ $WS_REQ, $WS_RES, $WS_FILE ] ) {
+    my @files = @$stream;
+    $expected = `cat @files`;
+    $cmd = Test::Command->new( cmd => "cat @files | log" );
+    $cmd->stdout_is_eq($expected, "log passes tunnel through after @files");
+    @stderr_lines = split /\n/, $cmd->stderr_value;
+    my $lines = ( $files[-1] eq $WS_FILE ? 2 + 5 : scalar(@files) - 1 );
+    is( $#stderr_lines+1, $lines, "only the HTTP messages and frames were logged" );
+}
+$cmd = Test::Command->new( cmd => "cat $CONNECT_REQ $CONNECT_RES $TUNNEL_FILE | log" );
+$cmd->exit_is_num(0, 'log exited with zero after tunnel');
+$cmd->stderr_like(qr/\[res\] HTTP\/1.1 200 clients6.google.com:443/, 'CONNECT response was logged');
+$cmd = Test::Command->new( cmd => "cat $WS_REQ $WS_RES $WS_FILE | log -v" );
+$cmd->stderr_like(qr/\[ws\] text \(fragment\) 7 bytes masked\n\tHello, \n.*\[ws\] ping 0 bytes masked\n.*\[ws\] continuation 9 bytes masked\n\twebsocket\n/s,
+                  'text frames were unmasked and printed');
+$cmd->stderr_like(qr/\[ws\] binary 512 bytes\n.*\[ws\] close 2 bytes\n/s, 'other frames were reported');
+unlink($TUNNEL_FILE);
+unlink($WS_FILE);
+
+# 35-42: parsing only the framing headers logs the same as parsing all
+# of them
+my @ALL_FILES = map { my $f = qx{ find @SEARCH_DIR -name $_ 2>/dev/null }; chomp($f); $f }
+    qw( sample-request-get.txt sample-response-302.txt sample-request-put.txt
+        sample-response-200-png.txt sample-request-head.txt sample-response-head.txt );
+$cmd = Test::Command->new( cmd => "cat @ALL_FILES | log -a" );
+$expected = $cmd->stderr_value;
+$cmd = Test::Command->new( cmd => "cat @ALL_FILES | log" );
+$cmd->stderr_is_eq($expected, 'framing only parse logs the same messages');
+$cmd->exit_is_num(0, 'log exited with zero when parsing framing only');
+
+# A skipped line is framed and checked as a parsed one would be: a bare
+# CR, or a line with no colon, fails the same way in both modes
+foreach my $bad ( 'X-A: a\\rContent-Length: 2\\r\\n\\r\\nhiHTTP/1.1 204 OK\\r\\n\\r\\n',
+                  'bad header\\r\\nContent-Length: 2\\r\\n\\r\\nhi',
+                  'X-B : b\\r\\nContent-Length: 2\\r\\n\\r\\nhi' ) {
+    my $input = qq{ printf 'HTTP/1.1 200 OK\\r\\n$bad' };
+    my $all = Test::Command->new( cmd => "$input | log -a" );
+    ( my $all_err = $all->stderr_value ) =~ s/\[\d+\]//g;
+    $cmd = Test::Command->new( cmd => "$input | log" );
+    ( my $err = $cmd->stderr_value ) =~ s/\[\d+\]//g;
+    is($err, $all_err, "framing only parse fails as a full one on '$bad'");
+    $cmd->exit_is_num($all->exit_value, "framing only parse exits as a full one on '$bad'");
+}
+
+# 43-48: HTTP/2 with prior knowledge is passed through, with each
+# stream's messages logged
+sub h2_frame {
+    my ($type, $flags, $id, $payload) = @_;
+    return substr(pack('N', length($payload)), 1) . pack('CCN', $type, $flags, $id) . $payload;
+}
+sub hpack_literal {
+    my ($name, $value) = @_;
+    return "\x00" . chr(length($name)) . $name . chr(length($value)) . $value;
+}
+my $H2_REQ = "/tmp/mumpsimus-h2req.$$";
+my $H2_RES = "/tmp/mumpsimus-h2res.$$";
+open(my $h2fh, '>', $H2_REQ) or die "$H2_REQ: $!";
+binmode($h2fh);
+print $h2fh "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n", h2_frame(4, 0, 0, ''),
+    h2_frame(1, 5, 1, "\x82\x86\x85" . hpack_literal(':authority', 'example.com')),
+    h2_frame(1, 4, 3, "\x83\x86" . hpack_literal(':path', '/submit')),
+    h2_frame(0, 1, 3, 'hello');
+close($h2fh);
+open($h2fh, '>', $H2_RES) or die "$H2_RES: $!";
+binmode($h2fh);
+print $h2fh h2_frame(4, 0, 0, "\x00\x03\x00\x00\x00\x64"),
+    h2_frame(1, 4, 1, "\x88" . hpack_literal('content-type', 'text/plain')),
+    h2_frame(0, 1, 1, 'hi'),
+    h2_frame(1, 5, 3, "\x89");
+close($h2fh);
+
+$cmd = Test::Command->new( cmd => "log < $H2_REQ" );
+$cmd->stdout_is_file($H2_REQ, 'log passes HTTP/2 requests through');
+$cmd->stderr_like(qr/\[req\] GET \/index.html HTTP\/2.0 \(stream 1\)\n.*\[req\] POST \/submit HTTP\/2.0 \(stream 3\)/s,
+                  'each HTTP/2 request was logged');
+$cmd = Test::Command->new( cmd => "log < $H2_RES" );
+$cmd->stdout_is_file($H2_RES, 'log passes HTTP/2 responses through');
+$cmd->stderr_like(qr/\[res\] HTTP\/2.0 200 .*\(stream 1\)\n.*\[res\] HTTP\/2.0 204 .*\(stream 3\)/s,
+                  'each HTTP/2 response was logged');
+$cmd = Test::Command->new( cmd => "log -v < $H2_REQ" );
+$cmd->stderr_like(qr/\t:scheme: http\r?\n\t:authority: example.com\r?\n/, 'HTTP/2 headers were decoded');
+$cmd->exit_is_num(0, 'log exited with zero after HTTP/2');
+unlink($H2_REQ);
+unlink($H2_RES);
+
+# 49-53: with -o, a record per message goes to the file instead of
+# stderr; mumplog prints binary records as the same JSON
+my $PUT_FILES = join(' ', map { my $f = qx{ find @SEARCH_DIR -name $_ 2>/dev/null }; chomp($f); $f }
+    qw( sample-request-put.txt sample-response-302.txt ));
+my $JSON_LOG = "/tmp/mumpsimus-log.json.$$";
+my $BIN_LOG = "/tmp/mumpsimus-log.bin.$$";
+$cmd = Test::Command->new( cmd => "cat $PUT_FILES | log -o $JSON_LOG" );
+$cmd->stderr_is_eq('', 'nothing was logged on stderr with -o');
+my @records = split /\n/, `cat $JSON_LOG`;
+is( scalar(@records), 2, 'one record per message' );
+like( $records[0], qr/^\{"type":"req","method":"PUT","url":"http:\/\/www.google.com.au\/","version":"1.1","header_bytes":380,"body_bytes":11,"begin_ns":\d+,"end_ns":\d+\}$/,
+      'request record has its sizes and times' );
+system("cat $PUT_FILES | log -o $BIN_LOG -F bin > /dev/null");
+(my $json = `cat $JSON_LOG`) =~ s/"(begin|end)_ns":\d+/$1/g;
+(my $decoded = `mumplog $BIN_LOG`) =~ s/"(begin|end)_ns":\d+/$1/g;
+is( $decoded, $json, 'binary records decode to the same JSON' );
+$cmd = Test::Command->new( cmd => "mumplog $JSON_LOG" );
+$cmd->exit_is_num(65, 'mumplog rejects a file that is not a binary log');
+unlink($JSON_LOG);
+unlink($BIN_LOG);
+
+# 54-57: with -H, histograms by method and status class are printed
+# at exit (and on SIGUSR1)
+$cmd = Test::Command->new( cmd => "cat $PUT_FILES | log -q -H" );
+$cmd->exit_is_num(0, 'log -H exits normally');
+$cmd->stderr_like(qr/^log.c: \[stats\] 2 messages in \d+\.\d{3}s\n/, 'summary counts the messages');
+$cmd->stderr_like(qr/\[stats\] PUT body n=1 min=11 p50=11 p90=11 p99=11 max=11\n.*\[stats\] 3xx header n=1 min=768 /s,
+                  'sizes are kept per method and status class');
+$cmd = Test::Command->new( cmd => "log -I 0 < /dev/null" );
+$cmd->exit_is_num(64, 'interval must be a positive number of seconds');
+
+# 58-62: with -p, responses are read from a second file and paired
+# with the requests from stdin, in order
+my $REQ_FILES = join(' ', map { my $f = qx{ find @SEARCH_DIR -name $_ 2>/dev/null }; chomp($f); $f }
+    qw( sample-request-get.txt sample-request-head.txt sample-request-put.txt ));
+my $RES_FILES = join(' ', map { my $f = qx{ find @SEARCH_DIR -name $_ 2>/dev/null }; chomp($f); $f }
+    qw( sample-response-302.txt sample-response-head.txt sample-response-200-png.txt ));
+my $RES_IN = "/tmp/mumpsimus-log.res.$$";
+my $RES_OUT = "/tmp/mumpsimus-log.out.$$";
+system("cat $RES_FILES > $RES_IN");
+$cmd = Test::Command->new( cmd => "cat $REQ_FILES | log -p $RES_IN -P $RES_OUT" );
+$cmd->exit_is_num(0, 'log -p exits normally');
+my $requests = `cat $REQ_FILES`;
+$cmd->stdout_is_eq($requests, 'requests were echoed to stdout');
+$cmd->stderr_like(qr/\[txn\] GET http:\/\/www.google.com\/ 302 ttfb_us=\d+ latency_us=\d+\n.*\[txn\] HEAD http:\/\/www.google.com\/ 200 .*\[res\] HTTP\/1.1 200 http:\/\/www.google.com.au\/\n.*\[txn\] PUT /s,
+                  'responses were paired with their requests');
+is( scalar(`cat $RES_OUT`), scalar(`cat $RES_IN`), 'responses were echoed to the -P file' );
+$cmd = Test::Command->new( cmd => "log -P $RES_OUT < /dev/null" );
+$cmd->exit_is_num(64, '-P needs -p');
+unlink($RES_IN);
+unlink($RES_OUT);
+
+# 63-66: with -s and -r, only some messages have their headers printed
+$cmd = Test::Command->new( cmd => "cat $REQ_FILES | log -v -s 1/2" );
+$cmd->exit_is_num(0, 'log -s exits normally');
+my $dumps = () = $cmd->stderr_value =~ /\[begin headers\]/g;
+is( $dumps, 2, 'headers of 1 in 2 messages were printed' );
+$cmd = Test::Command->new( cmd => "cat $REQ_FILES | log -v -r 1" );
+$dumps = () = $cmd->stderr_value =~ /\[begin headers\]/g;
+is( $dumps, 1, 'headers of 1 message a second were printed' );
+$cmd = Test::Command->new( cmd => "log -v -s 2 < /dev/null" );
+$cmd->exit_is_num(64, 'sampling is given as 1/N');
+
+# 67-68: verbose output has every header, however many and long
+my $COOKIES = "/tmp/mumpsimus-log.cookies.$$";
+open(my $fh, '>', $COOKIES) or die "$COOKIES: $!\n";
+print $fh "GET / HTTP/1.1\r\nHost: www.example.com\r\n",
+    (map { "Cookie: c$_=" . ('x' x 100) . "\r\n" } (1 .. 500)), "\r\n";
+close($fh);
+$cmd = Test::Command->new( cmd => "log -v < $COOKIES" );
+my $cookies = () = $cmd->stderr_value =~ /^\tCookie: c\d+=x{100}\r$/mg;
+is( $cookies, 500, 'all 500 cookies were printed' );
+$cmd->stderr_like(qr/\tCookie: c500=x{100}\r\n.*\[end headers\]\n\z/s, 'last cookie ends the headers');
+unlink($COOKIES);
+
+
+# 69-70: only a 101 (or 2xx to CONNECT) switches protocols: a 200 that
+# advertises an upgrade, or an upgrade request with no answer in a
+# stream of requests, leaves the rest of the stream HTTP
+my $ADVERTISE = "/tmp/mumpsimus-log.advertise.$$";
+open($fh, '>', $ADVERTISE) or die "$ADVERTISE: $!\n";
+print $fh "HTTP/1.1 200 OK\r\nUpgrade: h2,h2c\r\nConnection: Upgrade\r\nContent-Length: 5\r\n\r\nhello";
+close($fh);
+$cmd = Test::Command->new( cmd => "( cat $HEAD_TEST_FILE $ADVERTISE; sleep 1; cat $HEAD_TEST_FILE $BODY_TEST_FILE ) | log" );
+@stderr_lines = split /\n/, $cmd->stderr_value;
+is( $#stderr_lines+1, 4, 'responses after an advertised upgrade are logged' );
+my $WS_REQUEST = qx{ find @SEARCH_DIR -name sample-request-websocket.txt 2>/dev/null };   chomp($WS_REQUEST);
+$cmd = Test::Command->new( cmd => "cat $WS_REQUEST $HEAD_TEST_FILE | log" );
+@stderr_lines = split /\n/, $cmd->stderr_value;
+is( $#stderr_lines+1, 2, 'requests after an unanswered upgrade request are logged' );
+unlink($ADVERTISE);
@@ -5,7 +5,7 @@ use strict;
 
 use lib './lib', './system-tests/lib';
 
-use Test::More tests => 7;
+use Test::More tests => 11;
 use Test::Command;
 
 BEGIN {
@@ -36,3 +36,26 @@ my $cmd = Test::Command->new( cmd => qq{ cat $TEST_FILE | dup } );
 $cmd->exit_is_num(0, 'dup command exited normally');
 $cmd->stdout_is_eq($expected, 'dup did not modify stdout');
 $cmd->stderr_is_eq($expected, 'dup copied to stderr');
+
+# 8-11: while it runs, noop's counters can be seen with mumpstat,
+# and they go when it exits. noop runs until its input is closed,
+# which is once mumpstat has found it.
+my $NOOP_OUT = "/tmp/mumpsimus-noop.$$";
+open(my $noop, '|-', "noop > $NOOP_OUT")
+    or die "Cannot run noop: $!\n";
+select((select($noop), $| = 1)[0]);
+print $noop `cat $TEST_FILE`;
+my $running = 0;
+for ( my $i = 0; $i < 100 && !$running; $i++ ) {
+    $running = grep { /\.(\d+)\.noop$/ && kill(0, $1) } glob('/dev/shm/mumpsimus.*.noop');
+    select(undef, undef, undef, 0.1) unless $running;
+}
+$cmd = Test::Command->new( cmd => 'mumpstat -n 1' );
+$cmd->exit_is_num(0, 'mumpstat exited normally');
+$cmd->stdout_like(qr/^PID\s+TOOL\s+IN MB\/s\s+OUT MB\/s\s+MSG\/s\s+ERRORS\s+SPAWNS\s+IN-WAIT\s+OUT-WAIT\n.*^\d+\s+noop\s+\d+\.\d\d\s+\d+\.\d\d\s+0\.0\s+0\s+0\s+/ms,
+		  'noop was shown');
+close($noop);
+is( `cat $NOOP_OUT`, `cat $TEST_FILE`, 'noop output was not affected' );
+unlink($NOOP_OUT);
+my @left = glob('/dev/shm/mumpsimus.*.noop');
+is( scalar(grep { /\.(\d+)\.noop$/ && !kill(0, $1) } @left), 0, 'noop counters were removed at exit' );
@@ -0,0 +1,159 @@
+#include <check.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/access_log.h"
+
+static void
+fill_record(struct Access_Record *rec, const char *url, const char *error)
+{
+  memset(rec, 0, sizeof(*rec));
+  rec->type = HTTP_REQUEST;
+  rec->method = HTTP_POST;
+  rec->http_major = 1;
+  rec->http_minor = 1;
+  rec->begin_ns = 1700000000123456789ULL;
+  rec->end_ns = 1700000000123999999ULL;
+  rec->header_bytes = 380;
+  rec->body_bytes = 18446744073709551615ULL;
+  rec->url = url;
+  rec->url_len = strlen(url);
+  rec->error = error;
+  rec->error_len = (NULL == error ? 0 : strlen(error));
+}
+
+START_TEST(test_access_log_json)
+{
+  char buf[ACCESS_LOG_JSON_MAX];
+  struct Access_Record rec;
+
+  fill_record(&rec, "/a\"b\\c\x01\xe9", NULL);
+  buf[access_log_json(buf, &rec)] = '\0';
+  const char *expected = "{\"type\":\"req\",\"method\":\"POST\","
+    "\"url\":\"/a\\\"b\\\\c\\u0001\\u00e9\",\"version\":\"1.1\","
+    "\"header_bytes\":380,\"body_bytes\":18446744073709551615,"
+    "\"begin_ns\":1700000000123456789,\"end_ns\":1700000000123999999}\n";
+  fail_unless(strcmp(buf, expected) == 0, "got %s", buf);
+
+  // Responses have a status instead of a method; HTTP/2 a stream
+  rec.type = HTTP_RESPONSE;
+  rec.status_code = 204;
+  rec.http_major = 2;
+  rec.http_minor = 0;
+  rec.stream = 7;
+  rec.body_bytes = 0;
+  rec.url_len = 2;
+  rec.error = "HPE_INVALID_STATUS";
+  rec.error_len = strlen(rec.error);
+  buf[access_log_json(buf, &rec)] = '\0';
+  expected = "{\"type\":\"res\",\"status\":204,\"url\":\"/a\","
+    "\"version\":\"2.0\",\"stream\":7,\"header_bytes\":380,\"body_bytes\":0,"
+    "\"begin_ns\":1700000000123456789,\"end_ns\":1700000000123999999,"
+    "\"error\":\"HPE_INVALID_STATUS\"}\n";
+  fail_unless(strcmp(buf, expected) == 0, "got %s", buf);
+
+  // The longest URL fits
+  char *url = malloc(ACCESS_LOG_URL_MAX + 10);
+  memset(url, '"', ACCESS_LOG_URL_MAX + 10);
+  rec.url = url;
+  rec.url_len = ACCESS_LOG_URL_MAX + 10;
+  fail_unless(access_log_json(buf, &rec) < ACCESS_LOG_JSON_MAX);
+  free(url);
+}
+END_TEST
+
+START_TEST(test_access_log_binary)
+{
+  char buf[ACCESS_LOG_BIN_MAX * 2];
+  struct Access_Record rec, out;
+
+  fill_record(&rec, "/index.html", "bad");
+  size_t size = access_log_encode(buf, &rec);
+  fail_unless(size == ACCESS_LOG_FIXED + 11 + 3);
+  size_t total = size + access_log_encode(buf + size, &rec);
+
+  // A record is only decoded once all of it is there
+  for (size_t n = 0; n < size; n++)
+    fail_unless(access_log_decode(buf, n, &out) == 0, "length %zd", n);
+  fail_unless(access_log_decode(buf, total, &out) == size);
+
+  char json[ACCESS_LOG_JSON_MAX], expected[ACCESS_LOG_JSON_MAX];
+  json[access_log_json(json, &out)] = '\0';
+  expected[access_log_json(expected, &rec)] = '\0';
+  fail_unless(strcmp(json, expected) == 0, "got %s", json);
+
+  // Sizes that do not add up are malformed
+  buf[0] = ACCESS_LOG_FIXED - 1;
+  buf[1] = 0;
+  fail_unless(access_log_decode(buf, total, &out) == -1);
+  buf[0] = size + 1;
+  fail_unless(access_log_decode(buf, total, &out) == -1);
+}
+END_TEST
+
+START_TEST(test_access_log_file)
+{
+  char path[] = "/tmp/check_access_log.XXXXXX";
+  int fd = mkstemp(path);
+  fail_unless(fd >= 0);
+  close(fd);
+
+  // The magic number is written once, then records are appended
+  struct Access_Record rec;
+  fill_record(&rec, "/", NULL);
+  for (int i = 0; i < 2; i++)
+    {
+      struct Access_Log *log = access_log_open(path, ACCESS_LOG_BIN);
+      fail_unless(log != NULL);
+      for (int n = 0; n < 1000; n++)
+	fail_unless(access_log_write(log, &rec) == 0);
+      fail_unless(access_log_close(log) == 0);
+    }
+
+  FILE *f = fopen(path, "r");
+  char magic[ACCESS_LOG_MAGIC_LEN];
+  fail_unless(fread(magic, 1, ACCESS_LOG_MAGIC_LEN, f)
+	      == ACCESS_LOG_MAGIC_LEN);
+  fail_unless(memcmp(magic, ACCESS_LOG_MAGIC, ACCESS_LOG_MAGIC_LEN) == 0);
+  fseek(f, 0, SEEK_END);
+  fail_unless(ftell(f) == ACCESS_LOG_MAGIC_LEN
+	      + 2000 * (ACCESS_LOG_FIXED + 1));
+  fclose(f);
+  unlink(path);
+
+  fail_unless(access_log_format_lookup("json") == ACCESS_LOG_JSON);
+  fail_unless(access_log_format_lookup("bin") == ACCESS_LOG_BIN);
+  fail_unless(access_log_format_lookup("xml") == -1);
+  fail_unless(access_log_open("/nonexistent/log", ACCESS_LOG_JSON) == NULL);
+}
+END_TEST
+
+
+Suite *access_log_suite(void)
+{
+  Suite *s = suite_create("Access_Log");
+
+  // Core test case
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_test(tc_core, test_access_log_json);
+  tcase_add_test(tc_core, test_access_log_binary);
+  tcase_add_test(tc_core, test_access_log_file);
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
+
+
+int main(int argc, char *argv[])
+{
+  int number_failed = 0;
+  Suite   *s  = access_log_suite();
+  SRunner *sr = srunner_create(s);
+  srunner_run_all(sr, CK_NORMAL);
+  number_failed = srunner_ntests_failed(sr);
+  srunner_free(sr);
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
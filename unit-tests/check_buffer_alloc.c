@@ -0,0 +1,96 @@
+#include <check.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ulog.h"
+#include "util.h"
+
+#include "../src/buffer_alloc.h"
+
+#define HUGEPAGE_SIZE (2 * 1024 * 1024)
+
+/* Allocate, fill, grow and check contents survived */
+static void
+do_test_grow(size_t first, size_t second)
+{
+  char *buf = buffer_alloc(first);
+  fail_if(buf == NULL);
+  memset(buf, 'm', first);
+
+  buf = buffer_realloc(buf, second);
+  fail_if(buf == NULL);
+  for (size_t i = 0; i < first; i++)
+    fail_unless(buf[i] == 'm');
+  memset(buf, 'n', second);
+  buffer_free(buf);
+}
+
+START_TEST(test_malloc_backend)
+{
+  buffer_alloc_set(BUFFER_ALLOC_MALLOC, BUFFER_MAX, -1);
+  fail_unless(strcmp(buffer_alloc_describe(), "malloc") == 0);
+  do_test_grow(BUFFER_MAX, BUFFER_MAX * 4);
+  do_test_grow(10, 20);
+  buffer_free(NULL);
+}
+END_TEST
+
+START_TEST(test_hugepage_backend)
+{
+  buffer_alloc_set(BUFFER_ALLOC_HUGEPAGE, BUFFER_MAX, -1);
+  fail_unless(strncmp(buffer_alloc_describe(), "hugepage", 8) == 0);
+
+  // Mapped buffers start just past a cache line sized header
+  char *buf = buffer_alloc(BUFFER_MAX);
+  fail_if(buf == NULL);
+  fail_unless(((uintptr_t) buf % 64) == 0);
+  buffer_free(buf);
+
+  // Small buffers come from malloc, large ones are mapped
+  do_test_grow(10, 20);
+  do_test_grow(10, BUFFER_MAX * 2);
+  do_test_grow(BUFFER_MAX, HUGEPAGE_SIZE * 2);
+  do_test_grow(HUGEPAGE_SIZE * 2, 100);
+}
+END_TEST
+
+START_TEST(test_environment)
+{
+  setenv("MUMPSIMUS_ALLOC", "hugepage", 1);
+  setenv("MUMPSIMUS_ALLOC_THRESHOLD", "4096", 1);
+  setenv("MUMPSIMUS_ALLOC_NODE", "0", 1);
+  buffer_alloc_init();
+  fail_unless(strcmp(buffer_alloc_describe(),
+		     "hugepage >= 4096 bytes on node 0") == 0);
+}
+END_TEST
+
+
+Suite *buffer_alloc_suite(void)
+{
+  Suite *s = suite_create("Buffer_Alloc");
+
+  // Core test case 
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_test(tc_core, test_environment);
+  tcase_add_test(tc_core, test_malloc_backend);
+  tcase_add_test(tc_core, test_hugepage_backend);
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
+
+
+int main(int argc, char *argv[]) 
+{
+  int number_failed = 0;
+  Suite   *s  = buffer_alloc_suite();
+  SRunner *sr = srunner_create(s);
+  srunner_run_all(sr, CK_NORMAL);
+  number_failed = srunner_ntests_failed(sr);
+  srunner_free(sr);
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
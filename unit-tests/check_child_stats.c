@@ -0,0 +1,128 @@
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/child_stats.h"
+
+static struct rusage
+usage_of(long user_ms, long sys_ms, long maxrss_kb)
+{
+  struct rusage ru;
+  memset(&ru, 0, sizeof(ru));
+  ru.ru_utime.tv_sec = user_ms / 1000;
+  ru.ru_utime.tv_usec = (user_ms % 1000) * 1000;
+  ru.ru_stime.tv_sec = sys_ms / 1000;
+  ru.ru_stime.tv_usec = (sys_ms % 1000) * 1000;
+  ru.ru_maxrss = maxrss_kb;
+  return ru;
+}
+
+START_TEST(test_child_stats_record)
+{
+  struct Child_Stats *cs = child_stats_new();
+  fail_unless(cs != NULL);
+
+  struct rusage ru = usage_of(1500, 20, 800);
+  child_stats_record(cs, "gzip", "text/html; charset=utf-8", &ru, 2000000);
+  ru = usage_of(500, 10, 1200);
+  child_stats_record(cs, "gzip", "TEXT/HTML", &ru, 1000000);
+  child_stats_record(cs, "gzip", NULL, &ru, 1000000);
+  child_stats_record(cs, "gzip", "", &ru, 1000000);
+
+  // Parameters and case are ignored; no type at all is "-"
+  fail_unless(cs->count == 2);
+  fail_unless(strcmp(cs->usage[0].type, "text/html") == 0);
+  fail_unless(cs->usage[0].children == 2);
+  fail_unless(cs->usage[0].user_us == 2000000);
+  fail_unless(cs->usage[0].sys_us == 30000);
+  fail_unless(cs->usage[0].wall_ns == 3000000);
+  fail_unless(cs->usage[0].maxrss_kb == 1200);
+  fail_unless(strcmp(cs->usage[1].type, "-") == 0);
+  fail_unless(cs->usage[1].children == 2);
+
+  child_stats_delete(cs);
+}
+END_TEST
+
+START_TEST(test_child_stats_full)
+{
+  struct Child_Stats *cs = child_stats_new();
+  struct rusage ru = usage_of(1, 1, 1);
+  char type[32];
+  for (int n = 0; n < CHILD_STATS_MAX + 10; n++)
+    {
+      snprintf(type, sizeof(type), "type/%d", n);
+      child_stats_record(cs, "cat", type, &ru, 1);
+    }
+
+  // The last entry has all the types there was no room for
+  fail_unless(cs->count == CHILD_STATS_MAX);
+  fail_unless(strcmp(cs->usage[CHILD_STATS_MAX - 2].type, "type/30") == 0);
+  fail_unless(strcmp(cs->usage[CHILD_STATS_MAX - 1].type, "*") == 0);
+  fail_unless(cs->usage[CHILD_STATS_MAX - 1].children == 11);
+
+  // ...but types seen before are still counted apart
+  child_stats_record(cs, "cat", "type/0", &ru, 1);
+  fail_unless(cs->usage[0].children == 2);
+
+  child_stats_delete(cs);
+}
+END_TEST
+
+START_TEST(test_child_stats_dump)
+{
+  struct Child_Stats *cs = child_stats_new();
+  struct rusage ru = usage_of(10, 0, 100);
+  child_stats_record(cs, "tr a-z A-Z", "text/plain", &ru, 5000000);
+  ru = usage_of(200, 50, 300);
+  child_stats_record(cs, "tr a-z A-Z", "text/html", &ru, 7000000);
+  ru = usage_of(1, 0, 50);
+  child_stats_record(cs, "cat", NULL, &ru, 1000000);
+
+  char *text = NULL;
+  size_t size = 0;
+  FILE *out = open_memstream(&text, &size);
+  child_stats_dump(cs, out, "test:");
+  fclose(out);
+
+  // Most CPU first, then a line for each command
+  const char *expected =
+    "test: \"tr a-z A-Z\" text/html children=1 user_ms=200.000 sys_ms=50.000 wall_ms=7.000 maxrss_kb=300\n"
+    "test: \"tr a-z A-Z\" text/plain children=1 user_ms=10.000 sys_ms=0.000 wall_ms=5.000 maxrss_kb=100\n"
+    "test: \"cat\" - children=1 user_ms=1.000 sys_ms=0.000 wall_ms=1.000 maxrss_kb=50\n"
+    "test: \"tr a-z A-Z\" all children=2 user_ms=210.000 sys_ms=50.000 wall_ms=12.000 maxrss_kb=300\n"
+    "test: \"cat\" all children=1 user_ms=1.000 sys_ms=0.000 wall_ms=1.000 maxrss_kb=50\n";
+  fail_unless(strcmp(text, expected) == 0, "got:\n%s", text);
+
+  free(text);
+  child_stats_delete(cs);
+}
+END_TEST
+
+
+Suite *child_stats_suite(void)
+{
+  Suite *s = suite_create("Child_Stats");
+
+  // Core test case
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_test(tc_core, test_child_stats_record);
+  tcase_add_test(tc_core, test_child_stats_full);
+  tcase_add_test(tc_core, test_child_stats_dump);
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
+
+
+int main(int argc, char *argv[])
+{
+  int number_failed = 0;
+  Suite   *s  = child_stats_suite();
+  SRunner *sr = srunner_create(s);
+  srunner_run_all(sr, CK_NORMAL);
+  number_failed = srunner_ntests_failed(sr);
+  srunner_free(sr);
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,121 @@
+#include <check.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ulog.h"
+#include "util.h"
+
+#include "../src/chunked.h"
+
+/* Read everything written to the pipe so far */
+static size_t
+read_pipe(int fds[2], char *output, size_t size)
+{
+  close(fds[1]);
+  memset(output, 0, size);
+  size_t total = 0;
+  ssize_t bytes = 0;
+  while ((bytes = read(fds[0], output + total, size - total)) > 0)
+    total += bytes;
+  close(fds[0]);
+  return total;
+}
+
+START_TEST(test_chunked_header)
+{
+  char buf[CHUNK_HEADER_MAX];
+  char expected[CHUNK_HEADER_MAX + 1];
+  size_t lengths[] = { 1, 9, 10, 15, 16, 255, 256, 4096, 0x12345,
+    SIZE_MAX
+  };
+
+  for (int i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++)
+    {
+      int n = snprintf(expected, sizeof(expected), "%zx\r\n", lengths[i]);
+      fail_unless(chunked_header(buf, lengths[i]) == n);
+      fail_unless(memcmp(buf, expected, n) == 0, "length %zx", lengths[i]);
+    }
+}
+END_TEST
+
+START_TEST(test_chunked_write)
+{
+  int fds[2];
+  char output[BUFFER_MAX];
+
+  fail_unless(pipe(fds) == 0);
+  fail_unless(chunked_write(fds[1], "hello", 5) == 10);
+  fail_unless(chunked_write(fds[1], "", 0) == 0);
+  fail_unless(chunked_write_end(fds[1]) == 5);
+
+  const char *expected = "5\r\nhello\r\n0\r\n\r\n";
+  fail_unless(read_pipe(fds, output, BUFFER_MAX) == strlen(expected));
+  fail_unless(strcmp(output, expected) == 0, "got %s", output);
+}
+END_TEST
+
+START_TEST(test_chunk_writer)
+{
+  int fds[2];
+  char output[BUFFER_MAX];
+  struct Chunk_Writer *cw = chunk_writer_new(16);
+  fail_if(cw == NULL);
+
+  // Tiny pieces are gathered into chunks as big as the buffer
+  fail_unless(pipe(fds) == 0);
+  chunk_writer_start(cw, fds[1], true);
+  for (int i = 0; i < 10; i++)
+    chunk_writer_add(cw, "abc", 3);
+  chunk_writer_end(cw);
+
+  const char *expected = "f\r\nabcabcabcabcabc\r\n"
+    "f\r\nabcabcabcabcabc\r\n" "0\r\n\r\n";
+  fail_unless(read_pipe(fds, output, BUFFER_MAX) == strlen(expected));
+  fail_unless(strcmp(output, expected) == 0, "got %s", output);
+
+  // Big pieces go straight out, and unchunked output is unchanged
+  fail_unless(pipe(fds) == 0);
+  chunk_writer_start(cw, fds[1], false);
+  chunk_writer_add(cw, "ab", 2);
+  chunk_writer_add(cw, "0123456789abcdefghij", 20);
+  chunk_writer_add(cw, "cd", 2);
+  fail_if(cw->chunked);
+  chunk_writer_end(cw);
+
+  expected = "ab0123456789abcdefghijcd";
+  fail_unless(read_pipe(fds, output, BUFFER_MAX) == strlen(expected));
+  fail_unless(strcmp(output, expected) == 0, "got %s", output);
+
+  chunk_writer_delete(cw);
+}
+END_TEST
+
+
+Suite *chunked_suite(void)
+{
+  Suite *s = suite_create("Chunked");
+
+  // Core test case
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_test(tc_core, test_chunked_header);
+  tcase_add_test(tc_core, test_chunked_write);
+  tcase_add_test(tc_core, test_chunk_writer);
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
+
+
+int main(int argc, char *argv[])
+{
+  int number_failed = 0;
+  Suite   *s  = chunked_suite();
+  SRunner *sr = srunner_create(s);
+  srunner_run_all(sr, CK_NORMAL);
+  number_failed = srunner_ntests_failed(sr);
+  srunner_free(sr);
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
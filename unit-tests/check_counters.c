@@ -0,0 +1,97 @@
+#include <check.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/counters.h"
+
+START_TEST(test_counters_layout)
+{
+  // Every counter has a cache line to itself, after the head's
+  fail_unless(sizeof(union Counter) == COUNTERS_LINE);
+  fail_unless((char *) &counters->counter[0] - (char *) counters
+	      == COUNTERS_LINE);
+  fail_unless(strcmp(counter_name(COUNTER_BYTES_IN), "bytes_in") == 0);
+  fail_unless(strcmp(counter_name(COUNTER_WRITE_WAIT_NS),
+		     "write_wait_ns") == 0);
+}
+END_TEST
+
+START_TEST(test_counters_publish)
+{
+  char name[NAME_MAX], path[PATH_MAX];
+  snprintf(name, sizeof(name), COUNTERS_PREFIX "%d.check_counters",
+	   (int) getpid());
+  snprintf(path, sizeof(path), COUNTERS_DIR "/%s", name);
+
+  // Counted before the segment is made, and carried over into it
+  counter_add(COUNTER_MESSAGES, 3);
+  counters_open("/some/where/check_counters");
+  fail_unless(access(path, F_OK) == 0, "no %s", path);
+  counter_add(COUNTER_MESSAGES, 2);
+  counter_add(COUNTER_BYTES_IN, 1000);
+
+  const struct Counters_Segment *seg = counters_attach(name);
+  fail_unless(seg != NULL);
+  fail_unless(seg->pid == getpid());
+  fail_unless(strcmp(seg->tool, "check_counters") == 0);
+  fail_unless(counter_get(seg, COUNTER_MESSAGES) == 5);
+  fail_unless(counter_get(seg, COUNTER_BYTES_IN) == 1000);
+
+  // The reader sees counting as it happens
+  counter_add(COUNTER_BYTES_IN, 24);
+  fail_unless(counter_get(seg, COUNTER_BYTES_IN) == 1024);
+  counters_detach(seg);
+
+  // Closing removes the segment, but counting goes on
+  counters_close();
+  fail_unless(access(path, F_OK) != 0);
+  fail_unless(counters_attach(name) == NULL);
+  counter_add(COUNTER_MESSAGES, 1);
+  fail_unless(counter_get(counters, COUNTER_MESSAGES) == 6);
+}
+END_TEST
+
+START_TEST(test_counters_attach_other)
+{
+  // Only whole segments of this version are read
+  fail_unless(counters_attach("mumpsimus.0.nothing") == NULL);
+
+  setenv("MUMPSIMUS_COUNTERS", "0", 1);
+  counters_open("check_counters");
+  unsetenv("MUMPSIMUS_COUNTERS");
+  char name[NAME_MAX];
+  snprintf(name, sizeof(name), COUNTERS_PREFIX "%d.check_counters",
+	   (int) getpid());
+  fail_unless(counters_attach(name) == NULL);
+}
+END_TEST
+
+
+Suite *counters_suite(void)
+{
+  Suite *s = suite_create("Counters");
+
+  // Core test case
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_test(tc_core, test_counters_layout);
+  tcase_add_test(tc_core, test_counters_publish);
+  tcase_add_test(tc_core, test_counters_attach_other);
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
+
+
+int main(int argc, char *argv[])
+{
+  int number_failed = 0;
+  Suite   *s  = counters_suite();
+  SRunner *sr = srunner_create(s);
+  srunner_run_all(sr, CK_NORMAL);
+  number_failed = srunner_ntests_failed(sr);
+  srunner_free(sr);
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,302 @@
+#include <check.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/h2_parser.h"
+
+#define H2_TEST_MAX 4096
+
+/* What the callbacks saw, as text */
+struct Events
+{
+  char text[H2_TEST_MAX];
+};
+
+static void
+event(http_parser * parser, const char *format, const char *at,
+      size_t length)
+{
+  struct Events *e = parser->data;
+  size_t n = strlen(e->text);
+  snprintf(e->text + n, H2_TEST_MAX - n, format, (int) length, at);
+}
+
+static int
+cb_begin(http_parser * parser)
+{
+  char id[16];
+  snprintf(id, sizeof(id), "%u", h2_stream_id(parser));
+  event(parser, "begin %.*s;", id, strlen(id));
+  return 0;
+}
+
+static int
+cb_url(http_parser * parser, const char *at, size_t length)
+{
+  event(parser, "url %.*s;", at, length);
+  return 0;
+}
+
+static int
+cb_field(http_parser * parser, const char *at, size_t length)
+{
+  event(parser, "%.*s", at, length);
+  return 0;
+}
+
+static int
+cb_value(http_parser * parser, const char *at, size_t length)
+{
+  event(parser, "=%.*s;", at, length);
+  return 0;
+}
+
+static int
+cb_headers_complete(http_parser * parser)
+{
+  char line[64];
+  if (HTTP_REQUEST == parser->type)
+    snprintf(line, sizeof(line), "%s", http_method_str(parser->method));
+  else
+    snprintf(line, sizeof(line), "%d", parser->status_code);
+  event(parser, "headers %.*s;", line, strlen(line));
+  return 0;
+}
+
+static int
+cb_body(http_parser * parser, const char *at, size_t length)
+{
+  event(parser, "%.*s", at, length);
+  return 0;
+}
+
+static int
+cb_complete(http_parser * parser)
+{
+  event(parser, ";complete%.*s;", "", 0);
+  return 0;
+}
+
+/* Appends a frame with "length" bytes of payload */
+static size_t
+frame(char *buf, enum h2_frame_type type, uint8_t flags, uint32_t id,
+      const char *payload, size_t length)
+{
+  unsigned char *h = (unsigned char *) buf;
+  h[0] = length >> 16;
+  h[1] = (length >> 8) & 0xff;
+  h[2] = length & 0xff;
+  h[3] = type;
+  h[4] = flags;
+  h[5] = id >> 24;
+  h[6] = (id >> 16) & 0xff;
+  h[7] = (id >> 8) & 0xff;
+  h[8] = id & 0xff;
+  memcpy(buf + H2_FRAME_HEADER_LEN, payload, length);
+  return H2_FRAME_HEADER_LEN + length;
+}
+
+/* A client's side: two requests, the second in HEADERS and
+ * CONTINUATION frames, padded, with a body */
+static size_t
+client_stream(char *buf)
+{
+  size_t n = H2_PREFACE_LEN;
+  memcpy(buf, H2_PREFACE, n);
+  n += frame(buf + n, H2_SETTINGS, 0, 0, "", 0);
+  n += frame(buf + n, H2_HEADERS, H2_FLAG_END_HEADERS | H2_FLAG_END_STREAM,
+	     1, "\x82\x86\x41\x0b" "example.com" "\x84", 16);
+  n += frame(buf + n, H2_HEADERS, H2_FLAG_PADDED, 3,
+	     "\x02\x83\x44\x03" "/up" "\x00\x00", 9);
+  n += frame(buf + n, H2_CONTINUATION, H2_FLAG_END_HEADERS, 3,
+	     "\x5c\x01" "5", 3);
+  n += frame(buf + n, H2_WINDOW_UPDATE, 0, 0, "\x00\x00\x10\x00", 4);
+  n += frame(buf + n, H2_DATA, H2_FLAG_PADDED | H2_FLAG_END_STREAM, 3,
+	     "\x01" "hello" "\x00", 7);
+  return n;
+}
+
+/* A server's side: an interim response, then one with trailers */
+static size_t
+server_stream(char *buf)
+{
+  size_t n = frame(buf, H2_SETTINGS, 0, 0, "\x00\x03\x00\x00\x00\x64", 6);
+  n += frame(buf + n, H2_HEADERS, H2_FLAG_END_HEADERS, 1,
+	     "\x08\x03" "103", 5);
+  n += frame(buf + n, H2_HEADERS, H2_FLAG_END_HEADERS, 1,
+	     "\x88\x00\x04" "etag\x03" "\"x\"", 11);
+  n += frame(buf + n, H2_RST_STREAM, 0, 5, "\x00\x00\x00\x08", 4);
+  n += frame(buf + n, H2_DATA, 0, 1, "ok", 2);
+  n += frame(buf + n, H2_HEADERS, H2_FLAG_END_HEADERS | H2_FLAG_END_STREAM,
+	     1, "\x00\x0b" "grpc-status" "\x01" "0", 15);
+  return n;
+}
+
+/* Parse "len" bytes of "stream" in two pieces, split at "split" */
+static void
+parse_split(struct Events *e, enum http_parser_type type,
+	    const char *stream, size_t len, size_t split)
+{
+  http_parser_settings settings;
+  http_parser_settings_init(&settings);
+  settings.on_message_begin = cb_begin;
+  settings.on_url = cb_url;
+  settings.on_header_field = cb_field;
+  settings.on_header_value = cb_value;
+  settings.on_headers_complete = cb_headers_complete;
+  settings.on_body = cb_body;
+  settings.on_message_complete = cb_complete;
+
+  h2_parser h2;
+  memset(e, 0, sizeof(*e));
+  h2.data = e;
+  fail_unless(h2_parser_init(&h2, type) == 0);
+
+  fail_unless(h2_parser_execute(&h2, &settings, stream, split) == split);
+  fail_unless(h2_parser_execute(&h2, &settings, stream + split, len - split)
+	      == len - split);
+  fail_unless(h2.h2_errno == H2_OK, "split %zd: %s", split,
+	      h2_errno_str(h2.h2_errno));
+  h2_parser_free(&h2);
+}
+
+START_TEST(test_h2_parser_requests)
+{
+  char stream[H2_TEST_MAX];
+  size_t len = client_stream(stream);
+  struct Events *e = malloc(sizeof(struct Events));
+  const char *expected = "begin 1;url /;:scheme=http;:authority=example.com;"
+    "headers GET;;complete;"
+    "begin 3;url /up;content-length=5;headers POST;hello;complete;";
+
+  fail_unless(h2_detect(stream, len) == HTTP_REQUEST);
+  for (size_t split = 0; split <= len; split++)
+    {
+      parse_split(e, HTTP_BOTH, stream, len, split);
+      fail_unless(strcmp(e->text, expected) == 0, "split %zd: %s", split,
+		  e->text);
+    }
+  free(e);
+}
+END_TEST
+
+START_TEST(test_h2_parser_responses)
+{
+  char stream[H2_TEST_MAX];
+  size_t len = server_stream(stream);
+  struct Events *e = malloc(sizeof(struct Events));
+  const char *expected = "begin 1;headers 103;;complete;"
+    "begin 1;etag=\"x\";headers 200;okgrpc-status=0;;complete;";
+
+  fail_unless(h2_detect(stream, len) == HTTP_RESPONSE);
+  for (size_t split = 0; split <= len; split++)
+    {
+      parse_split(e, HTTP_BOTH, stream, len, split);
+      fail_unless(strcmp(e->text, expected) == 0, "split %zd: %s", split,
+		  e->text);
+    }
+  free(e);
+}
+END_TEST
+
+static int
+cb_count(http_parser * parser)
+{
+  (*(int *) parser->data)++;
+  return 0;
+}
+
+START_TEST(test_h2_parser_stale_stream)
+{
+  http_parser_settings settings;
+  http_parser_settings_init(&settings);
+  settings.on_message_complete = cb_count;
+  h2_parser h2;
+  int completed = 0;
+  h2.data = &completed;
+  char stream[H2_TEST_MAX];
+
+  // Stream 1 never ends (its reset went the other way), then as many
+  // again as there are slots end, the last taking its slot
+  size_t len = frame(stream, H2_HEADERS, H2_FLAG_END_HEADERS, 1, "\x88", 1);
+  for (uint32_t id = 3; id <= 2 * H2_STREAMS_MAX + 1; id += 2)
+    len += frame(stream + len, H2_HEADERS,
+		 H2_FLAG_END_HEADERS | H2_FLAG_END_STREAM, id, "\x88", 1);
+  fail_unless(h2_parser_init(&h2, HTTP_RESPONSE) == 0);
+  fail_unless(h2_parser_execute(&h2, &settings, stream, len) == len);
+  fail_unless(h2.h2_errno == H2_OK, "%s", h2_errno_str(h2.h2_errno));
+  fail_unless(completed == H2_STREAMS_MAX, "%d completed", completed);
+  h2_parser_free(&h2);
+}
+END_TEST
+
+START_TEST(test_h2_parser_errors)
+{
+  http_parser_settings settings;
+  http_parser_settings_init(&settings);
+  h2_parser h2;
+  char stream[H2_TEST_MAX];
+
+  // HTTP/1.x is not HTTP/2
+  const char *http1 = "GET / HTTP/1.1\r\n\r\n";
+  fail_unless(h2_detect(http1, strlen(http1)) == -1);
+  fail_unless(h2_parser_init(&h2, HTTP_REQUEST) == 0);
+  h2_parser_execute(&h2, &settings, http1, strlen(http1));
+  fail_unless(h2.h2_errno == H2_ERR_PREFACE);
+  h2_parser_free(&h2);
+
+  // Another frame inside a header block
+  size_t len = frame(stream, H2_HEADERS, 0, 1, "\x88", 1);
+  len += frame(stream + len, H2_DATA, 0, 1, "x", 1);
+  fail_unless(h2_parser_init(&h2, HTTP_RESPONSE) == 0);
+  h2_parser_execute(&h2, &settings, stream, len);
+  fail_unless(h2.h2_errno == H2_ERR_CONTINUATION);
+
+  // A failed parser stays failed
+  fail_unless(h2_parser_execute(&h2, &settings, stream, len) == 0);
+  h2_parser_free(&h2);
+
+  // Padding longer than the frame, and a bad header block
+  len = frame(stream, H2_DATA, H2_FLAG_PADDED, 1, "\x09" "x", 2);
+  fail_unless(h2_parser_init(&h2, HTTP_RESPONSE) == 0);
+  h2_parser_execute(&h2, &settings, stream, len);
+  fail_unless(h2.h2_errno == H2_ERR_FRAME);
+  h2_parser_free(&h2);
+
+  len = frame(stream, H2_HEADERS, H2_FLAG_END_HEADERS, 1, "\x80", 1);
+  fail_unless(h2_parser_init(&h2, HTTP_RESPONSE) == 0);
+  h2_parser_execute(&h2, &settings, stream, len);
+  fail_unless(h2.h2_errno == H2_ERR_HPACK);
+  h2_parser_free(&h2);
+}
+END_TEST
+
+
+Suite *h2_parser_suite(void)
+{
+  Suite *s = suite_create("H2_Parser");
+
+  // Core test case
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_test(tc_core, test_h2_parser_requests);
+  tcase_add_test(tc_core, test_h2_parser_responses);
+  tcase_add_test(tc_core, test_h2_parser_stale_stream);
+  tcase_add_test(tc_core, test_h2_parser_errors);
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
+
+
+int main(int argc, char *argv[])
+{
+  int number_failed = 0;
+  Suite   *s  = h2_parser_suite();
+  SRunner *sr = srunner_create(s);
+  srunner_run_all(sr, CK_NORMAL);
+  number_failed = srunner_ntests_failed(sr);
+  srunner_free(sr);
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,156 @@
+#include <check.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ulog.h"
+#include "util.h"
+
+#include "../src/header_buffer.h"
+
+#define TEST_HEADERS "GET /index.html HTTP/1.1\r\nHost: example.com\r\nAccept: */*\r\n\r\n"
+
+START_TEST(test_header_buffer_create)
+{
+  char read_buffer[BUFFER_MAX];
+  struct Header_Buffer *hb = header_buffer_new(read_buffer, BUFFER_MAX);
+  fail_if(hb == NULL);
+  fail_unless(header_buffer_count(hb) == 0);
+
+  size_t length = 99;
+  fail_unless(header_buffer_url(hb, &length) == NULL);
+  fail_unless(length == 0);
+  header_buffer_delete(hb);
+}
+END_TEST
+
+START_TEST(test_header_buffer_slices)
+{
+  char read_buffer[BUFFER_MAX];
+  strcpy(read_buffer, TEST_HEADERS);
+  struct Header_Buffer *hb = header_buffer_new(read_buffer, BUFFER_MAX);
+
+  // Tokens in the read buffer are not copied
+  fail_unless(header_buffer_add(hb, HB_URL, read_buffer + 4, 11) == 0);
+  fail_unless(header_buffer_add(hb, HB_FIELD, read_buffer + 26, 4) == 0);
+  fail_unless(header_buffer_add(hb, HB_VALUE, read_buffer + 32, 11) == 0);
+  fail_unless(header_buffer_count(hb) == 3);
+  fail_unless(hb->store_size == 0);
+
+  size_t length = 0;
+  const char *url = header_buffer_url(hb, &length);
+  fail_unless(url == read_buffer + 4);
+  fail_unless(length == 11);
+  fail_unless(strncmp(url, "/index.html", length) == 0);
+
+  // Contiguous continuation is merged in place
+  fail_unless(header_buffer_add(hb, HB_FIELD, read_buffer + 45, 3) == 0);
+  fail_unless(header_buffer_add(hb, HB_FIELD, read_buffer + 48, 3) == 0);
+  fail_unless(header_buffer_count(hb) == 4);
+  const char *tok = header_buffer_token(hb, 3, &length);
+  fail_unless(tok == read_buffer + 45);
+  fail_unless(length == 6);
+  fail_unless(hb->store_size == 0);
+
+  header_buffer_clear(hb);
+  fail_unless(header_buffer_count(hb) == 0);
+  header_buffer_delete(hb);
+}
+END_TEST
+
+START_TEST(test_header_buffer_retain)
+{
+  char read_buffer[BUFFER_MAX];
+  struct Header_Buffer *hb = header_buffer_new(read_buffer, BUFFER_MAX);
+
+  // Token split over two reads of the same buffer
+  strcpy(read_buffer, "X-Long-Hea");
+  fail_unless(header_buffer_add(hb, HB_FIELD, read_buffer, 10) == 0);
+  header_buffer_retain(hb);
+  memset(read_buffer, 0, BUFFER_MAX);
+  strcpy(read_buffer, "der: yes");
+  fail_unless(header_buffer_add(hb, HB_FIELD, read_buffer, 3) == 0);
+  fail_unless(header_buffer_add(hb, HB_VALUE, read_buffer + 5, 3) == 0);
+  fail_unless(header_buffer_count(hb) == 2);
+
+  size_t length = 0;
+  const char *tok = header_buffer_token(hb, 0, &length);
+  fail_unless(length == 13);
+  fail_unless(strncmp(tok, "X-Long-Header", length) == 0);
+  tok = header_buffer_token(hb, 1, &length);
+  fail_unless(length == 3);
+  fail_unless(tok == read_buffer + 5);
+
+  // Token from outside the read buffer is copied
+  const char *other = "elsewhere";
+  fail_unless(header_buffer_add(hb, HB_FIELD, other, 9) == 0);
+  tok = header_buffer_token(hb, 2, &length);
+  fail_if(tok == other);
+  fail_unless(strncmp(tok, other, length) == 0);
+
+  header_buffer_delete(hb);
+}
+END_TEST
+
+START_TEST(test_header_buffer_write)
+{
+  char read_buffer[BUFFER_MAX];
+  strcpy(read_buffer, TEST_HEADERS);
+  struct Header_Buffer *hb = header_buffer_new(read_buffer, BUFFER_MAX);
+  header_buffer_add(hb, HB_URL, read_buffer + 4, 11);
+  header_buffer_add(hb, HB_FIELD, read_buffer + 26, 4);
+  header_buffer_add(hb, HB_VALUE, read_buffer + 32, 11);
+  header_buffer_add(hb, HB_FIELD, read_buffer + 45, 6);
+  header_buffer_add(hb, HB_VALUE, read_buffer + 53, 3);
+
+  int fds[2];
+  fail_unless(pipe(fds) == 0);
+  header_buffer_write_line(hb, fds[1], "GET ", " HTTP/1.1\r\n");
+  header_buffer_write(hb, fds[1], 0, SIZE_MAX);
+  write_all(fds[1], "\r\n", 2);
+  close(fds[1]);
+
+  char output[BUFFER_MAX];
+  memset(output, 0, BUFFER_MAX);
+  ssize_t bytes = read(fds[0], output, BUFFER_MAX);
+  close(fds[0]);
+  fail_unless(bytes == strlen(TEST_HEADERS));
+  fail_unless(strcmp(output, TEST_HEADERS) == 0);
+
+  header_buffer_delete(hb);
+}
+END_TEST
+
+
+Suite *header_buffer_suite(void)
+{
+  Suite *s = suite_create("Header_Buffer");
+
+  // Core test case 
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_test(tc_core, test_header_buffer_create);
+  tcase_add_test(tc_core, test_header_buffer_slices);
+  tcase_add_test(tc_core, test_header_buffer_retain);
+  suite_add_tcase(s, tc_core);
+
+  // Output
+  TCase *tc_write = tcase_create("Write");
+  tcase_add_test(tc_write, test_header_buffer_write);
+  suite_add_tcase(s, tc_write);
+
+  return s;
+}
+
+
+int main(int argc, char *argv[]) 
+{
+  int number_failed = 0;
+  Suite   *s  = header_buffer_suite();
+  SRunner *sr = srunner_create(s);
+  srunner_run_all(sr, CK_NORMAL);
+  number_failed = srunner_ntests_failed(sr);
+  srunner_free(sr);
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,117 @@
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/http_parser.h"
+
+#define ID_TEST_MAX 16
+
+struct Id_Capture
+{
+  int ids[ID_TEST_MAX];
+  int count;
+};
+
+static int
+cb_field(http_parser * parser, const char *at, size_t length)
+{
+  struct Id_Capture *cap = (struct Id_Capture *) parser->data;
+  // Mark that a new header has started
+  if (cap->count < ID_TEST_MAX)
+    cap->ids[cap->count] = -1;
+  return 0;
+}
+
+/* Record the id seen when each header's value first arrives */
+static int
+cb_value_first(http_parser * parser, const char *at, size_t length)
+{
+  struct Id_Capture *cap = (struct Id_Capture *) parser->data;
+  if (cap->count < ID_TEST_MAX && cap->ids[cap->count] == -1)
+    cap->ids[cap->count++] = parser->header_id;
+  return 0;
+}
+
+#define TEST_MESSAGE "HTTP/1.1 200 OK\r\n" \
+  "content-LENGTH: 3\r\n" \
+  "Content: no\r\n" \
+  "Content-Lengthy: no\r\n" \
+  "X-Forwarded-For: 10.0.0.1\r\n" \
+  "Set-Cookie: a=b\r\n" \
+  "Sec-WebSocket-Extensions: none\r\n" \
+  "Contenu-Length: no\r\n" \
+  "Sesacl0-Length: no\r\n" \
+  "\r\nabc"
+
+static const int expected_ids[] = {
+  HTTP_HEADER_CONTENT_LENGTH, HTTP_HEADER_UNKNOWN, HTTP_HEADER_UNKNOWN,
+  HTTP_HEADER_X_FORWARDED_FOR, HTTP_HEADER_SET_COOKIE,
+  HTTP_HEADER_SEC_WEBSOCKET_EXTENSIONS, HTTP_HEADER_UNKNOWN,
+  HTTP_HEADER_UNKNOWN
+};
+
+/* Feed the message in two pieces split at every position. The hash of
+ * "Sesacl0-Length" is that of "Content-Length". */
+START_TEST(test_header_ids_split)
+{
+  size_t len = strlen(TEST_MESSAGE);
+  http_parser_settings settings;
+  http_parser_settings_init(&settings);
+  settings.on_header_field = cb_field;
+  settings.on_header_value = cb_value_first;
+
+  for (size_t split = 1; split < len; split++)
+    {
+      struct Id_Capture cap;
+      memset(&cap, 0, sizeof(cap));
+      http_parser parser;
+      parser.data = &cap;
+      http_parser_init(&parser, HTTP_RESPONSE);
+
+      fail_unless(http_parser_execute(&parser, &settings, TEST_MESSAGE, split)
+		  == split);
+      fail_unless(http_parser_execute(&parser, &settings, TEST_MESSAGE + split,
+				      len - split) == len - split);
+      fail_unless(cap.count == 8, "split %zd: %d headers", split, cap.count);
+      for (int i = 0; i < 8; i++)
+	fail_unless(cap.ids[i] == expected_ids[i], "split %zd: header %d id %d",
+		    split, i, cap.ids[i]);
+    }
+}
+END_TEST
+
+START_TEST(test_header_str)
+{
+  fail_unless(strcmp(http_header_str(HTTP_HEADER_CONTENT_TYPE), "Content-Type") == 0);
+  fail_unless(strcmp(http_header_str(HTTP_HEADER_WWW_AUTHENTICATE), "WWW-Authenticate") == 0);
+  fail_unless(strcmp(http_header_str(HTTP_HEADER_MAX), "<unknown>") == 0);
+}
+END_TEST
+
+
+Suite *header_ids_suite(void)
+{
+  Suite *s = suite_create("Header_Ids");
+
+  // Core test case 
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_test(tc_core, test_header_ids_split);
+  tcase_add_test(tc_core, test_header_str);
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
+
+
+int main(int argc, char *argv[]) 
+{
+  int number_failed = 0;
+  Suite   *s  = header_ids_suite();
+  SRunner *sr = srunner_create(s);
+  srunner_run_all(sr, CK_NORMAL);
+  number_failed = srunner_ntests_failed(sr);
+  srunner_free(sr);
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
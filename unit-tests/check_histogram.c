@@ -0,0 +1,114 @@
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/histogram.h"
+#include "../src/message_stats.h"
+
+START_TEST(test_histogram_buckets)
+{
+  // Small values are exact; larger ones within 1/16th
+  for (uint64_t v = 0; v < HISTOGRAM_SUB_COUNT; v++)
+    fail_unless(histogram_bucket_high(histogram_bucket(v)) == v);
+  for (uint64_t v = 1; v < UINT64_MAX / 3; v = v * 3 + 1)
+    {
+      size_t b = histogram_bucket(v);
+      uint64_t high = histogram_bucket_high(b);
+      fail_unless(b < HISTOGRAM_BUCKETS);
+      fail_unless(high >= v && high - v <= v / HISTOGRAM_SUB_COUNT,
+		  "value %llu, high %llu", v, high);
+      fail_unless(b == 0 || histogram_bucket_high(b - 1) < v);
+    }
+  fail_unless(histogram_bucket(UINT64_MAX) == HISTOGRAM_BUCKETS - 1);
+  fail_unless(histogram_bucket_high(HISTOGRAM_BUCKETS - 1) == UINT64_MAX);
+}
+END_TEST
+
+START_TEST(test_histogram_percentiles)
+{
+  struct Histogram h;
+  histogram_init(&h);
+  fail_unless(histogram_percentile(&h, 50) == 0);
+
+  for (uint64_t v = 1; v <= 1000; v++)
+    histogram_record(&h, v);
+  fail_unless(h.count == 1000 && h.min == 1 && h.max == 1000);
+  fail_unless(h.sum == 500500);
+
+  uint64_t p50 = histogram_percentile(&h, 50);
+  uint64_t p99 = histogram_percentile(&h, 99);
+  fail_unless(p50 >= 500 && p50 <= 500 + 500 / 16, "p50 %llu", p50);
+  fail_unless(p99 >= 990 && p99 <= 1000, "p99 %llu", p99);
+  fail_unless(histogram_percentile(&h, 100) == 1000);
+  fail_unless(histogram_percentile(&h, 0) == 1);
+}
+END_TEST
+
+START_TEST(test_message_stats)
+{
+  struct Message_Stats *stats = message_stats_new(0);
+  fail_unless(stats != NULL);
+
+  http_parser parser;
+  http_parser_init(&parser, HTTP_REQUEST);
+  parser.method = HTTP_PUT;
+  message_stats_record(stats, &parser, 100, 10, 1000000);
+  parser.type = HTTP_RESPONSE;
+  parser.status_code = 404;
+  message_stats_record(stats, &parser, 200, 0, 3000000);
+  parser.status_code = 999;
+  message_stats_record(stats, &parser, 50, 0, 3500000);
+  fail_unless(stats->messages == 3);
+
+  // Requests by method, responses by class; intervals in us
+  struct Histogram *put = stats->groups[HTTP_PUT];
+  struct Histogram *c4xx = stats->groups[STATS_METHODS + 4];
+  struct Histogram *other = stats->groups[STATS_METHODS];
+  fail_unless(put != NULL && c4xx != NULL && other != NULL);
+  fail_unless(put[STATS_SIZE].max == 110 && put[STATS_BODY].max == 10);
+  fail_unless(put[STATS_INTERVAL].count == 0);
+  fail_unless(c4xx[STATS_HEADER].max == 200);
+  fail_unless(c4xx[STATS_INTERVAL].max == 2000);
+  fail_unless(other[STATS_INTERVAL].max == 500);
+  fail_unless(stats->groups[HTTP_GET] == NULL);
+
+  char text[4096];
+  FILE *out = fmemopen(text, sizeof(text), "w");
+  message_stats_dump(stats, out, "[stats]", 4000000);
+  fclose(out);
+  fail_unless(strstr(text, "[stats] 3 messages in 0.004s\n") == text);
+  fail_unless(strstr(text, "[stats] PUT size n=1 min=110 p50=110 p90=110 "
+		      "p99=110 max=110\n") != NULL);
+  fail_unless(strstr(text, "[stats] 4xx interval_us n=1") != NULL);
+  fail_unless(strstr(text, "[stats] other header") != NULL);
+  message_stats_delete(stats);
+}
+END_TEST
+
+
+Suite *histogram_suite(void)
+{
+  Suite *s = suite_create("Histogram");
+
+  // Core test case
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_test(tc_core, test_histogram_buckets);
+  tcase_add_test(tc_core, test_histogram_percentiles);
+  tcase_add_test(tc_core, test_message_stats);
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
+
+
+int main(int argc, char *argv[])
+{
+  int number_failed = 0;
+  Suite   *s  = histogram_suite();
+  SRunner *sr = srunner_create(s);
+  srunner_run_all(sr, CK_NORMAL);
+  number_failed = srunner_ntests_failed(sr);
+  srunner_free(sr);
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
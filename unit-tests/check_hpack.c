@@ -0,0 +1,172 @@
+#include <check.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/hpack.h"
+
+#define HPACK_TEST_MAX 1024
+
+/* RFC 7541 Appendix C.3: requests without Huffman coding */
+static const char *plain_blocks[] = {
+  "\x82\x86\x84\x41\x0f" "www.example.com",
+  "\x82\x86\x84\xbe\x58\x08" "no-cache",
+  "\x82\x87\x85\xbf\x40\x0a" "custom-key" "\x0c" "custom-value"
+};
+static const size_t plain_lengths[] = { 20, 14, 29 };
+
+/* RFC 7541 Appendix C.4: the same requests with Huffman coding */
+static const char *huffman_blocks[] = {
+  "\x82\x86\x84\x41\x8c\xf1\xe3\xc2\xe5\xf2\x3a\x6b\xa0\xab\x90\xf4\xff",
+  "\x82\x86\x84\xbe\x58\x86\xa8\xeb\x10\x64\x9c\xbf",
+  "\x82\x87\x85\xbf\x40\x88\x25\xa8\x49\xe9\x5b\xa9\x7d\x7f\x89\x25\xa8"
+    "\x49\xe9\x5b\xb8\xe8\xb4\xbf"
+};
+static const size_t huffman_lengths[] = { 17, 12, 24 };
+
+static const char *expected[] = {
+  ":method: GET\n:scheme: http\n:path: /\n:authority: www.example.com\n",
+  ":method: GET\n:scheme: http\n:path: /\n:authority: www.example.com\n"
+    "cache-control: no-cache\n",
+  ":method: GET\n:scheme: https\n:path: /index.html\n"
+    ":authority: www.example.com\ncustom-key: custom-value\n"
+};
+
+/* Appends "name: value\n" to the text at "data" */
+static int
+cb_header(void *data, const char *name, size_t name_len, const char *value,
+	  size_t value_len)
+{
+  char *text = data;
+  size_t n = strlen(text);
+  if (n + name_len + value_len + 4 > HPACK_TEST_MAX)
+    return 1;
+  memcpy(text + n, name, name_len);
+  memcpy(text + n + name_len, ": ", 2);
+  memcpy(text + n + name_len + 2, value, value_len);
+  strcpy(text + n + name_len + 2 + value_len, "\n");
+  return 0;
+}
+
+static int
+cb_stop(void *data, const char *name, size_t name_len, const char *value,
+	size_t value_len)
+{
+  return 1;
+}
+
+/* Decodes the three blocks of one example with a new decoder */
+static void
+decode_example(const char **blocks, const size_t *lengths)
+{
+  struct Hpack_Decoder *hd = hpack_decoder_new();
+  fail_unless(hd != NULL);
+  for (int i = 0; i < 3; i++)
+    {
+      char text[HPACK_TEST_MAX] = "";
+      fail_unless(hpack_decode(hd, blocks[i], lengths[i], cb_header, text)
+		  == HPACK_OK, "block %d", i);
+      fail_unless(strcmp(text, expected[i]) == 0, "block %d: %s", i, text);
+    }
+  hpack_decoder_delete(hd);
+}
+
+START_TEST(test_hpack_requests)
+{
+  decode_example(plain_blocks, plain_lengths);
+  decode_example(huffman_blocks, huffman_lengths);
+}
+END_TEST
+
+START_TEST(test_hpack_eviction)
+{
+  // A table size update to 64 leaves room for one entry of 56 bytes
+  struct Hpack_Decoder *hd = hpack_decoder_new();
+  const char first[] = "\x3f\x21\x40\x04" "name" "\x14" "aaaaaaaaaaaaaaaaaaaa";
+  const char second[] = "\x40\x04" "next" "\x14" "bbbbbbbbbbbbbbbbbbbb";
+  char text[HPACK_TEST_MAX] = "";
+  fail_unless(hpack_decode(hd, first, sizeof(first) - 1, cb_header, text)
+	      == HPACK_OK);
+  fail_unless(hpack_decode(hd, second, sizeof(second) - 1, cb_header, text)
+	      == HPACK_OK);
+
+  // Index 62 is now "next"; 63 has been evicted
+  text[0] = '\0';
+  fail_unless(hpack_decode(hd, "\xbe", 1, cb_header, text) == HPACK_OK);
+  fail_unless(strcmp(text, "next: bbbbbbbbbbbbbbbbbbbb\n") == 0, "%s", text);
+  fail_unless(hpack_decode(hd, "\xbf", 1, cb_header, text)
+	      == HPACK_ERR_DECODE);
+  hpack_decoder_delete(hd);
+}
+END_TEST
+
+START_TEST(test_hpack_huffman)
+{
+  char out[64];
+  const unsigned char www[] = "\xf1\xe3\xc2\xe5\xf2\x3a\x6b\xa0\xab\x90\xf4\xff";
+  fail_unless(hpack_huffman_decode(out, www, 12) == 15);
+  fail_unless(memcmp(out, "www.example.com", 15) == 0);
+
+  // Padding longer than 7 bits, or not all ones, is an error
+  const unsigned char long_pad[] = "\xf1\xe3\xc2\xe5\xf2\x3a\x6b\xa0\xab\x90"
+    "\xf4\xff\xff";
+  fail_unless(hpack_huffman_decode(out, long_pad, 13) < 0);
+  const unsigned char zero_pad[] = "\xf1\xe3\xc2\xe5\xf2\x3a\x6b\xa0\xab\x90"
+    "\xf4\xfe";
+  fail_unless(hpack_huffman_decode(out, zero_pad, 12) < 0);
+}
+END_TEST
+
+START_TEST(test_hpack_errors)
+{
+  struct Hpack_Decoder *hd = hpack_decoder_new();
+  char text[HPACK_TEST_MAX] = "";
+
+  // Index 0, an index past the table, and a string cut short
+  fail_unless(hpack_decode(hd, "\x80", 1, cb_header, text)
+	      == HPACK_ERR_DECODE);
+  fail_unless(hpack_decode(hd, "\xff\x00", 2, cb_header, text)
+	      == HPACK_ERR_DECODE);
+  fail_unless(hpack_decode(hd, "\x40\x05" "na", 4, cb_header, text)
+	      == HPACK_ERR_DECODE);
+
+  // Table size update past the limit
+  fail_unless(hpack_decode(hd, "\x3f\xe1\xff\x07", 4, cb_header, text)
+	      == HPACK_ERR_DECODE);
+
+  // A callback returning non-zero stops decoding
+  fail_unless(hpack_decode(hd, "\x82\x86", 2, cb_stop, text)
+	      == HPACK_ERR_CALLBACK);
+  fail_unless(hpack_decode(hd, "\x82\x86", 2, NULL, NULL) == HPACK_OK);
+  hpack_decoder_delete(hd);
+}
+END_TEST
+
+
+Suite *hpack_suite(void)
+{
+  Suite *s = suite_create("HPACK");
+
+  // Core test case
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_test(tc_core, test_hpack_requests);
+  tcase_add_test(tc_core, test_hpack_eviction);
+  tcase_add_test(tc_core, test_hpack_huffman);
+  tcase_add_test(tc_core, test_hpack_errors);
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
+
+
+int main(int argc, char *argv[])
+{
+  int number_failed = 0;
+  Suite   *s  = hpack_suite();
+  SRunner *sr = srunner_create(s);
+  srunner_run_all(sr, CK_NORMAL);
+  number_failed = srunner_ntests_failed(sr);
+  srunner_free(sr);
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,226 @@
+#include <check.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ulog.h"
+#include "util.h"
+
+#include "../src/http_message.h"
+
+#define TEST_MESSAGE "HTTP/1.1 200 OK\r\n" \
+  "Content-Type: text/plain\r\n" \
+  "X-Custom: yes\r\n" \
+  "content-length: 3\r\n" \
+  "Content-Type: text/html\r\n" \
+  "\r\nabc"
+
+#define TEST_FRAMING "HTTP/1.1 200 OK\r\n" \
+  "Set-Cookie: a=b; path=/\r\n" \
+  "Cookie: x=y\r\n" \
+  "X-Folded: first\r\n" \
+  "  second: line\r\n" \
+  "Content-Type: text/plain\r\n" \
+  "Upgrade-Insecure-Requests: 1\r\n" \
+  "Transfer-Encoding: chunked\r\n" \
+  "Connection: close\r\n" \
+  "\r\n3\r\nabc\r\n0\r\n\r\n"
+
+static int
+cb_status(http_parser * parser, const char *at, size_t length)
+{
+  return http_message_on_url(parser->data, at, length);
+}
+
+static int
+cb_field(http_parser * parser, const char *at, size_t length)
+{
+  return http_message_on_header_field(parser->data, parser, at, length);
+}
+
+static int
+cb_value(http_parser * parser, const char *at, size_t length)
+{
+  return http_message_on_header_value(parser->data, at, length);
+}
+
+static int
+cb_headers_complete(http_parser * parser)
+{
+  http_message_on_headers_complete(parser->data, parser);
+  return 0;
+}
+
+/* Parse "text" split at "split", retaining between reads */
+static struct Http_Message *
+parse_text(char *read_buffer, const char *text, size_t split,
+	   int framing_only)
+{
+  struct Http_Message *msg = http_message_new(read_buffer, BUFFER_MAX);
+  http_parser_settings settings;
+  http_parser_settings_init(&settings);
+  settings.on_status = cb_status;
+  settings.on_header_field = cb_field;
+  settings.on_header_value = cb_value;
+  settings.on_headers_complete = cb_headers_complete;
+
+  http_parser parser;
+  http_parser_init(&parser, HTTP_RESPONSE);
+  parser.data = msg;
+  parser.framing_only = framing_only;
+
+  size_t len = strlen(text);
+  memcpy(read_buffer, text, split);
+  fail_unless(http_parser_execute(&parser, &settings, read_buffer, split)
+	      == split);
+  http_message_retain(msg);
+  memset(read_buffer, 'z', BUFFER_MAX);
+  memcpy(read_buffer, text + split, len - split);
+  fail_unless(http_parser_execute(&parser, &settings, read_buffer,
+				  len - split) == len - split, "%s",
+	      http_errno_name(HTTP_PARSER_ERRNO(&parser)));
+  return msg;
+}
+
+static struct Http_Message *
+parse_message(char *read_buffer, size_t split)
+{
+  return parse_text(read_buffer, TEST_MESSAGE, split, 0);
+}
+
+START_TEST(test_http_message_lookup)
+{
+  char read_buffer[BUFFER_MAX];
+  size_t len = strlen(TEST_MESSAGE);
+
+  for (size_t split = 1; split < len; split++)
+    {
+      struct Http_Message *msg = parse_message(read_buffer, split);
+      fail_unless(msg->head_complete);
+      fail_unless(msg->type == HTTP_RESPONSE);
+      fail_unless(msg->status_code == 200);
+      fail_unless(msg->content_length == 3);
+      fail_unless(http_message_header_count(msg) == 4, "split %zd", split);
+
+      size_t length = 0;
+      const char *at = http_message_url(msg, &length);
+      fail_unless(length == 2 && memcmp(at, "OK", 2) == 0, "split %zd",
+		  split);
+
+      // The first of a repeated header is found
+      fail_unless(http_message_find(msg, HTTP_HEADER_CONTENT_TYPE) == 0);
+      at = http_message_get(msg, HTTP_HEADER_CONTENT_TYPE, &length);
+      fail_unless(length == 10 && memcmp(at, "text/plain", 10) == 0,
+		  "split %zd", split);
+      fail_unless(http_message_find(msg, HTTP_HEADER_CONTENT_LENGTH) == 2,
+		  "split %zd", split);
+      fail_unless(http_message_find(msg, HTTP_HEADER_UNKNOWN) == -1);
+      fail_unless(http_message_find(msg, HTTP_HEADER_HOST) == -1);
+      fail_unless(http_message_get(msg, HTTP_HEADER_HOST, &length) == NULL);
+      fail_unless(http_message_header_id(msg, 1) == HTTP_HEADER_UNKNOWN);
+
+      http_message_delete(msg);
+    }
+}
+END_TEST
+
+START_TEST(test_http_message_rewrite)
+{
+  char read_buffer[BUFFER_MAX];
+  struct Http_Message *msg = parse_message(read_buffer, 20);
+
+  // Remove the first Content-Type; the second one is now found
+  http_message_remove(msg, 0);
+  fail_unless(http_message_find(msg, HTTP_HEADER_CONTENT_TYPE) == 2);
+  fail_unless(http_message_find(msg, HTTP_HEADER_CONTENT_LENGTH) == 1);
+
+  // Insert a well known header and rewrite a value
+  fail_unless(http_message_insert(msg, 0, "HOST", 4, "example.com", 11) == 0);
+  fail_unless(http_message_find(msg, HTTP_HEADER_HOST) == 0);
+  fail_unless(http_message_find(msg, HTTP_HEADER_CONTENT_LENGTH) == 2);
+  fail_unless(http_message_set_value(msg, 2, "12", 2) == 0);
+
+  int fds[2];
+  fail_unless(pipe(fds) == 0);
+  http_message_write_head(msg, fds[1]);
+  close(fds[1]);
+
+  const char *expected = "HTTP/1.1 200 OK\r\n"
+    "HOST: example.com\r\n"
+    "X-Custom: yes\r\n"
+    "content-length: 12\r\n" "Content-Type: text/html\r\n" "\r\n";
+  char output[BUFFER_MAX];
+  memset(output, 0, BUFFER_MAX);
+  ssize_t bytes = read(fds[0], output, BUFFER_MAX);
+  close(fds[0]);
+  fail_unless(bytes == strlen(expected));
+  fail_unless(strcmp(output, expected) == 0, "got %s", output);
+
+  // Cleared messages are empty
+  http_message_clear(msg);
+  fail_unless(http_message_header_count(msg) == 0);
+  fail_unless(http_message_find(msg, HTTP_HEADER_HOST) == -1);
+  fail_unless(!msg->head_complete);
+
+  http_message_delete(msg);
+}
+END_TEST
+
+START_TEST(test_http_message_framing_only)
+{
+  char read_buffer[BUFFER_MAX];
+  size_t len = strlen(TEST_FRAMING);
+
+  for (size_t split = 1; split < len; split++)
+    {
+      struct Http_Message *msg =
+	parse_text(read_buffer, TEST_FRAMING, split, 1);
+      fail_unless(msg->head_complete);
+      fail_unless(msg->chunked, "split %zd", split);
+      fail_unless(!msg->keep_alive, "split %zd", split);
+
+      // Only framing headers were called back, unless the parser had
+      // already passed on part of the name when the buffer ran out
+      size_t count = http_message_header_count(msg);
+      ssize_t n = http_message_find(msg, HTTP_HEADER_TRANSFER_ENCODING);
+      fail_unless(n >= 0 && n == count - 2, "split %zd", split);
+      fail_unless(http_message_find(msg, HTTP_HEADER_CONNECTION) == n + 1);
+      fail_unless(count <= 3, "split %zd: %zd headers", split, count);
+
+      size_t length = 0;
+      const char *at = http_message_get(msg, HTTP_HEADER_CONNECTION, &length);
+      fail_unless(length == 5 && memcmp(at, "close", 5) == 0);
+
+      http_message_delete(msg);
+    }
+}
+END_TEST
+
+
+Suite *http_message_suite(void)
+{
+  Suite *s = suite_create("Http_Message");
+
+  // Core test case
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_test(tc_core, test_http_message_lookup);
+  tcase_add_test(tc_core, test_http_message_rewrite);
+  tcase_add_test(tc_core, test_http_message_framing_only);
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
+
+
+int main(int argc, char *argv[])
+{
+  int number_failed = 0;
+  Suite   *s  = http_message_suite();
+  SRunner *sr = srunner_create(s);
+  srunner_run_all(sr, CK_NORMAL);
+  number_failed = srunner_ntests_failed(sr);
+  srunner_free(sr);
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
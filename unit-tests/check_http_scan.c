@@ -0,0 +1,228 @@
+#include <check.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/http_parser.h"
+#include "../src/http_scan.h"
+
+#define SCAN_TEST_MAX 200
+
+static const char *impls[] = { "scalar", "sse4.2", "avx2" };
+
+/* Reference answers, one byte at a time */
+static const char *
+ref_crlf(const char *p, const char *end)
+{
+  while (p < end && *p != '\r' && *p != '\n')
+    p++;
+  return p;
+}
+
+static const char *
+ref_url(const char *p, const char *end)
+{
+  while (p < end && (unsigned char) *p > ' ' && (unsigned char) *p < 0x7f
+	 && *p != '?' && *p != '#')
+    p++;
+  return p;
+}
+
+/* Put a single stop character at every position, for every length */
+static void
+do_test_scanner(const char *(*scan) (const char *, const char *),
+		const char *(*ref) (const char *, const char *),
+		char filler, const char *stops)
+{
+  char buf[SCAN_TEST_MAX];
+
+  for (const char *stop = stops; *stop; stop++)
+    {
+      for (int at = 0; at < SCAN_TEST_MAX; at++)
+	{
+	  memset(buf, filler, SCAN_TEST_MAX);
+	  buf[at] = *stop;
+	  for (int len = 0; len <= SCAN_TEST_MAX; len += 7)
+	    fail_unless(scan(buf, buf + len) == ref(buf, buf + len),
+			"stop %d at %d, len %d", *stop, at, len);
+	}
+    }
+}
+
+START_TEST(test_scan_crlf)
+{
+  for (int i = 0; i < 3; i++)
+    {
+      if (http_scan_select(impls[i]) != 0)
+	continue;
+      fail_unless(strcmp(http_scan_impl(), impls[i]) == 0);
+      do_test_scanner(http_scan_crlf, ref_crlf, 'a', "\r\n");
+      do_test_scanner(http_scan_crlf, ref_crlf, '\x80', "\r\n");
+    }
+}
+END_TEST
+
+START_TEST(test_scan_url)
+{
+  for (int i = 0; i < 3; i++)
+    {
+      if (http_scan_select(impls[i]) != 0)
+	continue;
+      do_test_scanner(http_scan_url, ref_url, 'a',
+		      " ?#\r\n\t\x01\x7f\x80\xff");
+      do_test_scanner(http_scan_url, ref_url, '~', "\"!@$>");
+    }
+}
+END_TEST
+
+START_TEST(test_scan_unmask)
+{
+  const unsigned char mask[4] = { 0x37, 0xfa, 0x21, 0x3d };
+  char buf[SCAN_TEST_MAX];
+  char ref[SCAN_TEST_MAX];
+
+  for (int i = 0; i < 3; i++)
+    {
+      if (http_scan_select(impls[i]) != 0)
+	continue;
+      for (int offset = 0; offset < 4; offset++)
+	for (int start = 0; start < 16; start++)
+	  for (int len = 0; start + len <= SCAN_TEST_MAX; len += 5)
+	    {
+	      for (int n = 0; n < SCAN_TEST_MAX; n++)
+		buf[n] = ref[n] = n * 7;
+	      for (int n = 0; n < len; n++)
+		ref[start + n] ^= mask[(offset + n) & 3];
+	      http_scan_unmask(buf + start, len, mask, offset);
+	      fail_unless(memcmp(buf, ref, SCAN_TEST_MAX) == 0,
+			  "%s offset %d, start %d, len %d", impls[i], offset,
+			  start, len);
+	    }
+    }
+}
+END_TEST
+
+START_TEST(test_scan_hex)
+{
+  const char digits[] = "0123456789abcdefABCDEF";
+  char buf[SCAN_TEST_MAX];
+
+  for (int i = 0; i < 3; i++)
+    {
+      if (http_scan_select(impls[i]) != 0)
+	continue;
+      // Every count of digits, then a stop, in buffers of every length
+      for (int count = 0; count <= 20; count++)
+	for (int len = 0; len <= 40; len++)
+	  for (const char *stop = ";\r g\x80"; *stop; stop++)
+	    {
+	      memset(buf, *stop, SCAN_TEST_MAX);
+	      for (int n = 0; n < count; n++)
+		buf[n] = digits[(n * 5 + count) % 22];
+
+	      uint64_t value = 1, ref_value = 1;
+	      const char *end = http_scan_hex(buf, buf + len, &value);
+	      http_scan_select("scalar");
+	      const char *ref_end = http_scan_hex(buf, buf + len, &ref_value);
+	      http_scan_select(impls[i]);
+
+	      int expect = (count < len ? count : len);
+	      expect = (expect < 16 ? expect : 16);
+	      fail_unless(ref_end == buf + expect, "scalar count %d, len %d",
+			  count, len);
+	      fail_unless(end == ref_end && value == ref_value,
+			  "%s count %d, len %d, stop %d", impls[i], count, len,
+			  *stop);
+	    }
+    }
+
+  uint64_t value = 0;
+  const char *text = "7fFfFfFfFfFfFfFf\r\n0123456789";
+  fail_unless(http_scan_hex(text, text + strlen(text), &value) == text + 16);
+  fail_unless(value == 0x7fffffffffffffffULL);
+}
+END_TEST
+
+/* Parse a chunked response whose first chunk size is "size" */
+static enum http_errno
+parse_chunk_size(const char *size)
+{
+  char text[256];
+  snprintf(text, sizeof(text), "HTTP/1.1 200 OK\r\n"
+	   "Transfer-Encoding: chunked\r\n\r\n%s\r\nabc", size);
+  http_parser_settings settings;
+  http_parser_settings_init(&settings);
+  http_parser parser;
+  http_parser_init(&parser, HTTP_RESPONSE);
+  http_parser_execute(&parser, &settings, text, strlen(text));
+  return HTTP_PARSER_ERRNO(&parser);
+}
+
+START_TEST(test_scan_hex_overflow)
+{
+  uint64_t value = 0;
+  const char *text = "ffffffffffffffff\r\n";
+
+  for (int i = 0; i < 3; i++)
+    {
+      if (http_scan_select(impls[i]) != 0)
+	continue;
+      // The scan gives all 16 digits; the parser must bound them
+      fail_unless(http_scan_hex(text, text + strlen(text), &value)
+		  == text + 16);
+      fail_unless(value == UINT64_MAX, "%s", impls[i]);
+
+      fail_unless(parse_chunk_size("ffffffffffffffff")
+		  == HPE_INVALID_CONTENT_LENGTH, "%s", impls[i]);
+      fail_unless(parse_chunk_size("0ffffffffffffffff")
+		  == HPE_INVALID_CONTENT_LENGTH, "%s", impls[i]);
+      fail_unless(parse_chunk_size("ffffffffffffffef") == HPE_OK, "%s",
+		  impls[i]);
+      fail_unless(parse_chunk_size("fffffffffffffff0") == HPE_INVALID_CONTENT_LENGTH,
+		  "%s", impls[i]);
+    }
+  http_scan_select(NULL);
+}
+END_TEST
+
+START_TEST(test_scan_select)
+{
+  fail_unless(http_scan_select(NULL) == 0);
+  fail_if(http_scan_impl() == NULL);
+  fail_unless(http_scan_select("scalar") == 0);
+  fail_unless(http_scan_select("no-such-scanner") == -1);
+  fail_unless(strcmp(http_scan_impl(), "scalar") == 0);
+}
+END_TEST
+
+
+Suite *http_scan_suite(void)
+{
+  Suite *s = suite_create("HTTP_Scan");
+
+  // Core test case 
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_test(tc_core, test_scan_select);
+  tcase_add_test(tc_core, test_scan_crlf);
+  tcase_add_test(tc_core, test_scan_url);
+  tcase_add_test(tc_core, test_scan_unmask);
+  tcase_add_test(tc_core, test_scan_hex);
+  tcase_add_test(tc_core, test_scan_hex_overflow);
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
+
+
+int main(int argc, char *argv[]) 
+{
+  int number_failed = 0;
+  Suite   *s  = http_scan_suite();
+  SRunner *sr = srunner_create(s);
+  srunner_run_all(sr, CK_NORMAL);
+  number_failed = srunner_ntests_failed(sr);
+  srunner_free(sr);
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,115 @@
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/method_queue.h"
+
+START_TEST(test_method_queue_fifo)
+{
+  struct Method_Queue *mq = method_queue_new();
+  fail_if(mq == NULL);
+  fail_unless(method_queue_pop(mq) == -1);
+
+  method_queue_push(mq, HTTP_HEAD);
+  method_queue_push(mq, HTTP_GET);
+  fail_unless(method_queue_count(mq) == 2);
+  fail_unless(method_queue_pop(mq) == HTTP_HEAD);
+  fail_unless(method_queue_pop(mq) == HTTP_GET);
+  fail_unless(method_queue_pop(mq) == -1);
+
+  // Overflow forgets the oldest
+  for (int i = 0; i <= METHOD_QUEUE_MAX; i++)
+    method_queue_push(mq, (i == 0 ? HTTP_HEAD : HTTP_POST));
+  fail_unless(method_queue_count(mq) == METHOD_QUEUE_MAX);
+  fail_unless(method_queue_pop(mq) == HTTP_POST);
+
+  method_queue_delete(mq);
+}
+END_TEST
+
+static struct Method_Queue *test_mq;
+
+static int
+cb_headers_complete(http_parser * parser)
+{
+  return method_queue_skip_body(test_mq, parser);
+}
+
+static int bodies;
+
+static int
+cb_body(http_parser * parser, const char *at, size_t length)
+{
+  bodies++;
+  return 0;
+}
+
+static int messages;
+
+static int
+cb_message_complete(http_parser * parser)
+{
+  messages++;
+  http_parser_init(parser, HTTP_BOTH);
+  return 0;
+}
+
+#define TEST_STREAM "HEAD / HTTP/1.1\r\nHost: a\r\n\r\n" \
+  "GET / HTTP/1.1\r\nHost: a\r\n\r\n" \
+  "HTTP/1.1 100 Continue\r\n\r\n" \
+  "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\n" \
+  "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhello" \
+  "HTTP/1.1 304 Not Modified\r\nContent-Length: 5\r\n\r\n"
+
+/* HEAD, 1xx and 304 responses end at their headers */
+START_TEST(test_method_queue_skip_body)
+{
+  test_mq = method_queue_new();
+  bodies = messages = 0;
+
+  http_parser_settings settings;
+  http_parser_settings_init(&settings);
+  settings.on_headers_complete = cb_headers_complete;
+  settings.on_body = cb_body;
+  settings.on_message_complete = cb_message_complete;
+
+  http_parser parser;
+  http_parser_init(&parser, HTTP_BOTH);
+  size_t len = strlen(TEST_STREAM);
+  fail_unless(http_parser_execute(&parser, &settings, TEST_STREAM, len) == len);
+  fail_unless(messages == 6, "%d messages", messages);
+  fail_unless(bodies == 1, "%d bodies", bodies);
+  fail_unless(test_mq->last_method == -1);
+  fail_unless(method_queue_count(test_mq) == 0);
+
+  method_queue_delete(test_mq);
+}
+END_TEST
+
+
+Suite *method_queue_suite(void)
+{
+  Suite *s = suite_create("Method_Queue");
+
+  // Core test case
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_test(tc_core, test_method_queue_fifo);
+  tcase_add_test(tc_core, test_method_queue_skip_body);
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
+
+
+int main(int argc, char *argv[])
+{
+  int number_failed = 0;
+  Suite   *s  = method_queue_suite();
+  SRunner *sr = srunner_create(s);
+  srunner_run_all(sr, CK_NORMAL);
+  number_failed = srunner_ntests_failed(sr);
+  srunner_free(sr);
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
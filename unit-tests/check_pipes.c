@@ -141,6 +141,10 @@ START_TEST(test_bipipe_create)
   fail_unless(0 == pipe_close(ph));
   fail_unless(PIPES_CLOSED == ph->state);
 
+  // What the child used is left behind
+  fail_unless(ph->wall_ns > 0);
+  fail_unless(ph->rusage.ru_maxrss > 0);
+
   pipe_handle_delete(ph);
 }
 END_TEST
@@ -176,6 +180,42 @@ START_TEST(test_bipipe_reset)
 END_TEST
 
 
+/* test_fds_pipe: Test running a command between two memfds.
+ */
+START_TEST(test_fds_pipe)
+{
+  struct Pipe_Handle *ph = pipe_handle_new();
+  assert(ph != NULL);
+
+  size_t length = strlen(TEST_STRING);
+  int fd_in = memfd_open("check_pipes_in");
+  int fd_out = memfd_open("check_pipes_out");
+  fail_unless(fd_in >= 0);
+  fail_unless(fd_out >= 0);
+  fail_unless(write(fd_in, TEST_STRING, length) == length);
+  memfd_seal(fd_in);
+
+  // Run the command with memfds as its stdin and stdout
+  fail_unless(0 == pipe_open_fds(ph, TEST_COMMAND, fd_in, fd_out));
+  fail_unless(PIPES_OPEN_FDS == ph->state);
+  fail_unless(ph->child_pid >= 1);
+  fail_unless(0 == pipe_close(ph));
+  fail_unless(PIPES_CLOSED == ph->state);
+
+  // Output should be waiting in the second memfd
+  char *buffer = malloc(length + 1);
+  assert(buffer != NULL);
+  fail_unless(pread(fd_out, buffer, length + 1, 0) == length);
+  fail_unless(strncmp(buffer, EXPECT_STRING, length) == 0);
+
+  free(buffer);
+  close(fd_in);
+  close(fd_out);
+  pipe_handle_delete(ph);
+}
+END_TEST
+
+
 Suite *pipes_suite(void)
 {
   Suite *s = suite_create("Pipes");
@@ -194,6 +234,11 @@ Suite *pipes_suite(void)
   tcase_add_test(tc_bidi, test_bipipe_reset);
   suite_add_tcase(s, tc_bidi);
 
+  // Descriptor (memfd) test case
+  TCase *tc_fds = tcase_create("Descriptors");
+  tcase_add_test(tc_fds, test_fds_pipe);
+  suite_add_tcase(s, tc_fds);
+
   return s;
 }
 
@@ -0,0 +1,106 @@
+#include <check.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ulog.h"
+#include "util.h"
+
+#include "../src/counters.h"
+#include "../src/stage_timing.h"
+
+/* Copies the value of header "n" as a string into "value" */
+static void
+header_value(struct Http_Message *msg, size_t n, char *value, size_t size)
+{
+  size_t length = 0;
+  const char *at = http_message_field(msg, n, &length);
+  fail_unless(length == strlen(STAGE_TIMING_FIELD)
+	      && memcmp(at, STAGE_TIMING_FIELD, length) == 0);
+  at = http_message_value(msg, n, &length);
+  snprintf(value, size, "%.*s", (int) length, at);
+}
+
+START_TEST(test_stage_timing_insert)
+{
+  char read_buffer[BUFFER_MAX];
+  char value[128];
+  struct Http_Message *msg = http_message_new(read_buffer, BUFFER_MAX);
+  http_message_insert(msg, 0, "Content-Length", 14, "3", 1);
+
+  struct Stage_Timing timing;
+  stage_timing_init(&timing, "body");
+  stage_timing_begin(&timing);
+  stage_timing_spawned(&timing, 1000);
+  usleep(2000);
+  stage_timing_end(&timing);
+  counter_add(COUNTER_WRITE_WAIT_NS, 500);
+  fail_unless(stage_timing_insert(&timing, msg, true) == 0);
+
+  // Added after the other headers
+  fail_unless(http_message_header_count(msg) == 2);
+  header_value(msg, 1, value, sizeof(value));
+  uint64_t in, spawn, xform, out;
+  fail_unless(sscanf(value, "body;in=%" SCNu64 ";spawn=%" SCNu64
+		     ";xform=%" SCNu64 ";out=%" SCNu64, &in, &spawn, &xform,
+		     &out) == 4, "%s", value);
+  fail_unless(in >= 2000000, "%s", value);
+  fail_unless(spawn == 1000);
+  fail_unless(out == 500);
+
+  // A fork after the message was read is not its command's time
+  stage_timing_begin(&timing);
+  stage_timing_end(&timing);
+  stage_timing_spawned(&timing, 10000000000ULL);
+  fail_unless(stage_timing_insert(&timing, msg, true) == 0);
+  header_value(msg, 2, value, sizeof(value));
+  fail_unless(strstr(value, ";spawn=10000000000;xform=0;out=0") != NULL,
+	      "%s", value);
+
+  http_message_delete(msg);
+}
+END_TEST
+
+START_TEST(test_stage_timing_off)
+{
+  char read_buffer[BUFFER_MAX];
+  struct Http_Message *msg = http_message_new(read_buffer, BUFFER_MAX);
+
+  struct Stage_Timing timing;
+  stage_timing_init(&timing, NULL);
+  stage_timing_begin(&timing);
+  stage_timing_end(&timing);
+  fail_unless(stage_timing_insert(&timing, msg, false) == 0);
+  fail_unless(http_message_header_count(msg) == 0);
+
+  http_message_delete(msg);
+}
+END_TEST
+
+
+Suite *stage_timing_suite(void)
+{
+  Suite *s = suite_create("Stage_Timing");
+
+  // Core test case
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_test(tc_core, test_stage_timing_insert);
+  tcase_add_test(tc_core, test_stage_timing_off);
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
+
+
+int main(int argc, char *argv[])
+{
+  int number_failed = 0;
+  Suite   *s  = stage_timing_suite();
+  SRunner *sr = srunner_create(s);
+  srunner_run_all(sr, CK_NORMAL);
+  number_failed = srunner_ntests_failed(sr);
+  srunner_free(sr);
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -46,6 +46,34 @@ START_TEST(test_buffer_add)
 END_TEST
 
 
+START_TEST(test_buffer_reserve)
+{
+  struct Stream_Buffer *buf = stream_buffer_new();
+  size_t want = BUFFER_MAX * 5 + 3;
+
+  // Grows to exactly what was asked for
+  fail_unless(stream_buffer_reserve(buf, want) == 0);
+  fail_unless(stream_buffer_capacity(buf) == want);
+
+  // Adding what was reserved doesn't reallocate
+  char *str = malloc(want);
+  memset(str, 'x', want);
+  char *head = buf->head;
+  fail_unless(stream_buffer_add(buf, str, want) == want);
+  fail_unless(buf->head == head);
+  fail_unless(stream_buffer_capacity(buf) == want);
+
+  // Reserving less than is free never shrinks
+  stream_buffer_clear(buf);
+  fail_unless(stream_buffer_reserve(buf, 10) == 0);
+  fail_unless(stream_buffer_capacity(buf) == want);
+
+  free(str);
+  stream_buffer_delete(buf);
+}
+END_TEST
+
+
 #define TEST_STRING "abcdefghijklmnopqrstuvwxyz.ABCDEFGHIJKLMNOPQRSTUVWXYZ.\n\1\n2\n3\n"
 START_TEST(test_buffer_clear)
 {
@@ -124,6 +152,7 @@ Suite *stream_buffer_suite(void)
   tcase_add_test(tc_core, test_buffer_create);
   tcase_add_test(tc_core, test_buffer_add);
   tcase_add_test(tc_core, test_buffer_clear);
+  tcase_add_test(tc_core, test_buffer_reserve);
   suite_add_tcase(s, tc_core);
 
   // Partial buffer writes
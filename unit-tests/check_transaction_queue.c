@@ -0,0 +1,75 @@
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/transaction_queue.h"
+
+START_TEST(test_transaction_queue_fifo)
+{
+  struct Transaction_Queue *tq = transaction_queue_new();
+  struct Transaction txn;
+  fail_if(tq == NULL);
+  fail_unless(!transaction_queue_pop(tq, &txn));
+
+  // Pipelined requests are answered in order
+  transaction_queue_begin(tq, 100);
+  transaction_queue_end(tq, HTTP_HEAD, "/a", 2, 150);
+  transaction_queue_begin(tq, 200);
+  fail_unless(transaction_queue_count(tq) == 2);
+
+  fail_unless(transaction_queue_pop(tq, &txn));
+  fail_unless(txn.method == HTTP_HEAD && txn.begin_ns == 100
+	      && txn.end_ns == 150);
+  fail_unless(txn.url_len == 2 && memcmp(txn.url, "/a", 2) == 0);
+
+  // A request still being sent has no end yet
+  fail_unless(transaction_queue_pop(tq, &txn));
+  fail_unless(txn.begin_ns == 200 && txn.end_ns == 0 && txn.url_len == 0);
+  fail_unless(transaction_queue_count(tq) == 0);
+
+  // Nothing to end; long URLs are cut
+  transaction_queue_end(tq, HTTP_GET, "/", 1, 300);
+  char url[TRANSACTION_URL_MAX + 10];
+  memset(url, 'x', sizeof(url));
+  transaction_queue_begin(tq, 400);
+  transaction_queue_end(tq, HTTP_GET, url, sizeof(url), 500);
+  fail_unless(transaction_queue_pop(tq, &txn));
+  fail_unless(txn.url_len == TRANSACTION_URL_MAX);
+
+  // Overflow forgets the oldest
+  for (int i = 0; i <= TRANSACTION_QUEUE_MAX; i++)
+    transaction_queue_begin(tq, i);
+  fail_unless(transaction_queue_count(tq) == TRANSACTION_QUEUE_MAX);
+  fail_unless(transaction_queue_pop(tq, &txn));
+  fail_unless(txn.begin_ns == 1);
+
+  transaction_queue_delete(tq);
+}
+END_TEST
+
+
+Suite *transaction_queue_suite(void)
+{
+  Suite *s = suite_create("Transaction_Queue");
+
+  // Core test case
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_test(tc_core, test_transaction_queue_fifo);
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
+
+
+int main(int argc, char *argv[])
+{
+  int number_failed = 0;
+  Suite   *s  = transaction_queue_suite();
+  SRunner *sr = srunner_create(s);
+  srunner_run_all(sr, CK_NORMAL);
+  number_failed = srunner_ntests_failed(sr);
+  srunner_free(sr);
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
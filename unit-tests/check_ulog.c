@@ -0,0 +1,178 @@
+#include <check.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/ulog.h"
+
+static int evaluated = 0;
+
+static int
+count_evaluation(void)
+{
+  return ++evaluated;
+}
+
+static char *
+read_file(const char *path)
+{
+  static char text[64 * 1024];
+  FILE *f = fopen(path, "r");
+  size_t n = fread(text, 1, sizeof(text) - 1, f);
+  text[n] = '\0';
+  fclose(f);
+  return text;
+}
+
+START_TEST(test_ulog_file)
+{
+  char path[] = "/tmp/check_ulog.XXXXXX";
+  int fd = mkstemp(path);
+  fail_unless(fd >= 0);
+  close(fd);
+
+  setenv("ULOG_TARGET", path, 1);
+  setenv("ULOG_LEVEL", "6", 1);
+  ulog_init("check_ulog");
+  for (int n = 0; n < 100; n++)
+    ulog(LOG_INFO, "message %d", n);
+  ulog_close();
+
+  // Every message is there, in order, once ulog_close returns
+  char *text = read_file(path);
+  char expected[64];
+  snprintf(expected, sizeof(expected), "check_ulog[%d]: message 0\n",
+	   (int) getpid());
+  fail_unless(strncmp(text, expected, strlen(expected)) == 0);
+  char *p = text;
+  for (int n = 0; n < 100; n++)
+    {
+      snprintf(expected, sizeof(expected), "]: message %d\n", n);
+      p = strstr(p, expected);
+      fail_unless(p != NULL, "message %d missing", n);
+    }
+  fail_unless(ulog_dropped() == 0);
+  unlink(path);
+  unsetenv("ULOG_TARGET");
+  unsetenv("ULOG_LEVEL");
+}
+END_TEST
+
+START_TEST(test_ulog_level)
+{
+  char path[] = "/tmp/check_ulog.XXXXXX";
+  int fd = mkstemp(path);
+  fail_unless(fd >= 0);
+  close(fd);
+
+  // Messages below the level do not even evaluate their arguments
+  setenv("ULOG_TARGET", path, 1);
+  setenv("ULOG_LEVEL", "4", 1);
+  ulog_init("check_ulog");
+  evaluated = 0;
+  ulog(LOG_DEBUG, "debug %d", count_evaluation());
+  ulog_debug("debug %d", count_evaluation());
+  ulog(LOG_INFO, "info %d", count_evaluation());
+  fail_unless(evaluated == 0);
+  ulog(LOG_WARNING, "warning %d", count_evaluation());
+  fail_unless(evaluated == 1);
+  ulog_close();
+
+  char *text = read_file(path);
+  fail_unless(strstr(text, "warning 1\n") != NULL);
+  fail_unless(strstr(text, "debug") == NULL);
+  fail_unless(strstr(text, "info") == NULL);
+  unlink(path);
+  unsetenv("ULOG_TARGET");
+  unsetenv("ULOG_LEVEL");
+}
+END_TEST
+
+struct Reader
+{
+  int fd;
+  int messages;
+  int reports;
+};
+
+static void *
+read_lines(void *arg)
+{
+  struct Reader *reader = arg;
+  FILE *f = fdopen(reader->fd, "r");
+  char line[1024];
+  while (fgets(line, sizeof(line), f) != NULL)
+    {
+      if (strstr(line, "messages dropped") != NULL)
+	reader->reports++;
+      else
+	reader->messages++;
+    }
+  fclose(f);
+  return NULL;
+}
+
+START_TEST(test_ulog_drops)
+{
+  int fds[2];
+  fail_unless(pipe(fds) == 0);
+
+  // Nothing reads the pipe at first, so the drain thread blocks and
+  // the ring fills: messages are dropped rather than waited for
+  char path[64];
+  snprintf(path, sizeof(path), "/dev/fd/%d", fds[1]);
+  setenv("ULOG_TARGET", path, 1);
+  setenv("ULOG_LEVEL", "6", 1);
+  ulog_init("check_ulog");
+  close(fds[1]);
+
+  char filler[400];
+  memset(filler, 'x', sizeof(filler) - 1);
+  filler[sizeof(filler) - 1] = '\0';
+  for (int n = 0; n < 2000; n++)
+    ulog(LOG_INFO, "%d %s", n, filler);
+  unsigned long long dropped = ulog_dropped();
+  fail_unless(dropped > 0);
+
+  struct Reader reader = { fds[0], 0, 0 };
+  pthread_t thread;
+  fail_unless(pthread_create(&thread, NULL, read_lines, &reader) == 0);
+  ulog_close();
+  pthread_join(thread, NULL);
+
+  fail_unless(reader.messages == 2000 - (int) dropped, "%d read, %llu dropped",
+	      reader.messages, dropped);
+  fail_unless(reader.reports >= 1);
+  unsetenv("ULOG_TARGET");
+  unsetenv("ULOG_LEVEL");
+}
+END_TEST
+
+
+Suite *ulog_suite(void)
+{
+  Suite *s = suite_create("Ulog");
+
+  // Core test case
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_test(tc_core, test_ulog_file);
+  tcase_add_test(tc_core, test_ulog_level);
+  tcase_add_test(tc_core, test_ulog_drops);
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
+
+
+int main(int argc, char *argv[])
+{
+  int number_failed = 0;
+  Suite   *s  = ulog_suite();
+  SRunner *sr = srunner_create(s);
+  srunner_run_all(sr, CK_NORMAL);
+  number_failed = srunner_ntests_failed(sr);
+  srunner_free(sr);
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,203 @@
+#include <check.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/http_scan.h"
+#include "../src/ws_parser.h"
+
+#define WS_TEST_MAX 70000
+
+static const char *impls[] = { "scalar", "sse4.2", "avx2" };
+
+/* What the callbacks saw */
+struct Frames
+{
+  int headers;
+  int completes;
+  int opcodes[4];
+  uint64_t lengths[4];
+  char payload[WS_TEST_MAX];
+  size_t payload_len;
+};
+
+static int
+cb_header(ws_parser * ws)
+{
+  struct Frames *f = ws->data;
+  if (f->headers < 4)
+    {
+      f->opcodes[f->headers] = ws->opcode;
+      f->lengths[f->headers] = ws->payload_length;
+    }
+  f->headers++;
+  return 0;
+}
+
+static int
+cb_payload(ws_parser * ws, const char *at, size_t length)
+{
+  struct Frames *f = ws->data;
+  memcpy(f->payload + f->payload_len, at, length);
+  f->payload_len += length;
+  return 0;
+}
+
+static int
+cb_complete(ws_parser * ws)
+{
+  struct Frames *f = ws->data;
+  f->completes++;
+  return 0;
+}
+
+/* Append a frame with payload "text" repeated to "length" bytes */
+static size_t
+make_frame(char *buf, int fin, enum ws_opcode opcode, const char *text,
+	   size_t length, const unsigned char *mask)
+{
+  size_t n = ws_frame_header((unsigned char *) buf, fin, opcode, length,
+			     mask);
+  for (size_t i = 0; i < length; i++)
+    {
+      buf[n + i] = text[i % strlen(text)];
+      if (mask != NULL)
+	buf[n + i] ^= mask[i & 3];
+    }
+  return n + length;
+}
+
+/* Parse "len" bytes of "stream" in two pieces, split at "split" */
+static void
+parse_split(struct Frames *f, char *stream, size_t len, size_t split)
+{
+  ws_parser_settings settings;
+  ws_parser_settings_init(&settings);
+  settings.on_frame_header = cb_header;
+  settings.on_payload = cb_payload;
+  settings.on_frame_complete = cb_complete;
+
+  ws_parser ws;
+  memset(f, 0, sizeof(*f));
+  ws.data = f;
+  ws_parser_init(&ws);
+
+  fail_unless(ws_parser_execute(&ws, &settings, stream, split) == split);
+  fail_unless(ws_parser_execute(&ws, &settings, stream + split, len - split)
+	      == len - split);
+  fail_unless(ws.ws_errno == WS_OK);
+}
+
+START_TEST(test_ws_parser_split)
+{
+  const unsigned char mask[4] = { 0x11, 0x22, 0x33, 0x44 };
+  char stream[64];
+  char copy[64];
+  struct Frames *f = malloc(sizeof(struct Frames));
+
+  for (int masked = 0; masked < 2; masked++)
+    {
+      const unsigned char *m = (masked ? mask : NULL);
+      size_t len = make_frame(stream, 0, WS_OP_TEXT, "Hello, ", 7, m);
+      len += make_frame(stream + len, 1, WS_OP_PING, "x", 0, m);
+      len += make_frame(stream + len, 1, WS_OP_CONTINUATION, "world", 5, m);
+
+      for (size_t split = 0; split <= len; split++)
+	{
+	  memcpy(copy, stream, len);
+	  parse_split(f, copy, len, split);
+	  fail_unless(f->headers == 3 && f->completes == 3, "split %zd",
+		      split);
+	  fail_unless(f->opcodes[0] == WS_OP_TEXT);
+	  fail_unless(f->opcodes[1] == WS_OP_PING);
+	  fail_unless(f->opcodes[2] == WS_OP_CONTINUATION);
+	  fail_unless(f->payload_len == 12);
+	  fail_unless(memcmp(f->payload, "Hello, world", 12) == 0,
+		      "masked %d, split %zd", masked, split);
+	}
+    }
+  free(f);
+}
+END_TEST
+
+START_TEST(test_ws_parser_lengths)
+{
+  const unsigned char mask[4] = { 0xa5, 0x01, 0xfe, 0x7c };
+  const uint64_t lengths[] = { 125, 126, 65535, 65536 };
+  char *stream = malloc(WS_TEST_MAX);
+  struct Frames *f = malloc(sizeof(struct Frames));
+
+  for (int i = 0; i < 3; i++)
+    {
+      if (http_scan_select(impls[i]) != 0)
+	continue;
+      for (int l = 0; l < 4; l++)
+	{
+	  size_t len = make_frame(stream, 1, WS_OP_BINARY, "abcdefghi",
+				  lengths[l], mask);
+	  size_t header = len - lengths[l];
+	  fail_unless(header == (l == 0 ? 6 : l < 3 ? 8 : 14));
+
+	  parse_split(f, stream, len, header + 3);
+	  fail_unless(f->lengths[0] == lengths[l]);
+	  fail_unless(f->payload_len == lengths[l]);
+	  for (size_t n = 0; n < lengths[l]; n++)
+	    fail_unless(f->payload[n] == "abcdefghi"[n % 9],
+			"%s length %llu at %zd", impls[i],
+			(unsigned long long) lengths[l], n);
+	}
+    }
+  free(stream);
+  free(f);
+}
+END_TEST
+
+START_TEST(test_ws_parser_errors)
+{
+  struct Frames f;
+  ws_parser_settings settings;
+  ws_parser_settings_init(&settings);
+  ws_parser ws;
+  ws.data = &f;
+
+  // Fragmented control frame
+  char stream[16];
+  size_t len = ws_frame_header((unsigned char *) stream, 0, WS_OP_PING, 0,
+			       NULL);
+  ws_parser_init(&ws);
+  fail_unless(ws_parser_execute(&ws, &settings, stream, len) < len
+	      || ws.ws_errno != WS_OK);
+  fail_unless(ws.ws_errno == WS_ERR_CONTROL);
+
+  // A failed parser stays failed
+  fail_unless(ws_parser_execute(&ws, &settings, stream, len) == 0);
+}
+END_TEST
+
+
+Suite *ws_parser_suite(void)
+{
+  Suite *s = suite_create("WS_Parser");
+
+  // Core test case
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_test(tc_core, test_ws_parser_split);
+  tcase_add_test(tc_core, test_ws_parser_lengths);
+  tcase_add_test(tc_core, test_ws_parser_errors);
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
+
+
+int main(int argc, char *argv[])
+{
+  int number_failed = 0;
+  Suite   *s  = ws_parser_suite();
+  SRunner *sr = srunner_create(s);
+  srunner_run_all(sr, CK_NORMAL);
+  number_failed = srunner_ntests_failed(sr);
+  srunner_free(sr);
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}